@@ -57,8 +57,18 @@ find_library(K4ABT_SDK
 		"${K4ABT_ROOT}/lib" # TODO: Determine linux package structure
 	NO_DEFAULT_PATH)
 
+# Playback of recordings, for the tracking service
+find_library(K4ARECORD_SDK
+	NAMES
+		k4arecord
+	PATHS
+		"${K4A_SDK_ROOT}/sdk/windows-desktop/amd64/release/lib"
+		"${K4A_SDK_ROOT}/sdk/linux_clang/amd64/release/lib"
+	NO_DEFAULT_PATH)
+
 set(K4A_INCLUDE_DIRS "${K4A_SDK_INCLUDE}" "${K4ABT_SDK_INCLUDE}")
 set(K4A_LIBRARIES "${K4A_SDK}" "${K4ABT_SDK}")
+set(K4ARECORD_LIBRARIES "${K4ARECORD_SDK}")
 
 find_file(K4A_DLL
 	NAMES
@@ -1,9 +1,119 @@
 #include "calibration.h"
+#include <atomic>
 
 namespace Calibration {
 
+	// HMD history kept for pairing, the head joint arrives a few frames late
+	static const uint64_t HMD_HISTORY_US = 2000000;
+	// Largest gap between two HMD poses that is still interpolated
+	static const uint64_t HMD_MAX_GAP_US = 100000;
+
+	bool ReadHeadSample(const calibration_data_t* data, head_sample_t* sample)
+	{
+		uint32_t before = data->headSequence;
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		head_sample_t copy;
+		copy.timeUs = data->headTimeUs;
+		copy.confidence = data->headConfidence;
+		copy.position = { data->headX, data->headY, data->headZ };
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t after = data->headSequence;
+
+		if (before != after || (before & 1) != 0)
+			return false;
+
+		*sample = copy;
+		return true;
+	}
+
+	Calibrator::Calibrator() {
+	}
+
+	Calibrator::~Calibrator() {
+	}
+
+	void Calibrator::Begin() {
+		m_hmd.clear();
+		m_source.clear();
+		m_target.clear();
+		m_sums.clear();
+		m_fit = pose_math::rigid_fit_result();
+		m_state = COLLECTING;
+	}
+
+	void Calibrator::AddHmdPose(uint64_t timeUs, const pose_math::rigid& pose) {
+		if (!m_hmd.empty() && timeUs <= m_hmd.back().timeUs)
+			return;
+
+		m_hmd.push_back({ timeUs, pose });
+		while (m_hmd.front().timeUs + HMD_HISTORY_US < timeUs)
+			m_hmd.pop_front();
+	}
+
+	bool Calibrator::InterpolateHmd(uint64_t timeUs, pose_math::rigid* pose) const {
+		for (size_t i = 1; i < m_hmd.size(); i++)
+		{
+			const hmd_sample_t& a = m_hmd[i - 1];
+			const hmd_sample_t& b = m_hmd[i];
+			if (timeUs < a.timeUs || timeUs > b.timeUs)
+				continue;
+			if (b.timeUs - a.timeUs > HMD_MAX_GAP_US)
+				return false;
+
+			float t = (float)(timeUs - a.timeUs) / (float)(b.timeUs - a.timeUs);
+			pose->rotation = pose_math::slerp(a.pose.rotation, b.pose.rotation, t);
+			pose->translation = pose_math::lerp(a.pose.translation, b.pose.translation, t);
+			return true;
+		}
+		return false;
+	}
+
+	void Calibrator::AddHeadSample(uint64_t timeUs, const pose_math::vec3& head) {
+		if (m_source.size() >= maxSamples)
+			return;
+
+		pose_math::rigid hmd;
+		if (!InterpolateHmd(timeUs, &hmd))
+			return;
+
+		pose_math::vec3 target = pose_math::transform(hmd, hmdToHead);
+		if (!m_target.empty() && pose_math::length(target - m_target.back()) < minStep)
+			return;
+
+		m_source.push_back(head);
+		m_target.push_back(target);
+		m_sums.add(head, target);
+	}
+
+	const State Calibrator::UpdateActive() const {
+		if (m_state != COLLECTING && m_state != READY)
+			return m_state;
+		if (m_source.size() < minSamples)
+			return COLLECTING;
+		// Only the spread is needed here, the solve is cheap from the sums
+		if (pose_math::solve(m_sums).spread < minSpread)
+			return COLLECTING;
+		return READY;
+	}
+
 	const State Calibrator::Calibrate() {
-		return State::SUCCESS;
+		if (m_source.size() < minSamples)
+			return m_state = NOT_ENOUGH_SAMPLES;
+
+		m_fit = pose_math::fit_rigid_robust(m_source.data(), m_target.data(), m_source.size());
+
+		if (!m_fit.valid || m_fit.inliers < minSamples / 2)
+			m_state = NOT_ENOUGH_SAMPLES;
+		else if (m_fit.spread < minSpread)
+			m_state = DEGENERATE;
+		else if (m_fit.rms > maxResidual || m_fit.inliers < m_source.size() / 2)
+			m_state = HIGH_RESIDUAL;
+		else
+			m_state = SUCCESS;
+
+		return m_state;
 	}
 
-} // namespace Calibration
\ No newline at end of file
+} // namespace Calibration
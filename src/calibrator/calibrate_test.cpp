@@ -0,0 +1,173 @@
+// Drives Calibration::Calibrator with synthetic HMD and head joint paths
+// generated from a known driver to world transform, the way the calibrator
+// window feeds it, and checks the solve. Returns non zero on failure.
+
+#include "calibration.h"
+#include <cstdio>
+#include <cstdint>
+
+using namespace pose_math;
+using namespace Calibration;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); s_failures++; } } while (0)
+
+// HMD at 90 Hz, body tracking at 30 Hz
+static const uint64_t HMD_PERIOD_US = 11111;
+static const uint64_t HEAD_PERIOD_US = 33333;
+// The head joint lags the HMD by a few frames
+static const uint64_t HEAD_LAG_US = 40000;
+
+static uint32_t s_seed = 0x9E3779B9;
+
+static float Random(float lo, float hi)
+{
+	s_seed ^= s_seed << 13;
+	s_seed ^= s_seed >> 17;
+	s_seed ^= s_seed << 5;
+	return lo + (hi - lo) * (float)(s_seed & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+typedef enum _Path
+{
+	PATH_WALK,
+	PATH_LINE
+} Path;
+
+// HMD in world at time t. The walk is a loop around the play space with the
+// head bobbing, the line goes back and forth facing one way.
+static rigid HmdPose(Path path, float t)
+{
+	if (path == PATH_LINE)
+	{
+		float x = 1.2F * std::sin(t * 0.8F);
+		return { identity(), { x, 1.7F, -2.F } };
+	}
+
+	float angle = t * 0.6F;
+	vec3 position = { 1.3F * std::cos(angle), 1.65F + 0.08F * std::sin(t * 2.3F), -2.F + 0.9F * std::sin(angle) };
+	// Facing along the path, a little pitch and roll
+	quat facing = axis_angle({ 0.F, 1.F, 0.F }, -angle) * axis_angle({ 1.F, 0.F, 0.F }, 0.15F * std::sin(t * 1.1F))
+		* axis_angle({ 0.F, 0.F, 1.F }, 0.1F * std::sin(t * 0.7F));
+	return { facing, position };
+}
+
+// Feeds duration seconds of the path. Every outlierEvery'th head sample is
+// off by up to half a metre, as when the wrong body is tracked for a frame.
+static void Feed(Calibrator& calibrator, const rigid& driverToWorld, Path path, float duration, int outlierEvery)
+{
+	rigid worldToDriver = inverse(driverToWorld);
+	uint64_t start = 1000000;
+	uint64_t end = start + (uint64_t)(duration * 1e6F);
+	uint64_t nextHead = start + HEAD_LAG_US;
+	int heads = 0;
+
+	for (uint64_t hmdUs = start; hmdUs <= end; hmdUs += HMD_PERIOD_US)
+	{
+		calibrator.AddHmdPose(hmdUs, HmdPose(path, (float)(hmdUs - start) * 1e-6F));
+
+		// Head samples once the HMD poses around them are in
+		while (nextHead + HMD_PERIOD_US <= hmdUs)
+		{
+			rigid hmd = HmdPose(path, (float)(nextHead - start) * 1e-6F);
+			vec3 head = transform(worldToDriver, transform(hmd, calibrator.hmdToHead));
+			head = head + vec3{ Random(-0.005F, 0.005F), Random(-0.005F, 0.005F), Random(-0.005F, 0.005F) };
+			if (outlierEvery > 0 && ++heads % outlierEvery == 0)
+				head = head + vec3{ Random(-0.5F, 0.5F), Random(-0.5F, 0.5F), Random(-0.5F, 0.5F) };
+
+			calibrator.AddHeadSample(nextHead, head);
+			nextHead += HEAD_PERIOD_US;
+		}
+	}
+}
+
+static rigid KnownTransform()
+{
+	// Camera 2.5 m in front of the play space centre, turned to face it and
+	// tilted down, the driver space a quarter turn off world
+	quat rotation = axis_angle({ 0.F, 1.F, 0.F }, 2.4F) * axis_angle({ 1.F, 0.F, 0.F }, -0.3F);
+	return { rotation, { 0.4F, 1.1F, -4.2F } };
+}
+
+static void TestRecoversTransform()
+{
+	rigid known = KnownTransform();
+	Calibrator calibrator;
+	calibrator.Begin();
+	Feed(calibrator, known, PATH_WALK, 30.F, 7);
+
+	CHECK(calibrator.GetSampleCount() >= calibrator.minSamples);
+	CHECK(calibrator.UpdateActive() == READY);
+	CHECK(calibrator.Calibrate() == SUCCESS);
+
+	const rigid& result = calibrator.GetResult();
+	float angle = angle_between(result.rotation, known.rotation);
+	float offset = length(result.translation - known.translation);
+	std::printf("  recovered within %.3f deg, %.1f mm, rms %.1f mm, %zu of %zu inliers\n", angle * 180.F / PI,
+		offset * 1000.F, calibrator.GetFit().rms * 1000.F, calibrator.GetFit().inliers, calibrator.GetSampleCount());
+	CHECK(angle < 0.5F * PI / 180.F);
+	CHECK(offset < 0.01F);
+	CHECK(calibrator.GetFit().inliers < calibrator.GetSampleCount());
+}
+
+static void TestStraightPathIsDegenerate()
+{
+	Calibrator calibrator;
+	calibrator.Begin();
+	Feed(calibrator, KnownTransform(), PATH_LINE, 30.F, 0);
+
+	CHECK(calibrator.GetSampleCount() >= calibrator.minSamples);
+	CHECK(calibrator.UpdateActive() == COLLECTING);
+	CHECK(calibrator.Calibrate() == DEGENERATE);
+}
+
+static void TestTooFewSamples()
+{
+	Calibrator calibrator;
+	calibrator.Begin();
+	CHECK(calibrator.Calibrate() == NOT_ENOUGH_SAMPLES);
+
+	calibrator.Begin();
+	Feed(calibrator, KnownTransform(), PATH_WALK, 2.F, 0);
+	CHECK(calibrator.GetSampleCount() > 0);
+	CHECK(calibrator.GetSampleCount() < calibrator.minSamples);
+	CHECK(calibrator.UpdateActive() == COLLECTING);
+	CHECK(calibrator.Calibrate() == NOT_ENOUGH_SAMPLES);
+}
+
+static void TestHeadWithoutHmdIsDropped()
+{
+	Calibrator calibrator;
+	calibrator.Begin();
+	calibrator.AddHeadSample(1000000, { 0.F, 0.F, 1.F });
+	CHECK(calibrator.GetSampleCount() == 0);
+}
+
+typedef struct _calibrate_test
+{
+	const char* name;
+	void(*run)();
+} calibrate_test_t;
+
+int main()
+{
+	static const calibrate_test_t tests[] = {
+		{ "recovers transform", TestRecoversTransform },
+		{ "straight path", TestStraightPathIsDegenerate },
+		{ "too few samples", TestTooFewSamples },
+		{ "head without hmd", TestHeadWithoutHmdIsDropped },
+	};
+
+	int failed = 0;
+	for (const calibrate_test_t& test : tests)
+	{
+		int before = s_failures;
+		test.run();
+		bool passed = s_failures == before;
+		std::printf("%-20s %s\n", test.name, passed ? "ok" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -1,12 +1,25 @@
 #ifndef K4A_OPENVR_CALIBRATOR_CALIBRATION_H
 #define K4A_OPENVR_CALIBRATOR_CALIBRATION_H
 
-#include "imgui.h"
-#include <openvr.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "math/pose_math.h"
+#include "math/rigid_fit.h"
 
 namespace Calibration {
 	enum State {
-		SUCCESS = 0
+		SUCCESS = 0,
+		// Collecting, not enough samples or movement yet
+		COLLECTING,
+		// Enough samples to attempt a solve
+		READY,
+		NOT_ENOUGH_SAMPLES,
+		// Samples are (close to) collinear, walk around instead of back and forth
+		DEGENERATE,
+		// Fit does not explain the samples, camera moved or the wrong body was tracked
+		HIGH_RESIDUAL
 	};
 
 
@@ -18,12 +31,22 @@ namespace Calibration {
 		float z;
 	} joint_offset_t;
 
+	// Must match calibration_data_t in provider/bone_provider.h
 	typedef struct _calibration_data
 	{
 		bool update;
 		bool moreTrackers;
 		// TODO see bone_provider.h for details
 		bool lessCameraFPS;
+		// Windowed polynomial fit instead of the Kalman filters, see polynomial_filter.h
+		bool polynomialFilter;
+		// Feet refined against the depth image, see foot_refiner.h
+		bool footRefinement;
+		// Floor found in the depth image sets the height and holds the feet, see floor_detector.h
+		bool autoFloor;
+		// Polynomial window and order, see bone_provider.h
+		int32_t polynomialWindow;
+		int32_t polynomialOrder;
 
 		float x;
 		float y;
@@ -32,17 +55,114 @@ namespace Calibration {
 		float fps;
 
 		joint_offset_t rotOffset;
+
+		// Raw head joint, see bone_provider.h
+		volatile uint32_t headSequence;
+		uint32_t headConfidence;
+		float headX;
+		float headY;
+		float headZ;
+		uint64_t headTimeUs;
+
+		// Drift correction diagnostics, see drift_corrector.h
+		uint32_t driftState;
+		float driftResidual;
+		float driftAngle;
+		float driftOffset;
+
+		// Gate counters, see bone_provider.h
+		uint32_t gateRejected[8];
+		uint32_t gateSwaps;
+
+		// Trackers covered by real ones, see bone_provider.h
+		uint32_t fusionCovered;
+
+		// Last floor found and its world height under the user before any
+		// automatic correction, metres
+		bool floorValid;
+		float floorHeight;
+
+		// The IMU saw the camera move since the last calibration, see imu_tracker.h.
+		// Cleared by the next calibration.
+		bool cameraMoved;
+
+		// SDK buffer pool counters, see buffer_pool.h
+		uint64_t poolHits;
+		uint64_t poolMisses;
+		uint64_t poolPeakBytes;
+
+		// SupervisorState of the device, its faults and reconnects, and the time it
+		// was down in total and in the current or last outage, seconds. See
+		// device_supervisor.h.
+		uint32_t deviceState;
+		uint32_t deviceFaults;
+		uint32_t deviceReconnects;
+		float deviceDowntime;
+		float deviceOutage;
 	} calibration_data_t;
 
+	// Head joint as published by the provider, with its capture time
+	typedef struct _head_sample
+	{
+		uint64_t timeUs;
+		uint32_t confidence;
+		pose_math::vec3 position;
+	} head_sample_t;
+
+	// Seqlock read of the head joint. Returns false while the provider is writing.
+	bool ReadHeadSample(const calibration_data_t* data, head_sample_t* sample);
+
+	// Solves the driver to world transform from the K4A head joint and the HMD
+	// while the user walks around. Pure, timestamps come from the caller, so it
+	// can be driven offline with synthetic trajectories.
 	class Calibrator {
 	public:
 		Calibrator();
 		~Calibrator();
 
+		// Drops every sample and starts collecting
+		void Begin();
+
+		// HMD pose in the tracking universe the result should map into
+		void AddHmdPose(uint64_t timeUs, const pose_math::rigid& pose);
+		// Head joint in driver space. Paired with the HMD interpolated to the
+		// same time, so HMD poses around timeUs must already be in.
+		void AddHeadSample(uint64_t timeUs, const pose_math::vec3& head);
+
 		const State UpdateActive() const;
 		const State Calibrate();
 
+		// Driver to world, valid after Calibrate() returned SUCCESS
+		const pose_math::rigid& GetResult() const { return m_fit.transform; }
+		const pose_math::rigid_fit_result& GetFit() const { return m_fit; }
+		size_t GetSampleCount() const { return m_source.size(); }
+
+		// Head joint centre in the HMD frame, metres (OpenVR, -z forward)
+		pose_math::vec3 hmdToHead = { 0.F, -0.02F, 0.09F };
+		// Distance the head has to move before another pair is taken, metres
+		float minStep = 0.05F;
+		size_t minSamples = 40;
+		size_t maxSamples = 1000;
+		// Second principal axis of the head path, metres
+		float minSpread = 0.15F;
+		float maxResidual = 0.05F;
+
+	private:
+		typedef struct _hmd_sample
+		{
+			uint64_t timeUs;
+			pose_math::rigid pose;
+		} hmd_sample_t;
+
+		bool InterpolateHmd(uint64_t timeUs, pose_math::rigid* pose) const;
+
+		std::deque<hmd_sample_t> m_hmd;
+		std::vector<pose_math::vec3> m_source;
+		std::vector<pose_math::vec3> m_target;
+		pose_math::rigid_fit_sums m_sums;
+		pose_math::rigid_fit_result m_fit;
+		State m_state = COLLECTING;
 	};
 } // namespace Calibration
 
-#endif
\ No newline at end of file
+#endif
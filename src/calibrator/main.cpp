@@ -10,7 +10,10 @@
 #include <tchar.h>
 #include <thread>
 #include <iostream>
+#include <string>
+#include <chrono>
 #include <math.h>
+#include <openvr.h>
 
 #ifdef _DEBUG
 #define DX12_ENABLE_DEBUG_LAYER
@@ -22,6 +25,9 @@
 #endif
 
 #include "calibration.h"
+#include "math/pose_math.h"
+// Same clock the provider stamps head samples with
+#include "provider/host_clock.h"
 
 struct ErrorEntry
 {
@@ -76,90 +82,36 @@ void InputLoop(vr::VROverlayHandle_t ulOverlayHandle, vr::VROverlayHandle_t ulOv
 
 
 
-double _copysign(double sizeval, float signval)
+pose_math::quat GetRotation(vr::TrackedDevicePose_t matrix)
 {
-    return ((0.0 < signval) - (signval < 0.0)) == 1 ? std::abs(sizeval) : -std::abs(sizeval);
+    return pose_math::rotation(pose_math::to_mat34(matrix.mDeviceToAbsoluteTracking));
 }
 
-vr::HmdQuaternion_t GetRotation(vr::TrackedDevicePose_t matrix)
-{
-    vr::HmdQuaternion_t q;
-    q.w = std::sqrt(std::fmax(0, 1 + matrix.mDeviceToAbsoluteTracking.m[0][0] + matrix.mDeviceToAbsoluteTracking.m[1][1] + matrix.mDeviceToAbsoluteTracking.m[2][2])) / 2;
-    q.x = std::sqrt(std::fmax(0, 1 + matrix.mDeviceToAbsoluteTracking.m[0][0] - matrix.mDeviceToAbsoluteTracking.m[1][1] - matrix.mDeviceToAbsoluteTracking.m[2][2])) / 2;
-    q.y = std::sqrt(std::fmax(0, 1 - matrix.mDeviceToAbsoluteTracking.m[0][0] + matrix.mDeviceToAbsoluteTracking.m[1][1] - matrix.mDeviceToAbsoluteTracking.m[2][2])) / 2;
-    q.z = std::sqrt(std::fmax(0, 1 - matrix.mDeviceToAbsoluteTracking.m[0][0] - matrix.mDeviceToAbsoluteTracking.m[1][1] + matrix.mDeviceToAbsoluteTracking.m[2][2])) / 2;
-    q.x = _copysign(q.x, matrix.mDeviceToAbsoluteTracking.m[2][1] - matrix.mDeviceToAbsoluteTracking.m[1][2]);
-    q.y = _copysign(q.y, matrix.mDeviceToAbsoluteTracking.m[0][2] - matrix.mDeviceToAbsoluteTracking.m[2][0]);
-    q.z = _copysign(q.z, matrix.mDeviceToAbsoluteTracking.m[1][0] - matrix.mDeviceToAbsoluteTracking.m[0][1]);
-    return q;
-}
-
-vr::HmdQuaternion_t offsetQuatZ{
-    std::cos(std::acos(-1) / -4),
-    0.0,
-    0.0,
-    std::sin(std::acos(-1) / -4)
-};
-vr::HmdQuaternion_t offsetQuatY{
-    std::cos(std::acos(-1) / 4),
-    0.0,
-    std::sin(std::acos(-1) / 4),
-    0.0
-};
-vr::HmdQuaternion_t offsetQuatX{
-    std::cos(std::acos(-1) / 4),
-    std::sin(std::acos(-1) / 4),
-    0.0,
-    0.0
-};
+// HMD on top of the camera facing away from it, to camera orientation
+static const pose_math::quat offsetQuat1 = pose_math::axis_angle({ 0.F, 0.F, 1.F }, -pose_math::PI / 2.F);
+static const pose_math::quat offsetQuat2 = pose_math::axis_angle({ 0.F, 1.F, 0.F }, pose_math::PI / 2.F);
+static const pose_math::quat offsetQuat3 = pose_math::axis_angle({ 0.F, 0.F, 1.F }, pose_math::PI);
+static const pose_math::quat offsetQuat4 = pose_math::axis_angle({ 0.F, 0.F, 1.F }, (-pose_math::PI / 2.F) * (7.3F / 90.F));
 
-vr::HmdQuaternion_t offsetQuat1{
-    std::cos(std::acos(-1) / -4),
-    0.0,
-    0.0,
-    std::sin(std::acos(-1) / -4)
-};
-vr::HmdQuaternion_t offsetQuat2{
-    std::cos(std::acos(-1) / 4),
-    0.0,
-    std::sin(std::acos(-1) / 4),
-    0.0
-};
-vr::HmdQuaternion_t offsetQuat3{
-    std::cos(std::acos(-1) / 2),
-    0.0,
-    0.0,
-    std::sin(std::acos(-1) / 2)
-};
-vr::HmdQuaternion_t offsetQuat4{
-    std::cos((std::acos(-1) / -4)* (7.3 / 90.0)),
-    0.0,
-    0.0,
-    std::sin((std::acos(-1) / -4)* (7.3 / 90.0))
-};
+static Calibration::calibration_data_t* calibrationData;
 
-inline vr::HmdQuaternion_t QuaternionProduct(vr::HmdQuaternion_t& quata, vr::HmdQuaternion_t& quatb)
-{
-    vr::HmdQuaternion_t quat;
-    quat.w = ((quata.w * quatb.w) - (quata.x * quatb.x) - (quata.y * quatb.y) - (quata.z * quatb.z));
-    quat.x = ((quata.w * quatb.x) + (quata.x * quatb.w) + (quata.y * quatb.z) - (quata.z * quatb.y));
-    quat.y = ((quata.w * quatb.y) - (quata.x * quatb.z) + (quata.y * quatb.w) + (quata.z * quatb.x));
-    quat.z = ((quata.w * quatb.z) + (quata.x * quatb.y) - (quata.y * quatb.x) + (quata.z * quatb.w));
-    return quat;
-}
+// K4ABT_JOINT_CONFIDENCE_MEDIUM, lower head joints are guesses from the rest of the body
+static const uint32_t HEAD_MIN_CONFIDENCE = 2;
 
-inline vr::HmdQuaternion_t QuaternionInverse(vr::HmdQuaternion_t& quat)
+static const char* StateText(Calibration::State state)
 {
-    vr::HmdQuaternion_t inverse_quat;
-    inverse_quat.w = quat.w;
-    inverse_quat.x = -(quat.x);
-    inverse_quat.y = -(quat.y);
-    inverse_quat.z = -(quat.z);
-    return inverse_quat;
+    switch (state)
+    {
+    case Calibration::SUCCESS: return "Calibrated";
+    case Calibration::COLLECTING: return "Walk around the play space";
+    case Calibration::READY: return "Solving";
+    case Calibration::NOT_ENOUGH_SAMPLES: return "Not enough samples, is the camera tracking you?";
+    case Calibration::DEGENERATE: return "Path too straight, walk in a circle";
+    case Calibration::HIGH_RESIDUAL: return "Fit too poor, check only one person is in view";
+    }
+    return "";
 }
 
-static Calibration::calibration_data_t* calibrationData;
-
 // Main code
 int main(int, char**)
 {
@@ -289,8 +241,8 @@ int main(int, char**)
 
     bool fineTuningRefQuatValid = false;
     vr::TrackedDevicePose_t refPose;
-    vr::HmdQuaternion_t fineTuningRefQuat = { 1.0, 0.0, 0.0, 0.0 };
-    vr::HmdQuaternion_t fineCalibrationRotation = { 1.0, 0.0, 0.0, 0.0 };
+    pose_math::quat fineTuningRefQuat = pose_math::identity();
+    pose_math::quat fineCalibrationRotation = pose_math::identity();
     int X = 0;
     bool Xneg = false;
     int Y = 0;
@@ -298,6 +250,12 @@ int main(int, char**)
     int Z = 0;
     bool Zneg = false;
 
+    Calibration::Calibrator autoCalibrator;
+    bool autoCalibrating = false;
+    bool autoCalibrated = false;
+    Calibration::State autoState = Calibration::COLLECTING;
+    uint64_t lastHeadTimeUs = 0;
+
     // Main loop
     MSG msg;
     ZeroMemory(&msg, sizeof(msg));
@@ -346,7 +304,14 @@ int main(int, char**)
             //    calibrationData->update = true;
             //ImGui::Checkbox("Activate Auto Smoothing(experimental)", &calibrationData->autoSmooth);
             ImGui::Checkbox("Activate more trackers(experimental, mega lag)", &calibrationData->moreTrackers);
-            vr::HmdQuaternion_t quat = GetRotation(hmdPose);
+            ImGui::Checkbox("Polynomial smoothing (less lag, cleaner velocity)", &calibrationData->polynomialFilter);
+            if (calibrationData->polynomialFilter) {
+                ImGui::SliderInt("Smoothing window (frames)", &calibrationData->polynomialWindow, 3, 31);
+                ImGui::SliderInt("Smoothing order", &calibrationData->polynomialOrder, 1, 2);
+            }
+            ImGui::Checkbox("Refine feet from depth", &calibrationData->footRefinement);
+            ImGui::Checkbox("Floor height from depth", &calibrationData->autoFloor);
+            pose_math::quat quat = GetRotation(hmdPose);
 
             ImGui::Text("{ %.4f, %.4f, %.4f }",
                 hmdPose.mDeviceToAbsoluteTracking.m[0][3],
@@ -359,6 +324,49 @@ int main(int, char**)
                 quat.y,
                 quat.z);
             ImGui::Text("fps: %.4f", calibrationData->fps);
+            ImGui::Text("Buffers: %llu hits, %llu misses, peak %.1f MB",
+                (unsigned long long)calibrationData->poolHits, (unsigned long long)calibrationData->poolMisses,
+                calibrationData->poolPeakBytes / (1024.0 * 1024.0));
+
+            // DriftCorrectorState in provider/drift_corrector.h
+            static const char* driftStates[] = { "idle", "collecting reference", "tracking", "correcting" };
+            ImGui::Text("Drift correction: %s, residual %.1f cm, error %.2f deg %.1f cm",
+                calibrationData->driftState < 4 ? driftStates[calibrationData->driftState] : "?",
+                calibrationData->driftResidual * 100.F,
+                calibrationData->driftAngle * 180.F / pose_math::PI,
+                calibrationData->driftOffset * 100.F);
+            ImGui::Text("Rejected: hip %u, chest %u, feet %u/%u, knees %u/%u, elbows %u/%u, swaps %u",
+                calibrationData->gateRejected[0], calibrationData->gateRejected[3],
+                calibrationData->gateRejected[1], calibrationData->gateRejected[2],
+                calibrationData->gateRejected[7], calibrationData->gateRejected[6],
+                calibrationData->gateRejected[5], calibrationData->gateRejected[4],
+                calibrationData->gateSwaps);
+            // SupervisorState in provider/device_supervisor.h
+            static const char* deviceStates[] = { "opening", "configuring", "starting cameras", "loading model", "running", "faulted", "waiting to reconnect", "standby" };
+            const char* deviceState = calibrationData->deviceState < 8 ? deviceStates[calibrationData->deviceState] : "?";
+            if (calibrationData->deviceState == 4)
+                ImGui::Text("Device: running, %u reconnects, %.1f s down in total", calibrationData->deviceReconnects, calibrationData->deviceDowntime);
+            else if (calibrationData->deviceState == 7)
+                ImGui::Text("Device: standby");
+            else
+                ImGui::TextColored(ImVec4(1.F, 0.6F, 0.F, 1.F), "Device: %s, down for %.1f s", deviceState, calibrationData->deviceOutage);
+            if (calibrationData->cameraMoved)
+                ImGui::TextColored(ImVec4(1.F, 0.6F, 0.F, 1.F), "Camera moved, recalibrate");
+            if (calibrationData->autoFloor) {
+                if (calibrationData->floorValid)
+                    ImGui::Text("Floor: %.1f cm before correction", calibrationData->floorHeight * 100.F);
+                else
+                    ImGui::Text("Floor: searching");
+            }
+            if (calibrationData->fusionCovered != 0) {
+                static const char* trackerNames[] = { "hip", "left foot", "right foot", "chest", "right elbow", "left elbow", "right knee", "left knee" };
+                std::string covered;
+                for (int i = 0; i < 8; i++) {
+                    if (calibrationData->fusionCovered & (1u << i))
+                        covered += std::string(covered.empty() ? "" : ", ") + trackerNames[i];
+                }
+                ImGui::Text("Real trackers on: %s", covered.c_str());
+            }
 
             ImGui::RadioButton("X", &X, 0);
             ImGui::RadioButton("Y", &X, 1);
@@ -407,13 +415,13 @@ int main(int, char**)
                             fineTuningRefQuatValid = true;
                         }
 
-                        vr::HmdQuaternion_t quat = GetRotation(rightHandPose);
+                        pose_math::quat quat = GetRotation(rightHandPose);
 
-                        fineCalibrationRotation = QuaternionProduct(quat, QuaternionInverse(fineTuningRefQuat));
+                        fineCalibrationRotation = quat * pose_math::conjugate(fineTuningRefQuat);
 
                         fineTuningRefQuat = GetRotation(rightHandPose);
 
-                        vr::HmdQuaternion_t currentCalibration = {
+                        pose_math::quat currentCalibration = {
                             calibrationData->rotOffset.w,
                             calibrationData->rotOffset.x,
                             calibrationData->rotOffset.y,
@@ -423,32 +431,32 @@ int main(int, char**)
                         switch (X)
                         {
                         case 0:
-                            fineCalibrationRotation = vr::HmdQuaternion_t{
+                            fineCalibrationRotation = pose_math::quat{
                             fineCalibrationRotation.w,
                             fineCalibrationRotation.z,
-                            0.0,
-                            0.0
+                            0.F,
+                            0.F
                             };
                             break;
                         case 1:
-                            fineCalibrationRotation = vr::HmdQuaternion_t{
+                            fineCalibrationRotation = pose_math::quat{
                             fineCalibrationRotation.w,
-                            0.0,
-                            0.0,
+                            0.F,
+                            0.F,
                             fineCalibrationRotation.y
                             };
                             break;
                         case 2:
-                            fineCalibrationRotation = vr::HmdQuaternion_t{
+                            fineCalibrationRotation = pose_math::quat{
                             fineCalibrationRotation.w,
-                            0.0,
+                            0.F,
                             fineCalibrationRotation.x,
-                            0.0
+                            0.F
                             };
                             break;
                         }
 
-                        vr::HmdQuaternion_t fineTunedCalibration = QuaternionProduct(currentCalibration, fineCalibrationRotation);
+                        pose_math::quat fineTunedCalibration = currentCalibration * fineCalibrationRotation;
 
                         calibrationData->rotOffset.w = fineTunedCalibration.w;
                         calibrationData->rotOffset.x = fineTunedCalibration.x;
@@ -465,13 +473,66 @@ int main(int, char**)
                 }
             }
 
+            // Pairs the K4A head joint with the HMD while the user walks around
+            if (autoCalibrating)
+            {
+                if (hmdPose.bPoseIsValid)
+                    autoCalibrator.AddHmdPose(HostTimeUs(), pose_math::to_rigid(pose_math::to_mat34(hmdPose.mDeviceToAbsoluteTracking)));
+
+                Calibration::head_sample_t head;
+                if (Calibration::ReadHeadSample(calibrationData, &head) && head.timeUs != lastHeadTimeUs)
+                {
+                    lastHeadTimeUs = head.timeUs;
+                    if (head.confidence >= HEAD_MIN_CONFIDENCE)
+                        autoCalibrator.AddHeadSample(head.timeUs, head.position);
+                }
+
+                autoState = autoCalibrator.UpdateActive();
+                if (autoState == Calibration::READY)
+                {
+                    autoState = autoCalibrator.Calibrate();
+                    autoCalibrating = false;
+                    autoCalibrated = true;
+
+                    if (autoState == Calibration::SUCCESS)
+                    {
+                        const pose_math::rigid& result = autoCalibrator.GetResult();
+
+                        calibrationData->rotOffset.w = result.rotation.w;
+                        calibrationData->rotOffset.x = result.rotation.x;
+                        calibrationData->rotOffset.y = result.rotation.y;
+                        calibrationData->rotOffset.z = result.rotation.z;
+
+                        calibrationData->x = result.translation.x;
+                        calibrationData->y = result.translation.y;
+                        calibrationData->z = result.translation.z;
+
+                        calibrationData->update = true;
+                    }
+                }
+
+                ImGui::Text("%s: %d samples", StateText(autoState), (int)autoCalibrator.GetSampleCount());
+                if (ImGui::Button("Cancel"))
+                    autoCalibrating = false;
+            }
+            else if (ImGui::Button("Auto calibrate"))
+            {
+                autoCalibrator.Begin();
+                autoCalibrating = true;
+                autoCalibrated = false;
+            }
+
+            if (autoCalibrated)
+            {
+                const pose_math::rigid_fit_result& fit = autoCalibrator.GetFit();
+                ImGui::Text("%s, residual %.1f cm, %d of %d samples used", StateText(autoState),
+                    fit.rms * 100.F, (int)fit.inliers, (int)autoCalibrator.GetSampleCount());
+            }
+
             if (ImGui::Button("Calibrate"))
             {
 
-                quat = QuaternionProduct(quat, offsetQuat1);
-                quat = QuaternionProduct(quat, offsetQuat2);
-                quat = QuaternionProduct(quat, offsetQuat3);
-                quat = QuaternionProduct(quat, offsetQuat4);
+                quat = quat * offsetQuat1 * offsetQuat2 * offsetQuat3 * offsetQuat4;
 
                 calibrationData->rotOffset.x = quat.x;
                 calibrationData->rotOffset.y = quat.y;
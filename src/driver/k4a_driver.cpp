@@ -101,7 +101,7 @@ vr::EVRInitError K4AServerDriver::Init(vr::IVRDriverContext* pDriverContext) {
 	VR_INIT_SERVER_DRIVER_CONTEXT(pDriverContext);
 	InitDriverLog(vr::VRDriverLog());
 
-	m_bone_provider = new K4ABoneProvider(&DriverLog);
+	m_bone_provider = new K4ABoneProvider(&DriverLog, &DriverLogAtSite);
 
 	m_bone_provider->Configure(K4A_DEPTH_MODE_WFOV_2X2BINNED, 0.075F);
 
@@ -138,11 +138,41 @@ vr::EVRInitError K4AServerDriver::Init(vr::IVRDriverContext* pDriverContext) {
 void K4AServerDriver::Cleanup() {
 	DriverLog("Stopping K4AServerDriver\n");
 
+	// Start only spawns the bone thread, the model loads on it
+	if (m_bone_started.valid())
+		m_bone_started.wait();
+	m_bone_provider->Stop();
+
 	DriverLog("Last error: %d", m_bone_provider->GetLastError());
+
+	delete m_bone_provider;
+	m_bone_provider = nullptr;
+	for (K4ATrackerDriver** tracker : { &m_pHipTracker, &m_pRightFootTracker, &m_pLeftFootTracker, &m_pChestTracker,
+		&m_pRightElbowTracker, &m_pLeftElbowTracker, &m_pRightKneeTracker, &m_pLeftKneeTracker })
+	{
+		delete *tracker;
+		*tracker = nullptr;
+	}
+
+	CleanupDriverLog();
+}
+
+void K4AServerDriver::EnterStandby()
+{
+	DriverLog("SteamVR standby\n");
+	m_bone_provider->EnterStandby();
+}
+
+void K4AServerDriver::LeaveStandby()
+{
+	DriverLog("SteamVR awake\n");
+	m_bone_provider->LeaveStandby();
 }
 
 void K4AServerDriver::PowerOff()
 {
+	// The provider itself goes in Cleanup
+	if (m_bone_started.valid())
+		m_bone_started.wait();
 	m_bone_provider->Stop();
-	m_bone_provider->~K4ABoneProvider();
 }
\ No newline at end of file
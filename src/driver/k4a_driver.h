@@ -14,42 +14,6 @@
 
 #include "provider/bone_provider.h"
 
-inline vr::HmdQuaternion_t QuaternionInverse(k4a_quaternion_t::_wxyz& quat)
-{
-	vr::HmdQuaternion_t inverse_quat;
-	inverse_quat.w = quat.w;
-	inverse_quat.x = -(quat.x);
-	inverse_quat.y = -(quat.y);
-	inverse_quat.z = -(quat.z);
-	return inverse_quat;
-}
-
-inline vr::HmdQuaternion_t HmdQuaternion_Init(double w, double x, double y, double z)
-{
-	vr::HmdQuaternion_t quat;
-	quat.w = w;
-	quat.x = x;
-	quat.y = y;
-	quat.z = z;
-	return quat;
-}
-
-inline void HmdMatrix_SetIdentity(vr::HmdMatrix34_t* pMatrix)
-{
-	pMatrix->m[0][0] = 1.f;
-	pMatrix->m[0][1] = 0.f;
-	pMatrix->m[0][2] = 0.f;
-	pMatrix->m[0][3] = 0.f;
-	pMatrix->m[1][0] = 0.f;
-	pMatrix->m[1][1] = 1.f;
-	pMatrix->m[1][2] = 0.f;
-	pMatrix->m[1][3] = 0.f;
-	pMatrix->m[2][0] = 0.f;
-	pMatrix->m[2][1] = 0.f;
-	pMatrix->m[2][2] = 1.f;
-	pMatrix->m[2][3] = 0.f;
-}
-
 class K4AWatchdogDriver : public vr::IVRWatchdogProvider {
 public:
 	K4AWatchdogDriver() {
@@ -96,6 +60,7 @@ public:
 		return m_pose;
 	};
 
+	// One camera for every tracker, the provider idles it from K4AServerDriver
 	virtual bool ShouldBlockStandbyMode() { return false; };
 	virtual void EnterStandby() { };
 	virtual void LeaveStandby() { };
@@ -130,8 +95,8 @@ public:
 	virtual void RunFrame() { };
 
 	virtual bool ShouldBlockStandbyMode() { return false; };
-	virtual void EnterStandby() { };
-	virtual void LeaveStandby() { };
+	virtual void EnterStandby();
+	virtual void LeaveStandby();
 
 
 	virtual void PowerOff();
@@ -4,33 +4,662 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "provider/thread_scheduler.h"
 
 static vr::IVRDriverLog* s_pLogFile = NULL;
 
-#if !defined( WIN32)
-#define vsnprintf_s vsnprintf
-#endif
+// Number of records in the ring, must be a power of two
+static const size_t LOG_RING_SIZE = 256;
+static const size_t LOG_MAX_ARGS = 12;
+// Storage for copies of %s arguments, per record
+static const size_t LOG_TEXT_SIZE = 256;
+
+// At most LOG_RATE_LIMIT messages with the same format or call site per LOG_RATE_WINDOW_MS
+static const uint32_t LOG_RATE_LIMIT = 10;
+static const int64_t LOG_RATE_WINDOW_MS = 1000;
+static const size_t LOG_RATE_SLOTS = 64;
+
+// How long the log thread sleeps when the ring is empty
+static const int LOG_FLUSH_INTERVAL_MS = 5;
+
+typedef enum _LogArgKind : uint8_t
+{
+	LogArg_Int,
+	LogArg_Uint,
+	LogArg_Double,
+	LogArg_Pointer,
+	LogArg_String
+} LogArgKind;
+
+typedef union _LogArgValue
+{
+	int64_t i;
+	uint64_t u;
+	double d;
+	const void* p;
+	size_t text; // offset into LogRecord::text
+} LogArgValue;
+
+typedef struct _LogRecord
+{
+	// Slot sequence relative to the slot index, so a zeroed ring is a valid empty ring
+	std::atomic<size_t> sequence;
+
+	const char* format;
+	DriverLogSeverity severity;
+	uint32_t suppressed;
+	uint32_t argCount;
+	uint32_t textUsed;
+
+	LogArgKind kinds[LOG_MAX_ARGS];
+	LogArgValue args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];
+} LogRecord;
+
+typedef struct _LogRateSlot
+{
+	std::atomic<const char*> key;
+	std::atomic<int> line;
+	std::atomic<int64_t> window;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> suppressed;
+} LogRateSlot;
+
+static LogRecord s_ring[LOG_RING_SIZE];
+static std::atomic<size_t> s_enqueuePos{ 0 };
+// Only touched by the log thread (or CleanupDriverLog after it has joined)
+static size_t s_dequeuePos = 0;
+
+static std::atomic<uint64_t> s_dropped{ 0 };
+static LogRateSlot s_rateSlots[LOG_RATE_SLOTS];
+
+static std::thread s_logThread;
+static std::atomic<bool> s_logRunning{ false };
+
+// --------------------------------------------------------------------------
+// Ring (bounded MPSC queue, one sequence number per slot)
+// --------------------------------------------------------------------------
+
+static LogRecord* AcquireRecord(size_t& pos)
+{
+	pos = s_enqueuePos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		size_t index = pos & (LOG_RING_SIZE - 1);
+		LogRecord* record = &s_ring[index];
+		size_t seq = record->sequence.load(std::memory_order_acquire) + index;
+		ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+		if (diff == 0)
+		{
+			if (s_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return record;
+		}
+		else if (diff < 0)
+		{
+			// Full, the log thread is behind
+			return nullptr;
+		}
+		else
+		{
+			pos = s_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static void PublishRecord(LogRecord* record, size_t pos)
+{
+	size_t index = pos & (LOG_RING_SIZE - 1);
+	record->sequence.store(pos + 1 - index, std::memory_order_release);
+}
+
+// --------------------------------------------------------------------------
+// Rate limiting, keyed on the format pointer or on the (file, line) of the
+// call site, line 0 for the former. Slots are shared by hash and updated
+// racily; an occasional extra or missing message is acceptable.
+// --------------------------------------------------------------------------
+
+static bool RateLimit(const char* key, int line, uint32_t& suppressed)
+{
+	int64_t window = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() / LOG_RATE_WINDOW_MS;
+
+	uint64_t hash = ((uint64_t)(uintptr_t)key + (uint64_t)(uint32_t)line * 0x100000001B3ULL) * 0x9E3779B97F4A7C15ULL;
+	LogRateSlot& slot = s_rateSlots[(hash >> 32) & (LOG_RATE_SLOTS - 1)];
+
+	if (slot.key.load(std::memory_order_relaxed) != key || slot.line.load(std::memory_order_relaxed) != line)
+	{
+		slot.key.store(key, std::memory_order_relaxed);
+		slot.line.store(line, std::memory_order_relaxed);
+		slot.window.store(window, std::memory_order_relaxed);
+		slot.count.store(1, std::memory_order_relaxed);
+		slot.suppressed.store(0, std::memory_order_relaxed);
+		suppressed = 0;
+		return true;
+	}
+
+	if (slot.window.load(std::memory_order_relaxed) != window)
+	{
+		slot.window.store(window, std::memory_order_relaxed);
+		slot.count.store(1, std::memory_order_relaxed);
+		suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	if (slot.count.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_LIMIT)
+	{
+		suppressed = slot.suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	slot.suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+// --------------------------------------------------------------------------
+// printf conversion parsing, shared by the capture and format sides
+// --------------------------------------------------------------------------
+
+typedef enum _LogLength
+{
+	LogLength_None,
+	LogLength_Long,
+	LogLength_LongLong,
+	LogLength_Size,
+	LogLength_LongDouble
+} LogLength;
+
+typedef struct _LogSpec
+{
+	const char* begin; // the '%'
+	const char* end; // one past the conversion character
+	int stars;
+	LogLength length;
+	char conversion;
+} LogSpec;
+
+// Parses the conversion starting at pSpec ('%'). Returns false for "%%" or a
+// malformed conversion, in which case end still points past what was consumed.
+static bool ParseSpec(const char* pSpec, LogSpec& spec)
+{
+	const char* c = pSpec + 1;
+	spec.begin = pSpec;
+	spec.stars = 0;
+	spec.length = LogLength_None;
+	spec.conversion = 0;
+
+	if (*c == '%')
+	{
+		spec.end = c + 1;
+		return false;
+	}
+
+	while (*c == '-' || *c == '+' || *c == ' ' || *c == '#' || *c == '0')
+		c++;
+
+	if (*c == '*')
+	{
+		spec.stars++;
+		c++;
+	}
+	else
+	{
+		while (*c >= '0' && *c <= '9')
+			c++;
+	}
+
+	if (*c == '.')
+	{
+		c++;
+		if (*c == '*')
+		{
+			spec.stars++;
+			c++;
+		}
+		else
+		{
+			while (*c >= '0' && *c <= '9')
+				c++;
+		}
+	}
+
+	switch (*c)
+	{
+	case 'h':
+		c += (c[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		if (c[1] == 'l')
+		{
+			spec.length = LogLength_LongLong;
+			c += 2;
+		}
+		else
+		{
+			spec.length = LogLength_Long;
+			c++;
+		}
+		break;
+	case 'j':
+		spec.length = LogLength_LongLong;
+		c++;
+		break;
+	case 'z':
+	case 't':
+		spec.length = LogLength_Size;
+		c++;
+		break;
+	case 'L':
+		spec.length = LogLength_LongDouble;
+		c++;
+		break;
+	case 'I': // MSVC I, I32 and I64
+		if (c[1] == '6' && c[2] == '4')
+		{
+			spec.length = LogLength_LongLong;
+			c += 3;
+		}
+		else if (c[1] == '3' && c[2] == '2')
+		{
+			c += 3;
+		}
+		else
+		{
+			spec.length = LogLength_Size;
+			c++;
+		}
+		break;
+	default:
+		break;
+	}
+
+	spec.conversion = *c;
+	spec.end = (*c != 0) ? c + 1 : c;
+
+	switch (spec.conversion)
+	{
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+	case 's': case 'p': case 'n':
+		return true;
+	default:
+		return false;
+	}
+}
+
+// --------------------------------------------------------------------------
+// Capture side, runs on the caller's thread
+// --------------------------------------------------------------------------
+
+static bool PushArg(LogRecord* record, LogArgKind kind, LogArgValue value)
+{
+	if (record->argCount >= LOG_MAX_ARGS)
+		return false;
+
+	record->kinds[record->argCount] = kind;
+	record->args[record->argCount] = value;
+	record->argCount++;
+	return true;
+}
+
+static bool PushString(LogRecord* record, const char* str)
+{
+	LogArgValue value;
+	value.text = record->textUsed;
+
+	if (str == nullptr)
+		str = "(null)";
+
+	size_t available = LOG_TEXT_SIZE - record->textUsed;
+	if (available == 0)
+		return false;
+
+	size_t length = strlen(str);
+	if (length >= available)
+		length = available - 1;
+
+	memcpy(record->text + record->textUsed, str, length);
+	record->text[record->textUsed + length] = 0;
+	record->textUsed += (uint32_t)(length + 1);
+
+	return PushArg(record, LogArg_String, value);
+}
+
+static void CaptureArgs(LogRecord* record, const char* pMsgFormat, va_list args)
+{
+	record->argCount = 0;
+	record->textUsed = 0;
+
+	const char* c = pMsgFormat;
+	while ((c = strchr(c, '%')) != nullptr)
+	{
+		LogSpec spec;
+		bool convert = ParseSpec(c, spec);
+		c = spec.end;
+
+		if (!convert)
+		{
+			if (spec.conversion == 0 && spec.end != spec.begin + 2)
+				return; // malformed, format the rest literally
+			continue;
+		}
+
+		LogArgValue value;
+		for (int i = 0; i < spec.stars; i++)
+		{
+			value.i = va_arg(args, int);
+			if (!PushArg(record, LogArg_Int, value))
+				return;
+		}
+
+		bool pushed = true;
+		switch (spec.conversion)
+		{
+		case 'd':
+		case 'i':
+			if (spec.length == LogLength_Long)
+				value.i = va_arg(args, long);
+			else if (spec.length == LogLength_LongLong)
+				value.i = va_arg(args, long long);
+			else if (spec.length == LogLength_Size)
+				value.i = va_arg(args, ptrdiff_t);
+			else
+				value.i = va_arg(args, int);
+			pushed = PushArg(record, LogArg_Int, value);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			if (spec.length == LogLength_Long)
+				value.u = va_arg(args, unsigned long);
+			else if (spec.length == LogLength_LongLong)
+				value.u = va_arg(args, unsigned long long);
+			else if (spec.length == LogLength_Size)
+				value.u = va_arg(args, size_t);
+			else
+				value.u = va_arg(args, unsigned int);
+			pushed = PushArg(record, LogArg_Uint, value);
+			break;
+		case 'c':
+			value.i = va_arg(args, int);
+			pushed = PushArg(record, LogArg_Int, value);
+			break;
+		case 's':
+			pushed = PushString(record, va_arg(args, const char*));
+			break;
+		case 'p':
+			value.p = va_arg(args, void*);
+			pushed = PushArg(record, LogArg_Pointer, value);
+			break;
+		case 'n':
+			// Never written back, the caller's stack is gone by the time we format
+			(void)va_arg(args, void*);
+			break;
+		default:
+			if (spec.length == LogLength_LongDouble)
+				value.d = (double)va_arg(args, long double);
+			else
+				value.d = va_arg(args, double);
+			pushed = PushArg(record, LogArg_Double, value);
+			break;
+		}
+
+		if (!pushed)
+			return;
+	}
+}
+
+static void DriverLogVarArgs(DriverLogSeverity severity, const char* pRateKey, int nRateLine, const char* pMsgFormat, va_list args)
+{
+	if (severity < K4A_DRIVER_LOG_LEVEL || pMsgFormat == nullptr)
+		return;
+
+	uint32_t suppressed;
+	if (!RateLimit(pRateKey, nRateLine, suppressed))
+		return;
+
+	size_t pos;
+	LogRecord* record = AcquireRecord(pos);
+	if (record == nullptr)
+	{
+		s_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	record->format = pMsgFormat;
+	record->severity = severity;
+	record->suppressed = suppressed;
+	CaptureArgs(record, pMsgFormat, args);
+
+	PublishRecord(record, pos);
+}
+
+// --------------------------------------------------------------------------
+// Format side, runs on the log thread
+// --------------------------------------------------------------------------
+
+template <typename T>
+static int FormatArg(char* out, size_t size, const char* spec, const int* stars, int starCount, T value)
+{
+	switch (starCount)
+	{
+	case 0:
+		return snprintf(out, size, spec, value);
+	case 1:
+		return snprintf(out, size, spec, stars[0], value);
+	default:
+		return snprintf(out, size, spec, stars[0], stars[1], value);
+	}
+}
+
+static void FormatRecord(const LogRecord* record, char* buf, size_t bufSize)
+{
+	size_t used = 0;
+	uint32_t arg = 0;
+	const char* c = record->format;
+
+	switch (record->severity)
+	{
+	case DriverLogSeverity_Debug:
+		used = snprintf(buf, bufSize, "Debug: ");
+		break;
+	case DriverLogSeverity_Warning:
+		used = snprintf(buf, bufSize, "Warning: ");
+		break;
+	case DriverLogSeverity_Error:
+		used = snprintf(buf, bufSize, "Error: ");
+		break;
+	default:
+		break;
+	}
+
+	while (*c && used + 1 < bufSize)
+	{
+		const char* next = strchr(c, '%');
+		size_t literal = next ? (size_t)(next - c) : strlen(c);
+		if (literal > bufSize - used - 1)
+			literal = bufSize - used - 1;
+
+		memcpy(buf + used, c, literal);
+		used += literal;
+		c += literal;
+
+		if (!next || used + 1 >= bufSize)
+			break;
+
+		LogSpec spec;
+		bool convert = ParseSpec(c, spec);
+		bool missing = spec.stars + (spec.conversion != 'n' ? 1 : 0) > (int)(record->argCount - arg);
+
+		if (!convert || missing)
+		{
+			if (spec.end == spec.begin + 2 && spec.begin[1] == '%')
+			{
+				buf[used++] = '%';
+				c = spec.end;
+				continue;
+			}
+			// Malformed or out of captured arguments, copy the rest verbatim
+			size_t rest = strlen(c);
+			if (rest > bufSize - used - 1)
+				rest = bufSize - used - 1;
+			memcpy(buf + used, c, rest);
+			used += rest;
+			break;
+		}
+
+		c = spec.end;
+		if (spec.conversion == 'n')
+			continue;
+
+		// Rebuild the conversion with the length modifier matching what we captured
+		char fmt[32];
+		size_t fmtLength = 0;
+		for (const char* s = spec.begin; s < spec.end - 1 && fmtLength < sizeof(fmt) - 4; s++)
+		{
+			if (*s == 'h' || *s == 'l' || *s == 'j' || *s == 'z' || *s == 't' || *s == 'L' || *s == 'I')
+				break;
+			fmt[fmtLength++] = *s;
+		}
+
+		int stars[2] = { 0, 0 };
+		for (int i = 0; i < spec.stars; i++)
+			stars[i] = (int)record->args[arg++].i;
+
+		const LogArgValue& value = record->args[arg];
+		LogArgKind kind = record->kinds[arg];
+		arg++;
+
+		if ((kind == LogArg_Int && spec.conversion != 'c') || kind == LogArg_Uint)
+		{
+			fmt[fmtLength++] = 'l';
+			fmt[fmtLength++] = 'l';
+		}
+		fmt[fmtLength++] = spec.conversion;
+		fmt[fmtLength] = 0;
+
+		int written = 0;
+		char* out = buf + used;
+		size_t available = bufSize - used;
+		switch (kind)
+		{
+		case LogArg_Int:
+			if (spec.conversion == 'c')
+				written = FormatArg(out, available, fmt, stars, spec.stars, (int)value.i);
+			else
+				written = FormatArg(out, available, fmt, stars, spec.stars, (long long)value.i);
+			break;
+		case LogArg_Uint:
+			written = FormatArg(out, available, fmt, stars, spec.stars, (unsigned long long)value.u);
+			break;
+		case LogArg_Double:
+			written = FormatArg(out, available, fmt, stars, spec.stars, value.d);
+			break;
+		case LogArg_Pointer:
+			written = FormatArg(out, available, fmt, stars, spec.stars, value.p);
+			break;
+		case LogArg_String:
+			written = FormatArg(out, available, fmt, stars, spec.stars, (const char*)(record->text + value.text));
+			break;
+		}
+
+		if (written > 0)
+			used += ((size_t)written < available) ? (size_t)written : available - 1;
+	}
+
+	buf[used] = 0;
+
+	if (record->suppressed > 0)
+	{
+		bool newline = used > 0 && buf[used - 1] == '\n';
+		if (newline)
+			buf[--used] = 0;
+
+		snprintf(buf + used, bufSize - used, " (%u similar messages suppressed)%s", record->suppressed, newline ? "\n" : "");
+	}
+}
+
+// Returns true if anything was written
+static bool DrainLog()
+{
+	static uint64_t s_reportedDrops = 0;
+	bool wrote = false;
+	char buf[1024];
+
+	for (;;)
+	{
+		size_t index = s_dequeuePos & (LOG_RING_SIZE - 1);
+		LogRecord* record = &s_ring[index];
+		size_t seq = record->sequence.load(std::memory_order_acquire) + index;
+
+		if (seq != s_dequeuePos + 1)
+			break;
+
+		FormatRecord(record, buf, sizeof(buf));
+		record->sequence.store(s_dequeuePos + LOG_RING_SIZE - index, std::memory_order_release);
+		s_dequeuePos++;
+
+		if (s_pLogFile)
+			s_pLogFile->Log(buf);
+		wrote = true;
+	}
+
+	uint64_t dropped = s_dropped.load(std::memory_order_relaxed);
+	if (dropped != s_reportedDrops)
+	{
+		snprintf(buf, sizeof(buf), "Log ring full, %llu messages dropped\n", (unsigned long long)(dropped - s_reportedDrops));
+		s_reportedDrops = dropped;
+
+		if (s_pLogFile)
+			s_pLogFile->Log(buf);
+		wrote = true;
+	}
+
+	return wrote;
+}
+
+static void LogThread()
+{
+	ScopedThread scheduled("k4a log", THREAD_ROLE_BACKGROUND);
+	while (s_logRunning.load(std::memory_order_acquire))
+	{
+		if (!DrainLog())
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+	}
+
+	DrainLog();
+}
 
 bool InitDriverLog(vr::IVRDriverLog* pDriverLog)
 {
 	if (s_pLogFile)
 		return false;
 	s_pLogFile = pDriverLog;
+
+	if (s_pLogFile != NULL && !s_logRunning.exchange(true))
+		s_logThread = std::thread(LogThread);
+
 	return s_pLogFile != NULL;
 }
 
 void CleanupDriverLog()
 {
+	if (s_logRunning.exchange(false))
+		s_logThread.join();
+
 	s_pLogFile = NULL;
 }
 
-static void DriverLogVarArgs(const char* pMsgFormat, va_list args)
+uint64_t GetDriverLogDropCount()
 {
-	char buf[1024];
-	vsnprintf_s(buf, sizeof(buf), pMsgFormat, args);
-
-	if (s_pLogFile)
-		s_pLogFile->Log(buf);
+	return s_dropped.load(std::memory_order_relaxed);
 }
 
 
@@ -39,20 +668,29 @@ void DriverLog(const char* pMsgFormat, ...)
 	va_list args;
 	va_start(args, pMsgFormat);
 
-	DriverLogVarArgs(pMsgFormat, args);
+	DriverLogVarArgs(DriverLogSeverity_Info, pMsgFormat, 0, pMsgFormat, args);
+
+	va_end(args);
+}
+
+
+void DriverLogAt(DriverLogSeverity severity, const char* pMsgFormat, ...)
+{
+	va_list args;
+	va_start(args, pMsgFormat);
+
+	DriverLogVarArgs(severity, pMsgFormat, 0, pMsgFormat, args);
 
 	va_end(args);
 }
 
 
-void DebugDriverLog(const char* pMsgFormat, ...)
+void DriverLogAtSite(DriverLogSeverity severity, const char* pchFile, int nLine, const char* pMsgFormat, ...)
 {
-#ifdef _DEBUG
 	va_list args;
 	va_start(args, pMsgFormat);
 
-	DriverLogVarArgs(pMsgFormat, args);
+	DriverLogVarArgs(severity, pchFile ? pchFile : pMsgFormat, nLine, pMsgFormat, args);
 
 	va_end(args);
-#endif
-}
\ No newline at end of file
+}
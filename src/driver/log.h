@@ -3,14 +3,69 @@
 #include <string>
 #include <openvr_driver.h>
 
+// --------------------------------------------------------------------------
+// Severities, lowest to highest. Messages below K4A_DRIVER_LOG_LEVEL are
+// compiled out by the logging macros at the bottom of this file.
+// --------------------------------------------------------------------------
+#define K4A_DRIVER_LOG_LEVEL_DEBUG 0
+#define K4A_DRIVER_LOG_LEVEL_INFO 1
+#define K4A_DRIVER_LOG_LEVEL_WARNING 2
+#define K4A_DRIVER_LOG_LEVEL_ERROR 3
 
-extern void DriverLog(const char* pchFormat, ...);
+#ifndef K4A_DRIVER_LOG_LEVEL
+#ifdef _DEBUG
+#define K4A_DRIVER_LOG_LEVEL K4A_DRIVER_LOG_LEVEL_DEBUG
+#else
+#define K4A_DRIVER_LOG_LEVEL K4A_DRIVER_LOG_LEVEL_INFO
+#endif
+#endif
+
+typedef enum _DriverLogSeverity
+{
+	DriverLogSeverity_Debug = K4A_DRIVER_LOG_LEVEL_DEBUG,
+	DriverLogSeverity_Info = K4A_DRIVER_LOG_LEVEL_INFO,
+	DriverLogSeverity_Warning = K4A_DRIVER_LOG_LEVEL_WARNING,
+	DriverLogSeverity_Error = K4A_DRIVER_LOG_LEVEL_ERROR
+} DriverLogSeverity;
 
 // --------------------------------------------------------------------------
-// Purpose: Write to the log file only in debug builds
+// Purpose: Queue a message for the log thread. Only the format pointer and
+// the arguments are captured on the calling thread, so pchFormat must be a
+// string literal. %s arguments are copied and may be freed after the call.
+// Repeats of the same format are rate limited and the ring never blocks; if
+// it is full the message is dropped and counted.
 // --------------------------------------------------------------------------
-extern void DebugDriverLog(const char* pchFormat, ...);
+extern void DriverLog(const char* pchFormat, ...);
+
+extern void DriverLogAt(DriverLogSeverity severity, const char* pchFormat, ...);
 
+// Same as DriverLogAt, but repeats are rate limited per (pchFile, nLine) rather
+// than per format, for messages forwarded through one format such as the SDK's.
+// pchFile must outlive the process, __FILE__ or a literal.
+extern void DriverLogAtSite(DriverLogSeverity severity, const char* pchFile, int nLine, const char* pchFormat, ...);
 
+// Number of messages dropped because the ring was full
+extern uint64_t GetDriverLogDropCount();
+
+// Starts the log thread. Messages queued before this are flushed once it runs.
 extern bool InitDriverLog(vr::IVRDriverLog* pDriverLog);
-extern void CleanupDriverLog();
\ No newline at end of file
+// Flushes everything still queued and stops the log thread
+extern void CleanupDriverLog();
+
+// --------------------------------------------------------------------------
+// Purpose: Severity filtered logging, calls below K4A_DRIVER_LOG_LEVEL do not
+// evaluate their arguments. DebugDriverLog is therefore gone from release builds.
+// --------------------------------------------------------------------------
+#if K4A_DRIVER_LOG_LEVEL <= K4A_DRIVER_LOG_LEVEL_DEBUG
+#define DebugDriverLog(...) DriverLogAt(DriverLogSeverity_Debug, __VA_ARGS__)
+#else
+#define DebugDriverLog(...) ((void)0)
+#endif
+
+#if K4A_DRIVER_LOG_LEVEL <= K4A_DRIVER_LOG_LEVEL_WARNING
+#define WarningDriverLog(...) DriverLogAt(DriverLogSeverity_Warning, __VA_ARGS__)
+#else
+#define WarningDriverLog(...) ((void)0)
+#endif
+
+#define ErrorDriverLog(...) DriverLogAt(DriverLogSeverity_Error, __VA_ARGS__)
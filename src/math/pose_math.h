@@ -0,0 +1,580 @@
+#pragma once
+#ifndef K4A_OPENVR_POSE_MATH_H
+#define K4A_OPENVR_POSE_MATH_H
+
+// Header only vector, quaternion and rigid transform math shared by the
+// driver, the provider and the calibrator. Everything is float; convert at
+// the OpenVR boundary where the SDK wants doubles.
+//
+// Quaternions are Hamilton, stored w, x, y, z like k4a_quaternion_t and
+// vr::HmdQuaternion_t. a * b applies b first, then a.
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSE_MATH_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define POSE_MATH_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace pose_math {
+
+	struct vec3
+	{
+		float x;
+		float y;
+		float z;
+	};
+
+	struct quat
+	{
+		float w;
+		float x;
+		float y;
+		float z;
+	};
+
+	// Row major 3x4, same layout as vr::HmdMatrix34_t. Column 3 is the translation.
+	struct mat34
+	{
+		float m[3][4];
+	};
+
+	// p' = rotation * p + translation
+	struct rigid
+	{
+		quat rotation;
+		vec3 translation;
+	};
+
+	constexpr float PI = 3.14159265358979323846f;
+
+	// ----------------------------------------------------------------------
+	// vec3
+	// ----------------------------------------------------------------------
+
+	constexpr vec3 operator+(const vec3& a, const vec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	constexpr vec3 operator-(const vec3& a, const vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	constexpr vec3 operator-(const vec3& a) { return { -a.x, -a.y, -a.z }; }
+	constexpr vec3 operator*(const vec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	constexpr vec3 operator*(float s, const vec3& a) { return { a.x * s, a.y * s, a.z * s }; }
+	constexpr vec3 operator/(const vec3& a, float s) { return { a.x / s, a.y / s, a.z / s }; }
+
+	constexpr float dot(const vec3& a, const vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	constexpr vec3 cross(const vec3& a, const vec3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	constexpr float length_squared(const vec3& a) { return dot(a, a); }
+
+	inline float length(const vec3& a) { return std::sqrt(dot(a, a)); }
+
+	inline vec3 normalize(const vec3& a)
+	{
+		float len = length(a);
+		return (len > 0.F) ? a / len : vec3{ 0.F, 0.F, 0.F };
+	}
+
+	constexpr vec3 lerp(const vec3& a, const vec3& b, float t) { return a + (b - a) * t; }
+
+	// ----------------------------------------------------------------------
+	// quat
+	// ----------------------------------------------------------------------
+
+	constexpr quat identity() { return { 1.F, 0.F, 0.F, 0.F }; }
+
+	constexpr quat operator*(const quat& a, const quat& b)
+	{
+		return {
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w
+		};
+	}
+
+	constexpr quat operator*(const quat& a, float s) { return { a.w * s, a.x * s, a.y * s, a.z * s }; }
+	constexpr quat operator+(const quat& a, const quat& b) { return { a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z }; }
+	constexpr quat operator-(const quat& a) { return { -a.w, -a.x, -a.y, -a.z }; }
+
+	constexpr float dot(const quat& a, const quat& b) { return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	constexpr quat conjugate(const quat& q) { return { q.w, -q.x, -q.y, -q.z }; }
+
+	// Inverse of any non zero quaternion; for unit quaternions use conjugate
+	constexpr quat inverse(const quat& q)
+	{
+		return conjugate(q) * (1.F / dot(q, q));
+	}
+
+	inline quat normalize(const quat& q)
+	{
+		float len = std::sqrt(dot(q, q));
+		return (len > 0.F) ? q * (1.F / len) : identity();
+	}
+
+	constexpr vec3 vector_part(const quat& q) { return { q.x, q.y, q.z }; }
+
+	// Rotates v by the unit quaternion q
+	constexpr vec3 rotate(const quat& q, const vec3& v)
+	{
+		// v + 2w(u x v) + 2u x (u x v), without building the matrix
+		vec3 u = vector_part(q);
+		vec3 t = cross(u, v) * 2.F;
+		return v + t * q.w + cross(u, t);
+	}
+
+	inline quat axis_angle(const vec3& axis, float angle)
+	{
+		vec3 n = normalize(axis) * std::sin(angle * 0.5F);
+		return { std::cos(angle * 0.5F), n.x, n.y, n.z };
+	}
+
+	// Quaternion exponential of the pure quaternion (0, v). exp(axis * angle / 2)
+	// is the rotation of angle radians about axis.
+	inline quat exp(const vec3& v)
+	{
+		float theta = length(v);
+		if (theta < 1e-6F)
+			return normalize(quat{ 1.F, v.x, v.y, v.z });
+
+		float s = std::sin(theta) / theta;
+		return { std::cos(theta), v.x * s, v.y * s, v.z * s };
+	}
+
+	// Inverse of exp for unit quaternions, picking the short way round
+	inline vec3 log(const quat& q)
+	{
+		quat p = (q.w < 0.F) ? -q : q;
+		vec3 u = vector_part(p);
+		float s = length(u);
+		if (s < 1e-6F)
+			return u;
+
+		float theta = std::atan2(s, p.w);
+		return u * (theta / s);
+	}
+
+	// Rotation vector (axis * angle) of a unit quaternion and back
+	inline vec3 to_rotation_vector(const quat& q) { return log(q) * 2.F; }
+	inline quat from_rotation_vector(const vec3& v) { return exp(v * 0.5F); }
+
+	// Angle in radians between two orientations
+	inline float angle_between(const quat& a, const quat& b)
+	{
+		float d = std::fabs(dot(a, b));
+		return 2.F * std::acos(d > 1.F ? 1.F : d);
+	}
+
+	// Angle in radians of the twist of q about +y (world up), in [-PI, PI].
+	// The swing about the other two axes does not change it.
+	inline float twist_y(const quat& q)
+	{
+		float angle = 2.F * std::atan2(q.y, q.w);
+		if (angle > PI)
+			angle -= 2.F * PI;
+		else if (angle < -PI)
+			angle += 2.F * PI;
+		return angle;
+	}
+
+	inline quat nlerp(const quat& a, const quat& b, float t)
+	{
+		quat c = (dot(a, b) < 0.F) ? -b : b;
+		return normalize(a * (1.F - t) + c * t);
+	}
+
+	inline quat slerp(const quat& a, const quat& b, float t)
+	{
+		float d = dot(a, b);
+		quat c = b;
+		if (d < 0.F)
+		{
+			d = -d;
+			c = -b;
+		}
+
+		// Too close for the sine ratio, nlerp is indistinguishable here
+		if (d > 0.9995F)
+			return nlerp(a, c, t);
+
+		float theta = std::acos(d);
+		float s = 1.F / std::sin(theta);
+		return a * (std::sin((1.F - t) * theta) * s) + c * (std::sin(t * theta) * s);
+	}
+
+	// Shortest rotation taking direction a onto direction b
+	inline quat rotation_between(const vec3& a, const vec3& b)
+	{
+		vec3 u = normalize(a);
+		vec3 v = normalize(b);
+		float d = dot(u, v);
+		if (d < -0.9999F)
+		{
+			// Opposite, half a turn about any perpendicular axis
+			vec3 axis = cross(vec3{ 1.F, 0.F, 0.F }, u);
+			if (length_squared(axis) < 1e-6F)
+				axis = cross(vec3{ 0.F, 1.F, 0.F }, u);
+			return axis_angle(axis, PI);
+		}
+		vec3 c = cross(u, v);
+		return normalize(quat{ 1.F + d, c.x, c.y, c.z });
+	}
+
+	// ----------------------------------------------------------------------
+	// mat34 and rigid
+	// ----------------------------------------------------------------------
+
+	constexpr mat34 identity34()
+	{
+		return { { { 1.F, 0.F, 0.F, 0.F }, { 0.F, 1.F, 0.F, 0.F }, { 0.F, 0.F, 1.F, 0.F } } };
+	}
+
+	constexpr rigid identity_rigid() { return { identity(), { 0.F, 0.F, 0.F } }; }
+
+	constexpr vec3 transform(const mat34& a, const vec3& p)
+	{
+		return {
+			a.m[0][0] * p.x + a.m[0][1] * p.y + a.m[0][2] * p.z + a.m[0][3],
+			a.m[1][0] * p.x + a.m[1][1] * p.y + a.m[1][2] * p.z + a.m[1][3],
+			a.m[2][0] * p.x + a.m[2][1] * p.y + a.m[2][2] * p.z + a.m[2][3]
+		};
+	}
+
+	// Linear part only, for velocities and other directions
+	constexpr vec3 transform_vector(const mat34& a, const vec3& v)
+	{
+		return {
+			a.m[0][0] * v.x + a.m[0][1] * v.y + a.m[0][2] * v.z,
+			a.m[1][0] * v.x + a.m[1][1] * v.y + a.m[1][2] * v.z,
+			a.m[2][0] * v.x + a.m[2][1] * v.y + a.m[2][2] * v.z
+		};
+	}
+
+	constexpr mat34 operator*(const mat34& a, const mat34& b)
+	{
+		mat34 r = {};
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+			}
+			r.m[i][3] += a.m[i][3];
+		}
+		return r;
+	}
+
+	constexpr mat34 scale34(float s)
+	{
+		return { { { s, 0.F, 0.F, 0.F }, { 0.F, s, 0.F, 0.F }, { 0.F, 0.F, s, 0.F } } };
+	}
+
+	constexpr mat34 to_mat34(const quat& q, const vec3& t = { 0.F, 0.F, 0.F })
+	{
+		return { {
+			{ 1.F - 2.F * (q.y * q.y + q.z * q.z), 2.F * (q.x * q.y - q.z * q.w), 2.F * (q.x * q.z + q.y * q.w), t.x },
+			{ 2.F * (q.x * q.y + q.z * q.w), 1.F - 2.F * (q.x * q.x + q.z * q.z), 2.F * (q.y * q.z - q.x * q.w), t.y },
+			{ 2.F * (q.x * q.z - q.y * q.w), 2.F * (q.y * q.z + q.x * q.w), 1.F - 2.F * (q.x * q.x + q.y * q.y), t.z }
+		} };
+	}
+
+	constexpr mat34 to_mat34(const rigid& a) { return to_mat34(a.rotation, a.translation); }
+
+	constexpr vec3 translation(const mat34& a) { return { a.m[0][3], a.m[1][3], a.m[2][3] }; }
+
+	// Rotation part of a (scale free) matrix as a unit quaternion
+	inline quat rotation(const mat34& a)
+	{
+		float trace = a.m[0][0] + a.m[1][1] + a.m[2][2];
+		quat q;
+		if (trace > 0.F)
+		{
+			float s = 0.5F / std::sqrt(trace + 1.F);
+			q = { 0.25F / s, (a.m[2][1] - a.m[1][2]) * s, (a.m[0][2] - a.m[2][0]) * s, (a.m[1][0] - a.m[0][1]) * s };
+		}
+		else if (a.m[0][0] > a.m[1][1] && a.m[0][0] > a.m[2][2])
+		{
+			float s = 2.F * std::sqrt(1.F + a.m[0][0] - a.m[1][1] - a.m[2][2]);
+			q = { (a.m[2][1] - a.m[1][2]) / s, 0.25F * s, (a.m[0][1] + a.m[1][0]) / s, (a.m[0][2] + a.m[2][0]) / s };
+		}
+		else if (a.m[1][1] > a.m[2][2])
+		{
+			float s = 2.F * std::sqrt(1.F + a.m[1][1] - a.m[0][0] - a.m[2][2]);
+			q = { (a.m[0][2] - a.m[2][0]) / s, (a.m[0][1] + a.m[1][0]) / s, 0.25F * s, (a.m[1][2] + a.m[2][1]) / s };
+		}
+		else
+		{
+			float s = 2.F * std::sqrt(1.F + a.m[2][2] - a.m[0][0] - a.m[1][1]);
+			q = { (a.m[1][0] - a.m[0][1]) / s, (a.m[0][2] + a.m[2][0]) / s, (a.m[1][2] + a.m[2][1]) / s, 0.25F * s };
+		}
+		return normalize(q);
+	}
+
+	inline rigid to_rigid(const mat34& a) { return { rotation(a), translation(a) }; }
+
+	constexpr vec3 transform(const rigid& a, const vec3& p) { return rotate(a.rotation, p) + a.translation; }
+
+	// a * b applies b first
+	constexpr rigid operator*(const rigid& a, const rigid& b)
+	{
+		return { a.rotation * b.rotation, rotate(a.rotation, b.translation) + a.translation };
+	}
+
+	constexpr rigid inverse(const rigid& a)
+	{
+		quat r = conjugate(a.rotation);
+		return { r, -rotate(r, a.translation) };
+	}
+
+	// ----------------------------------------------------------------------
+	// Batch kernels, in and out may alias
+	// ----------------------------------------------------------------------
+
+	// out[i] = a * in[i]
+	inline void transform_points(const mat34& a, const vec3* in, vec3* out, size_t count)
+	{
+#if defined(POSE_MATH_SSE)
+		const __m128 c0 = _mm_setr_ps(a.m[0][0], a.m[1][0], a.m[2][0], 0.F);
+		const __m128 c1 = _mm_setr_ps(a.m[0][1], a.m[1][1], a.m[2][1], 0.F);
+		const __m128 c2 = _mm_setr_ps(a.m[0][2], a.m[1][2], a.m[2][2], 0.F);
+		const __m128 c3 = _mm_setr_ps(a.m[0][3], a.m[1][3], a.m[2][3], 0.F);
+		for (size_t i = 0; i < count; i++)
+		{
+			__m128 r = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[i].x)), _mm_mul_ps(c1, _mm_set1_ps(in[i].y))),
+				_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(in[i].z)), c3));
+			_mm_storel_pi((__m64*)&out[i].x, r);
+			_mm_store_ss(&out[i].z, _mm_movehl_ps(r, r));
+		}
+#elif defined(POSE_MATH_NEON)
+		const float32x4_t c0 = { a.m[0][0], a.m[1][0], a.m[2][0], 0.F };
+		const float32x4_t c1 = { a.m[0][1], a.m[1][1], a.m[2][1], 0.F };
+		const float32x4_t c2 = { a.m[0][2], a.m[1][2], a.m[2][2], 0.F };
+		const float32x4_t c3 = { a.m[0][3], a.m[1][3], a.m[2][3], 0.F };
+		for (size_t i = 0; i < count; i++)
+		{
+			float32x4_t r = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(c3, c0, in[i].x), c1, in[i].y), c2, in[i].z);
+			vst1_f32(&out[i].x, vget_low_f32(r));
+			out[i].z = vgetq_lane_f32(r, 2);
+		}
+#else
+		for (size_t i = 0; i < count; i++)
+			out[i] = transform(a, in[i]);
+#endif
+	}
+
+	// Same as transform_points for structure of arrays input, four points per step
+	inline void transform_points(const mat34& a, const float* x, const float* y, const float* z,
+		float* out_x, float* out_y, float* out_z, size_t count)
+	{
+		size_t i = 0;
+#if defined(POSE_MATH_SSE)
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(x + i);
+			__m128 py = _mm_loadu_ps(y + i);
+			__m128 pz = _mm_loadu_ps(z + i);
+			__m128 r[3];
+			for (int row = 0; row < 3; row++)
+			{
+				r[row] = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(a.m[row][0])), _mm_mul_ps(py, _mm_set1_ps(a.m[row][1]))),
+					_mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(a.m[row][2])), _mm_set1_ps(a.m[row][3])));
+			}
+			_mm_storeu_ps(out_x + i, r[0]);
+			_mm_storeu_ps(out_y + i, r[1]);
+			_mm_storeu_ps(out_z + i, r[2]);
+		}
+#elif defined(POSE_MATH_NEON)
+		for (; i + 4 <= count; i += 4)
+		{
+			float32x4_t px = vld1q_f32(x + i);
+			float32x4_t py = vld1q_f32(y + i);
+			float32x4_t pz = vld1q_f32(z + i);
+			float32x4_t r[3];
+			for (int row = 0; row < 3; row++)
+			{
+				r[row] = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(a.m[row][3]),
+					px, a.m[row][0]), py, a.m[row][1]), pz, a.m[row][2]);
+			}
+			vst1q_f32(out_x + i, r[0]);
+			vst1q_f32(out_y + i, r[1]);
+			vst1q_f32(out_z + i, r[2]);
+		}
+#endif
+		for (; i < count; i++)
+		{
+			vec3 p = transform(a, vec3{ x[i], y[i], z[i] });
+			out_x[i] = p.x;
+			out_y[i] = p.y;
+			out_z[i] = p.z;
+		}
+	}
+
+	// out[i] = left * in[i] * right
+	inline void transform_rotations(const quat& left, const quat& right, const quat* in, quat* out, size_t count)
+	{
+#if defined(POSE_MATH_SSE)
+		// Hamilton product with a broadcast per component of the left operand,
+		// lanes are w, x, y, z
+		struct product
+		{
+			static __m128 mul(__m128 a, __m128 b)
+			{
+				const __m128 sx = _mm_setr_ps(-1.F, 1.F, -1.F, 1.F);
+				const __m128 sy = _mm_setr_ps(-1.F, 1.F, 1.F, -1.F);
+				const __m128 sz = _mm_setr_ps(-1.F, -1.F, 1.F, 1.F);
+
+				__m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b);
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), sx),
+					_mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1))));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), sy),
+					_mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+				r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), sz),
+					_mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3))));
+				return r;
+			}
+		};
+
+		const __m128 l = _mm_loadu_ps(&left.w);
+		const __m128 r = _mm_loadu_ps(&right.w);
+		for (size_t i = 0; i < count; i++)
+			_mm_storeu_ps(&out[i].w, product::mul(product::mul(l, _mm_loadu_ps(&in[i].w)), r));
+#elif defined(POSE_MATH_NEON)
+		struct product
+		{
+			static float32x4_t mul(float32x4_t a, float32x4_t b)
+			{
+				const float32x4_t sx = { -1.F, 1.F, -1.F, 1.F };
+				const float32x4_t sy = { -1.F, 1.F, 1.F, -1.F };
+				const float32x4_t sz = { -1.F, -1.F, 1.F, 1.F };
+
+				float32x4_t bx = vrev64q_f32(b); // x w z y
+				float32x4_t by = vextq_f32(b, b, 2); // y z w x
+				float32x4_t bz = vrev64q_f32(by); // z y x w
+
+				float32x4_t r = vmulq_n_f32(b, vgetq_lane_f32(a, 0));
+				r = vmlaq_f32(r, vmulq_n_f32(sx, vgetq_lane_f32(a, 1)), bx);
+				r = vmlaq_f32(r, vmulq_n_f32(sy, vgetq_lane_f32(a, 2)), by);
+				r = vmlaq_f32(r, vmulq_n_f32(sz, vgetq_lane_f32(a, 3)), bz);
+				return r;
+			}
+		};
+
+		const float32x4_t l = vld1q_f32(&left.w);
+		const float32x4_t r = vld1q_f32(&right.w);
+		for (size_t i = 0; i < count; i++)
+			vst1q_f32(&out[i].w, product::mul(product::mul(l, vld1q_f32(&in[i].w)), r));
+#else
+		for (size_t i = 0; i < count; i++)
+			out[i] = left * in[i] * right;
+#endif
+	}
+
+	// ----------------------------------------------------------------------
+	// Conversions. These are templates over the member layout so this header
+	// needs neither the K4A nor the OpenVR headers:
+	//   k4a_float3_t            .xyz.x       to_vec3 / store
+	//   k4a_quaternion_t        .wxyz.w      to_quat / store
+	//   vr::HmdQuaternion(f)_t  .w           to_quat / to_hmd<T> / store
+	//   vr::HmdMatrix34_t       .m[3][4]     to_mat34 / store
+	//   double[3], float[3]                  to_vec3 / store
+	// ----------------------------------------------------------------------
+
+	template <typename K>
+	constexpr auto to_vec3(const K& k) -> decltype(k.xyz.x, vec3())
+	{
+		return { k.xyz.x, k.xyz.y, k.xyz.z };
+	}
+
+	template <typename T>
+	constexpr vec3 to_vec3(const T(&v)[3])
+	{
+		return { (float)v[0], (float)v[1], (float)v[2] };
+	}
+
+	template <typename K>
+	constexpr auto to_quat(const K& k) -> decltype(k.wxyz.w, quat())
+	{
+		return { k.wxyz.w, k.wxyz.x, k.wxyz.y, k.wxyz.z };
+	}
+
+	template <typename H>
+	constexpr auto to_quat(const H& h) -> decltype(h.w, quat())
+	{
+		return { (float)h.w, (float)h.x, (float)h.y, (float)h.z };
+	}
+
+	template <typename M>
+	constexpr auto to_mat34(const M& a) -> decltype(a.m[2][3], mat34())
+	{
+		return { {
+			{ (float)a.m[0][0], (float)a.m[0][1], (float)a.m[0][2], (float)a.m[0][3] },
+			{ (float)a.m[1][0], (float)a.m[1][1], (float)a.m[1][2], (float)a.m[1][3] },
+			{ (float)a.m[2][0], (float)a.m[2][1], (float)a.m[2][2], (float)a.m[2][3] }
+		} };
+	}
+
+	// vr::HmdQuaternion_t hq = to_hmd<vr::HmdQuaternion_t>(q);
+	template <typename H>
+	constexpr H to_hmd(const quat& q)
+	{
+		H h = {};
+		h.w = q.w;
+		h.x = q.x;
+		h.y = q.y;
+		h.z = q.z;
+		return h;
+	}
+
+	template <typename K>
+	inline auto store(const vec3& v, K& k) -> decltype(k.xyz.x, void())
+	{
+		k.xyz.x = v.x;
+		k.xyz.y = v.y;
+		k.xyz.z = v.z;
+	}
+
+	template <typename T>
+	inline void store(const vec3& v, T(&out)[3])
+	{
+		out[0] = v.x;
+		out[1] = v.y;
+		out[2] = v.z;
+	}
+
+	template <typename K>
+	inline auto store(const quat& q, K& k) -> decltype(k.wxyz.w, void())
+	{
+		k.wxyz.w = q.w;
+		k.wxyz.x = q.x;
+		k.wxyz.y = q.y;
+		k.wxyz.z = q.z;
+	}
+
+	template <typename H>
+	inline auto store(const quat& q, H& h) -> decltype(h.w, void())
+	{
+		h.w = q.w;
+		h.x = q.x;
+		h.y = q.y;
+		h.z = q.z;
+	}
+
+	template <typename M>
+	inline auto store(const mat34& a, M& out) -> decltype(out.m[2][3], void())
+	{
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 4; j++)
+				out.m[i][j] = a.m[i][j];
+	}
+
+} // namespace pose_math
+
+#endif
@@ -0,0 +1,95 @@
+// Times the batch kernels against the scalar operators on a skeleton sized
+// and a point cloud sized batch. Not a test, run it by hand:
+//   pose_math_bench [iterations]
+
+#include "math/pose_math.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace pose_math;
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Keeps the compiler from dropping the loops whose results are unused
+static volatile float s_sink;
+
+template <typename F>
+static double NanosecondsPerItem(size_t items, int iterations, F&& run)
+{
+	run();
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < iterations; i++)
+		run();
+	double elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+
+	return elapsed / ((double)items * (double)iterations);
+}
+
+static void BenchPoints(size_t count, int iterations)
+{
+	mat34 a = to_mat34(normalize(quat{ 0.9F, 0.1F, -0.3F, 0.2F }), vec3{ 0.1F, 1.2F, -2.F });
+	std::vector<vec3> in(count), out(count);
+	std::vector<float> x(count), y(count), z(count), ox(count), oy(count), oz(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		in[i] = { (float)(i % 640) * 1e-3F, (float)(i / 640) * 1e-3F, 1.F + (float)(i % 7) * 0.1F };
+		x[i] = in[i].x;
+		y[i] = in[i].y;
+		z[i] = in[i].z;
+	}
+
+	double scalar = NanosecondsPerItem(count, iterations, [&] {
+		for (size_t i = 0; i < count; i++)
+			out[i] = transform(a, in[i]);
+		s_sink = out[count - 1].x;
+	});
+	double aos = NanosecondsPerItem(count, iterations, [&] {
+		transform_points(a, in.data(), out.data(), count);
+		s_sink = out[count - 1].x;
+	});
+	double soa = NanosecondsPerItem(count, iterations, [&] {
+		transform_points(a, x.data(), y.data(), z.data(), ox.data(), oy.data(), oz.data(), count);
+		s_sink = ox[count - 1];
+	});
+
+	std::printf("transform_points    %7zu: scalar %6.2f ns, batch %6.2f ns (%.1fx), soa %6.2f ns (%.1fx)\n",
+		count, scalar, aos, scalar / aos, soa, scalar / soa);
+}
+
+static void BenchRotations(size_t count, int iterations)
+{
+	quat left = normalize(quat{ 0.7F, 0.1F, 0.7F, 0.F });
+	quat right = normalize(quat{ 0.9F, -0.2F, 0.F, 0.4F });
+	std::vector<quat> in(count, normalize(quat{ 0.5F, 0.5F, -0.5F, 0.5F })), out(count);
+
+	double scalar = NanosecondsPerItem(count, iterations, [&] {
+		for (size_t i = 0; i < count; i++)
+			out[i] = left * in[i] * right;
+		s_sink = out[count - 1].w;
+	});
+	double batch = NanosecondsPerItem(count, iterations, [&] {
+		transform_rotations(left, right, in.data(), out.data(), count);
+		s_sink = out[count - 1].w;
+	});
+
+	std::printf("transform_rotations %7zu: scalar %6.2f ns, batch %6.2f ns (%.1fx)\n",
+		count, scalar, batch, scalar / batch);
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = (argc > 1) ? std::atoi(argv[1]) : 200;
+	if (iterations < 1)
+		iterations = 1;
+
+	// One skeleton, then a WFOV binned depth image
+	BenchPoints(32, iterations * 1000);
+	BenchPoints(512 * 512, iterations);
+	BenchRotations(32, iterations * 1000);
+	BenchRotations(4096, iterations * 10);
+
+	return 0;
+}
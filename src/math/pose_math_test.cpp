@@ -0,0 +1,291 @@
+// Checks the SSE/NEON batch kernels against the scalar operators they
+// replace, and the round trips everything else relies on. Returns non zero
+// on the first group with a failure so ctest reports it.
+
+#include "math/pose_math.h"
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+using namespace pose_math;
+
+// Same member layout as the SDK types the conversions are written against,
+// so the test builds without the K4A or OpenVR headers
+typedef union
+{
+	struct { float x; float y; float z; } xyz;
+	float v[3];
+} k4a_float3_t;
+
+typedef union
+{
+	struct { float w; float x; float y; float z; } wxyz;
+	float v[4];
+} k4a_quaternion_t;
+
+typedef struct { double w, x, y, z; } HmdQuaternion_t;
+typedef struct { float w, x, y, z; } HmdQuaternionf_t;
+typedef struct { float m[3][4]; } HmdMatrix34_t;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); s_failures++; } } while (0)
+#define CHECK_NEAR(a, b, eps) do { float _a = (a), _b = (b); if (!(std::fabs(_a - _b) <= (eps))) { \
+	std::printf("%s:%d: %s = %g, expected %s = %g\n", __FILE__, __LINE__, #a, _a, #b, _b); s_failures++; } } while (0)
+
+static const float EPS = 1e-5F;
+
+// xorshift, so runs are repeatable on every platform
+static uint32_t s_seed = 0x12345678;
+
+static float Random(float lo, float hi)
+{
+	s_seed ^= s_seed << 13;
+	s_seed ^= s_seed >> 17;
+	s_seed ^= s_seed << 5;
+	return lo + (hi - lo) * (float)(s_seed & 0xFFFFFF) / (float)0xFFFFFF;
+}
+
+static vec3 RandomVec(float range)
+{
+	return { Random(-range, range), Random(-range, range), Random(-range, range) };
+}
+
+static quat RandomQuat()
+{
+	return normalize(quat{ Random(-1.F, 1.F), Random(-1.F, 1.F), Random(-1.F, 1.F), Random(-1.F, 1.F) });
+}
+
+static mat34 RandomTransform()
+{
+	return to_mat34(RandomQuat(), RandomVec(5.F));
+}
+
+static void CheckVec(const vec3& a, const vec3& b, float eps)
+{
+	CHECK_NEAR(a.x, b.x, eps);
+	CHECK_NEAR(a.y, b.y, eps);
+	CHECK_NEAR(a.z, b.z, eps);
+}
+
+// q and -q are the same rotation
+static void CheckRotation(const quat& a, const quat& b, float eps)
+{
+	float sign = (dot(a, b) < 0.F) ? -1.F : 1.F;
+	CHECK_NEAR(a.w, b.w * sign, eps);
+	CHECK_NEAR(a.x, b.x * sign, eps);
+	CHECK_NEAR(a.y, b.y * sign, eps);
+	CHECK_NEAR(a.z, b.z * sign, eps);
+}
+
+static void TestTransformPoints()
+{
+	// Odd counts to cover the scalar tail of the four wide loop
+	for (size_t count : { 0, 1, 3, 4, 7, 32, 101 })
+	{
+		mat34 a = RandomTransform();
+		std::vector<vec3> in(count), out(count);
+		std::vector<float> x(count), y(count), z(count), ox(count), oy(count), oz(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			in[i] = RandomVec(3.F);
+			x[i] = in[i].x;
+			y[i] = in[i].y;
+			z[i] = in[i].z;
+		}
+
+		transform_points(a, in.data(), out.data(), count);
+		transform_points(a, x.data(), y.data(), z.data(), ox.data(), oy.data(), oz.data(), count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			vec3 expected = transform(a, in[i]);
+			CheckVec(out[i], expected, EPS);
+			CheckVec(vec3{ ox[i], oy[i], oz[i] }, expected, EPS);
+		}
+
+		// In place
+		transform_points(a, in.data(), in.data(), count);
+		for (size_t i = 0; i < count; i++)
+			CheckVec(in[i], out[i], 0.F);
+	}
+}
+
+static void TestTransformRotations()
+{
+	for (size_t count : { 0, 1, 5, 32 })
+	{
+		quat left = RandomQuat();
+		quat right = RandomQuat();
+		std::vector<quat> in(count), out(count);
+		for (size_t i = 0; i < count; i++)
+			in[i] = RandomQuat();
+
+		transform_rotations(left, right, in.data(), out.data(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			quat expected = left * in[i] * right;
+			CHECK_NEAR(out[i].w, expected.w, EPS);
+			CHECK_NEAR(out[i].x, expected.x, EPS);
+			CHECK_NEAR(out[i].y, expected.y, EPS);
+			CHECK_NEAR(out[i].z, expected.z, EPS);
+		}
+	}
+}
+
+static void TestRotation()
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		quat q = RandomQuat();
+		CheckRotation(rotation(to_mat34(q)), q, 1e-4F);
+	}
+
+	// Every branch of the trace test: identity and half turns about each axis
+	CheckRotation(rotation(identity34()), identity(), EPS);
+	CheckRotation(rotation(to_mat34(axis_angle({ 1.F, 0.F, 0.F }, PI))), axis_angle({ 1.F, 0.F, 0.F }, PI), EPS);
+	CheckRotation(rotation(to_mat34(axis_angle({ 0.F, 1.F, 0.F }, PI))), axis_angle({ 0.F, 1.F, 0.F }, PI), EPS);
+	CheckRotation(rotation(to_mat34(axis_angle({ 0.F, 0.F, 1.F }, PI))), axis_angle({ 0.F, 0.F, 1.F }, PI), EPS);
+
+	// The matrix and the quaternion rotate points alike
+	quat q = RandomQuat();
+	vec3 p = RandomVec(2.F);
+	CheckVec(transform(to_mat34(q), p), rotate(q, p), EPS);
+}
+
+static void TestSlerp()
+{
+	for (int i = 0; i < 200; i++)
+	{
+		quat a = RandomQuat();
+		quat b = RandomQuat();
+
+		CheckRotation(slerp(a, b, 0.F), a, 1e-4F);
+		CheckRotation(slerp(a, b, 1.F), b, 1e-4F);
+
+		// Constant angular speed along the short arc
+		float total = angle_between(a, b);
+		float t = Random(0.F, 1.F);
+		quat c = slerp(a, b, t);
+		CHECK_NEAR(std::sqrt(dot(c, c)), 1.F, EPS);
+		CHECK_NEAR(angle_between(a, c), total * t, 1e-3F);
+		CHECK_NEAR(angle_between(c, b), total * (1.F - t), 1e-3F);
+	}
+
+	// Nearly equal, the nlerp branch
+	quat a = RandomQuat();
+	quat b = normalize(a + quat{ 1e-4F, 0.F, 0.F, 0.F });
+	CheckRotation(slerp(a, b, 0.5F), nlerp(a, b, 0.5F), EPS);
+}
+
+static void TestExpLog()
+{
+	for (int i = 0; i < 1000; i++)
+	{
+		quat q = RandomQuat();
+		CheckRotation(exp(log(q)), q, 1e-4F);
+
+		// Angles short of a half turn come back exactly
+		vec3 v = normalize(RandomVec(1.F)) * Random(0.F, PI * 0.99F);
+		CheckVec(to_rotation_vector(from_rotation_vector(v)), v, 1e-4F);
+	}
+
+	CheckRotation(exp(vec3{ 0.F, 0.F, 0.F }), identity(), 0.F);
+	CheckVec(log(identity()), vec3{ 0.F, 0.F, 0.F }, 0.F);
+	CheckVec(log(-identity()), vec3{ 0.F, 0.F, 0.F }, 0.F);
+}
+
+static void TestTwist()
+{
+	const vec3 up = { 0.F, 1.F, 0.F };
+	for (int i = 0; i < 200; i++)
+	{
+		float angle = Random(-PI * 0.99F, PI * 0.99F);
+		CHECK_NEAR(twist_y(axis_angle(up, angle)), angle, 1e-4F);
+		CHECK_NEAR(twist_y(-axis_angle(up, angle)), angle, 1e-4F);
+
+		// A swing about a horizontal axis applied after the twist leaves it alone
+		vec3 horizontal = normalize(vec3{ Random(-1.F, 1.F), 0.F, Random(-1.F, 1.F) });
+		quat swing = axis_angle(horizontal, Random(-1.F, 1.F));
+		CHECK_NEAR(twist_y(swing * axis_angle(up, angle)), angle, 1e-4F);
+	}
+}
+
+static void TestConversions()
+{
+	k4a_float3_t kv = {};
+	kv.xyz.x = 1.F;
+	kv.xyz.y = -2.F;
+	kv.xyz.z = 3.5F;
+	vec3 v = to_vec3(kv);
+	CheckVec(v, vec3{ 1.F, -2.F, 3.5F }, 0.F);
+
+	k4a_float3_t kv2 = {};
+	store(v, kv2);
+	CHECK(kv2.v[0] == 1.F && kv2.v[1] == -2.F && kv2.v[2] == 3.5F);
+
+	double dv[3] = { 0.25, 0.5, -0.75 };
+	CheckVec(to_vec3(dv), vec3{ 0.25F, 0.5F, -0.75F }, 0.F);
+	float fv[3];
+	store(v, fv);
+	CHECK(fv[0] == 1.F && fv[1] == -2.F && fv[2] == 3.5F);
+
+	quat q = RandomQuat();
+	k4a_quaternion_t kq = {};
+	store(q, kq);
+	CHECK(kq.v[0] == q.w && kq.v[1] == q.x && kq.v[2] == q.y && kq.v[3] == q.z);
+	CheckRotation(to_quat(kq), q, 0.F);
+
+	HmdQuaternion_t hq = to_hmd<HmdQuaternion_t>(q);
+	CheckRotation(to_quat(hq), q, 0.F);
+	HmdQuaternionf_t hqf = {};
+	store(q, hqf);
+	CHECK(hqf.w == q.w && hqf.x == q.x && hqf.y == q.y && hqf.z == q.z);
+
+	mat34 a = RandomTransform();
+	HmdMatrix34_t hm = {};
+	store(a, hm);
+	mat34 b = to_mat34(hm);
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 4; j++)
+			CHECK(b.m[i][j] == a.m[i][j]);
+}
+
+typedef struct _pose_math_test
+{
+	const char* name;
+	void(*run)();
+} pose_math_test_t;
+
+int main()
+{
+	static const pose_math_test_t tests[] = {
+		{ "transform_points", TestTransformPoints },
+		{ "transform_rotations", TestTransformRotations },
+		{ "rotation", TestRotation },
+		{ "slerp", TestSlerp },
+		{ "exp/log", TestExpLog },
+		{ "twist_y", TestTwist },
+		{ "conversions", TestConversions },
+	};
+
+#if defined(POSE_MATH_SSE)
+	std::printf("pose_math: SSE kernels\n");
+#elif defined(POSE_MATH_NEON)
+	std::printf("pose_math: NEON kernels\n");
+#else
+	std::printf("pose_math: scalar kernels\n");
+#endif
+
+	int failed = 0;
+	for (const pose_math_test_t& test : tests)
+	{
+		int before = s_failures;
+		test.run();
+		bool passed = s_failures == before;
+		std::printf("%-20s %s\n", test.name, passed ? "ok" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+#pragma once
+#ifndef K4A_OPENVR_RIGID_FIT_H
+#define K4A_OPENVR_RIGID_FIT_H
+
+// Least squares rigid transform between two point sets (Horn's closed form
+// quaternion method). Accumulates in double, the centred covariance of
+// points a few metres from the origin loses too much in float.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "math/pose_math.h"
+
+namespace pose_math {
+
+	// Weighted sums of point pairs, enough to solve the fit without keeping
+	// the points. target ~= transform * source.
+	struct rigid_fit_sums
+	{
+		double weight = 0.0;
+		double source[3] = { 0.0, 0.0, 0.0 };
+		double target[3] = { 0.0, 0.0, 0.0 };
+		// sum of w * source * target^T
+		double cross[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+		// sum of w * source * source^T, for the degeneracy check
+		double spread[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+		double target_squared = 0.0;
+
+		void add(const vec3& s, const vec3& t, double w = 1.0)
+		{
+			const double sv[3] = { s.x, s.y, s.z };
+			const double tv[3] = { t.x, t.y, t.z };
+
+			weight += w;
+			for (int i = 0; i < 3; i++)
+			{
+				source[i] += w * sv[i];
+				target[i] += w * tv[i];
+				for (int j = 0; j < 3; j++)
+				{
+					cross[i][j] += w * sv[i] * tv[j];
+					spread[i][j] += w * sv[i] * sv[j];
+				}
+				target_squared += w * tv[i] * tv[i];
+			}
+		}
+
+		// Exponential forgetting, for recursive estimates over a sliding window
+		void scale(double factor)
+		{
+			weight *= factor;
+			target_squared *= factor;
+			for (int i = 0; i < 3; i++)
+			{
+				source[i] *= factor;
+				target[i] *= factor;
+				for (int j = 0; j < 3; j++)
+				{
+					cross[i][j] *= factor;
+					spread[i][j] *= factor;
+				}
+			}
+		}
+
+		void clear() { *this = rigid_fit_sums(); }
+	};
+
+	struct rigid_fit_result
+	{
+		rigid transform = identity_rigid();
+		// Weighted RMS distance between target and transform * source, metres
+		float rms = 0.F;
+		// Spread of the source points along their second principal axis (standard
+		// deviation, metres). Near zero the points are collinear and the rotation
+		// about that line is unconstrained.
+		float spread = 0.F;
+		size_t inliers = 0;
+		bool valid = false;
+	};
+
+	namespace detail {
+
+		// Cyclic Jacobi eigen decomposition of a small symmetric matrix. Eigenvalues
+		// end up on the diagonal of a, eigenvectors in the columns of v.
+		template <int N>
+		inline void jacobi_eigen(double(&a)[N][N], double(&v)[N][N])
+		{
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++)
+					v[i][j] = (i == j) ? 1.0 : 0.0;
+
+			for (int sweep = 0; sweep < 32; sweep++)
+			{
+				double off = 0.0;
+				for (int p = 0; p < N; p++)
+					for (int q = p + 1; q < N; q++)
+						off += a[p][q] * a[p][q];
+				if (off < 1e-22)
+					return;
+
+				for (int p = 0; p < N; p++)
+				{
+					for (int q = p + 1; q < N; q++)
+					{
+						if (std::fabs(a[p][q]) < 1e-300)
+							continue;
+
+						double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+						double t = ((theta >= 0.0) ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+						double c = 1.0 / std::sqrt(t * t + 1.0);
+						double s = t * c;
+
+						for (int k = 0; k < N; k++)
+						{
+							double akp = a[k][p];
+							double akq = a[k][q];
+							a[k][p] = c * akp - s * akq;
+							a[k][q] = s * akp + c * akq;
+						}
+						for (int k = 0; k < N; k++)
+						{
+							double apk = a[p][k];
+							double aqk = a[q][k];
+							a[p][k] = c * apk - s * aqk;
+							a[q][k] = s * apk + c * aqk;
+						}
+						for (int k = 0; k < N; k++)
+						{
+							double vkp = v[k][p];
+							double vkq = v[k][q];
+							v[k][p] = c * vkp - s * vkq;
+							v[k][q] = s * vkp + c * vkq;
+						}
+					}
+				}
+			}
+		}
+
+	} // namespace detail
+
+	inline rigid_fit_result solve(const rigid_fit_sums& sums)
+	{
+		rigid_fit_result result;
+		if (sums.weight <= 0.0)
+			return result;
+
+		double ms[3];
+		double mt[3];
+		for (int i = 0; i < 3; i++)
+		{
+			ms[i] = sums.source[i] / sums.weight;
+			mt[i] = sums.target[i] / sums.weight;
+		}
+
+		// Centred cross covariance S and source covariance C
+		double s[3][3];
+		double c[3][3];
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				s[i][j] = sums.cross[i][j] - sums.weight * ms[i] * mt[j];
+				c[i][j] = sums.spread[i][j] / sums.weight - ms[i] * ms[j];
+			}
+		}
+
+		double n[4][4] = {
+			{ s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0] },
+			{ s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2] },
+			{ s[2][0] - s[0][2], s[0][1] + s[1][0], -s[0][0] + s[1][1] - s[2][2], s[1][2] + s[2][1] },
+			{ s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], -s[0][0] - s[1][1] + s[2][2] }
+		};
+		double v[4][4];
+		detail::jacobi_eigen(n, v);
+
+		int best = 0;
+		for (int i = 1; i < 4; i++)
+			if (n[i][i] > n[best][best])
+				best = i;
+
+		quat q = normalize(quat{ (float)v[0][best], (float)v[1][best], (float)v[2][best], (float)v[3][best] });
+		if (q.w < 0.F)
+			q = -q;
+
+		vec3 source_mean = { (float)ms[0], (float)ms[1], (float)ms[2] };
+		vec3 target_mean = { (float)mt[0], (float)mt[1], (float)mt[2] };
+
+		result.transform.rotation = q;
+		result.transform.translation = target_mean - rotate(q, source_mean);
+
+		// sum |t' - R s'|^2 = sum |t'|^2 + sum |s'|^2 - 2 * largest eigenvalue
+		double source_centred = sums.weight * (c[0][0] + c[1][1] + c[2][2]);
+		double target_centred = sums.target_squared - sums.weight * (mt[0] * mt[0] + mt[1] * mt[1] + mt[2] * mt[2]);
+		double error = std::max(0.0, source_centred + target_centred - 2.0 * n[best][best]);
+		result.rms = (float)std::sqrt(error / sums.weight);
+
+		double e[3][3];
+		detail::jacobi_eigen(c, e);
+		double eig[3] = { c[0][0], c[1][1], c[2][2] };
+		std::sort(eig, eig + 3);
+		result.spread = (float)std::sqrt(std::max(0.0, eig[1]));
+
+		result.valid = true;
+		return result;
+	}
+
+	// Iteratively reweighted fit that drops pairs further than max(min_threshold,
+	// sigmas * robust sigma) from the current estimate and refits. inlier may be
+	// null, otherwise it receives the final inlier mask.
+	inline rigid_fit_result fit_rigid_robust(const vec3* source, const vec3* target, size_t count,
+		float min_threshold = 0.03F, float sigmas = 3.F, int iterations = 5, bool* inlier = nullptr)
+	{
+		std::vector<bool> keep(count, true);
+		std::vector<bool> fitted(count, true);
+		std::vector<float> residuals(count);
+		rigid_fit_result result;
+
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			rigid_fit_sums sums;
+			size_t used = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (keep[i])
+				{
+					sums.add(source[i], target[i]);
+					used++;
+				}
+			}
+
+			result = solve(sums);
+			result.inliers = used;
+			fitted = keep;
+			if (!result.valid)
+				return result;
+
+			for (size_t i = 0; i < count; i++)
+				residuals[i] = length(target[i] - transform(result.transform, source[i]));
+
+			// Median absolute residual, scaled to a standard deviation
+			std::vector<float> sorted(residuals);
+			std::nth_element(sorted.begin(), sorted.begin() + count / 2, sorted.end());
+			float threshold = std::max(min_threshold, sigmas * 1.4826F * sorted[count / 2]);
+
+			bool changed = false;
+			size_t inliers = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				bool in = residuals[i] <= threshold;
+				changed |= (in != keep[i]);
+				keep[i] = in;
+				inliers += in ? 1 : 0;
+			}
+
+			if (!changed || inliers < 3)
+				break;
+		}
+
+		if (inlier != nullptr)
+			for (size_t i = 0; i < count; i++)
+				inlier[i] = fitted[i];
+
+		return result;
+	}
+
+} // namespace pose_math
+
+#endif
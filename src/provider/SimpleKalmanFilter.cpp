@@ -11,6 +11,7 @@ SimpleKalmanFilter::SimpleKalmanFilter(float mea_e, float est_e, float q)
 {
   _err_measure=mea_e;
   _err_estimate=est_e;
+  _initial_err_estimate=est_e;
   _q = q;
   _kalman_gain = 0;
   _current_estimate = 0;
@@ -27,6 +28,14 @@ float SimpleKalmanFilter::updateEstimate(float mea)
   return _current_estimate;
 }
 
+void SimpleKalmanFilter::reset(float estimate)
+{
+  _err_estimate=_initial_err_estimate;
+  _kalman_gain = 0;
+  _current_estimate = estimate;
+  _last_estimate = estimate;
+}
+
 void SimpleKalmanFilter::setMeasurementError(float mea_e)
 {
   _err_measure=mea_e;
@@ -13,6 +13,8 @@ class SimpleKalmanFilter
 public:
 	SimpleKalmanFilter(float mea_e, float est_e, float q);
 	float updateEstimate(float mea);
+	// Restarts from a known value instead of the last estimate
+	void reset(float estimate);
 	void setMeasurementError(float mea_e);
 	void setEstimateError(float est_e);
 	void setProcessNoise(float q);
@@ -22,6 +24,7 @@ public:
 private:
 	float _err_measure;
 	float _err_estimate;
+	float _initial_err_estimate;
 	float _q;
 	float _current_estimate;
 	float _last_estimate;
@@ -1,6 +1,10 @@
 #include "bone_filter.h"
+#include <algorithm>
 
 k4abt_joint_t bone_filter::getNextPos(k4abt_joint_t rawJoint) {
+	if (!warm)
+		reset(rawJoint);
+
 	k4abt_joint_t predictedJoint;
 	predictedJoint.position.xyz.x = x.updateEstimate(rawJoint.position.xyz.x);
 	predictedJoint.position.xyz.y = y.updateEstimate(rawJoint.position.xyz.y);
@@ -9,14 +13,80 @@ k4abt_joint_t bone_filter::getNextPos(k4abt_joint_t rawJoint) {
 	predictedJoint.orientation.wxyz.x = qx.updateEstimate(rawJoint.orientation.wxyz.x);
 	predictedJoint.orientation.wxyz.y = qy.updateEstimate(rawJoint.orientation.wxyz.y);
 	predictedJoint.orientation.wxyz.z = qz.updateEstimate(rawJoint.orientation.wxyz.z);
-	k4a_quaternion_t normed = normalize(predictedJoint.orientation);
-	predictedJoint.orientation.wxyz.w = normed.wxyz.w;
-	predictedJoint.orientation.wxyz.x = normed.wxyz.z;
-	predictedJoint.orientation.wxyz.y = normed.wxyz.x;
-	predictedJoint.orientation.wxyz.z = normed.wxyz.y;
+	predictedJoint.confidence_level = rawJoint.confidence_level;
+	pose_math::store(pose_math::normalize(pose_math::to_quat(predictedJoint.orientation)), predictedJoint.orientation);
+	constrain(predictedJoint, nullptr);
 	return predictedJoint;
 }
 
+k4abt_joint_t bone_filter::getNextPos(const SkeletonHistory& history, k4abt_joint_id_t joint, float lead, k4a_float3_t* velocity) {
+	k4abt_joint_t rawJoint;
+	pose_math::store(history.Position(joint, 0), rawJoint.position);
+	pose_math::store(history.Orientation(joint, 0), rawJoint.orientation);
+	rawJoint.confidence_level = history.Confidence(joint, 0);
+
+	// Kalman filters keep running so switching back does not start from stale state
+	k4abt_joint_t predictedJoint = getNextPos(rawJoint);
+
+	polynomial.Update(history, joint);
+
+	pose_math::vec3 position;
+	pose_math::vec3 fitted;
+	if (polynomial.Evaluate(lead, &position, &fitted)) {
+		pose_math::store(position, predictedJoint.position);
+		pose_math::store(fitted, *velocity);
+		constrain(predictedJoint, velocity);
+	}
+	else {
+		pose_math::store(pose_math::vec3{ 0.F, 0.F, 0.F }, *velocity);
+	}
+	return predictedJoint;
+}
+
+void bone_filter::reset(k4abt_joint_t rawJoint) {
+	x.reset(rawJoint.position.xyz.x);
+	y.reset(rawJoint.position.xyz.y);
+	z.reset(rawJoint.position.xyz.z);
+	qw.reset(rawJoint.orientation.wxyz.w);
+	qx.reset(rawJoint.orientation.wxyz.x);
+	qy.reset(rawJoint.orientation.wxyz.y);
+	qz.reset(rawJoint.orientation.wxyz.z);
+	polynomial.Reset();
+	warm = true;
+}
+
+void bone_filter::setFloor(const floor_plane_t& plane) {
+	floor = plane;
+}
+
+void bone_filter::constrain(k4abt_joint_t& joint, k4a_float3_t* velocity) const {
+	if (!floor.valid)
+		return;
+
+	pose_math::vec3 position = pose_math::to_vec3(joint.position);
+	float height = pose_math::dot(floor.up, position) - floor.height - floor_contact;
+	if (height >= floor_band)
+		return;
+
+	// 2t^2 - t^3 of the band, flat at the floor and meeting the raw height at
+	// the top of the band with the same slope
+	float t = std::max(height / floor_band, 0.F);
+	float constrained = floor_band * t * t * (2.F - t);
+	pose_math::store(position + floor.up * (constrained - height), joint.position);
+
+	if (velocity != nullptr) {
+		pose_math::vec3 v = pose_math::to_vec3(*velocity);
+		float vertical = pose_math::dot(floor.up, v);
+		pose_math::store(v + floor.up * (vertical * t * (4.F - 3.F * t) - vertical), *velocity);
+	}
+}
+
+void bone_filter::setWindow(size_t window, int order) {
+	polynomial.window = window;
+	polynomial.order = order;
+	polynomial.Reset();
+}
+
 void bone_filter::setEstimateError(float est_e) {
 	x.setEstimateError(est_e);
 	y.setEstimateError(est_e);
@@ -1,24 +1,35 @@
 #include "k4abt.h"
 #include "SimpleKalmanFilter.h"
 #include <cmath>
+#include "math/pose_math.h"
+#include "polynomial_filter.h"
+#include "floor_detector.h"
 
 #ifndef bone_filter_h
 #define bone_filter_h
 
-inline k4a_quaternion_t normalize(k4a_quaternion_t a) {
-	float mag = pow(sqrt(a.wxyz.w * a.wxyz.w + a.wxyz.x * a.wxyz.x + a.wxyz.y * a.wxyz.y + a.wxyz.z * a.wxyz.z), 2);
-	a.wxyz.w /= mag;
-	a.wxyz.x /= mag;
-	a.wxyz.y /= mag;
-	a.wxyz.z /= mag;
-	return a;
-}
-
 class bone_filter {
 
 public:
 	// Give raw position data, get estimated position
 	k4abt_joint_t getNextPos(k4abt_joint_t);
+
+	// Polynomial mode: position from the fit over the joint's samples in history,
+	// lead seconds past the newest, and its velocity in camera space per second.
+	// Orientation still goes through the Kalman filters.
+	k4abt_joint_t getNextPos(const SkeletonHistory& history, k4abt_joint_id_t joint, float lead, k4a_float3_t* velocity);
+
+	// Warm start from a measurement, after the body was lost. Also happens on the
+	// first measurement so nothing slides in from the camera origin.
+	void reset(k4abt_joint_t rawJoint);
+
+	// Feet only: the floor the joint stays above, camera space. A joint
+	// closer than floor_contact is lifted, one within floor_band above that
+	// has its height compressed so a planted foot stops jittering.
+	void setFloor(const floor_plane_t& plane);
+
+	// samples in the polynomial window and its order (1 or 2), starts the fit over
+	void setWindow(size_t window, int order);
 	
 	// set the measurement error of all 3 axis
 	void setMeasurementError(float mea_e);
@@ -37,6 +48,17 @@ private:
 	SimpleKalmanFilter qx = SimpleKalmanFilter(0.001, 0.001, 0.014);
 	SimpleKalmanFilter qy = SimpleKalmanFilter(0.001, 0.001, 0.014);
 	SimpleKalmanFilter qz = SimpleKalmanFilter(0.001, 0.001, 0.014);
+
+	PolynomialFilter polynomial;
+
+	// Moves an output onto or above the floor, velocity optional
+	void constrain(k4abt_joint_t& joint, k4a_float3_t* velocity) const;
+
+	floor_plane_t floor = {};
+	float floor_contact = 40.F;
+	float floor_band = 40.F;
+
+	bool warm = false;
 };
 
 
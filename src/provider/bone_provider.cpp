@@ -3,13 +3,28 @@
 #include <math.h>
 #include "bone_provider.h"
 #include "bone_filter.h"
+#include "camera_transform.h"
 #include <time.h>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <climits>
 #include <fstream>
 #include <string>
+#include <cstdio>
+#include <memory>
 #include <windows.h>
-#include <omp.h>
+#include "thread_scheduler.h"
+#include "host_clock.h"
 
 
+// SteamVR settings section of the driver, body profiles and modes
+static const char* SETTINGS_SECTION = "driver_k4a_openvr";
+
+// Polynomial filter window, samples, and order until the calibrator sets them
+static const int POLYNOMIAL_FILTER_WINDOW = 7;
+static const int POLYNOMIAL_FILTER_ORDER = 2;
+
 static TCHAR calibrationMemName[] = TEXT("BoneCalibrationMemmap");
 
 static HANDLE calibrationMemHandle = INVALID_HANDLE_VALUE;
@@ -22,12 +37,51 @@ static void k4a_log_cb(void* context,
 	const int line,
 	const char* message)
 {
-	((K4ABoneProvider*)context)->m_driver_log("%d : %s:%d - %s\n", level, file, line, message);
+	DriverLogSeverity severity;
+	switch (level)
+	{
+	case K4A_LOG_LEVEL_CRITICAL:
+	case K4A_LOG_LEVEL_ERROR:
+		severity = DriverLogSeverity_Error;
+		break;
+	case K4A_LOG_LEVEL_WARNING:
+		severity = DriverLogSeverity_Warning;
+		break;
+	case K4A_LOG_LEVEL_INFO:
+		severity = DriverLogSeverity_Info;
+		break;
+	default:
+		severity = DriverLogSeverity_Debug;
+		break;
+	}
+
+	// Every SDK message shares this format, so the budget is per SDK call site
+	((K4ABoneProvider*)context)->m_sdk_log(severity, file, line, "K4A %s:%d - %s\n", file, line, message);
 }
 
-K4ABoneProvider::K4ABoneProvider(DriverLog_t driver_log)
+// Seqlock write of the raw head joint, read by the calibrator process
+static void PublishHead(const k4abt_joint_t& head, uint64_t time_us)
+{
+	pose_math::vec3 position = CameraToDriver(pose_math::to_vec3(head.position));
+
+	uint32_t sequence = calibrationMem->headSequence;
+	calibrationMem->headSequence = sequence + 1;
+	std::atomic_thread_fence(std::memory_order_release);
+
+	calibrationMem->headConfidence = (uint32_t)head.confidence_level;
+	calibrationMem->headX = position.x;
+	calibrationMem->headY = position.y;
+	calibrationMem->headZ = position.z;
+	calibrationMem->headTimeUs = time_us;
+
+	std::atomic_thread_fence(std::memory_order_release);
+	calibrationMem->headSequence = sequence + 2;
+}
+
+K4ABoneProvider::K4ABoneProvider(DriverLog_t driver_log, DriverLogAtSite_t sdk_log)
 {
 	m_driver_log = driver_log;
+	m_sdk_log = sdk_log;
 
 	calibrationMemHandle = CreateFileMapping(
 		INVALID_HANDLE_VALUE,
@@ -57,6 +111,25 @@ K4ABoneProvider::K4ABoneProvider(DriverLog_t driver_log)
 		else
 		{
 			calibrationMem->update = false;
+			calibrationMem->polynomialFilter = false;
+			calibrationMem->polynomialWindow = POLYNOMIAL_FILTER_WINDOW;
+			calibrationMem->polynomialOrder = POLYNOMIAL_FILTER_ORDER;
+			calibrationMem->footRefinement = false;
+			calibrationMem->autoFloor = false;
+			calibrationMem->floorValid = false;
+			calibrationMem->cameraMoved = false;
+			calibrationMem->poolHits = 0;
+			calibrationMem->poolMisses = 0;
+			calibrationMem->poolPeakBytes = 0;
+			calibrationMem->deviceState = SUPERVISOR_OPEN;
+			calibrationMem->deviceFaults = 0;
+			calibrationMem->deviceReconnects = 0;
+			calibrationMem->deviceDowntime = 0.F;
+			calibrationMem->deviceOutage = 0.F;
+
+			// Before any SDK handle exists, every buffer after comes from the pool
+			if (!BufferPool::Instance().Install())
+				m_driver_log("Buffer pool not installed, SDK allocator in use\n");
 
 			calibrationMem->x = 0.F;
 			calibrationMem->y = 0.F;
@@ -67,68 +140,364 @@ K4ABoneProvider::K4ABoneProvider(DriverLog_t driver_log)
 			calibrationMem->rotOffset.y = 0.F;
 			calibrationMem->rotOffset.z = 0.F;
 
+			calibrationMem->headSequence = 0;
+			calibrationMem->headConfidence = K4ABT_JOINT_CONFIDENCE_NONE;
+			calibrationMem->headTimeUs = 0;
+
+			calibrationMem->driftState = DRIFT_IDLE;
+			calibrationMem->driftResidual = 0.F;
+			calibrationMem->driftAngle = 0.F;
+			calibrationMem->driftOffset = 0.F;
+
 			k4a_set_debug_message_handler(k4a_log_cb, this, k4a_log_level_t::K4A_LOG_LEVEL_ERROR);
 
-			if (k4a_device_open(K4A_DEVICE_DEFAULT, &m_device) != K4A_RESULT_SUCCEEDED)
-			{
-				m_driver_log("Open K4A device failed\n");
-				m_error = BONE_PROVIDER_OPEN_ERROR;
-			}
-			else
-				m_open = true;
+			// The device itself is opened by Start, off SteamVR's thread
+			m_mapped = true;
 		}
 	}
 }
 
 K4ABoneProvider::~K4ABoneProvider()
 {
-	k4a_device_close(m_device);
+	// The bone thread owns the tracker and the device while it runs
+	Stop();
+	if (m_tracker != NULL)
+		k4abt_tracker_destroy(m_tracker);
+	if (m_open)
+		k4a_device_close(m_device);
 }
 
 K4ABoneProviderError K4ABoneProvider::Configure(k4a_depth_mode_t new_depth_mode, float new_smoothing_rate)
 {
-	m_device_config.depth_mode = new_depth_mode;
 	m_smoothing_rate = new_smoothing_rate;
+	if (!m_bone_thread.joinable() || m_remote)
+	{
+		// The calibration depends on the mode, Start fetches it again
+		if (new_depth_mode != m_device_config.depth_mode)
+			m_has_calibration = false;
+		m_device_config.depth_mode = new_depth_mode;
+		return BONE_PROVIDER_NO_ERROR;
+	}
 
-	if (m_open)
+	// Running, the bone thread restarts the cameras between captures
+	m_pending_depth_mode = new_depth_mode;
+	m_reconfigure = true;
+	return BONE_PROVIDER_NO_ERROR;
+}
+
+bool K4ABoneProvider::WaitForStop(uint32_t timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(m_stop_mutex);
+	return m_stop_wake.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return m_stopping.load(); });
+}
+
+static float MillisecondsSince(uint64_t start_us)
+{
+	return (float)(HostTimeUs() - start_us) * 1e-3F;
+}
+
+// Stop is seen this soon while the model loads, milliseconds
+static const int MODEL_POLL_MS = 20;
+
+// The body tracker's model load, on a thread of its own. The SDK cannot
+// cancel it, so a setup abandoned by Stop leaves the tracker to the thread.
+typedef struct _model_load
+{
+	std::mutex mutex;
+	std::condition_variable done_wake;
+	bool done = false;
+	bool abandoned = false;
+	k4abt_tracker_t tracker = nullptr;
+	float ms = 0.F;
+} model_load_t;
+
+static std::shared_ptr<model_load_t> LoadModel(k4a_calibration_t calibration)
+{
+	std::shared_ptr<model_load_t> load = std::make_shared<model_load_t>();
+	std::thread([load, calibration] {
+		uint64_t start_us = HostTimeUs();
+		k4abt_tracker_t tracker = nullptr;
+		if (k4abt_tracker_create(&calibration, ::K4ABT_TRACKER_CONFIG_DEFAULT, &tracker) != K4A_RESULT_SUCCEEDED)
+			tracker = nullptr;
+
+		std::lock_guard<std::mutex> lock(load->mutex);
+		load->ms = MillisecondsSince(start_us);
+		load->done = true;
+		if (load->abandoned && tracker != nullptr)
+			k4abt_tracker_destroy(tracker);
+		else
+			load->tracker = tracker;
+		load->done_wake.notify_all();
+	}).detach();
+	return load;
+}
+
+// Destroys the loaded tracker, or leaves that to the load still running
+static void AbandonModel(std::shared_ptr<model_load_t>& load)
+{
+	if (!load)
+		return;
+	std::lock_guard<std::mutex> lock(load->mutex);
+	if (load->tracker != nullptr)
+		k4abt_tracker_destroy(load->tracker);
+	load->tracker = nullptr;
+	load->abandoned = true;
+	load.reset();
+}
+
+// False when stopping first
+static bool WaitForModel(model_load_t& load, const std::atomic<bool>& stopping)
+{
+	std::unique_lock<std::mutex> lock(load.mutex);
+	while (!load.done && !stopping)
+		load.done_wake.wait_for(lock, std::chrono::milliseconds(MODEL_POLL_MS));
+	return load.done;
+}
+
+K4ABoneProviderError K4ABoneProvider::OpenDevice(startup_times_t* times)
+{
+	// With a calibration cached for the last device, the body tracker's model
+	// loads on another thread while the device opens. Whatever is not cached
+	// starts as soon as the calibration is in. Stop is checked between the
+	// stages, the device is left to the teardown.
+	char last_serial[64] = {};
+	vr::EVRSettingsError error = vr::VRSettingsError_None;
+	vr::VRSettings()->GetString(SETTINGS_SECTION, "lastDevice", last_serial, sizeof(last_serial), &error);
+	if (error != vr::VRSettingsError_None)
+		last_serial[0] = '\0';
+
+	uint64_t stage_us = HostTimeUs();
+	CalibrationCache cache;
+	k4a_calibration_t cached;
+	bool have_cached = !m_has_calibration && cache.Load(last_serial, m_device_config.depth_mode, &cached);
+	times->cache = MillisecondsSince(stage_us);
+
+	std::shared_ptr<model_load_t> model;
+	if (have_cached || m_has_calibration)
+		model = LoadModel(have_cached ? cached : m_calibration);
+
+	stage_us = HostTimeUs();
+	m_supervisor.Enter(SUPERVISOR_OPEN);
+	if (!m_open)
+	{
+		if (k4a_device_open(K4A_DEVICE_DEFAULT, &m_device) != K4A_RESULT_SUCCEEDED)
+		{
+			m_driver_log("Open K4A device failed\n");
+			AbandonModel(model);
+			return BONE_PROVIDER_OPEN_ERROR;
+		}
+		m_open = true;
+	}
+	times->open = MillisecondsSince(stage_us);
+	if (m_stopping)
+	{
+		AbandonModel(model);
+		return BONE_PROVIDER_STOPPED;
+	}
+
+	stage_us = HostTimeUs();
+	m_supervisor.Enter(SUPERVISOR_CONFIGURE);
+	std::string serial = CalibrationCache::Serial(m_device);
+	bool same_device = have_cached && serial == last_serial;
+	if (!m_has_calibration)
 	{
-		if (K4A_RESULT_SUCCEEDED != k4a_device_get_calibration(m_device, m_device_config.depth_mode, K4A_COLOR_RESOLUTION_OFF, &m_calibration))
+		if (same_device)
+			m_calibration = cached;
+		else if (!cache.Fetch(m_device, serial.c_str(), m_device_config.depth_mode, &m_calibration))
 		{
 			m_driver_log("Get depth camera calibration failed!\n");
+			AbandonModel(model);
 			return BONE_PROVIDER_CALIB_ERROR;
 		}
+		m_has_calibration = true;
+		if (!serial.empty() && serial != last_serial)
+			vr::VRSettings()->SetString(SETTINGS_SECTION, "lastDevice", serial.c_str());
 	}
+	times->calibration = MillisecondsSince(stage_us);
+	times->cached = same_device;
 
-	return BONE_PROVIDER_OPEN_ERROR;
+	// A model built on another device's calibration is built again
+	if (have_cached && !same_device)
+		AbandonModel(model);
+	if (m_stopping)
+	{
+		AbandonModel(model);
+		return BONE_PROVIDER_STOPPED;
+	}
+	if (!model)
+		model = LoadModel(m_calibration);
+
+	// Exact size classes for this mode's images
+	if (!BufferPool::Instance().Configure(m_calibration.depth_camera_calibration.resolution_width,
+		m_calibration.depth_camera_calibration.resolution_height))
+		m_driver_log("Buffer pool busy, size classes of the last depth mode kept\n");
+
+	// The cameras start while the model may still be loading
+	stage_us = HostTimeUs();
+	m_supervisor.Enter(SUPERVISOR_START_CAMERAS);
+	K4ABoneProviderError result = StartCameras();
+	times->cameras = MillisecondsSince(stage_us);
+
+	stage_us = HostTimeUs();
+	m_supervisor.Enter(SUPERVISOR_CREATE_TRACKER);
+	bool loaded = WaitForModel(*model, m_stopping);
+	times->model = model->ms;
+	times->model_wait = MillisecondsSince(stage_us);
+	if (!loaded)
+	{
+		AbandonModel(model);
+		if (result == BONE_PROVIDER_NO_ERROR)
+			StopCameras();
+		return BONE_PROVIDER_STOPPED;
+	}
+	if (result != BONE_PROVIDER_NO_ERROR)
+	{
+		AbandonModel(model);
+		return result;
+	}
+	if (model->tracker == nullptr)
+	{
+		m_driver_log("Body tracker create failed\n");
+		StopCameras();
+		return BONE_PROVIDER_TRACKER_START_ERROR;
+	}
+	m_tracker = model->tracker;
+	model->tracker = nullptr;
+	return BONE_PROVIDER_NO_ERROR;
+}
+
+// Thread CPU time and context switches logged this often, microseconds
+static const uint64_t THREAD_REPORT_US = 30000000;
+
+void K4ABoneProvider::ConfigureThreads()
+{
+	thread_schedule_t schedule;
+	vr::EVRSettingsError error = vr::VRSettingsError_None;
+	bool priorities = vr::VRSettings()->GetBool(SETTINGS_SECTION, "threadPriorities", &error);
+	if (error == vr::VRSettingsError_None)
+		schedule.priorities = priorities;
+	bool realtime = vr::VRSettings()->GetBool(SETTINGS_SECTION, "realtimeThreads", &error);
+	if (error == vr::VRSettingsError_None)
+		schedule.realtime = realtime;
+	int32_t cores = vr::VRSettings()->GetInt32(SETTINGS_SECTION, "trackingCores", &error);
+	if (error == vr::VRSettingsError_None)
+		schedule.tracking_cores = (uint32_t)cores;
+	cores = vr::VRSettings()->GetInt32(SETTINGS_SECTION, "backgroundCores", &error);
+	if (error == vr::VRSettingsError_None)
+		schedule.background_cores = (uint32_t)cores;
+	ThreadScheduler::Instance().Configure(schedule);
+
+	m_driver_log("Threads: priorities %s%s, tracking cores 0x%llx, background cores 0x%llx\n",
+		schedule.priorities ? "on" : "off", schedule.realtime ? " realtime" : "",
+		(unsigned long long)schedule.tracking_cores, (unsigned long long)schedule.background_cores);
+}
+
+void K4ABoneProvider::ReportThreads()
+{
+	char line[512];
+	int length = std::snprintf(line, sizeof(line), "Threads:");
+	for (const thread_stats_t& thread : ThreadScheduler::Instance().Sample())
+	{
+		if (length < 0 || length >= (int)sizeof(line))
+			break;
+		length += std::snprintf(line + length, sizeof(line) - length, " %s %.1f%% cpu %.0f/s switches (%.0f involuntary)%s;",
+			thread.name.c_str(), thread.cpu * 100.F, thread.switches, thread.involuntary, thread.applied ? "" : " unscheduled");
+	}
+	m_driver_log("%s\n", line);
 }
 
 K4ABoneProviderError K4ABoneProvider::Start()
 {
-	if (m_open)
+	if (m_mapped)
 	{
-		m_device_config.camera_fps = K4A_FRAMES_PER_SECOND_15;
-		if (k4a_device_start_cameras(m_device, &m_device_config) != K4A_RESULT_SUCCEEDED)
+		ConfigureThreads();
+
+		// With the tracking service the device and the body tracker are its own
+		vr::EVRSettingsError error = vr::VRSettingsError_None;
+		bool remote = vr::VRSettings()->GetBool(SETTINGS_SECTION, "trackingService", &error);
+		m_remote = error == vr::VRSettingsError_None && remote;
+		bool presence = vr::VRSettings()->GetBool(SETTINGS_SECTION, "standbyPresence", &error);
+		m_standby_presence = error != vr::VRSettingsError_None || presence;
+		if (m_remote)
 		{
-			m_driver_log("Start camera failed\n");
-			m_error = BONE_PROVIDER_CAMERA_START_ERROR;
+			m_driver_log("Skeletons from the tracking service\n");
+			m_bone_thread = std::thread(ProcessBones, this);
 			return m_error;
 		}
-		
 
-		m_bone_thread = new std::thread(ProcessBones, this);
+		// The bone thread opens the device, Stop does not wait on the model load
+		m_start_us = HostTimeUs();
+		m_supervisor.Reset(m_start_us);
+		m_error = BONE_PROVIDER_NO_ERROR;
+
+		m_bone_thread = std::thread(ProcessBones, this);
+	}
+	return m_error;
+}
 
+K4ABoneProviderError K4ABoneProvider::StartCameras()
+{
+	vr::EVRSettingsError error = vr::VRSettingsError_None;
+	int32_t interval = vr::VRSettings()->GetInt32(SETTINGS_SECTION, "keyframeInterval", &error);
+	if (error == vr::VRSettingsError_None)
+		m_keyframe_interval = interval;
+
+	// Keyframe mode captures at 30 fps with inference on every Nth frame,
+	// otherwise inference sets the pace
+	m_device_config.camera_fps = K4A_FRAMES_PER_SECOND_15;
+	if (m_keyframe_interval > 1)
+	{
+		if (m_device_config.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED)
+		{
+			m_driver_log("Depth mode does not run at 30 fps, keyframe mode off\n");
+			m_keyframe_interval = 1;
+		}
+		else
+		{
+			m_device_config.camera_fps = K4A_FRAMES_PER_SECOND_30;
+			m_driver_log("Keyframe mode, inference every %d frames\n", m_keyframe_interval);
+		}
+	}
+	if (k4a_device_start_cameras(m_device, &m_device_config) != K4A_RESULT_SUCCEEDED)
+	{
+		m_driver_log("Start camera failed\n");
+		return BONE_PROVIDER_CAMERA_START_ERROR;
 	}
-	return BONE_PROVIDER_OPEN_ERROR;
+
+	// Gravity for the camera's tilt, bumps and the floor
+	m_imu = k4a_device_start_imu(m_device) == K4A_RESULT_SUCCEEDED;
+	if (!m_imu)
+		m_driver_log("Start IMU failed, no tilt or bump detection\n");
+
+	m_device_clock_reset = true;
+	return BONE_PROVIDER_NO_ERROR;
+}
+
+void K4ABoneProvider::StopCameras()
+{
+	if (m_imu)
+		k4a_device_stop_imu(m_device);
+	m_imu = false;
+	k4a_device_stop_cameras(m_device);
 }
 
 K4ABoneProviderError K4ABoneProvider::Stop()
 {
-	if (m_open && m_online)
+	if (m_bone_thread.joinable())
 	{
+		// Every wait on the bone thread and its helpers is short or woken here
+		{
+			std::lock_guard<std::mutex> lock(m_stop_mutex);
+			m_stopping = true;
+		}
+		m_stop_wake.notify_all();
+
+		uint64_t stop_us = HostTimeUs();
+		m_bone_thread.join();
 		m_online = false;
+		m_stopping = false;
+		m_reconfigure = false;
 
-		m_bone_thread->join();
-		
 		m_hip_pose.deviceIsConnected = false;
 		m_rleg_pose.deviceIsConnected = false;
 		m_lleg_pose.deviceIsConnected = false;
@@ -156,11 +525,12 @@ K4ABoneProviderError K4ABoneProvider::Stop()
 		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_lknee_id, m_lknee_pose, sizeof(vr::DriverPose_t));
 		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(m_chest_id, m_chest_pose, sizeof(vr::DriverPose_t));
 
-		k4a_device_stop_cameras(m_device);
+		if (m_open)
+			StopCameras();
 
 		m_error = BONE_PROVIDER_NO_ERROR;
 
-		m_driver_log("Device is now offline for reconfiguration\n");
+		m_driver_log("Device is now offline, bone thread stopped in %.0f ms\n", MillisecondsSince(stop_us));
 	}
 	else
 	{
@@ -170,48 +540,781 @@ K4ABoneProviderError K4ABoneProvider::Stop()
 	return m_error;
 }
 
-void UpdateCalibration(vr::DriverPose_t *poses)
+void K4ABoneProvider::UpdateCalibration()
 {
 	// TODO:
 	// if default values are changed, save changes to file
 	// then
 	// push file values onto variables
 
-	float x = calibrationMem->x;
-	float y = calibrationMem->y;
-	float z = calibrationMem->z;
+	m_world_from_driver.translation = { calibrationMem->x, calibrationMem->y, calibrationMem->z };
+	m_world_from_driver.rotation = pose_math::normalize(pose_math::quat{ calibrationMem->rotOffset.w,
+		calibrationMem->rotOffset.x, calibrationMem->rotOffset.y, calibrationMem->rotOffset.z });
 
-	float qw = calibrationMem->rotOffset.w;
-	float qx = calibrationMem->rotOffset.x;
-	float qy = calibrationMem->rotOffset.y;
-	float qz = calibrationMem->rotOffset.z;
+	// Calibrations are absolute, they already account for how the camera is mounted
+	m_camera_tilt = pose_math::identity();
+	m_calibrated = true;
 
-	// updates calibration for every bone pose
-	for (int i = 0; i < 8; i++) {
-		poses[i].vecWorldFromDriverTranslation[0] = x;
-		poses[i].vecWorldFromDriverTranslation[1] = y;
-		poses[i].vecWorldFromDriverTranslation[2] = z;
+	m_camera_to_world = ComposeCameraTransform(m_camera_tilt, m_world_from_driver);
 
-		poses[i].qWorldFromDriverRotation.w = qw;
-		poses[i].qWorldFromDriverRotation.x = qx;
-		poses[i].qWorldFromDriverRotation.y = qy;
-		poses[i].qWorldFromDriverRotation.z = qz;
-	}
+	// A new calibration is the new reference
+	m_drift.Reset(m_world_from_driver);
+	m_drift_last_us = 0;
+	m_imu_rereference = true;
+	calibrationMem->cameraMoved = false;
 
 	calibrationMem->update = false;
 }
 
+// How far ahead of the newest sample the polynomial filter is evaluated, seconds.
+// Zero is the fit's own lag, positive values trade noise for less lag.
+static const float POLYNOMIAL_FILTER_LEAD = 0.F;
+
+// Frame time assumed until the history has two frames, seconds
+static const float NOMINAL_FRAME_TIME = 1.F / 15.F;
+
+// Head moving faster than this makes the capture to HMD timing error dominate, m/s
+static const float DRIFT_MAX_HMD_SPEED = 0.5F;
+// Gaps longer than this are not trusted for the correction rate, seconds
+static const float DRIFT_MAX_STEP = 0.5F;
+
+void K4ABoneProvider::CorrectDrift(const k4abt_joint_t& head, const vr::TrackedDevicePose_t& hmd, uint64_t capture_us)
+{
+	if (head.confidence_level < K4ABT_JOINT_CONFIDENCE_MEDIUM)
+		return;
+
+	if (!hmd.bPoseIsValid || hmd.eTrackingResult != vr::TrackingResult_Running_OK)
+		return;
+	if (pose_math::length(pose_math::to_vec3(hmd.vVelocity.v)) > DRIFT_MAX_HMD_SPEED)
+		return;
+
+	float dt = (m_drift_last_us != 0 && capture_us > m_drift_last_us) ? (float)(capture_us - m_drift_last_us) * 1e-6F : 0.F;
+	m_drift_last_us = capture_us;
+
+	DriftCorrectorState last_state = m_drift.GetDiagnostics().state;
+	pose_math::vec3 hmd_head = pose_math::transform(pose_math::to_mat34(hmd.mDeviceToAbsoluteTracking), HMD_TO_HEAD);
+
+	if (m_drift.Update(CameraToDriver(pose_math::to_vec3(head.position)), hmd_head, std::min(dt, DRIFT_MAX_STEP)))
+	{
+		m_world_from_driver = m_drift.GetCalibration();
+		m_camera_to_world = ComposeCameraTransform(m_camera_tilt, m_world_from_driver);
+
+		// Written back so the calibrator fine tunes from the corrected values
+		calibrationMem->x = m_world_from_driver.translation.x;
+		calibrationMem->y = m_world_from_driver.translation.y;
+		calibrationMem->z = m_world_from_driver.translation.z;
+		pose_math::store(m_world_from_driver.rotation, calibrationMem->rotOffset);
+	}
+
+	drift_diagnostics_t diagnostics = m_drift.GetDiagnostics();
+	calibrationMem->driftState = diagnostics.state;
+	calibrationMem->driftResidual = diagnostics.residual;
+	calibrationMem->driftAngle = diagnostics.angle;
+	calibrationMem->driftOffset = diagnostics.offset;
+
+	if (diagnostics.state != last_state)
+		m_driver_log("Drift correction state %d, residual %.3f m, error %.2f deg %.3f m\n", diagnostics.state,
+			diagnostics.residual, diagnostics.angle * 180.F / pose_math::PI, diagnostics.offset);
+}
+
+// Settings key of a profile's bone, "<profile>_<bone>"
+static std::string BoneKey(const char* profile, size_t bone)
+{
+	return std::string(profile) + "_" + SkeletonSolver::BoneName(bone);
+}
+
+void K4ABoneProvider::LoadBodyProfile()
+{
+	vr::EVRSettingsError error = vr::VRSettingsError_None;
+	vr::VRSettings()->GetString(SETTINGS_SECTION, "profile", m_profile, sizeof(m_profile), &error);
+	if (error != vr::VRSettingsError_None || m_profile[0] == '\0')
+		snprintf(m_profile, sizeof(m_profile), "default");
+
+	float lengths[SOLVER_BONE_COUNT];
+	int loaded = 0;
+	for (size_t i = 0; i < SOLVER_BONE_COUNT; i++)
+	{
+		error = vr::VRSettingsError_None;
+		lengths[i] = vr::VRSettings()->GetFloat(SETTINGS_SECTION, BoneKey(m_profile, i).c_str(), &error);
+		if (error != vr::VRSettingsError_None)
+			lengths[i] = 0.F;
+		else if (lengths[i] > 0.F)
+			loaded++;
+	}
+	m_solver.SetLengths(lengths);
+
+	m_driver_log("Body profile %s, %d bone lengths cached\n", m_profile, loaded);
+}
+
+void K4ABoneProvider::SaveBodyProfile()
+{
+	float lengths[SOLVER_BONE_COUNT];
+	m_solver.GetLengths(lengths);
+	for (size_t i = 0; i < SOLVER_BONE_COUNT; i++)
+	{
+		if (lengths[i] > 0.F)
+			vr::VRSettings()->SetFloat(SETTINGS_SECTION, BoneKey(m_profile, i).c_str(), lengths[i]);
+	}
+}
+
+// Velocities decay with this time constant while coasting, seconds
+static const float COAST_DECAY_TIME = 0.15F;
+
+// Dead reckoning of a published pose over dt seconds
+static void CoastPose(vr::DriverPose_t& pose, float dt, float decay)
+{
+	pose_math::vec3 velocity = pose_math::to_vec3(pose.vecVelocity);
+	pose_math::vec3 angular_velocity = pose_math::to_vec3(pose.vecAngularVelocity);
+
+	pose_math::store(pose_math::to_vec3(pose.vecPosition) + velocity * dt, pose.vecPosition);
+	pose_math::store(pose_math::normalize(pose_math::from_rotation_vector(angular_velocity * dt) * pose_math::to_quat(pose.qRotation)), pose.qRotation);
+
+	pose_math::store(velocity * decay, pose.vecVelocity);
+	pose_math::store(angular_velocity * decay, pose.vecAngularVelocity);
+	pose_math::store(pose_math::vec3{ 0.F, 0.F, 0.F }, pose.vecAcceleration);
+	pose_math::store(pose_math::vec3{ 0.F, 0.F, 0.F }, pose.vecAngularAcceleration);
+}
+
+void K4ABoneProvider::CoastBones(vr::DriverPose_t* poses, const uint32_t* ids, int count, uint64_t time_us)
+{
+	// Nothing to extrapolate from yet, or already out of range
+	if (m_last_seen_us == 0 || m_out_of_range || time_us <= m_last_seen_us)
+		return;
+
+	if (!m_lost)
+	{
+		m_lost = true;
+		m_coast_us = m_last_seen_us;
+	}
+
+	float dt = (time_us > m_coast_us) ? (float)(time_us - m_coast_us) * 1e-6F : 0.F;
+	float elapsed = (float)(time_us - m_last_seen_us) * 1e-6F;
+	m_coast_us = time_us;
+
+	if (elapsed > m_coast_time)
+	{
+		m_out_of_range = true;
+		for (int i = 0; i < count; i++)
+		{
+			poses[i].poseIsValid = false;
+			poses[i].result = vr::TrackingResult_Running_OutOfRange;
+			pose_math::store(pose_math::vec3{ 0.F, 0.F, 0.F }, poses[i].vecVelocity);
+			pose_math::store(pose_math::vec3{ 0.F, 0.F, 0.F }, poses[i].vecAngularVelocity);
+			vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
+		}
+		m_driver_log("Body lost for %.2f s, trackers out of range\n", elapsed);
+		return;
+	}
+
+	float decay = std::exp(-dt / COAST_DECAY_TIME);
+	for (int i = 0; i < count; i++)
+	{
+		CoastPose(poses[i], dt, decay);
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
+	}
+}
+
+// Share of the head's motion each tracked joint follows, same order as jointIDs
+// in ProcessBones: hip, feet, chest, elbows, knees
+static const latency_weight_t LATENCY_WEIGHTS[8] = {
+	{ 0.8F, 0.6F }, { 0.25F, 0.2F }, { 0.25F, 0.2F }, { 0.9F, 0.8F },
+	{ 0.8F, 0.8F }, { 0.8F, 0.8F }, { 0.5F, 0.4F }, { 0.5F, 0.4F }
+};
+
+void K4ABoneProvider::CompensateLatency(const vr::TrackedDevicePose_t& hmd_at_capture, const vr::TrackedDevicePose_t& hmd_now,
+	pose_math::vec3* positions, pose_math::quat* rotations, size_t count)
+{
+	if (!hmd_at_capture.bPoseIsValid || !hmd_now.bPoseIsValid)
+		return;
+
+	// Needs the raw universe related to world, which the drift reference provides
+	pose_math::rigid world_from_raw;
+	if (!m_drift.GetWorldFromRaw(&world_from_raw))
+		return;
+
+	// Joints near a real tracker follow it rather than the head
+	latency_weight_t weights[8];
+	for (size_t i = 0; i < count; i++)
+	{
+		float hmd_share = 1.F - m_fusion.GetAnchorWeight(i);
+		weights[i] = { LATENCY_WEIGHTS[i].translation * hmd_share, LATENCY_WEIGHTS[i].yaw * hmd_share };
+	}
+
+	m_latency.hmd_to_head = HMD_TO_HEAD;
+	if (m_latency.SetMotion(world_from_raw * pose_math::to_rigid(pose_math::to_mat34(hmd_at_capture.mDeviceToAbsoluteTracking)),
+		world_from_raw * pose_math::to_rigid(pose_math::to_mat34(hmd_now.mDeviceToAbsoluteTracking))))
+		m_latency.Apply(weights, positions, rotations, count);
+	m_fusion.Apply(positions, rotations, count);
+}
+
+void K4ABoneProvider::FuseTrackers(const vr::TrackedDevicePose_t* at_capture, const vr::TrackedDevicePose_t* now, const uint32_t* ids,
+	const pose_math::vec3* joints, size_t count, float dt)
+{
+	fusion_device_t devices[vr::k_unMaxTrackedDeviceCount];
+	size_t device_count = 0;
+
+	// Real trackers only exist relative to world once the drift reference does
+	pose_math::rigid world_from_raw;
+	if (m_drift.GetWorldFromRaw(&world_from_raw))
+	{
+		for (uint32_t index = 0; index < vr::k_unMaxTrackedDeviceCount; index++)
+		{
+			if (!at_capture[index].bPoseIsValid || !now[index].bPoseIsValid || at_capture[index].eTrackingResult != vr::TrackingResult_Running_OK)
+				continue;
+			if (std::find(ids, ids + 8, index) != ids + 8)
+				continue;
+
+			// Class is looked up once per device index
+			if (m_device_class[index] == vr::TrackedDeviceClass_Invalid)
+				m_device_class[index] = (vr::ETrackedDeviceClass)vr::VRProperties()->GetInt32Property(
+					vr::VRProperties()->TrackedDeviceToPropertyContainer(index), vr::Prop_DeviceClass_Int32);
+			if (m_device_class[index] != vr::TrackedDeviceClass_GenericTracker)
+				continue;
+
+			devices[device_count].index = index;
+			devices[device_count].at_capture = world_from_raw * pose_math::to_rigid(pose_math::to_mat34(at_capture[index].mDeviceToAbsoluteTracking));
+			devices[device_count].now = world_from_raw * pose_math::to_rigid(pose_math::to_mat34(now[index].mDeviceToAbsoluteTracking));
+			device_count++;
+		}
+	}
+
+	uint32_t covered = m_fusion.GetCoveredMask();
+	m_fusion.Associate(devices, device_count, joints, count, dt);
+	calibrationMem->fusionCovered = m_fusion.GetCoveredMask();
+	if (calibrationMem->fusionCovered != covered)
+		m_driver_log("Trackers covered by real ones now %#x\n", calibrationMem->fusionCovered);
+}
+
+void K4ABoneProvider::Resynchronize(k4a_image_t depth, const k4abt_skeleton_t* skeleton)
+{
+	if (skeleton == nullptr)
+		m_propagator.Clear();
+	else if (depth != nullptr)
+		m_propagator.Keyframe(m_calibration, depth, *skeleton);
+}
+
+// Height errors below this are left alone, metres
+static const float FLOOR_DEADBAND = 0.015F;
+// A floor further than this from level in world means the calibration's
+// rotation is off, its height is not used, radians
+static const float FLOOR_MAX_WORLD_TILT = 0.1F;
+
+void K4ABoneProvider::RequestFloor(k4a_image_t depth, uint64_t time_us, const pose_math::vec3& up)
+{
+	float interval = calibrationMem->floorValid ? FLOOR_REFRESH_INTERVAL : FLOOR_SEARCH_INTERVAL;
+	if (m_floor_request_us != 0 && time_us < m_floor_request_us + (uint64_t)(interval * 1e6F))
+		return;
+
+	// Gravity if the IMU has it, the calibration's up otherwise
+	pose_math::vec3 gravity_up = up;
+	GetGravityUp(&gravity_up);
+	if (m_floor_worker.Request(depth, gravity_up))
+		m_floor_request_us = time_us;
+}
+
+bool K4ABoneProvider::TakeFloor(floor_plane_t* floor)
+{
+	if (!m_floor_done)
+		return m_floor_worker.Take(floor);
+	*floor = m_floor;
+	m_floor_done = false;
+	return true;
+}
+
+void K4ABoneProvider::AdjustHeight(const floor_plane_t& floor, const pose_math::vec3& over)
+{
+	if (!floor.valid)
+		return;
+
+	pose_math::vec3 point = over + floor.up * (floor.height - pose_math::dot(floor.up, over));
+	pose_math::vec3 world = pose_math::transform(m_camera_to_world.position, point);
+	pose_math::vec3 world_up = pose_math::normalize(pose_math::transform_vector(m_camera_to_world.position, floor.up));
+	calibrationMem->floorHeight = world.y;
+	calibrationMem->floorValid = true;
+
+	if (!m_calibrated || world_up.y < std::cos(FLOOR_MAX_WORLD_TILT) || std::fabs(world.y) < FLOOR_DEADBAND)
+		return;
+
+	// Through the calibrator's path, so drift correction takes it as its new reference
+	calibrationMem->y -= world.y;
+	calibrationMem->update = true;
+	m_driver_log("Floor %.1f cm off, height corrected\n", world.y * 100.F);
+}
+
+// Longest wait for an IMU sample before checking for shutdown, milliseconds
+static const int IMU_TIMEOUT_MS = 20;
+// Tilt changes below this are not worth recomposing the transform for, radians
+static const float LEVEL_TOLERANCE = 0.002F;
+
+void K4ABoneProvider::ProcessImu(K4ABoneProvider* context)
+{
+	ScopedThread scheduled("k4a imu", THREAD_ROLE_SENSOR);
+	ImuTracker& tracker = context->m_imu_tracker;
+	tracker.Reset();
+	uint64_t last_us = 0;
+	k4a_imu_sample_t sample;
+
+	while (!context->m_stopping && context->m_imu_running)
+	{
+		if (k4a_device_get_imu_sample(context->m_device, &sample, IMU_TIMEOUT_MS) != K4A_WAIT_RESULT_SUCCEEDED)
+			continue;
+
+		// The reference is taken once the filter has settled
+		if (tracker.IsAtRest() && context->m_imu_rereference.exchange(false))
+			tracker.SetReference();
+
+		float dt = (last_us != 0 && sample.acc_timestamp_usec > last_us) ? (float)(sample.acc_timestamp_usec - last_us) * 1e-6F : 0.F;
+		last_us = sample.acc_timestamp_usec;
+
+		pose_math::vec3 acceleration = SensorToDepth(context->m_calibration, K4A_CALIBRATION_TYPE_ACCEL, pose_math::to_vec3(sample.acc_sample));
+		pose_math::vec3 angular_velocity = SensorToDepth(context->m_calibration, K4A_CALIBRATION_TYPE_GYRO, pose_math::to_vec3(sample.gyro_sample));
+		if (tracker.Update(acceleration, angular_velocity, dt))
+			context->m_camera_moved = true;
+
+		if (tracker.HasUp())
+		{
+			std::lock_guard<std::mutex> lock(context->m_imu_mutex);
+			context->m_imu_up = tracker.GetUp();
+			context->m_imu_has_up = true;
+		}
+	}
+}
+
+bool K4ABoneProvider::GetGravityUp(pose_math::vec3* up)
+{
+	std::lock_guard<std::mutex> lock(m_imu_mutex);
+	if (!m_imu_has_up)
+		return false;
+	*up = m_imu_up;
+	return true;
+}
+
+void K4ABoneProvider::LevelFromImu()
+{
+	pose_math::vec3 up;
+	if (!GetGravityUp(&up))
+		return;
+
+	// Tilt takes the camera's up, in driver space, to world up
+	pose_math::quat tilt = pose_math::rotation_between(pose_math::rotate(CAMERA_AXIS_SWAP, up), pose_math::vec3{ 0.F, 1.F, 0.F });
+	if (pose_math::angle_between(tilt, m_camera_tilt) < LEVEL_TOLERANCE)
+		return;
+	m_camera_tilt = tilt;
+	m_camera_to_world = ComposeCameraTransform(m_camera_tilt, m_world_from_driver);
+}
+
+// Longest wait for a capture before checking for shutdown, milliseconds. The
+// supervisor decides when a run of these means the device is gone.
+static const int32_t CAPTURE_TIMEOUT_MS = 50;
+// Wait between checks while backing off, milliseconds
+static const int BACKOFF_POLL_MS = 100;
+
+void K4ABoneProvider::TearDown(k4abt_tracker_t* tracker, std::thread* imu_thread)
+{
+	m_imu_running = false;
+	if (imu_thread->joinable())
+		imu_thread->join();
+	if (*tracker != NULL)
+	{
+		k4abt_tracker_shutdown(*tracker);
+		k4abt_tracker_destroy(*tracker);
+		*tracker = NULL;
+	}
+	if (m_open)
+	{
+		StopCameras();
+		k4a_device_close(m_device);
+		m_device = NULL;
+		m_open = false;
+	}
+	// Whatever is plugged in next goes through the calibration cache again
+	m_has_calibration = false;
+}
+
+static void MarkOutOfRange(vr::DriverPose_t* poses, const uint32_t* ids, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		poses[i].poseIsValid = false;
+		poses[i].result = vr::TrackingResult_Running_OutOfRange;
+		vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
+	}
+}
+
+// Inference while looking for a body in standby, one capture this often, microseconds
+static const uint64_t PRESENCE_INTERVAL_US = 1000000;
+// A body that woke the tracker in standby, gone this long, and it stands by again, microseconds
+static const uint64_t STANDBY_REARM_US = 5000000;
+
+static void DrainTracker(k4abt_tracker_t tracker)
+{
+	k4abt_frame_t body_frame = nullptr;
+	while (tracker != nullptr && k4abt_tracker_pop_result(tracker, &body_frame, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+		k4abt_frame_release(body_frame);
+}
+
+bool K4ABoneProvider::WantStandby(uint64_t now_us)
+{
+	if (!m_standby)
+	{
+		m_woken = false;
+		return false;
+	}
+	if (m_woken && now_us > m_body_us + STANDBY_REARM_US)
+	{
+		m_woken = false;
+		m_driver_log("No body for %.0f s, back to standby\n", (float)(now_us - m_body_us) * 1e-6F);
+	}
+	return !m_woken;
+}
+
+void K4ABoneProvider::UpdateStandby(k4abt_tracker_t* tracker, std::thread* imu_thread,
+	vr::DriverPose_t* poses, const uint32_t* ids, int count)
+{
+	bool standby = WantStandby(HostTimeUs());
+	SupervisorState state = m_supervisor.GetState();
+	if (standby && state == SUPERVISOR_RUNNING)
+	{
+		MarkOutOfRange(poses, ids, count);
+		m_lost = true;
+		m_standby_us = HostTimeUs();
+		if (m_standby_presence)
+		{
+			// The IMU goes with the cameras, nothing to read it for meanwhile
+			m_imu_running = false;
+			if (imu_thread->joinable())
+				imu_thread->join();
+			StopCameras();
+			// Results of captures from before standby are of no use in it
+			DrainTracker(*tracker);
+			m_device_config.camera_fps = K4A_FRAMES_PER_SECOND_5;
+			if (k4a_device_start_cameras(m_device, &m_device_config) != K4A_RESULT_SUCCEEDED)
+			{
+				m_driver_log("Start camera for standby failed\n");
+				m_supervisor.Fault(HostTimeUs());
+				return;
+			}
+			m_presence_us = 0;
+			m_presence_pending = false;
+			m_driver_log("Standby, looking for a body once a second\n");
+		}
+		else
+		{
+			TearDown(tracker, imu_thread);
+			m_driver_log("Standby, camera and body tracker off\n");
+		}
+		m_supervisor.Enter(SUPERVISOR_STANDBY);
+	}
+	else if (!standby && state == SUPERVISOR_STANDBY)
+	{
+		m_resume_us = HostTimeUs();
+		if (!m_open)
+		{
+			// Set up again by NextCapture, as after a fault but without the backoff
+			m_supervisor.Enter(SUPERVISOR_OPEN);
+			return;
+		}
+
+		StopCameras();
+		DrainTracker(*tracker);
+		m_presence_pending = false;
+		if (StartCameras() != BONE_PROVIDER_NO_ERROR)
+		{
+			m_supervisor.Fault(HostTimeUs());
+			return;
+		}
+		m_imu_running = m_imu;
+		if (m_imu)
+			*imu_thread = std::thread(ProcessImu, this);
+		m_supervisor.Running(HostTimeUs());
+		m_driver_log("Resumed from standby in %.0f ms\n", MillisecondsSince(m_resume_us));
+		m_resume_us = 0;
+	}
+}
+
+bool K4ABoneProvider::DetectPresence(k4a_capture_t capture, k4abt_tracker_t tracker, uint64_t now_us)
+{
+	bool present = false;
+	k4abt_frame_t body_frame = nullptr;
+	while (m_presence_pending && k4abt_tracker_pop_result(tracker, &body_frame, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		// Anything but the capture sent for presence is from before standby
+		if (k4abt_frame_get_device_timestamp_usec(body_frame) == m_presence_device_us)
+		{
+			present = k4abt_frame_get_num_bodies(body_frame) != 0;
+			m_presence_pending = false;
+		}
+		k4abt_frame_release(body_frame);
+	}
+	if (m_presence_pending || now_us < m_presence_us + PRESENCE_INTERVAL_US)
+		return present;
+	k4a_image_t depth = k4a_capture_get_depth_image(capture);
+	if (depth == nullptr)
+		return present;
+	m_presence_device_us = k4a_image_get_device_timestamp_usec(depth);
+	k4a_image_release(depth);
+	if (k4abt_tracker_enqueue_capture(tracker, capture, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		m_presence_pending = true;
+		m_presence_us = now_us;
+	}
+	return present;
+}
+
+bool K4ABoneProvider::NextCapture(k4a_capture_t* capture, k4abt_tracker_t* tracker, std::thread* imu_thread,
+	vr::DriverPose_t* poses, const uint32_t* ids, int count)
+{
+	// A new depth mode from Configure, set up again like after a fault but
+	// without the backoff
+	if (m_reconfigure.exchange(false) && m_pending_depth_mode != m_device_config.depth_mode)
+	{
+		if (m_supervisor.GetState() == SUPERVISOR_RUNNING)
+		{
+			MarkOutOfRange(poses, ids, count);
+			m_lost = true;
+			TearDown(tracker, imu_thread);
+			m_supervisor.Enter(SUPERVISOR_OPEN);
+		}
+		m_device_config.depth_mode = m_pending_depth_mode;
+		m_has_calibration = false;
+		m_driver_log("Depth mode changed, setting the device up again\n");
+	}
+	UpdateStandby(tracker, imu_thread, poses, ids, count);
+
+	bool captured = false;
+	uint64_t now_us = HostTimeUs();
+	switch (m_supervisor.GetState())
+	{
+	case SUPERVISOR_RUNNING:
+	{
+		k4a_wait_result_t result = k4a_device_get_capture(m_device, capture, CAPTURE_TIMEOUT_MS);
+		now_us = HostTimeUs();
+		if (result == K4A_WAIT_RESULT_SUCCEEDED)
+		{
+			m_supervisor.Captured(now_us);
+			captured = true;
+		}
+		else if (result == K4A_WAIT_RESULT_FAILED ? m_supervisor.CaptureFailed(now_us) : m_supervisor.CaptureTimedOut(now_us))
+		{
+			m_driver_log("K4A device lost, %s\n", result == K4A_WAIT_RESULT_FAILED ? "captures failing" : "no captures");
+			m_supervisor.Fault(now_us);
+		}
+		break;
+	}
+	case SUPERVISOR_STANDBY:
+	{
+		if (!m_open)
+		{
+			WaitForStop(BACKOFF_POLL_MS);
+			break;
+		}
+		k4a_wait_result_t result = k4a_device_get_capture(m_device, capture, CAPTURE_TIMEOUT_MS);
+		now_us = HostTimeUs();
+		if (result == K4A_WAIT_RESULT_SUCCEEDED)
+		{
+			m_supervisor.Captured(now_us);
+			if (DetectPresence(*capture, *tracker, now_us))
+			{
+				// SteamVR's standby stays, the body only wakes the tracker
+				m_woken = true;
+				m_body_us = now_us;
+				m_driver_log("Body seen, tracking while SteamVR is in standby\n");
+			}
+			k4a_capture_release(*capture);
+			*capture = nullptr;
+		}
+		else if (result == K4A_WAIT_RESULT_FAILED ? m_supervisor.CaptureFailed(now_us) : m_supervisor.CaptureTimedOut(now_us))
+		{
+			m_driver_log("K4A device lost in standby\n");
+			m_supervisor.Fault(now_us);
+		}
+		break;
+	}
+	case SUPERVISOR_FAULTED:
+	{
+		// Out of range until the device is back, then warm started like a lost body
+		MarkOutOfRange(poses, ids, count);
+		m_lost = true;
+		TearDown(tracker, imu_thread);
+		m_supervisor.Backoff(now_us);
+		m_driver_log("K4A device closed, next attempt in %.1f s\n", m_supervisor.GetStats(now_us).retry_in);
+		break;
+	}
+	default:
+	{
+		if (!m_supervisor.IsDue(now_us))
+		{
+			WaitForStop(BACKOFF_POLL_MS);
+			break;
+		}
+		if (m_stopping)
+			break;
+
+		startup_times_t times = {};
+		K4ABoneProviderError result = OpenDevice(&times);
+		now_us = HostTimeUs();
+		if (result == BONE_PROVIDER_STOPPED)
+			break;
+		m_error = result;
+		if (m_error != BONE_PROVIDER_NO_ERROR)
+		{
+			if (m_start_us != 0)
+				m_driver_log("K4A device not ready, retrying in the background\n");
+			m_start_us = 0;
+			m_supervisor.Fault(now_us);
+			break;
+		}
+		*tracker = m_tracker;
+		m_tracker = NULL;
+		k4abt_tracker_set_temporal_smoothing(*tracker, 0);
+		m_unprojector.SetCalibration(m_calibration);
+		m_floor_worker.SetCalibration(m_calibration);
+		m_propagator.Clear();
+		m_imu_running = m_imu;
+		if (m_imu)
+			*imu_thread = std::thread(ProcessImu, this);
+
+		uint32_t reconnects = m_supervisor.GetStats(now_us).reconnects;
+		m_supervisor.Running(now_us);
+		supervisor_stats_t stats = m_supervisor.GetStats(now_us);
+		if (m_start_us != 0)
+			m_driver_log("Started in %.0f ms: cache %.0f, open %.0f, calibration %.0f%s, cameras %.0f, model %.0f (%.0f waited)\n",
+				MillisecondsSince(m_start_us), times.cache, times.open, times.calibration, times.cached ? " cached" : "",
+				times.cameras, times.model, times.model_wait);
+		else if (stats.reconnects != reconnects)
+			m_driver_log("K4A device back after %.1f s, reconnect %u\n", stats.outage, stats.reconnects);
+		else if (m_resume_us != 0)
+			m_driver_log("Resumed from standby in %.0f ms, model %.0f\n", MillisecondsSince(m_resume_us), times.model);
+		else
+			m_driver_log("K4A device set up again\n");
+		m_resume_us = 0;
+		m_start_us = 0;
+		break;
+	}
+	}
+
+	supervisor_stats_t stats = m_supervisor.GetStats(now_us);
+	calibrationMem->deviceState = stats.state;
+	calibrationMem->deviceFaults = stats.faults;
+	calibrationMem->deviceReconnects = stats.reconnects;
+	calibrationMem->deviceDowntime = stats.downtime;
+	calibrationMem->deviceOutage = stats.outage;
+	return captured;
+}
+
+// Longest wait for a frame from the tracking service before checking for shutdown, milliseconds
+static const uint32_t REMOTE_TIMEOUT_MS = 50;
+// The service counts as gone after this long without a frame or heartbeat, microseconds
+static const uint64_t REMOTE_LOST_US = 1000000;
+
+bool K4ABoneProvider::ReadRemote(skeleton_frame_t* frame, vr::DriverPose_t* poses, const uint32_t* ids, int count)
+{
+	if (!m_channel.IsOpen())
+	{
+		if (!m_channel.Open())
+		{
+			WaitForStop(REMOTE_TIMEOUT_MS);
+			return false;
+		}
+		m_driver_log("Tracking service connected\n");
+		m_remote_lost = false;
+		m_remote_moved = false;
+		m_remote_floor = 0;
+	}
+
+	// Every frame, the calibrator toggles them any time
+	uint64_t now_us = HostTimeUs();
+	bool standby = WantStandby(now_us);
+	uint32_t standby_options = m_standby_presence ? SKELETON_OPTION_STANDBY | SKELETON_OPTION_PRESENCE : SKELETON_OPTION_STANDBY;
+	m_channel.SetOptions((calibrationMem->footRefinement ? SKELETON_OPTION_FEET : 0) | (calibrationMem->autoFloor ? SKELETON_OPTION_FLOOR : 0) |
+		(standby ? standby_options : 0));
+	if (m_imu_rereference.exchange(false))
+		m_channel.RequestReference();
+	if (standby != m_remote_standby)
+	{
+		m_remote_standby = standby;
+		if (standby)
+		{
+			MarkOutOfRange(poses, ids, count);
+			m_lost = true;
+			m_standby_us = now_us;
+			calibrationMem->deviceState = SUPERVISOR_STANDBY;
+			m_driver_log("Standby, tracking service %s\n", m_standby_presence ? "looking for a body once a second" : "idle");
+		}
+		else
+			m_resume_us = HostTimeUs();
+	}
+
+	if (!m_channel.Read(frame, REMOTE_TIMEOUT_MS))
+	{
+		if (!m_remote_lost && !m_channel.IsWriterAlive(REMOTE_LOST_US))
+		{
+			// Out of range until it is back, then warm started like a lost body
+			MarkOutOfRange(poses, ids, count);
+			m_remote_lost = true;
+			m_lost = true;
+			calibrationMem->deviceState = SUPERVISOR_FAULTED;
+			m_driver_log("Tracking service stopped sending\n");
+		}
+		return false;
+	}
+	if (m_remote_lost)
+	{
+		m_driver_log("Tracking service back, %llu frames skipped so far\n", (unsigned long long)m_channel.GetSkipped());
+		m_remote_lost = false;
+	}
+	if (standby)
+	{
+		// Frames only for presence until standby ends. Those captured before
+		// the service went into standby are full tracking, not presence.
+		if (frame->body && frame->capture_us >= m_standby_us)
+		{
+			m_woken = true;
+			m_body_us = HostTimeUs();
+			m_driver_log("Body seen, tracking while SteamVR is in standby\n");
+		}
+		return false;
+	}
+	if (m_resume_us != 0)
+	{
+		m_driver_log("Resumed from standby in %.0f ms\n", MillisecondsSince(m_resume_us));
+		m_resume_us = 0;
+	}
+	calibrationMem->deviceState = SUPERVISOR_RUNNING;
+
+	// The camera as the service sees it, in place of the IMU and floor threads
+	{
+		std::lock_guard<std::mutex> lock(m_imu_mutex);
+		m_imu_up = frame->up;
+		m_imu_has_up = frame->has_up;
+	}
+	if (frame->moved && !m_remote_moved)
+		m_camera_moved = true;
+	m_remote_moved = frame->moved;
+	if (frame->floor_sequence != m_remote_floor)
+	{
+		m_remote_floor = frame->floor_sequence;
+		m_floor = frame->floor;
+		m_floor_done = true;
+	}
+	return true;
+}
+
 void K4ABoneProvider::ProcessBones(K4ABoneProvider* context)
 {
+	ScopedThread scheduled("k4a bones", THREAD_ROLE_TRACKING);
 
 	// Wait for every bone to be activated before attempting to populate pose data
 	while (context->m_hip_id == vr::k_unTrackedDeviceIndexInvalid || context->m_rleg_id == vr::k_unTrackedDeviceIndexInvalid || context->m_lleg_id == vr::k_unTrackedDeviceIndexInvalid || context->m_relbow_id == vr::k_unTrackedDeviceIndexInvalid || context->m_lelbow_id == vr::k_unTrackedDeviceIndexInvalid
 		|| context->m_rknee_id == vr::k_unTrackedDeviceIndexInvalid || context->m_lknee_id == vr::k_unTrackedDeviceIndexInvalid || context->m_chest_id == vr::k_unTrackedDeviceIndexInvalid)
-		std::this_thread::sleep_for(std::chrono::milliseconds(33));
+	{
+		// The tracker, if any, stays with the provider
+		if (context->WaitForStop(33))
+			return;
+	}
 
 	// Bring thread relevent data into the thread stack
 
-	k4a_device_t device = context->m_device;
 	k4abt_tracker_t tracker;
 
 	uint32_t ids[8] = { context->m_hip_id, context->m_lleg_id, context->m_rleg_id, context->m_chest_id, context->m_relbow_id,
@@ -220,14 +1323,23 @@ void K4ABoneProvider::ProcessBones(K4ABoneProvider* context)
 	k4a_capture_t capture = nullptr;
 	k4abt_frame_t body_frame = nullptr;
 
-	if (k4abt_tracker_create(&context->m_calibration, ::K4ABT_TRACKER_CONFIG_DEFAULT, &tracker) == K4A_RESULT_SUCCEEDED)
+	// None until the supervisor's setup creates one, owned by this thread
+	// from there
+	tracker = context->m_tracker;
+	context->m_tracker = NULL;
 	{
-		k4abt_tracker_set_temporal_smoothing(tracker, 0);
+		if (tracker != NULL)
+			k4abt_tracker_set_temporal_smoothing(tracker, 0);
 
 		if (!context->IsOnline())
 		{
 			context->m_online = true;
 
+			// Ready, out of range until a body is seen
+			for (vr::DriverPose_t* pose : { &context->m_hip_pose, &context->m_rleg_pose, &context->m_lleg_pose, &context->m_chest_pose,
+				&context->m_relbow_pose, &context->m_lelbow_pose, &context->m_rknee_pose, &context->m_lknee_pose })
+				pose->result = vr::TrackingResult_Running_OutOfRange;
+
 			context->m_hip_pose.deviceIsConnected = true;
 			context->m_rleg_pose.deviceIsConnected = true;
 			context->m_lleg_pose.deviceIsConnected = true;
@@ -249,8 +1361,13 @@ void K4ABoneProvider::ProcessBones(K4ABoneProvider* context)
 
 		uint64_t last_timestamp = 0;
 
+		// Device to host clock offset, the smallest host minus device time seen at
+		// capture arrival. Includes the minimum transfer delay, which is what the
+		// calibrator wants to line captures up with HMD poses.
+		int64_t host_from_device_us = LLONG_MAX;
+
 		// recreate stack copies from the calibrated baseline pose
-		vr::DriverPose_t poses[] = { context->m_hip_pose, context->m_lleg_pose, context->m_rleg_pose, context->m_rleg_pose, 
+		vr::DriverPose_t poses[] = { context->m_hip_pose, context->m_lleg_pose, context->m_rleg_pose,
 			context->m_chest_pose, context->m_relbow_pose, context->m_lelbow_pose, context->m_rknee_pose, context->m_lknee_pose};
 
 		// create array of jointIDs for array access
@@ -261,111 +1378,379 @@ void K4ABoneProvider::ProcessBones(K4ABoneProvider* context)
 		bool updateData = false;
 		// create bone filter for each bone
 		bone_filter filters[8];
-		// initialize time variable
-		clock_t lastTime;
-		lastTime = clock();
-
-		while (context->m_online)
+		int filter_window = POLYNOMIAL_FILTER_WINDOW;
+		int filter_order = POLYNOMIAL_FILTER_ORDER;
+		for (bone_filter& filter : filters)
+			filter.setWindow(filter_window, filter_order);
+		// derivatives come from the shared skeleton history
+		SkeletonHistory& history = context->m_history;
+		MotionEstimator motion;
+		history.Clear();
+
+		// Trackers driven by the skeleton, the first entries of poses
+		const int tracked = 3;
+		context->LoadBodyProfile();
+		context->m_solver.Reset();
+		context->m_gate.Reset();
+		context->m_fusion.Reset();
+		// Trackers handed to real ones, bit per entry of poses
+		uint32_t covered_mask = 0;
+
+		int keyframe_interval = context->m_keyframe_interval;
+		uint64_t capture_index = 0;
+		context->m_propagator.Clear();
+		context->m_unprojector.SetCalibration(context->m_calibration);
+		context->m_floor_worker.SetCalibration(context->m_calibration);
+		context->m_floor_request_us = 0;
+		context->m_floor_done = false;
+		context->m_floor_worker.Start();
+		context->m_imu_has_up = false;
+		context->m_camera_moved = false;
+		context->m_imu_rereference = context->m_calibrated;
+		std::thread imu_thread;
+		context->m_imu_running = context->m_imu;
+		if (context->m_imu)
+			imu_thread = std::thread(ProcessImu, context);
+		// Feet filters hold a floor while the detection is on
+		bool floor_held = false;
+		context->m_last_seen_us = 0;
+		context->m_lost = false;
+		context->m_out_of_range = false;
+
+		uint64_t report_us = HostTimeUs();
+
+		while (!context->m_stopping)
 		{
-			if (k4a_device_get_capture(device, &capture, K4A_WAIT_INFINITE) != K4A_WAIT_RESULT_SUCCEEDED)
+			if (HostTimeUs() > report_us + THREAD_REPORT_US)
+			{
+				context->ReportThreads();
+				report_us = HostTimeUs();
+			}
+			if (!context->m_remote && !context->NextCapture(&capture, &tracker, &imu_thread, poses, ids, tracked))
 			{
 				continue;
 			}
 			else
 			{
-				if (k4abt_tracker_enqueue_capture(tracker, capture, 3) != K4A_WAIT_RESULT_SUCCEEDED)
+				bool have_frame = false;
+				bool body_seen = false;
+				uint64_t frame_us = 0;
+				k4abt_skeleton_t skeleton;
+				// Depth image the skeleton comes from, none from the tracking service
+				k4a_image_t frame_depth = nullptr;
+				if (context->m_remote)
 				{
-					k4a_capture_release(capture);
+					skeleton_frame_t remote;
+					if (context->ReadRemote(&remote, poses, ids, tracked))
+					{
+						frame_us = remote.frame_us;
+						body_seen = remote.body;
+						skeleton = remote.skeleton;
+						if (remote.capture_us != 0)
+							host_from_device_us = (int64_t)remote.capture_us - (int64_t)remote.frame_us;
+						have_frame = history.Size() == 0 || frame_us > history.Time(0);
+					}
+				}
+				else
+				{
+					// Frame times from before a camera restart or a reconnect are
+					// ahead of the new ones
+					if (context->m_device_clock_reset)
+					{
+						context->m_device_clock_reset = false;
+						history.Clear();
+						host_from_device_us = LLONG_MAX;
+						capture_index = 0;
+						context->m_propagator.Clear();
+						context->m_last_seen_us = 0;
+					}
+
+					uint64_t arrival_us = HostTimeUs();
+					k4a_image_t depth = k4a_capture_get_depth_image(capture);
+					if (depth != nullptr)
+					{
+						int64_t offset = (int64_t)arrival_us - (int64_t)k4a_image_get_device_timestamp_usec(depth);
+						if (offset < host_from_device_us)
+							host_from_device_us = offset;
+						k4a_image_release(depth);
+					}
+
+					// In keyframe mode only every Nth capture goes to the DNN, the ones
+					// between are propagated from the last keyframe in the depth image
+					bool keyframe = keyframe_interval <= 1 || capture_index % keyframe_interval == 0;
+					capture_index++;
+					if (keyframe && k4abt_tracker_enqueue_capture(tracker, capture, 3) != K4A_WAIT_RESULT_SUCCEEDED)
+						updateData = true;
+
+					if (k4abt_tracker_pop_result(tracker, &body_frame, keyframe ? 3 : 0) == K4A_WAIT_RESULT_SUCCEEDED)
+					{
+						frame_us = k4abt_frame_get_device_timestamp_usec(body_frame);
+
+						// Trackers follow the first body the tracker reports
+						body_seen = k4abt_frame_get_num_bodies(body_frame) != 0 && k4abt_frame_get_body_skeleton(body_frame, 0, &skeleton) == K4A_RESULT_SUCCEEDED;
+						k4a_capture_t inferred = k4abt_frame_get_capture(body_frame);
+						if (inferred != nullptr)
+						{
+							frame_depth = k4a_capture_get_depth_image(inferred);
+							k4a_capture_release(inferred);
+						}
+						if (keyframe_interval > 1)
+							context->Resynchronize(frame_depth, body_seen ? &skeleton : nullptr);
+						k4abt_frame_release(body_frame);
+
+						// Inference finished after a later capture was propagated, the
+						// keyframe then only resynchronizes
+						have_frame = history.Size() == 0 || frame_us > history.Time(0);
+					}
+					if (!have_frame && !keyframe && context->m_propagator.IsReady())
+					{
+						if (frame_depth != nullptr)
+							k4a_image_release(frame_depth);
+						frame_depth = k4a_capture_get_depth_image(capture);
+						if (frame_depth != nullptr)
+						{
+							frame_us = k4a_image_get_device_timestamp_usec(frame_depth);
+							if (history.Size() == 0 || frame_us > history.Time(0))
+								have_frame = body_seen = context->m_propagator.Propagate(context->m_calibration, frame_depth, &skeleton);
+						}
+					}
+				}
+
+				if (!have_frame)
+				{
+					if (frame_depth != nullptr)
+						k4a_image_release(frame_depth);
+					if (capture != nullptr)
+						k4a_capture_release(capture);
+					capture = nullptr;
 					updateData = true;
 					continue;
 				}
 				else
 				{
-					if (k4abt_tracker_pop_result(tracker, &body_frame, 3) != K4A_WAIT_RESULT_SUCCEEDED)
+					if (!body_seen)
 					{
-						k4a_capture_release(capture);
-						updateData = true;
-						continue;
+						// Occluded or left the view, carry on from the last state for a while
+						context->CoastBones(poses, ids, tracked, frame_us);
 					}
 					else
 					{
-						if (int num_bodies = k4abt_frame_get_num_bodies(body_frame) != 0)
+						if (calibrationMem->update)
+							context->UpdateCalibration();
+						else if (!context->m_calibrated)
+							context->LevelFromImu();
+
+						if (context->m_camera_moved.exchange(false))
+						{
+							calibrationMem->cameraMoved = true;
+							context->m_driver_log("Camera moved, recalibration needed\n");
+						}
+
+						if (context->m_lost)
+						{
+							// Warm start from this measurement instead of sliding in from stale state
+							for (int i = 0; i < 8; i++)
+								filters[i].reset(skeleton.joints[jointIDs[i]]);
+							if (context->m_last_seen_us != 0)
+								context->m_driver_log("Body reacquired after %.2f s\n", (float)(frame_us - context->m_last_seen_us) * 1e-6F);
+							else
+								context->m_driver_log("Body acquired\n");
+							context->m_lost = false;
+							context->m_out_of_range = false;
+						}
+						context->m_last_seen_us = frame_us;
+						context->m_body_us = HostTimeUs();
+
 						{
-							if (calibrationMem->update)
-								UpdateCalibration(poses);
+							// Raw poses of every device back at the capture time and now
+							vr::TrackedDevicePose_t at_capture[vr::k_unMaxTrackedDeviceCount] = {};
+							vr::TrackedDevicePose_t now[vr::k_unMaxTrackedDeviceCount] = {};
+							const vr::TrackedDevicePose_t& hmd_at_capture = at_capture[vr::k_unTrackedDeviceIndex_Hmd];
+							const vr::TrackedDevicePose_t& hmd_now = now[vr::k_unTrackedDeviceIndex_Hmd];
+							if (host_from_device_us != LLONG_MAX)
+							{
+								uint64_t capture_us = (uint64_t)((int64_t)frame_us + host_from_device_us);
+								PublishHead(skeleton.joints[K4ABT_JOINT_HEAD], capture_us);
+
+								uint64_t now_us = HostTimeUs();
+								float age = (now_us > capture_us) ? (float)(now_us - capture_us) * 1e-6F : 0.F;
+								vr::VRServerDriverHost()->GetRawTrackedDevicePoses(-age, at_capture, vr::k_unMaxTrackedDeviceCount);
+								vr::VRServerDriverHost()->GetRawTrackedDevicePoses(0.F, now, vr::k_unMaxTrackedDeviceCount);
 
-							for (int i = 0; i < num_bodies; i++)
+								if (context->m_calibrated)
+									context->CorrectDrift(skeleton.joints[K4ABT_JOINT_HEAD], hmd_at_capture, capture_us);
+							}
+
+							// Floor from a depth image now and then, applied once found
+							floor_plane_t floor;
+							if (calibrationMem->autoFloor && frame_depth != nullptr)
+								context->RequestFloor(frame_depth, frame_us, CameraUp(context->m_camera_to_world));
+							if (context->TakeFloor(&floor) && calibrationMem->autoFloor && floor.valid)
+							{
+								filters[1].setFloor(floor);
+								filters[2].setFloor(floor);
+								floor_held = true;
+								context->AdjustHeight(floor, pose_math::to_vec3(skeleton.joints[K4ABT_JOINT_PELVIS].position));
+							}
+							else if (!calibrationMem->autoFloor && floor_held)
 							{
-								k4abt_skeleton_t skeleton;
-								if (k4abt_frame_get_body_skeleton(body_frame, i, &skeleton) != K4A_RESULT_SUCCEEDED)
+								filters[1].setFloor(floor_plane_t{});
+								filters[2].setFloor(floor_plane_t{});
+								floor_held = false;
+								calibrationMem->floorValid = false;
+							}
+
+							// Feet moved onto the depth image's feet, before the gate judges them
+							if (calibrationMem->footRefinement && frame_depth != nullptr)
+								context->m_foot_refiner.Refine(context->m_unprojector, frame_depth, CameraUp(context->m_camera_to_world), skeleton);
+
+							// Swapped limbs and outliers caught before the solver and filters see them
+							context->m_gate.Apply(history, frame_us, skeleton);
+							for (int i = 0; i < 8; i++)
+								calibrationMem->gateRejected[i] = context->m_gate.GetRejections(jointIDs[i]);
+							calibrationMem->gateSwaps = context->m_gate.GetSwaps();
+
+							// Occluded limbs rebuilt from the learned bone lengths before any stage reads them
+							context->m_solver.Solve(skeleton);
+							history.Append(frame_us, skeleton);
+
+							float timePassed = (history.Contiguous(motion.max_gap) > 1) ? -history.Seconds(1) : NOMINAL_FRAME_TIME;
+
+							// lambda function that updates a bone from its world space position and rotation
+							// fitted_velocity is set when the filter already produced a smooth position and its derivative
+							auto updateBone = [&history, &motion](vr::DriverPose_t& bone_pose, k4abt_joint_id_t joint, const pose_math::vec3& measured, const pose_math::quat& rotation,
+								const pose_math::vec3* fitted_velocity, float timePassed) {
+								bone_pose.poseIsValid = true;
+								bone_pose.result = vr::TrackingResult_Running_OK;
+								pose_math::store(rotation, bone_pose.qRotation);
+
+								// Blend with the last published position carried forward
+								pose_math::vec3 position = measured;
+								if (fitted_velocity == nullptr && history.Contiguous(motion.max_gap) > 1 && history.HasOutput(joint, 1))
 								{
-									for (int i = 0; i < 8; i++) {
-										poses[i].poseIsValid = false;
-										vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
-									}
+									pose_math::vec3 last = history.OutputPosition(joint, 1);
+									pose_math::vec3 velocity = pose_math::to_vec3(bone_pose.vecVelocity);
+									position = (last + velocity * timePassed) * 0.3F + measured * 0.7F;
 								}
-								else
-								{
-									clock_t thisTime = clock();
-									float timePassed = float(thisTime - lastTime) / CLOCKS_PER_SEC;
-									
-									// lambda function that updates a bone's position and rotation
-									auto updateBone = [](bone_filter& boneFilter, k4abt_joint_t bone, vr::DriverPose_t& bone_pose, float timePassed, bool takeOrientation) {
-										k4abt_joint_t bonePrediction = boneFilter.getNextPos(bone);
-										float temp;
-										//k4a_quaternion_t slerped = nlerp(bone_pose.qRotation, bone.orientation, 0.6);
-										bone_pose.poseIsValid = true;
-										bone_pose.qRotation.w = bonePrediction.orientation.wxyz.w;
-										bone_pose.qRotation.x = bonePrediction.orientation.wxyz.x;
-										bone_pose.qRotation.y = bonePrediction.orientation.wxyz.y;
-										bone_pose.qRotation.z = bonePrediction.orientation.wxyz.z;
-
-										//bone_pose.vecAngularVelocity[0] = angularVelocities.xyz.z;
-										//bone_pose.vecAngularVelocity[1] = angularVelocities.xyz.x;
-										//bone_pose.vecAngularVelocity[2] = angularVelocities.xyz.y;
-										temp = bone_pose.vecPosition[0];
-										bone_pose.vecPosition[0] = (0.3 * (bone_pose.vecPosition[0] + (bone_pose.vecVelocity[0] * timePassed))) + (0.7 * (bonePrediction.position.xyz.z / 1000));
-										bone_pose.vecVelocity[0] = (bone_pose.vecPosition[0] - temp) / timePassed;
-										temp = bone_pose.vecPosition[1];
-										bone_pose.vecPosition[1] = (0.3 * (bone_pose.vecPosition[1] + (bone_pose.vecVelocity[1] * timePassed))) + (0.7 * (bonePrediction.position.xyz.x / 1000));
-										bone_pose.vecVelocity[1] = (bone_pose.vecPosition[1] - temp) / timePassed;
-										temp = bone_pose.vecPosition[2];
-										bone_pose.vecPosition[2] = (0.3 * (bone_pose.vecPosition[2] + (bone_pose.vecVelocity[2] * timePassed))) + (0.7 * (bonePrediction.position.xyz.y / 1000));
-										bone_pose.vecVelocity[2] = (bone_pose.vecPosition[2] - temp) / timePassed;
-										bone_pose.poseTimeOffset = timePassed;
-									};
-
-									
-
-
-									// Extra tracker functionality disabled for now
-									if (calibrationMem->moreTrackers) {
-										/*#pragma omp parallel for
-										for (int i = 0; i < 8; i++) {
-											updateBone(std::ref(filters[i]), skeleton.joints[jointIDs[i]], std::ref(poses[i]), timePassed);
-											vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
-										}*/
+								pose_math::store(position, bone_pose.vecPosition);
+								history.SetOutput(joint, position, rotation);
+
+								// Derivatives for SteamVR's prediction, rotations included
+								motion_state_t state = motion.Estimate(history, joint);
+								if (fitted_velocity != nullptr)
+									state.velocity = *fitted_velocity;
+								pose_math::store(state.velocity, bone_pose.vecVelocity);
+								pose_math::store(state.acceleration, bone_pose.vecAcceleration);
+								pose_math::store(state.angular_velocity, bone_pose.vecAngularVelocity);
+								pose_math::store(state.angular_acceleration, bone_pose.vecAngularAcceleration);
+								bone_pose.poseTimeOffset = timePassed;
+							};
+
+							// Extra tracker functionality disabled for now
+							if (calibrationMem->moreTrackers) {
+								/*#pragma omp parallel for
+								for (int i = 0; i < 8; i++) {
+									updateBone(poses[i], jointIDs[i], positions[i], rotations[i], polynomial ? &velocities[i] : nullptr, timePassed);
+									vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
+								}*/
+							}
+							else {
+								// Filter in camera space, then move every joint to world space in one pass
+								pose_math::vec3 positions[8];
+								pose_math::quat rotations[8];
+								pose_math::vec3 velocities[8];
+								bool polynomial = calibrationMem->polynomialFilter;
+								if (polynomial) {
+									// Lag against smoothing, as the calibrator sets it
+									int window = std::min(std::max((int)calibrationMem->polynomialWindow, 3), SKELETON_HISTORY_CAPACITY - 1);
+									int order = std::min(std::max((int)calibrationMem->polynomialOrder, 1), 2);
+									if (window != filter_window || order != filter_order) {
+										filter_window = window;
+										filter_order = order;
+										for (bone_filter& filter : filters)
+											filter.setWindow(window, order);
 									}
-									else {
-										omp_set_num_threads(2);
-										#pragma omp parallel for
-										for (int i = 0; i < 3; i++) {
-											updateBone(std::ref(filters[i]), skeleton.joints[jointIDs[i]], std::ref(poses[i]), timePassed, (i == 0)? true: true);
+								}
+
+								// Joints worn with a real tracker are left to it
+								pose_math::vec3 raw_positions[8];
+								pose_math::quat raw_rotations[8];
+								for (int i = 0; i < tracked; i++) {
+									raw_positions[i] = pose_math::to_vec3(skeleton.joints[jointIDs[i]].position);
+									raw_rotations[i] = pose_math::to_quat(skeleton.joints[jointIDs[i]].orientation);
+								}
+								ApplyCameraTransform(context->m_camera_to_world, raw_positions, raw_rotations, tracked);
+								context->FuseTrackers(at_capture, now, ids, raw_positions, tracked, timePassed);
+
+								for (int i = 0; i < tracked; i++) {
+									bool covered = context->m_fusion.IsCovered(i);
+									if (covered != ((covered_mask >> i) & 1)) {
+										// Hand over once, back to the camera from fresh measurements
+										covered_mask ^= 1u << i;
+										if (covered) {
+											poses[i].poseIsValid = false;
+											poses[i].result = vr::TrackingResult_Running_OutOfRange;
 											vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
 										}
+										else
+											filters[i].reset(skeleton.joints[jointIDs[i]]);
+									}
+								}
+
+								for (int i = 0; i < tracked; i++) {
+									if (covered_mask & (1u << i)) {
+										positions[i] = pose_math::to_vec3(skeleton.joints[jointIDs[i]].position);
+										rotations[i] = pose_math::to_quat(skeleton.joints[jointIDs[i]].orientation);
+										continue;
+									}
+									k4abt_joint_t filtered;
+									if (polynomial) {
+										k4a_float3_t velocity;
+										filtered = filters[i].getNextPos(history, jointIDs[i], POLYNOMIAL_FILTER_LEAD, &velocity);
+										velocities[i] = pose_math::transform_vector(context->m_camera_to_world.position, pose_math::to_vec3(velocity));
 									}
-									lastTime = clock();
-									calibrationMem->fps = 1 / timePassed;
+									else
+										filtered = filters[i].getNextPos(skeleton.joints[jointIDs[i]]);
+									positions[i] = pose_math::to_vec3(filtered.position);
+									rotations[i] = pose_math::to_quat(filtered.orientation);
+								}
+								ApplyCameraTransform(context->m_camera_to_world, positions, rotations, tracked);
+								context->CompensateLatency(hmd_at_capture, hmd_now, positions, rotations, tracked);
+
+								// On this thread as scheduled, three bones are not worth OpenMP's workers
+								for (int i = 0; i < tracked; i++) {
+									if (covered_mask & (1u << i))
+										continue;
+									updateBone(poses[i], jointIDs[i], positions[i], rotations[i], polynomial ? &velocities[i] : nullptr, timePassed);
+									vr::VRServerDriverHost()->TrackedDevicePoseUpdated(ids[i], poses[i], sizeof(vr::DriverPose_t));
 								}
 							}
+							calibrationMem->fps = 1 / timePassed;
+
+							buffer_pool_stats_t pool = BufferPool::Instance().GetStats();
+							calibrationMem->poolHits = pool.hits;
+							calibrationMem->poolMisses = pool.misses;
+							calibrationMem->poolPeakBytes = pool.peak_bytes;
 						}
-						k4abt_frame_release(body_frame);
 					}
 				}
-				k4a_capture_release(capture);
+				if (frame_depth != nullptr)
+					k4a_image_release(frame_depth);
+				if (capture != nullptr)
+					k4a_capture_release(capture);
+				capture = nullptr;
 			}
 		}
-		k4abt_tracker_destroy(tracker);
+		context->m_floor_worker.Stop();
+		if (imu_thread.joinable())
+			imu_thread.join();
+		context->SaveBodyProfile();
+		if (tracker != NULL)
+		{
+			k4abt_tracker_shutdown(tracker);
+			k4abt_tracker_destroy(tracker);
+		}
+		context->m_channel.Close();
 	}
 }
 
@@ -380,8 +1765,9 @@ void K4ABoneProvider::setup_bone(uint32_t unObjectId, k4abt_joint_id_t bone)
 	bone_pose.qDriverFromHeadRotation.y = 0.F;
 	bone_pose.qDriverFromHeadRotation.z = 0.F;
 
-	bone_pose.qWorldFromDriverRotation.w = std::cos(std::acos(-1) / 4);
-	bone_pose.qWorldFromDriverRotation.x = std::sin(std::acos(-1) / 4);
+	// Poses are published in world space, see camera_transform.h
+	bone_pose.qWorldFromDriverRotation.w = 1.F;
+	bone_pose.qWorldFromDriverRotation.x = 0.F;
 	bone_pose.qWorldFromDriverRotation.y = 0.F;
 	bone_pose.qWorldFromDriverRotation.z = 0.F;
 
@@ -412,6 +1798,12 @@ void K4ABoneProvider::setup_bone(uint32_t unObjectId, k4abt_joint_id_t bone)
 	bone_pose.willDriftInYaw = false;
 	bone_pose.shouldApplyHeadModel = false;
 
+	// Shown as initializing until the body tracker is up
+	bone_pose.deviceIsConnected = true;
+	bone_pose.poseIsValid = false;
+	bone_pose.result = vr::TrackingResult_Calibrating_InProgress;
+	vr::VRServerDriverHost()->TrackedDevicePoseUpdated(unObjectId, bone_pose, sizeof(vr::DriverPose_t));
+
 	if (bone == K4ABT_JOINT_PELVIS)
 	{
 		m_hip_pose = bone_pose;
@@ -7,10 +7,34 @@
 #include "k4abttypes.h"
 #include <openvr_driver.h>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cmath>
 #include "bone_filter.h"
+#include "math/pose_math.h"
+#include "camera_transform.h"
+#include "drift_corrector.h"
+#include "latency_compensator.h"
+#include "motion_estimator.h"
+#include "skeleton_history.h"
+#include "skeleton_solver.h"
+#include "measurement_gate.h"
+#include "tracker_fusion.h"
+#include "depth_propagator.h"
+#include "foot_refiner.h"
+#include "floor_detector.h"
+#include "floor_worker.h"
+#include "imu_tracker.h"
+#include "buffer_pool.h"
+#include "calibration_cache.h"
+#include "skeleton_channel.h"
+#include "device_supervisor.h"
+#include "driver/log.h"
 
 typedef void(*DriverLog_t)(const char* pMsgFormat, ...);
+// Severity and call site of a forwarded SDK message, see DriverLogAtSite
+typedef void(*DriverLogAtSite_t)(DriverLogSeverity severity, const char* file, int line, const char* pMsgFormat, ...);
 
 typedef struct _joint_offset
 {
@@ -27,6 +51,16 @@ typedef struct _calibration_data
 	// TODO: make this setting togglable for less powerful GPU setups. 
 	// Right now camera is set to 15fps by default as seen in https://github.com/microsoft/Azure-Kinect-Sensor-SDK/issues/514
 	bool lessCameraFPS;
+	// Windowed polynomial fit instead of the Kalman filters, see polynomial_filter.h
+	bool polynomialFilter;
+	// Feet refined against the depth image, see foot_refiner.h
+	bool footRefinement;
+	// Floor found in the depth image sets the height and holds the feet, see floor_detector.h
+	bool autoFloor;
+	// The polynomial fit's window, samples, and order, 1 or 2. A shorter
+	// window or lower order lags less and smooths less. Clamped by the provider.
+	int32_t polynomialWindow;
+	int32_t polynomialOrder;
 
 	float x;
 	float y;
@@ -35,69 +69,73 @@ typedef struct _calibration_data
 	float fps;
 
 	joint_offset_t rotOffset;
+
+	// Raw head joint for the calibrator, in driver space (metres, before the
+	// calibration is applied). headSequence is odd while the provider writes,
+	// readers retry until it is even and unchanged around their copy.
+	volatile uint32_t headSequence;
+	uint32_t headConfidence;
+	float headX;
+	float headY;
+	float headZ;
+	// Capture time on the host steady clock, microseconds
+	uint64_t headTimeUs;
+
+	// Drift correction diagnostics, see drift_corrector.h
+	uint32_t driftState;
+	float driftResidual;
+	float driftAngle;
+	float driftOffset;
+
+	// Measurements rejected per tracker, in the provider's tracker order (hip,
+	// left foot, right foot, chest, right elbow, left elbow, right knee, left
+	// knee), and limb swaps corrected. See measurement_gate.h.
+	uint32_t gateRejected[8];
+	uint32_t gateSwaps;
+
+	// Trackers left to real trackers worn on the same joint, bit per tracker
+	// in the order above. See tracker_fusion.h.
+	uint32_t fusionCovered;
+
+	// Last floor found and its world height under the user before any
+	// automatic correction, metres
+	bool floorValid;
+	float floorHeight;
+
+	// The IMU saw the camera move since the last calibration, see imu_tracker.h.
+	// Cleared by the next calibration.
+	bool cameraMoved;
+
+	// SDK buffer pool counters, see buffer_pool.h
+	uint64_t poolHits;
+	uint64_t poolMisses;
+	uint64_t poolPeakBytes;
+
+	// SupervisorState of the device, its faults and reconnects, and the time it
+	// was down in total and in the current or last outage, seconds. See
+	// device_supervisor.h.
+	uint32_t deviceState;
+	uint32_t deviceFaults;
+	uint32_t deviceReconnects;
+	float deviceDowntime;
+	float deviceOutage;
 } calibration_data_t;
 
 #define	CALIBRATION_MEMSIZE sizeof(calibration_data_t)
 
-inline vr::HmdQuaternion_t QuaternionProduct(vr::HmdQuaternion_t& quata, vr::HmdQuaternion_t& quatb)
-{
-	vr::HmdQuaternion_t quat;
-	quat.w = ((quata.w * quatb.w) - (quata.x * quatb.x) - (quata.y * quatb.y) - (quata.z * quatb.z));
-	quat.x = ((quata.w * quatb.x) + (quata.x * quatb.w) + (quata.y * quatb.z) - (quata.z * quatb.y));
-	quat.y = ((quata.w * quatb.y) - (quata.x * quatb.z) + (quata.y * quatb.w) + (quata.z * quatb.x));
-	quat.z = ((quata.w * quatb.z) + (quata.x * quatb.y) - (quata.y * quatb.x) + (quata.z * quatb.w));
-	return quat;
-}
-
-inline vr::HmdQuaternion_t QuaternionProduct(vr::HmdQuaternion_t& quata, k4a_quaternion_t& quatb)
-{
-	vr::HmdQuaternion_t quat;
-	quat.w = ((quata.w * quatb.wxyz.w) - (quata.x * quatb.wxyz.x) - (quata.y * quatb.wxyz.y) - (quata.z * quatb.wxyz.z));
-	quat.x = ((quata.w * quatb.wxyz.x) + (quata.x * quatb.wxyz.w) + (quata.y * quatb.wxyz.z) - (quata.z * quatb.wxyz.y));
-	quat.y = ((quata.w * quatb.wxyz.y) - (quata.x * quatb.wxyz.z) + (quata.y * quatb.wxyz.w) + (quata.z * quatb.wxyz.x));
-	quat.z = ((quata.w * quatb.wxyz.z) + (quata.x * quatb.wxyz.y) - (quata.y * quatb.wxyz.x) + (quata.z * quatb.wxyz.w));
-	return quat;
-}
-
-inline vr::HmdQuaternionf_t QuaternionProduct(k4a_quaternion_t& quata, k4a_quaternion_t& quatb)
+// Startup stage durations, milliseconds
+typedef struct _startup_times
 {
-	vr::HmdQuaternionf_t quat;
-	quat.w = ((quata.wxyz.w * quatb.wxyz.w) - (quata.wxyz.x * quatb.wxyz.x) - (quata.wxyz.y * quatb.wxyz.y) - (quata.wxyz.z * quatb.wxyz.z));
-	quat.x = ((quata.wxyz.w * quatb.wxyz.x) + (quata.wxyz.x * quatb.wxyz.w) + (quata.wxyz.y * quatb.wxyz.z) - (quata.wxyz.z * quatb.wxyz.y));
-	quat.y = ((quata.wxyz.w * quatb.wxyz.y) - (quata.wxyz.x * quatb.wxyz.z) + (quata.wxyz.y * quatb.wxyz.w) + (quata.wxyz.z * quatb.wxyz.x));
-	quat.z = ((quata.wxyz.w * quatb.wxyz.z) + (quata.wxyz.x * quatb.wxyz.y) - (quata.wxyz.y * quatb.wxyz.x) + (quata.wxyz.z * quatb.wxyz.w));
-	return quat;
-}
-
-inline vr::HmdQuaternion_t QuaternionInverse(vr::HmdQuaternion_t& quat)
-{
-	vr::HmdQuaternion_t inverse_quat;
-	inverse_quat.w = quat.w;
-	inverse_quat.x = -(quat.x);
-	inverse_quat.y = -(quat.y);
-	inverse_quat.z = -(quat.z);
-	return inverse_quat;
-}
-
-/*
-inline k4a_quaternion_t nlerp(vr::HmdQuaternion_t q1, k4a_quaternion_t q2, float percent) {
-	k4a_quaternion_t lerped;
-	// Linear interpolation
-	lerped.wxyz.w = (q1.w + percent * (q2.wxyz.w - q1.w));
-	lerped.wxyz.x = (q1.x + percent * (q2.wxyz.z - q1.x));
-	lerped.wxyz.y = (q1.y + percent * (q2.wxyz.x - q1.y));
-	lerped.wxyz.z = (q1.z + percent * (q2.wxyz.y - q1.z));
-	// Normilized
-	float mag = pow(sqrt(lerped.wxyz.w * lerped.wxyz.w + lerped.wxyz.x * lerped.wxyz.x + lerped.wxyz.y * lerped.wxyz.y + lerped.wxyz.z * lerped.wxyz.z), 2);
-	lerped.wxyz.w /= mag;
-	lerped.wxyz.x /= mag;
-	lerped.wxyz.y /= mag;
-	lerped.wxyz.z /= mag;
-	return lerped;
-}*/
-
-
-
+	float cache;
+	float open;
+	float calibration;
+	// The calibration came from the cache
+	bool cached;
+	float cameras;
+	// Model load on its own thread, and how long startup waited for it
+	float model;
+	float model_wait;
+} startup_times_t;
 
 typedef enum _K4ABoneProviderError
 {
@@ -108,15 +146,22 @@ typedef enum _K4ABoneProviderError
 	BONE_PROVIDER_TRACKER_QUEUE_CAP_ERROR,
 	BONE_PROVIDER_TRACKER_FRAME_POP_ERROR,
 	BONE_PROVIDER_CALIB_ERROR,
-	BONE_PROVIDER_MUTEX_ERROR
+	BONE_PROVIDER_MUTEX_ERROR,
+	// Setup given up for Stop
+	BONE_PROVIDER_STOPPED
 } K4ABoneProviderError;
 
 class K4ABoneProvider
 {
 public:
-	K4ABoneProvider(DriverLog_t driver_log);
+	K4ABoneProvider(DriverLog_t driver_log, DriverLogAtSite_t sdk_log);
 	~K4ABoneProvider();
 
+	// Start, Configure and Stop come from one thread. Start spawns the bone
+	// thread, which opens the device. Stop returns once the bone thread is
+	// joined, within about a capture timeout, a model load still running is
+	// left to finish on its own. Configure while running only leaves the new
+	// depth mode for the bone thread.
 	K4ABoneProviderError Start();
 	K4ABoneProviderError Configure(k4a_depth_mode_t new_depth_mode, float new_smoothing_rate);
 	K4ABoneProviderError Stop();
@@ -138,24 +183,118 @@ public:
 		return m_smoothing_rate;
 	};
 
+	// Runs inference on every Nth capture at 30 fps and propagates the rest,
+	// 1 for inference on every capture at 15 fps. Read at Start, where the
+	// driver's keyframeInterval setting overrides it.
+	void SetKeyframeInterval(int interval)
+	{
+		m_keyframe_interval = interval;
+	};
+
+	// How long trackers are extrapolated after the body is lost, seconds
+	void SetCoastTime(float seconds)
+	{
+		m_coast_time = seconds;
+	};
+
+	// SteamVR standby, applied by the bone thread between captures. The
+	// cameras and the body tracker stop, or with the standbyPresence setting
+	// the cameras run at 5 fps and the tracker once a second. A body seen
+	// then has it tracked while SteamVR stays in standby, until it has been
+	// gone a few seconds.
+	void EnterStandby()
+	{
+		m_standby = true;
+	};
+	void LeaveStandby()
+	{
+		m_standby = false;
+	};
+	bool IsStandby() const
+	{
+		return m_standby;
+	};
+
 	DriverLog_t m_driver_log;
+	DriverLogAtSite_t m_sdk_log;
 
 	void setup_bone(uint32_t unObjectId, k4abt_joint_id_t bone);
 
 private:
-	std::thread* m_bone_thread = nullptr;
+	std::thread m_bone_thread;
 
 	k4a_device_t m_device = NULL;
 
 	k4a_device_configuration_t m_device_config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
 	k4a_calibration_t m_calibration = { 0 };
+	bool m_has_calibration = false;
 	float m_smoothing_rate = 0.1F;
 	k4abt_skeleton_t skeleton;
 
-	K4ABoneProviderError m_error = BONE_PROVIDER_NO_ERROR;
+	// Written by the bone thread as it opens the device, read by the driver
+	std::atomic<K4ABoneProviderError> m_error{ BONE_PROVIDER_NO_ERROR };
 
+	// Calibration memory mapped, the device is opened by the bone thread
+	bool m_mapped = false;
 	bool m_open = false;
-	bool m_online = false;
+	std::atomic<bool> m_online{ false };
+
+	// Set by Stop. Every loop on the bone thread and its helpers checks it,
+	// sleeps wait on m_stop_wake instead.
+	std::atomic<bool> m_stopping{ false };
+	std::mutex m_stop_mutex;
+	std::condition_variable m_stop_wake;
+	// Waits up to timeout_ms, true when stopping
+	bool WaitForStop(uint32_t timeout_ms);
+	// A depth mode from Configure for the bone thread
+	std::atomic<bool> m_reconfigure{ false };
+	std::atomic<k4a_depth_mode_t> m_pending_depth_mode{ K4A_DEPTH_MODE_OFF };
+
+	// Staged startup: device open, calibration (cached per serial) and the
+	// body tracker's model load overlap, then the cameras start. Gives up
+	// with BONE_PROVIDER_STOPPED between stages once stopping.
+	K4ABoneProviderError OpenDevice(startup_times_t* times);
+	K4ABoneProviderError StartCameras();
+	void StopCameras();
+
+	// Thread priorities and cores from the driver settings, see
+	// thread_scheduler.h, and each thread's CPU time and context switches
+	// logged every THREAD_REPORT_US
+	void ConfigureThreads();
+	void ReportThreads();
+
+	// Setup, capture and recovery under the supervisor, on the bone thread.
+	// The next capture while running; otherwise tears down a fault or sets
+	// up again once the backoff is over, with the trackers out of range.
+	bool NextCapture(k4a_capture_t* capture, k4abt_tracker_t* tracker, std::thread* imu_thread,
+		vr::DriverPose_t* poses, const uint32_t* ids, int count);
+	// Stops the IMU thread, then closes the tracker and the device
+	void TearDown(k4abt_tracker_t* tracker, std::thread* imu_thread);
+	DeviceSupervisor m_supervisor;
+
+	// Into or out of standby as asked for, while running or standing by
+	void UpdateStandby(k4abt_tracker_t* tracker, std::thread* imu_thread, vr::DriverPose_t* poses, const uint32_t* ids, int count);
+	// A capture while looking for a body in standby, true when one is seen
+	bool DetectPresence(k4a_capture_t capture, k4abt_tracker_t tracker, uint64_t now_us);
+	// SteamVR's standby unless a body woke the bone thread, which lasts until
+	// the body has been gone for a while
+	bool WantStandby(uint64_t now_us);
+	std::atomic<bool> m_standby{ false };
+	bool m_woken = false;
+	// Host time of the last frame with a body, and of entering standby,
+	// frames captured before it are stale
+	uint64_t m_body_us = 0;
+	uint64_t m_standby_us = 0;
+	// The standbyPresence setting, read at Start
+	bool m_standby_presence = true;
+	// Start called at, until the first setup is done
+	uint64_t m_start_us = 0;
+	// Standby left at, for the time full tracking takes to come back
+	uint64_t m_resume_us = 0;
+	uint64_t m_presence_us = 0;
+	// Device time of the capture sent for presence, results of any other are stale
+	uint64_t m_presence_device_us = 0;
+	bool m_presence_pending = false;
 
 protected:
 	static void ProcessBones(K4ABoneProvider* context);
@@ -182,7 +321,117 @@ protected:
 	uint32_t m_chest_id = vr::k_unTrackedDeviceIndexInvalid;
 	
 
+	// Recomposes m_camera_to_world from the shared calibration memory
+	void UpdateCalibration();
+
+	pose_math::quat m_camera_tilt = DefaultCameraTilt();
+	pose_math::rigid m_world_from_driver = pose_math::identity_rigid();
+	camera_transform_t m_camera_to_world = ComposeCameraTransform(DefaultCameraTilt(), pose_math::identity_rigid());
+
 	bool m_calibrated = false;
+
+	// Follows the calibration from the head joint against the raw HMD pose at
+	// the capture time, called per body frame
+	void CorrectDrift(const k4abt_joint_t& head, const vr::TrackedDevicePose_t& hmd, uint64_t capture_us);
+
+	// Moves world space joints by the HMD's motion since the capture
+	void CompensateLatency(const vr::TrackedDevicePose_t& hmd_at_capture, const vr::TrackedDevicePose_t& hmd_now,
+		pose_math::vec3* positions, pose_math::quat* rotations, size_t count);
+
+	// Last body frames, read by every temporal stage. Written by the bone thread only.
+	SkeletonHistory m_history;
+
+	DriftCorrector m_drift;
+	uint64_t m_drift_last_us = 0;
+	LatencyCompensator m_latency;
+
+	// Extrapolates the last published poses while no body is seen, then marks
+	// them out of range once the coast time has passed
+	void CoastBones(vr::DriverPose_t* poses, const uint32_t* ids, int count, uint64_t time_us);
+
+	float m_coast_time = 0.5F;
+	// Device time of the last frame with a body, and of the last coasted frame
+	uint64_t m_last_seen_us = 0;
+	uint64_t m_coast_us = 0;
+	bool m_lost = false;
+	bool m_out_of_range = false;
+
+	// Bone lengths of the profile named by the driver's "profile" setting,
+	// cached in the SteamVR settings between sessions
+	void LoadBodyProfile();
+	void SaveBodyProfile();
+
+	SkeletonSolver m_solver;
+	MeasurementGate m_gate;
+
+	// Finds real trackers worn on tracked joints from every device's raw pose
+	// at the capture time and now, joints are raw in world space
+	void FuseTrackers(const vr::TrackedDevicePose_t* at_capture, const vr::TrackedDevicePose_t* now, const uint32_t* ids,
+		const pose_math::vec3* joints, size_t count, float dt);
+
+	TrackerFusion m_fusion;
+	vr::ETrackedDeviceClass m_device_class[vr::k_unMaxTrackedDeviceCount] = {};
+
+	// Keyframe mode, see SetKeyframeInterval
+	int m_keyframe_interval = 1;
+	// Set when the cameras start, the device clock starts over with them
+	bool m_device_clock_reset = false;
+	DepthPropagator m_propagator;
+	// Takes an inferred depth image as the propagator's keyframe, clears it without a body
+	void Resynchronize(k4a_image_t depth, const k4abt_skeleton_t* skeleton);
+
+	// Depth pixels to points, shared by everything reading the depth image
+	DepthUnprojector m_unprojector;
+	FootRefiner m_foot_refiner;
+
+	// Floor detection on the floor worker's thread, started and stopped by
+	// the bone thread, which hands over a depth image now and then
+	void RequestFloor(k4a_image_t depth, uint64_t time_us, const pose_math::vec3& up);
+	// The worker's plane, or the tracking service's
+	bool TakeFloor(floor_plane_t* floor);
+	// Moves the calibration's height so the floor under over, camera space,
+	// is at world zero
+	void AdjustHeight(const floor_plane_t& floor, const pose_math::vec3& over);
+
+	FloorWorker m_floor_worker;
+	uint64_t m_floor_request_us = 0;
+	// From the tracking service and not taken yet, bone thread only
+	floor_plane_t m_floor = {};
+	bool m_floor_done = false;
+
+	// IMU thread, started and joined by the bone thread when the IMU runs.
+	// Every sample goes through m_imu_tracker there, nothing else reads it.
+	static void ProcessImu(K4ABoneProvider* context);
+	// Gravity's up in camera space, false until the IMU thread has one
+	bool GetGravityUp(pose_math::vec3* up);
+	// Levels the camera from gravity until there is a calibration
+	void LevelFromImu();
+
+	bool m_imu = false;
+	// Cleared to stop the IMU thread before the device closes
+	std::atomic<bool> m_imu_running{ false };
+	ImuTracker m_imu_tracker;
+	std::mutex m_imu_mutex;
+	pose_math::vec3 m_imu_up = { 0.F, 0.F, 0.F };
+	bool m_imu_has_up = false;
+	// Bone thread to IMU thread: a calibration happened, take a new reference
+	std::atomic<bool> m_imu_rereference{ false };
+	// IMU thread to bone thread: the camera moved
+	std::atomic<bool> m_camera_moved{ false };
+	char m_profile[64] = "default";
+
+	// Skeletons from the tracking service instead of the device, the driver's
+	// trackingService setting. Read at Start.
+	bool m_remote = false;
+	SkeletonChannel m_channel;
+	// The service's next frame, also handing its IMU and floor results to
+	// what the IMU and floor threads feed. Marks poses out of range while
+	// the service is silent.
+	bool ReadRemote(skeleton_frame_t* frame, vr::DriverPose_t* poses, const uint32_t* ids, int count);
+	bool m_remote_lost = false;
+	bool m_remote_standby = false;
+	bool m_remote_moved = false;
+	uint32_t m_remote_floor = 0;
 };
 
 #endif
\ No newline at end of file
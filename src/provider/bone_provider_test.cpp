@@ -0,0 +1,187 @@
+// Times Stop, Configure and the destructor of a provider running against
+// sdk_mock.cpp. SteamVR's shutdown and the settings page wait on them, each
+// has to return within SHUTDOWN_LIMIT_MS. Returns non zero on failure.
+
+#include "bone_provider.h"
+#include "sdk_mock.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+
+typedef std::chrono::steady_clock test_clock;
+
+static const double SHUTDOWN_LIMIT_MS = 100.0;
+// The model load in the slow case, far longer than anything waits on it
+static const int SLOW_MODEL_MS = 3000;
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); s_failures++; } } while (0)
+#define CHECK_FAST(what, ms) do { double _ms = (ms); std::printf("  %s: %.1f ms\n", what, _ms); if (!(_ms < SHUTDOWN_LIMIT_MS)) { \
+	std::printf("%s:%d: %s took %.1f ms\n", __FILE__, __LINE__, what, _ms); s_failures++; } } while (0)
+
+static void Log(const char* pMsgFormat, ...)
+{
+	va_list args;
+	va_start(args, pMsgFormat);
+	std::printf("    ");
+	std::vprintf(pMsgFormat, args);
+	va_end(args);
+}
+
+static void LogAtSite(DriverLogSeverity severity, const char* file, int line, const char* pMsgFormat, ...)
+{
+	va_list args;
+	va_start(args, pMsgFormat);
+	std::printf("    ");
+	std::vprintf(pMsgFormat, args);
+	va_end(args);
+}
+
+static void Wait(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+template <typename F>
+static double Milliseconds(F&& run)
+{
+	test_clock::time_point start = test_clock::now();
+	run();
+	return std::chrono::duration<double, std::milli>(test_clock::now() - start).count();
+}
+
+static void SetUpBones(K4ABoneProvider& provider)
+{
+	static const k4abt_joint_id_t joints[] = { K4ABT_JOINT_PELVIS, K4ABT_JOINT_FOOT_RIGHT, K4ABT_JOINT_FOOT_LEFT, K4ABT_JOINT_SPINE_CHEST,
+		K4ABT_JOINT_ELBOW_RIGHT, K4ABT_JOINT_ELBOW_LEFT, K4ABT_JOINT_KNEE_RIGHT, K4ABT_JOINT_KNEE_LEFT };
+	for (uint32_t i = 0; i < 8; i++)
+		provider.setup_bone(i + 1, joints[i]);
+}
+
+// The bone thread waits for SteamVR to activate the trackers
+static void TestStopBeforeActivation()
+{
+	K4ABoneProvider provider(&Log, &LogAtSite);
+	provider.Start();
+	Wait(100);
+	CHECK_FAST("stop", Milliseconds([&] { provider.Stop(); }));
+}
+
+static void TestStopRunning()
+{
+	K4ABoneProvider provider(&Log, &LogAtSite);
+	SetUpBones(provider);
+	for (int i = 0; i < 3; i++)
+	{
+		provider.Start();
+		Wait(700);
+		CHECK(provider.IsOnline());
+		CHECK_FAST("stop", Milliseconds([&] { provider.Stop(); }));
+		CHECK(!provider.IsOnline());
+	}
+}
+
+static void TestStopSilentDevice()
+{
+	K4ABoneProvider provider(&Log, &LogAtSite);
+	SetUpBones(provider);
+	provider.Start();
+	Wait(300);
+	SdkMock().captures = false;
+	Wait(500);
+	CHECK_FAST("stop", Milliseconds([&] { provider.Stop(); }));
+	SdkMock().captures = true;
+}
+
+static void TestConfigureRunning()
+{
+	K4ABoneProvider provider(&Log, &LogAtSite);
+	SetUpBones(provider);
+	SdkMock().model_ms = 300;
+	provider.Start();
+	Wait(700);
+	CHECK_FAST("configure", Milliseconds([&] { provider.Configure(K4A_DEPTH_MODE_NFOV_UNBINNED, 0.075F); }));
+	Wait(1000);
+	CHECK(provider.IsOnline());
+	CHECK_FAST("stop", Milliseconds([&] { provider.Stop(); }));
+	// The bone thread owns the device configuration until it is stopped
+	CHECK(provider.GetDepthMode() == K4A_DEPTH_MODE_NFOV_UNBINNED);
+	SdkMock().model_ms = 0;
+}
+
+// A body seen in standby wakes the tracker but SteamVR's standby stays
+static void TestStopInStandby()
+{
+	K4ABoneProvider provider(&Log, &LogAtSite);
+	SetUpBones(provider);
+	provider.Start();
+	Wait(700);
+	provider.EnterStandby();
+	Wait(2500);
+	CHECK(provider.IsStandby());
+	CHECK_FAST("stop", Milliseconds([&] { provider.Stop(); }));
+}
+
+// Stop and the destructor leave a model load still running to finish on its own
+static void TestStopDuringModelLoad()
+{
+	K4ABoneProvider* provider = new K4ABoneProvider(&Log, &LogAtSite);
+	SetUpBones(*provider);
+	SdkMock().model_ms = SLOW_MODEL_MS;
+	provider->Start();
+	Wait(200);
+	CHECK_FAST("stop", Milliseconds([&] { provider->Stop(); }));
+	CHECK_FAST("delete", Milliseconds([&] { delete provider; }));
+	SdkMock().model_ms = 0;
+
+	// The abandoned tracker is destroyed once it is loaded
+	for (int waited = 0; SdkMock().trackers != 0 && waited < 2 * SLOW_MODEL_MS; waited += 10)
+		Wait(10);
+	CHECK(SdkMock().trackers == 0);
+}
+
+static void TestDestroyRunning()
+{
+	K4ABoneProvider* provider = new K4ABoneProvider(&Log, &LogAtSite);
+	SetUpBones(*provider);
+	provider->Start();
+	Wait(700);
+	CHECK_FAST("delete", Milliseconds([&] { delete provider; }));
+	CHECK(SdkMock().trackers == 0);
+}
+
+typedef struct _bone_provider_test
+{
+	const char* name;
+	void(*run)();
+} bone_provider_test_t;
+
+int main()
+{
+	static const bone_provider_test_t tests[] = {
+		{ "stop before activation", TestStopBeforeActivation },
+		{ "stop running", TestStopRunning },
+		{ "stop silent device", TestStopSilentDevice },
+		{ "configure running", TestConfigureRunning },
+		{ "stop in standby", TestStopInStandby },
+		{ "stop during model load", TestStopDuringModelLoad },
+		{ "destroy running", TestDestroyRunning },
+	};
+
+	InstallSdkMock();
+
+	int failed = 0;
+	for (const bone_provider_test_t& test : tests)
+	{
+		int before = s_failures;
+		std::printf("%s\n", test.name);
+		test.run();
+		bool passed = s_failures == before;
+		std::printf("%-24s %s\n", test.name, passed ? "ok" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+#include "buffer_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// Power of two classes for everything else, fixed, then the exact ones
+static const size_t GENERIC_MIN = 4096;
+static const size_t GENERIC_COUNT = 14;
+static const size_t GENERIC_KEEP = 4;
+// Buffers of the depth mode's images kept per capture sized class
+static const size_t IMAGE_KEEP = 8;
+static const size_t INDEX_MAP_KEEP = 4;
+
+// In front of every buffer, keeps the one handed out aligned
+typedef struct alignas(BUFFER_POOL_ALIGNMENT) _buffer_header
+{
+	size_t size;
+	int index;
+} buffer_header_t;
+
+static uint8_t* AlignedAlloc(size_t size)
+{
+#if defined(_MSC_VER)
+	return (uint8_t*)_aligned_malloc(size, BUFFER_POOL_ALIGNMENT);
+#else
+	return (uint8_t*)std::aligned_alloc(BUFFER_POOL_ALIGNMENT, (size + BUFFER_POOL_ALIGNMENT - 1) & ~(size_t)(BUFFER_POOL_ALIGNMENT - 1));
+#endif
+}
+
+static void AlignedFree(uint8_t* block)
+{
+#if defined(_MSC_VER)
+	_aligned_free(block);
+#else
+	std::free(block);
+#endif
+}
+
+BufferPool& BufferPool::Instance()
+{
+	static BufferPool pool;
+	return pool;
+}
+
+bool BufferPool::Install()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_installed)
+		return true;
+
+	if (m_class_count == 0)
+	{
+		m_class_count = GENERIC_COUNT;
+		for (size_t i = 0; i < GENERIC_COUNT; i++)
+		{
+			m_classes[i].size = GENERIC_MIN << i;
+			m_classes[i].keep = GENERIC_KEEP;
+			m_classes[i].free.reserve(GENERIC_KEEP);
+			m_classes[i].outstanding = 0;
+		}
+	}
+
+	m_installed = k4a_set_allocator(&BufferPool::Allocate, &BufferPool::Release) == K4A_RESULT_SUCCEEDED;
+	return m_installed;
+}
+
+int BufferPool::Find(size_t size) const
+{
+	int best = -1;
+	for (size_t i = 0; i < m_class_count; i++)
+	{
+		if (m_classes[i].size >= size && (best < 0 || m_classes[i].size < m_classes[best].size))
+			best = (int)i;
+	}
+	return best;
+}
+
+void BufferPool::Reset(const size_t* sizes, const size_t* keep, size_t count)
+{
+	// Exact classes only, the generic ones may have buffers out at any time
+	for (size_t i = GENERIC_COUNT; i < m_class_count; i++)
+	{
+		for (uint8_t* block : m_classes[i].free)
+			AlignedFree(block);
+		m_stats.cached_bytes -= m_classes[i].free.size() * m_classes[i].size;
+		m_classes[i].free.clear();
+	}
+
+	m_class_count = GENERIC_COUNT;
+	for (size_t i = 0; i < count && m_class_count < BUFFER_POOL_MAX_CLASSES; i++)
+	{
+		size_class_t& size_class = m_classes[m_class_count++];
+		size_class.size = sizes[i];
+		size_class.keep = keep[i];
+		size_class.free.clear();
+		size_class.free.reserve(keep[i]);
+		size_class.outstanding = 0;
+	}
+}
+
+bool BufferPool::Configure(int width, int height)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_class_count < GENERIC_COUNT)
+		return false;
+	for (size_t i = GENERIC_COUNT; i < m_class_count; i++)
+	{
+		if (m_classes[i].outstanding != 0)
+			return false;
+	}
+
+	size_t pixels = (size_t)width * height;
+	size_t sizes[] = { pixels * sizeof(uint16_t), pixels };
+	size_t keep[] = { IMAGE_KEEP, INDEX_MAP_KEEP };
+	Reset(sizes, keep, pixels != 0 ? 2 : 0);
+
+	// Prewarmed so the first captures do not go to the heap either
+	for (size_t i = GENERIC_COUNT; i < m_class_count; i++)
+	{
+		size_class_t& size_class = m_classes[i];
+		while (size_class.free.size() < size_class.keep && m_stats.cached_bytes + size_class.size <= max_cached_bytes)
+		{
+			uint8_t* block = AlignedAlloc(sizeof(buffer_header_t) + size_class.size);
+			if (block == nullptr)
+				break;
+			size_class.free.push_back(block);
+			m_stats.cached_bytes += size_class.size;
+		}
+	}
+	return true;
+}
+
+buffer_pool_stats_t BufferPool::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+uint8_t* BufferPool::Allocate(int size, void** context)
+{
+	BufferPool& pool = Instance();
+	*context = nullptr;
+	if (size <= 0)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(pool.m_mutex);
+	int index = pool.Find((size_t)size);
+	size_t block_size = (index >= 0) ? pool.m_classes[index].size : (size_t)size;
+
+	uint8_t* block = nullptr;
+	if (index >= 0 && !pool.m_classes[index].free.empty())
+	{
+		block = pool.m_classes[index].free.back();
+		pool.m_classes[index].free.pop_back();
+		pool.m_stats.cached_bytes -= block_size;
+		pool.m_stats.hits++;
+	}
+	else
+	{
+		block = AlignedAlloc(sizeof(buffer_header_t) + block_size);
+		if (block == nullptr)
+			return nullptr;
+		pool.m_stats.misses++;
+	}
+
+	buffer_header_t* header = (buffer_header_t*)block;
+	header->size = block_size;
+	header->index = index;
+	if (index >= 0)
+		pool.m_classes[index].outstanding++;
+	pool.m_stats.outstanding_bytes += block_size;
+	pool.m_stats.peak_bytes = std::max(pool.m_stats.peak_bytes, pool.m_stats.outstanding_bytes);
+	return block + sizeof(buffer_header_t);
+}
+
+void BufferPool::Release(void* buffer, void* /*context*/)
+{
+	if (buffer == nullptr)
+		return;
+
+	BufferPool& pool = Instance();
+	uint8_t* block = (uint8_t*)buffer - sizeof(buffer_header_t);
+	buffer_header_t* header = (buffer_header_t*)block;
+
+	std::lock_guard<std::mutex> lock(pool.m_mutex);
+	pool.m_stats.outstanding_bytes -= header->size;
+	if (header->index >= 0 && (size_t)header->index < pool.m_class_count)
+	{
+		size_class_t& size_class = pool.m_classes[header->index];
+		size_class.outstanding--;
+		if (size_class.size == header->size && size_class.free.size() < size_class.keep &&
+			pool.m_stats.cached_bytes + header->size <= pool.max_cached_bytes)
+		{
+			size_class.free.push_back(block);
+			pool.m_stats.cached_bytes += header->size;
+			return;
+		}
+	}
+	AlignedFree(block);
+}
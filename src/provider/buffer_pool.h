@@ -0,0 +1,75 @@
+#pragma once
+#ifndef K4A_OPENVR_BUFFER_POOL_H
+#define K4A_OPENVR_BUFFER_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "k4a/k4a.h"
+
+#define BUFFER_POOL_ALIGNMENT 64
+#define BUFFER_POOL_MAX_CLASSES 24
+
+typedef struct _buffer_pool_stats
+{
+	// Served from a free list, and taken from the heap
+	uint64_t hits;
+	uint64_t misses;
+	// Handed out to the SDK now and at most, and kept in free lists
+	uint64_t outstanding_bytes;
+	uint64_t peak_bytes;
+	uint64_t cached_bytes;
+} buffer_pool_stats_t;
+
+// Allocator for every K4A SDK buffer, installed with k4a_set_allocator.
+// Buffers come from size classes with free lists: exact classes for the
+// images of the configured depth mode, prewarmed, and powers of two for
+// everything else. Released buffers go back to their class up to its keep
+// count and max_cached_bytes overall, so the capture path stops touching the
+// heap once warm and the footprint stays bounded. 64 byte aligned.
+class BufferPool
+{
+public:
+	// The SDK's allocator is process wide, so is the pool
+	static BufferPool& Instance();
+
+	// Installs the pool with the SDK, before any device is opened. False if
+	// the SDK refused, it then keeps its own allocator.
+	bool Install();
+
+	// Exact classes for images of width x height depth pixels: depth and IR
+	// at 16 bits, the body index map at 8. Only while no buffer of the
+	// current classes is out, otherwise the classes stay as they are.
+	bool Configure(int width, int height);
+
+	buffer_pool_stats_t GetStats();
+
+	// Free lists never hold more than this in total
+	uint64_t max_cached_bytes = 96ull << 20;
+
+private:
+	typedef struct _size_class
+	{
+		size_t size;
+		size_t keep;
+		std::vector<uint8_t*> free;
+		// Out with the SDK
+		size_t outstanding;
+	} size_class_t;
+
+	static uint8_t* Allocate(int size, void** context);
+	static void Release(void* buffer, void* context);
+
+	// Smallest class that fits, -1 if none
+	int Find(size_t size) const;
+	void Reset(const size_t* sizes, const size_t* keep, size_t count);
+
+	std::mutex m_mutex;
+	size_class_t m_classes[BUFFER_POOL_MAX_CLASSES];
+	size_t m_class_count = 0;
+	buffer_pool_stats_t m_stats = {};
+	bool m_installed = false;
+};
+
+#endif
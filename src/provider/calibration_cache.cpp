@@ -0,0 +1,74 @@
+#include "calibration_cache.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+CalibrationCache::CalibrationCache()
+{
+	const char* local = std::getenv("LOCALAPPDATA");
+	std::error_code error;
+	std::filesystem::path base = (local != nullptr) ? std::filesystem::path(local) : std::filesystem::temp_directory_path(error);
+	m_directory = (base / "K4AOpenVR").string();
+}
+
+CalibrationCache::CalibrationCache(const std::string& directory) : m_directory(directory)
+{
+}
+
+std::string CalibrationCache::Path(const char* serial) const
+{
+	return (std::filesystem::path(m_directory) / (std::string("calibration_") + serial + ".json")).string();
+}
+
+std::string CalibrationCache::Serial(k4a_device_t device)
+{
+	char serial[64] = {};
+	size_t size = sizeof(serial);
+	if (k4a_device_get_serialnum(device, serial, &size) != K4A_BUFFER_RESULT_SUCCEEDED)
+		return std::string();
+	return std::string(serial);
+}
+
+bool CalibrationCache::Load(const char* serial, k4a_depth_mode_t depth_mode, k4a_calibration_t* calibration) const
+{
+	if (serial == nullptr || serial[0] == '\0')
+		return false;
+
+	std::ifstream file(Path(serial), std::ios::binary);
+	if (!file)
+		return false;
+	std::vector<char> raw((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (raw.empty())
+		return false;
+
+	// The SDK wants the terminating zero counted
+	raw.push_back('\0');
+	return k4a_calibration_get_from_raw(raw.data(), raw.size(), depth_mode, K4A_COLOR_RESOLUTION_OFF, calibration) == K4A_RESULT_SUCCEEDED;
+}
+
+bool CalibrationCache::Fetch(k4a_device_t device, const char* serial, k4a_depth_mode_t depth_mode, k4a_calibration_t* calibration) const
+{
+	size_t size = 0;
+	std::vector<uint8_t> raw;
+	if (k4a_device_get_raw_calibration(device, nullptr, &size) == K4A_BUFFER_RESULT_TOO_SMALL && size > 0)
+	{
+		raw.resize(size);
+		if (k4a_device_get_raw_calibration(device, raw.data(), &size) != K4A_BUFFER_RESULT_SUCCEEDED)
+			raw.clear();
+	}
+
+	if (raw.empty() || k4a_calibration_get_from_raw((char*)raw.data(), raw.size(), depth_mode, K4A_COLOR_RESOLUTION_OFF, calibration) != K4A_RESULT_SUCCEEDED)
+		return k4a_device_get_calibration(device, depth_mode, K4A_COLOR_RESOLUTION_OFF, calibration) == K4A_RESULT_SUCCEEDED;
+
+	// Stored without the terminating zero, a failed write only costs the next start
+	if (serial != nullptr && serial[0] != '\0')
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_directory, error);
+		std::ofstream file(Path(serial), std::ios::binary | std::ios::trunc);
+		size_t length = (raw.back() == 0) ? raw.size() - 1 : raw.size();
+		file.write((const char*)raw.data(), (std::streamsize)length);
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef K4A_OPENVR_CALIBRATION_CACHE_H
+#define K4A_OPENVR_CALIBRATION_CACHE_H
+
+#include <string>
+#include <vector>
+#include "k4a/k4a.h"
+
+// Raw factory calibration blobs kept on disk per device serial number, so
+// startup parses a file instead of reading the blob from the device, and the
+// body tracker can be created before the device is even open.
+class CalibrationCache
+{
+public:
+	// %LOCALAPPDATA%\K4AOpenVR, or the temp directory without it
+	CalibrationCache();
+	explicit CalibrationCache(const std::string& directory);
+
+	// Calibration of serial for depth_mode from the cached blob
+	bool Load(const char* serial, k4a_depth_mode_t depth_mode, k4a_calibration_t* calibration) const;
+
+	// Reads the blob from the open device, stores it, and parses it. Falls
+	// back to k4a_device_get_calibration if the blob cannot be read.
+	bool Fetch(k4a_device_t device, const char* serial, k4a_depth_mode_t depth_mode, k4a_calibration_t* calibration) const;
+
+	// Device serial number, empty on failure
+	static std::string Serial(k4a_device_t device);
+
+private:
+	std::string Path(const char* serial) const;
+
+	std::string m_directory;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "camera_transform.h"
+
+camera_transform_t ComposeCameraTransform(const pose_math::quat& tilt, const pose_math::rigid& calibration)
+{
+	camera_transform_t transform;
+
+	pose_math::quat rotation = pose_math::normalize(calibration.rotation * tilt * CAMERA_AXIS_SWAP);
+
+	transform.position = pose_math::to_mat34(rotation, calibration.translation) * pose_math::scale34(CAMERA_MM_TO_M);
+	transform.rotation = rotation;
+	transform.joint_basis = pose_math::conjugate(CAMERA_AXIS_SWAP);
+
+	return transform;
+}
+
+void ApplyCameraTransform(const camera_transform_t& transform, pose_math::vec3* positions, pose_math::quat* rotations, size_t count)
+{
+	pose_math::transform_points(transform.position, positions, positions, count);
+	pose_math::transform_rotations(transform.rotation, transform.joint_basis, rotations, rotations, count);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef K4A_OPENVR_CAMERA_TRANSFORM_H
+#define K4A_OPENVR_CAMERA_TRANSFORM_H
+
+#include <cstddef>
+#include "math/pose_math.h"
+
+// Every coordinate convention between the K4A depth camera and SteamVR lives
+// here. Joints come out of the body tracker in camera space (millimetres, x
+// right, y down, z forward) and are published in world space (metres), so
+// poses carry an identity qWorldFromDriverRotation/vecWorldFromDriverTranslation.
+//
+// world = calibration * tilt * axis swap * mm to m * camera
+typedef struct _camera_transform
+{
+	// The whole chain for positions, scale included
+	pose_math::mat34 position;
+
+	// Joint orientations become rotation * q * joint_basis. joint_basis maps
+	// the tracker frame back onto the K4A joint frame
+	pose_math::quat rotation;
+	pose_math::quat joint_basis;
+} camera_transform_t;
+
+// Camera z, x, y is driver x, y, z. A cyclic permutation, so a proper rotation:
+// 120 degrees about (1, 1, 1)
+constexpr pose_math::quat CAMERA_AXIS_SWAP = { 0.5F, 0.5F, 0.5F, 0.5F };
+
+constexpr float CAMERA_MM_TO_M = 0.001F;
+
+// Camera space position to driver space, before tilt and calibration. This is
+// the space calibrations map from.
+inline pose_math::vec3 CameraToDriver(const pose_math::vec3& position)
+{
+	return pose_math::rotate(CAMERA_AXIS_SWAP, position * CAMERA_MM_TO_M);
+}
+
+// Mount assumed before the calibrator has run, the camera pitched 90 degrees
+// about x. Calibrations are absolute and replace it.
+inline pose_math::quat DefaultCameraTilt()
+{
+	return pose_math::axis_angle({ 1.F, 0.F, 0.F }, pose_math::PI / 2.F);
+}
+
+// Composes the chain, called whenever the tilt or the calibration changes
+camera_transform_t ComposeCameraTransform(const pose_math::quat& tilt, const pose_math::rigid& calibration);
+
+// World up in camera space, the gradient of world height over the camera axes
+inline pose_math::vec3 CameraUp(const camera_transform_t& transform)
+{
+	return pose_math::normalize(pose_math::vec3{ transform.position.m[1][0], transform.position.m[1][1], transform.position.m[1][2] });
+}
+
+// Camera space joints to world space in one pass, in place
+void ApplyCameraTransform(const camera_transform_t& transform, pose_math::vec3* positions, pose_math::quat* rotations, size_t count);
+
+#endif
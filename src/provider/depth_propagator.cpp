@@ -0,0 +1,209 @@
+#include "depth_propagator.h"
+#include <algorithm>
+#include <cmath>
+
+// Joints followed in the depth image, the pelvis first
+static const k4abt_joint_id_t PROPAGATED_JOINTS[PROPAGATOR_JOINT_COUNT] = {
+	K4ABT_JOINT_PELVIS,
+	K4ABT_JOINT_HIP_LEFT, K4ABT_JOINT_HIP_RIGHT,
+	K4ABT_JOINT_KNEE_LEFT, K4ABT_JOINT_KNEE_RIGHT,
+	K4ABT_JOINT_ANKLE_LEFT, K4ABT_JOINT_ANKLE_RIGHT,
+	K4ABT_JOINT_FOOT_LEFT, K4ABT_JOINT_FOOT_RIGHT
+};
+
+void DepthPropagator::Clear()
+{
+	m_ready = false;
+	for (int i = 0; i < PROPAGATOR_JOINT_COUNT; i++)
+		m_patches[i].valid = false;
+}
+
+bool DepthPropagator::Cut(k4a_image_t depth, int u, int v, patch_t* patch, float* surface) const
+{
+	int radius = std::min(patch_radius, (PROPAGATOR_MAX_PATCH - 1) / 2);
+	int width = k4a_image_get_width_pixels(depth);
+	int height = k4a_image_get_height_pixels(depth);
+	if (u - radius < 0 || v - radius < 0 || u + radius >= width || v + radius >= height)
+		return false;
+
+	const uint8_t* buffer = k4a_image_get_buffer(depth);
+	int stride = k4a_image_get_stride_bytes(depth);
+	int size = 2 * radius + 1;
+
+	uint16_t present[PROPAGATOR_MAX_PATCH * PROPAGATOR_MAX_PATCH];
+	int count = 0;
+	for (int y = 0; y < size; y++)
+	{
+		const uint16_t* row = (const uint16_t*)(buffer + (size_t)(v - radius + y) * stride) + (u - radius);
+		for (int x = 0; x < size; x++)
+		{
+			patch->depth[y * size + x] = row[x];
+			if (row[x] != 0)
+				present[count++] = row[x];
+		}
+	}
+	if (count < min_valid * size * size)
+		return false;
+
+	std::nth_element(present, present + count / 2, present + count);
+	*surface = present[count / 2];
+	patch->u = u;
+	patch->v = v;
+	return true;
+}
+
+void DepthPropagator::Keyframe(const k4a_calibration_t& calibration, k4a_image_t depth, const k4abt_skeleton_t& skeleton)
+{
+	m_skeleton = skeleton;
+	for (int i = 0; i < PROPAGATOR_JOINT_COUNT; i++)
+	{
+		const k4abt_joint_t& joint = skeleton.joints[PROPAGATED_JOINTS[i]];
+		patch_t& patch = m_patches[i];
+		patch.valid = false;
+		if (joint.confidence_level < K4ABT_JOINT_CONFIDENCE_LOW)
+			continue;
+
+		k4a_float2_t pixel;
+		int projected = 0;
+		if (k4a_calibration_3d_to_2d(&calibration, &joint.position, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH,
+			&pixel, &projected) != K4A_RESULT_SUCCEEDED || !projected)
+			continue;
+
+		float surface;
+		if (Cut(depth, (int)std::lround(pixel.xy.x), (int)std::lround(pixel.xy.y), &patch, &surface))
+		{
+			patch.offset = joint.position.xyz.z - surface;
+			patch.valid = true;
+		}
+	}
+	m_ready = m_patches[0].valid;
+}
+
+bool DepthPropagator::Propagate(const k4a_calibration_t& calibration, k4a_image_t depth, k4abt_skeleton_t* skeleton)
+{
+	if (!m_ready)
+		return false;
+
+	int radius = std::min(patch_radius, (PROPAGATOR_MAX_PATCH - 1) / 2);
+	int size = 2 * radius + 1;
+	int width = k4a_image_get_width_pixels(depth);
+	int height = k4a_image_get_height_pixels(depth);
+	const uint8_t* buffer = k4a_image_get_buffer(depth);
+	int stride = k4a_image_get_stride_bytes(depth);
+
+	k4abt_skeleton_t next = m_skeleton;
+	k4a_float3_t pelvis_shift = { { 0.F, 0.F, 0.F } };
+	bool moved[PROPAGATOR_JOINT_COUNT] = {};
+
+	for (int i = 0; i < PROPAGATOR_JOINT_COUNT; i++)
+	{
+		patch_t& patch = m_patches[i];
+		if (!patch.valid)
+			continue;
+
+		// Zero mean SAD over every offset in the search window
+		float best = max_error;
+		int best_u = 0;
+		int best_v = 0;
+		for (int dv = -search_radius; dv <= search_radius; dv++)
+		{
+			int top = patch.v + dv - radius;
+			if (top < 0 || top + size > height)
+				continue;
+			for (int du = -search_radius; du <= search_radius; du++)
+			{
+				int left = patch.u + du - radius;
+				if (left < 0 || left + size > width)
+					continue;
+
+				int64_t sum = 0;
+				int count = 0;
+				for (int y = 0; y < size; y++)
+				{
+					const uint16_t* row = (const uint16_t*)(buffer + (size_t)(top + y) * stride) + left;
+					const uint16_t* reference = patch.depth + y * size;
+					for (int x = 0; x < size; x++)
+					{
+						if (row[x] != 0 && reference[x] != 0)
+						{
+							sum += (int)row[x] - (int)reference[x];
+							count++;
+						}
+					}
+				}
+				if (count < min_valid * size * size)
+					continue;
+
+				float mean = (float)sum / count;
+				float error = 0.F;
+				for (int y = 0; y < size; y++)
+				{
+					const uint16_t* row = (const uint16_t*)(buffer + (size_t)(top + y) * stride) + left;
+					const uint16_t* reference = patch.depth + y * size;
+					for (int x = 0; x < size; x++)
+						if (row[x] != 0 && reference[x] != 0)
+							error += std::fabs((float)row[x] - (float)reference[x] - mean);
+				}
+				error /= count;
+
+				if (error < best)
+				{
+					best = error;
+					best_u = patch.u + du;
+					best_v = patch.v + dv;
+				}
+			}
+		}
+		if (best >= max_error)
+			continue;
+
+		patch_t found;
+		float surface;
+		if (!Cut(depth, best_u, best_v, &found, &surface))
+			continue;
+
+		k4a_float2_t pixel = { { (float)best_u, (float)best_v } };
+		k4a_float3_t position;
+		int unprojected = 0;
+		if (k4a_calibration_2d_to_3d(&calibration, &pixel, surface + patch.offset, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH,
+			&position, &unprojected) != K4A_RESULT_SUCCEEDED || !unprojected)
+			continue;
+
+		// Tracks against the newest appearance, the next keyframe resets any drift
+		found.offset = patch.offset;
+		found.valid = true;
+		patch = found;
+
+		k4abt_joint_t& joint = next.joints[PROPAGATED_JOINTS[i]];
+		if (i == 0)
+		{
+			pelvis_shift.xyz.x = position.xyz.x - joint.position.xyz.x;
+			pelvis_shift.xyz.y = position.xyz.y - joint.position.xyz.y;
+			pelvis_shift.xyz.z = position.xyz.z - joint.position.xyz.z;
+		}
+		joint.position = position;
+		moved[i] = true;
+	}
+
+	if (!moved[0])
+		return false;
+
+	// The rest of the body, and joints whose patch was lost, ride on the pelvis
+	bool propagated[K4ABT_JOINT_COUNT] = {};
+	for (int i = 0; i < PROPAGATOR_JOINT_COUNT; i++)
+		propagated[PROPAGATED_JOINTS[i]] = moved[i];
+	for (int j = 0; j < K4ABT_JOINT_COUNT; j++)
+	{
+		if (propagated[j])
+			continue;
+		next.joints[j].position.xyz.x += pelvis_shift.xyz.x;
+		next.joints[j].position.xyz.y += pelvis_shift.xyz.y;
+		next.joints[j].position.xyz.z += pelvis_shift.xyz.z;
+		if (next.joints[j].confidence_level > K4ABT_JOINT_CONFIDENCE_LOW)
+			next.joints[j].confidence_level = K4ABT_JOINT_CONFIDENCE_LOW;
+	}
+
+	m_skeleton = next;
+	*skeleton = next;
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#ifndef K4A_OPENVR_DEPTH_PROPAGATOR_H
+#define K4A_OPENVR_DEPTH_PROPAGATOR_H
+
+#include <cstdint>
+#include "k4a/k4a.h"
+#include "k4abttypes.h"
+
+#define PROPAGATOR_JOINT_COUNT 9
+#define PROPAGATOR_MAX_PATCH 31
+
+// Carries a body tracker skeleton over the depth frames the DNN skips. At a
+// keyframe each lower body joint's depth patch is cut around its projection.
+// On the frames after, the patch is registered in the new depth image by a
+// zero mean SAD search around its last position, so depth changes of the
+// whole patch do not count. The joint follows the patch and keeps its
+// keyframe depth below the surface. Joints not propagated move with the
+// pelvis. Everything is in the depth camera, millimetres and pixels.
+class DepthPropagator
+{
+public:
+	// Takes the patches from the depth image the skeleton was inferred on
+	void Keyframe(const k4a_calibration_t& calibration, k4a_image_t depth, const k4abt_skeleton_t& skeleton);
+
+	// The last skeleton moved to a later depth image. False if there is no
+	// keyframe, or the pelvis is lost.
+	bool Propagate(const k4a_calibration_t& calibration, k4a_image_t depth, k4abt_skeleton_t* skeleton);
+
+	void Clear();
+	bool IsReady() const
+	{
+		return m_ready;
+	};
+
+	// Patch and search half sizes, pixels
+	int patch_radius = 6;
+	int search_radius = 8;
+	// Mean absolute difference above which a match is not trusted, mm
+	float max_error = 30.F;
+	// Pixels of a patch that need a depth for it to be used, fraction
+	float min_valid = 0.5F;
+
+private:
+	typedef struct _patch
+	{
+		bool valid;
+		int u;
+		int v;
+		// Joint depth below the patch's median surface, mm
+		float offset;
+		uint16_t depth[PROPAGATOR_MAX_PATCH * PROPAGATOR_MAX_PATCH];
+	} patch_t;
+
+	// Copies the patch around (u, v), false if too little of it has depth
+	bool Cut(k4a_image_t depth, int u, int v, patch_t* patch, float* surface) const;
+
+	patch_t m_patches[PROPAGATOR_JOINT_COUNT];
+	k4abt_skeleton_t m_skeleton;
+	bool m_ready = false;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "depth_unprojector.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define DEPTH_UNPROJECTOR_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2,popcnt")))
+#endif
+#endif
+
+void DepthPoints::Reserve(const depth_roi_t& roi)
+{
+	pitch = DepthUnprojector::Pitch(std::max(roi.width, 0));
+	rows = std::max(roi.height, 0);
+	size_t blocks = std::max((size_t)pitch * rows / 8, (size_t)1);
+	if (m_x.size() < blocks)
+	{
+		m_x.resize(blocks);
+		m_y.resize(blocks);
+		m_z.resize(blocks);
+	}
+}
+
+#if defined(DEPTH_UNPROJECTOR_AVX2)
+static bool HasAvx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// The OS saves the YMM registers
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Eight pixels a step, the scalar tail left to the caller. Returns the pixels done.
+AVX2_TARGET static int UnprojectRowAvx2(const uint16_t* depth, const float* ray_x, const float* ray_y, const float* ray_z,
+	int width, float* x, float* y, float* z, size_t* count)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	size_t valid = 0;
+	int u = 0;
+	for (; u + 8 <= width; u += 8)
+	{
+		__m128i raw = _mm_loadu_si128((const __m128i*)(depth + u));
+		__m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(raw));
+		__m256 pz = _mm256_mul_ps(_mm256_loadu_ps(ray_z + u), d);
+		// Output rows start 32 byte aligned and u steps by 8
+		_mm256_store_ps(x + u, _mm256_mul_ps(_mm256_loadu_ps(ray_x + u), d));
+		_mm256_store_ps(y + u, _mm256_mul_ps(_mm256_loadu_ps(ray_y + u), d));
+		_mm256_store_ps(z + u, pz);
+		valid += (size_t)_mm_popcnt_u32((unsigned)_mm256_movemask_ps(_mm256_cmp_ps(pz, zero, _CMP_GT_OQ)));
+	}
+	*count += valid;
+	return u;
+}
+#endif
+
+void DepthUnprojector::SetCalibration(const k4a_calibration_t& calibration)
+{
+	m_calibration = calibration;
+	m_width = calibration.depth_camera_calibration.resolution_width;
+	m_height = calibration.depth_camera_calibration.resolution_height;
+	size_t size = (size_t)m_width * m_height;
+	m_ray_x.assign(size, 0.F);
+	m_ray_y.assign(size, 0.F);
+	m_ray_z.assign(size, 0.F);
+
+	for (int v = 0; v < m_height; v++)
+	{
+		for (int u = 0; u < m_width; u++)
+		{
+			k4a_float2_t pixel = { { (float)u, (float)v } };
+			k4a_float3_t ray;
+			int valid = 0;
+			if (k4a_calibration_2d_to_3d(&calibration, &pixel, 1000.F, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH,
+				&ray, &valid) == K4A_RESULT_SUCCEEDED && valid)
+			{
+				size_t i = (size_t)v * m_width + u;
+				m_ray_x[i] = ray.xyz.x / 1000.F;
+				m_ray_y[i] = ray.xyz.y / 1000.F;
+				m_ray_z[i] = 1.F;
+			}
+		}
+	}
+
+#if defined(DEPTH_UNPROJECTOR_AVX2)
+	m_avx2 = HasAvx2();
+#endif
+}
+
+size_t DepthUnprojector::Unproject(k4a_image_t depth, const depth_roi_t& roi, float* x, float* y, float* z) const
+{
+	if (m_width == 0 || depth == nullptr || k4a_image_get_width_pixels(depth) != m_width || k4a_image_get_height_pixels(depth) != m_height)
+		return 0;
+
+	int pitch = Pitch(roi.width);
+	int left = std::max(roi.left, 0);
+	int right = std::min(roi.left + roi.width, m_width);
+	int top = std::max(roi.top, 0);
+	int bottom = std::min(roi.top + roi.height, m_height);
+	if (right <= left || bottom <= top)
+	{
+		if (roi.width > 0 && roi.height > 0)
+		{
+			std::memset(x, 0, sizeof(float) * pitch * roi.height);
+			std::memset(y, 0, sizeof(float) * pitch * roi.height);
+			std::memset(z, 0, sizeof(float) * pitch * roi.height);
+		}
+		return 0;
+	}
+
+	const uint8_t* buffer = k4a_image_get_buffer(depth);
+	int stride = k4a_image_get_stride_bytes(depth);
+	size_t count = 0;
+
+	for (int r = 0; r < roi.height; r++)
+	{
+		float* out_x = x + (size_t)r * pitch;
+		float* out_y = y + (size_t)r * pitch;
+		float* out_z = z + (size_t)r * pitch;
+		int v = roi.top + r;
+		if (v < top || v >= bottom)
+		{
+			std::fill(out_x, out_x + pitch, 0.F);
+			std::fill(out_y, out_y + pitch, 0.F);
+			std::fill(out_z, out_z + pitch, 0.F);
+			continue;
+		}
+
+		// Columns outside the image, and the pitch padding, are empty
+		int skip = left - roi.left;
+		std::fill(out_x, out_x + skip, 0.F);
+		std::fill(out_y, out_y + skip, 0.F);
+		std::fill(out_z, out_z + skip, 0.F);
+		std::fill(out_x + (right - roi.left), out_x + pitch, 0.F);
+		std::fill(out_y + (right - roi.left), out_y + pitch, 0.F);
+		std::fill(out_z + (right - roi.left), out_z + pitch, 0.F);
+
+		const uint16_t* row = (const uint16_t*)(buffer + (size_t)v * stride) + left;
+		size_t offset = (size_t)v * m_width + left;
+		const float* ray_x = m_ray_x.data() + offset;
+		const float* ray_y = m_ray_y.data() + offset;
+		const float* ray_z = m_ray_z.data() + offset;
+		int width = right - left;
+		int u = 0;
+
+#if defined(DEPTH_UNPROJECTOR_AVX2)
+		// Aligned stores need the clipped start on a block boundary
+		if (m_avx2 && use_simd && skip % 8 == 0)
+			u = UnprojectRowAvx2(row, ray_x, ray_y, ray_z, width, out_x + skip, out_y + skip, out_z + skip, &count);
+#endif
+		for (; u < width; u++)
+		{
+			float d = row[u];
+			out_x[skip + u] = ray_x[u] * d;
+			out_y[skip + u] = ray_y[u] * d;
+			out_z[skip + u] = ray_z[u] * d;
+			if (out_z[skip + u] > 0.F)
+				count++;
+		}
+	}
+	return count;
+}
+
+size_t DepthUnprojector::Unproject(k4a_image_t depth, const depth_roi_t& roi, DepthPoints& points) const
+{
+	points.Reserve(roi);
+	return Unproject(depth, roi, points.x(), points.y(), points.z());
+}
+
+size_t DepthUnprojector::Unproject(k4a_image_t depth, DepthPoints& points) const
+{
+	depth_roi_t frame = { 0, 0, m_width, m_height };
+	return Unproject(depth, frame, points);
+}
+
+size_t DepthUnprojector::Unproject(k4a_image_t depth, int step, DepthPoints& points) const
+{
+	if (step <= 1)
+		return Unproject(depth, points);
+
+	depth_roi_t sampled = { 0, 0, (m_width + step - 1) / step, (m_height + step - 1) / step };
+	points.Reserve(sampled);
+	if (m_width == 0 || depth == nullptr || k4a_image_get_width_pixels(depth) != m_width || k4a_image_get_height_pixels(depth) != m_height)
+	{
+		points.rows = 0;
+		return 0;
+	}
+
+	const uint8_t* buffer = k4a_image_get_buffer(depth);
+	int stride = k4a_image_get_stride_bytes(depth);
+	size_t count = 0;
+
+	for (int r = 0; r < sampled.height; r++)
+	{
+		float* out_x = points.x() + (size_t)r * points.pitch;
+		float* out_y = points.y() + (size_t)r * points.pitch;
+		float* out_z = points.z() + (size_t)r * points.pitch;
+		int v = r * step;
+		const uint16_t* row = (const uint16_t*)(buffer + (size_t)v * stride);
+		size_t offset = (size_t)v * m_width;
+
+		for (int c = 0; c < sampled.width; c++)
+		{
+			int u = c * step;
+			float d = row[u];
+			out_x[c] = m_ray_x[offset + u] * d;
+			out_y[c] = m_ray_y[offset + u] * d;
+			out_z[c] = m_ray_z[offset + u] * d;
+			if (out_z[c] > 0.F)
+				count++;
+		}
+		std::fill(out_x + sampled.width, out_x + points.pitch, 0.F);
+		std::fill(out_y + sampled.width, out_y + points.pitch, 0.F);
+		std::fill(out_z + sampled.width, out_z + points.pitch, 0.F);
+	}
+	return count;
+}
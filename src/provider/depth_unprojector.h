@@ -0,0 +1,126 @@
+#pragma once
+#ifndef K4A_OPENVR_DEPTH_UNPROJECTOR_H
+#define K4A_OPENVR_DEPTH_UNPROJECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "k4a/k4a.h"
+
+// Rectangle of depth camera pixels
+typedef struct _depth_roi
+{
+	int left;
+	int top;
+	int width;
+	int height;
+} depth_roi_t;
+
+// One 32 byte aligned block of an output plane
+typedef struct alignas(32) _depth_lanes
+{
+	float lane[8];
+} depth_lanes_t;
+
+// Caller owned output of DepthUnprojector, planes of x, y and z. Row r of the
+// region starts at r * pitch. Keep one around, Reserve only grows it.
+class DepthPoints
+{
+public:
+	void Reserve(const depth_roi_t& roi);
+
+	float* x()
+	{
+		return m_x.data()->lane;
+	};
+	float* y()
+	{
+		return m_y.data()->lane;
+	};
+	float* z()
+	{
+		return m_z.data()->lane;
+	};
+	const float* x() const
+	{
+		return m_x.data()->lane;
+	};
+	const float* y() const
+	{
+		return m_y.data()->lane;
+	};
+	const float* z() const
+	{
+		return m_z.data()->lane;
+	};
+
+	int pitch = 0;
+	int rows = 0;
+
+private:
+	std::vector<depth_lanes_t> m_x;
+	std::vector<depth_lanes_t> m_y;
+	std::vector<depth_lanes_t> m_z;
+};
+
+// Depth image to camera space points without the SDK's point cloud
+// transformation, which allocates and converts every pixel of the frame.
+// Each pixel's ray is computed once from the calibration; a point is then
+// its ray scaled by the depth, eight pixels at a time with AVX2 where the
+// CPU has it. Pixels without a ray or a depth come out as (0, 0, 0), as they
+// do from the SDK. Camera space millimetres, depth camera pixels.
+class DepthUnprojector
+{
+public:
+	// Builds the ray table for the calibration's depth mode, slow, call once
+	void SetCalibration(const k4a_calibration_t& calibration);
+
+	// Unprojects roi of depth, clipped to the image, into planes of
+	// Pitch(roi.width) * roi.height floats each, 32 byte aligned. Returns the
+	// number of points with a depth, 0 if depth does not match the table.
+	size_t Unproject(k4a_image_t depth, const depth_roi_t& roi, float* x, float* y, float* z) const;
+	size_t Unproject(k4a_image_t depth, const depth_roi_t& roi, DepthPoints& points) const;
+	// The whole frame
+	size_t Unproject(k4a_image_t depth, DepthPoints& points) const;
+	// Every step-th pixel of every step-th row of the frame, for what only
+	// needs a sample of it. Scalar, the SIMD path needs contiguous pixels.
+	size_t Unproject(k4a_image_t depth, int step, DepthPoints& points) const;
+
+	// Floats between output rows, a multiple of 8
+	static int Pitch(int width)
+	{
+		return (width + 7) & ~7;
+	};
+
+	bool IsReady() const
+	{
+		return m_width > 0;
+	};
+	int GetWidth() const
+	{
+		return m_width;
+	};
+	int GetHeight() const
+	{
+		return m_height;
+	};
+	const k4a_calibration_t& GetCalibration() const
+	{
+		return m_calibration;
+	};
+
+	// False forces the scalar path, to compare against
+	bool use_simd = true;
+
+private:
+	k4a_calibration_t m_calibration = {};
+	// Per pixel x / z, y / z, and 1 or 0 for pixels with a ray
+	std::vector<float> m_ray_x;
+	std::vector<float> m_ray_y;
+	std::vector<float> m_ray_z;
+	int m_width = 0;
+	int m_height = 0;
+	bool m_avx2 = false;
+};
+
+#endif
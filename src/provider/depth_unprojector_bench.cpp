@@ -0,0 +1,234 @@
+// Plays a recording through DepthUnprojector, scalar and AVX2, and through
+// the SDK's k4a_transformation_depth_image_to_point_cloud. Prints the time of
+// each per frame and checks the three agree. Also times FloorDetector on
+// every frame, gravity from the recording's IMU. Run it by hand:
+//   depth_unprojector_bench file.mkv [frames]
+// Returns non zero if the paths disagree.
+
+#include "depth_unprojector.h"
+#include "floor_detector.h"
+#include "imu_tracker.h"
+#include "camera_transform.h"
+#include <k4arecord/playback.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+typedef std::chrono::steady_clock bench_clock;
+
+// The SDK rounds to whole millimetres and builds its own ray table, so allow
+// a little more than the rounding
+static const float SDK_TOLERANCE_MM = 2.F;
+
+typedef struct _bench_stats
+{
+	double scalar_ms = 0.0;
+	double simd_ms = 0.0;
+	double sdk_ms = 0.0;
+	size_t frames = 0;
+	size_t points = 0;
+	// Scalar against AVX2, exact
+	size_t simd_mismatches = 0;
+	// Ours against the SDK's, within SDK_TOLERANCE_MM, and pixels one has and the other not
+	size_t sdk_mismatches = 0;
+	size_t sdk_coverage = 0;
+	float sdk_worst = 0.F;
+	// Strided unprojection and RANSAC, the floor thread's work per request
+	double floor_ms = 0.0;
+	double floor_worst_ms = 0.0;
+	size_t floors = 0;
+	float floor_height = 0.F;
+} bench_stats_t;
+
+// IMU samples the gravity estimate settles over, seconds
+static const float IMU_SETTLE_TIME = 2.F;
+
+// Gravity's up in the depth camera from the start of the recording, the
+// camera standing level without an IMU track
+static pose_math::vec3 RecordedUp(k4a_playback_t playback, const k4a_calibration_t& calibration)
+{
+	ImuTracker tracker;
+	k4a_imu_sample_t sample;
+	uint64_t first_us = 0;
+	uint64_t last_us = 0;
+	while (k4a_playback_get_next_imu_sample(playback, &sample) == K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		float dt = (last_us != 0 && sample.acc_timestamp_usec > last_us) ? (float)(sample.acc_timestamp_usec - last_us) * 1e-6F : 0.F;
+		if (first_us == 0)
+			first_us = sample.acc_timestamp_usec;
+		last_us = sample.acc_timestamp_usec;
+		tracker.Update(SensorToDepth(calibration, K4A_CALIBRATION_TYPE_ACCEL, pose_math::to_vec3(sample.acc_sample)),
+			SensorToDepth(calibration, K4A_CALIBRATION_TYPE_GYRO, pose_math::to_vec3(sample.gyro_sample)), dt);
+		if (last_us > first_us + (uint64_t)(IMU_SETTLE_TIME * 1e6F))
+			break;
+	}
+	if (tracker.HasUp())
+		return tracker.GetUp();
+	std::printf("No IMU track, floor searched with the camera taken as level\n");
+	return CameraUp(ComposeCameraTransform(DefaultCameraTilt(), pose_math::identity_rigid()));
+}
+
+static double MillisecondsSince(bench_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static void Compare(const DepthUnprojector& unprojector, const DepthPoints& scalar, const DepthPoints& simd,
+	k4a_image_t cloud, bench_stats_t& stats)
+{
+	int width = unprojector.GetWidth();
+	int height = unprojector.GetHeight();
+	const int16_t* sdk = (const int16_t*)k4a_image_get_buffer(cloud);
+
+	for (int v = 0; v < height; v++)
+	{
+		for (int u = 0; u < width; u++)
+		{
+			size_t i = (size_t)v * scalar.pitch + u;
+			if (scalar.x()[i] != simd.x()[i] || scalar.y()[i] != simd.y()[i] || scalar.z()[i] != simd.z()[i])
+				stats.simd_mismatches++;
+
+			const int16_t* p = sdk + ((size_t)v * width + u) * 3;
+			bool ours = scalar.z()[i] > 0.F;
+			bool theirs = p[2] > 0;
+			if (ours != theirs)
+			{
+				stats.sdk_coverage++;
+				continue;
+			}
+			if (!ours)
+				continue;
+
+			float error = std::fmax(std::fabs(scalar.x()[i] - p[0]),
+				std::fmax(std::fabs(scalar.y()[i] - p[1]), std::fabs(scalar.z()[i] - p[2])));
+			if (error > stats.sdk_worst)
+				stats.sdk_worst = error;
+			if (error > SDK_TOLERANCE_MM)
+				stats.sdk_mismatches++;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "Usage: %s file.mkv [frames]\n", argv[0]);
+		return 2;
+	}
+	size_t max_frames = (argc > 2) ? (size_t)std::atoi(argv[2]) : 300;
+
+	k4a_playback_t playback = nullptr;
+	if (k4a_playback_open(argv[1], &playback) != K4A_RESULT_SUCCEEDED)
+	{
+		std::fprintf(stderr, "Open recording %s failed\n", argv[1]);
+		return 2;
+	}
+
+	k4a_calibration_t calibration;
+	if (k4a_playback_get_calibration(playback, &calibration) != K4A_RESULT_SUCCEEDED)
+	{
+		std::fprintf(stderr, "Recording has no calibration\n");
+		k4a_playback_close(playback);
+		return 2;
+	}
+
+	bench_clock::time_point start = bench_clock::now();
+	DepthUnprojector unprojector;
+	unprojector.SetCalibration(calibration);
+	std::printf("Ray table %dx%d in %.0f ms\n", unprojector.GetWidth(), unprojector.GetHeight(), MillisecondsSince(start));
+
+	int width = unprojector.GetWidth();
+	int height = unprojector.GetHeight();
+	k4a_transformation_t transformation = k4a_transformation_create(&calibration);
+	k4a_image_t cloud = nullptr;
+	if (transformation == nullptr || k4a_image_create(K4A_IMAGE_FORMAT_CUSTOM, width, height,
+		width * 3 * (int)sizeof(int16_t), &cloud) != K4A_RESULT_SUCCEEDED)
+	{
+		std::fprintf(stderr, "Create transformation failed\n");
+		if (transformation)
+			k4a_transformation_destroy(transformation);
+		k4a_playback_close(playback);
+		return 2;
+	}
+
+	pose_math::vec3 up = RecordedUp(playback, calibration);
+	FloorDetector detector;
+
+	DepthPoints scalar;
+	DepthPoints simd;
+	bench_stats_t stats;
+	k4a_capture_t capture = nullptr;
+
+	while (stats.frames < max_frames && k4a_playback_get_next_capture(playback, &capture) == K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		k4a_image_t depth = k4a_capture_get_depth_image(capture);
+		if (depth == nullptr)
+		{
+			k4a_capture_release(capture);
+			continue;
+		}
+
+		unprojector.use_simd = false;
+		start = bench_clock::now();
+		size_t points = unprojector.Unproject(depth, scalar);
+		stats.scalar_ms += MillisecondsSince(start);
+
+		unprojector.use_simd = true;
+		start = bench_clock::now();
+		unprojector.Unproject(depth, simd);
+		stats.simd_ms += MillisecondsSince(start);
+
+		start = bench_clock::now();
+		k4a_result_t result = k4a_transformation_depth_image_to_point_cloud(transformation, depth, K4A_CALIBRATION_TYPE_DEPTH, cloud);
+		stats.sdk_ms += MillisecondsSince(start);
+
+		if (result == K4A_RESULT_SUCCEEDED)
+			Compare(unprojector, scalar, simd, cloud, stats);
+		else
+			std::fprintf(stderr, "SDK point cloud failed on frame %zu\n", stats.frames);
+
+		floor_plane_t floor;
+		start = bench_clock::now();
+		detector.Detect(unprojector, depth, up, &floor);
+		double floor_ms = MillisecondsSince(start);
+		stats.floor_ms += floor_ms;
+		stats.floor_worst_ms = std::fmax(stats.floor_worst_ms, floor_ms);
+		if (floor.valid)
+		{
+			stats.floors++;
+			stats.floor_height = floor.height;
+		}
+
+		stats.points += points;
+		stats.frames++;
+		k4a_image_release(depth);
+		k4a_capture_release(capture);
+	}
+
+	k4a_image_release(cloud);
+	k4a_transformation_destroy(transformation);
+	k4a_playback_close(playback);
+
+	if (stats.frames == 0)
+	{
+		std::fprintf(stderr, "No depth frames in %s\n", argv[1]);
+		return 2;
+	}
+
+	double frames = (double)stats.frames;
+	std::printf("%zu frames, %.0f points each\n", stats.frames, (double)stats.points / frames);
+	std::printf("scalar %.3f ms, avx2 %.3f ms (%.1fx), sdk %.3f ms (%.1fx)\n", stats.scalar_ms / frames,
+		stats.simd_ms / frames, stats.scalar_ms / stats.simd_ms, stats.sdk_ms / frames, stats.sdk_ms / stats.simd_ms);
+	std::printf("avx2 vs scalar: %zu mismatches\n", stats.simd_mismatches);
+	std::printf("sdk vs scalar: %zu over %.0f mm, worst %.2f mm, %zu pixels in one only\n", stats.sdk_mismatches,
+		SDK_TOLERANCE_MM, stats.sdk_worst, stats.sdk_coverage);
+	std::printf("floor %.3f ms, worst %.3f ms, stride %d, %d hypotheses: found in %zu frames, the last at %.0f mm along up\n",
+		stats.floor_ms / frames, stats.floor_worst_ms, detector.stride, detector.iterations, stats.floors, stats.floor_height);
+
+	// A few edge pixels where the two ray tables disagree on validity are fine
+	bool agree = stats.simd_mismatches == 0 && stats.sdk_mismatches == 0 &&
+		(double)stats.sdk_coverage <= 0.001 * (double)width * (double)height * frames;
+	return agree ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "device_supervisor.h"
+#include <algorithm>
+
+static uint64_t Microseconds(float seconds)
+{
+	return (uint64_t)(seconds * 1e6F);
+}
+
+void DeviceSupervisor::Reset(uint64_t now_us)
+{
+	m_state = SUPERVISOR_OPEN;
+	m_failures = 0;
+	m_last_capture_us = now_us;
+	m_running_us = 0;
+	m_backoff = initial_backoff;
+	m_retry_us = now_us;
+	m_down_us = 0;
+	m_downtime_us = 0;
+	m_outage_us = 0;
+	m_faults = 0;
+	m_reconnects = 0;
+	m_failed_attempts = 0;
+}
+
+void DeviceSupervisor::Enter(SupervisorState stage)
+{
+	m_state = stage;
+}
+
+void DeviceSupervisor::Running(uint64_t now_us)
+{
+	if (m_down_us != 0)
+	{
+		m_outage_us = now_us - m_down_us;
+		m_downtime_us += m_outage_us;
+		m_down_us = 0;
+		m_reconnects++;
+	}
+	m_state = SUPERVISOR_RUNNING;
+	m_failures = 0;
+	m_last_capture_us = now_us;
+	m_running_us = now_us;
+}
+
+void DeviceSupervisor::Fault(uint64_t now_us)
+{
+	if (m_state == SUPERVISOR_RUNNING || m_state == SUPERVISOR_STANDBY)
+	{
+		m_faults++;
+		m_down_us = now_us;
+	}
+	else
+	{
+		m_failed_attempts++;
+		// Down from the first failed start too
+		if (m_down_us == 0)
+			m_down_us = now_us;
+	}
+	m_state = SUPERVISOR_FAULTED;
+}
+
+void DeviceSupervisor::Backoff(uint64_t now_us)
+{
+	m_state = SUPERVISOR_BACKOFF;
+	m_retry_us = now_us + Microseconds(m_backoff);
+	m_backoff = std::min(m_backoff * 2.F, max_backoff);
+}
+
+bool DeviceSupervisor::IsDue(uint64_t now_us) const
+{
+	return m_state != SUPERVISOR_BACKOFF || now_us >= m_retry_us;
+}
+
+void DeviceSupervisor::Captured(uint64_t now_us)
+{
+	m_failures = 0;
+	m_last_capture_us = now_us;
+	if (m_running_us != 0 && now_us > m_running_us + Microseconds(stable_time))
+	{
+		m_backoff = initial_backoff;
+		m_running_us = 0;
+	}
+}
+
+bool DeviceSupervisor::CaptureFailed(uint64_t now_us)
+{
+	return ++m_failures >= max_failures || CaptureTimedOut(now_us);
+}
+
+bool DeviceSupervisor::CaptureTimedOut(uint64_t now_us)
+{
+	return now_us > m_last_capture_us + Microseconds(capture_timeout);
+}
+
+supervisor_stats_t DeviceSupervisor::GetStats(uint64_t now_us) const
+{
+	supervisor_stats_t stats;
+	stats.state = m_state;
+	stats.faults = m_faults;
+	stats.reconnects = m_reconnects;
+	stats.failed_attempts = m_failed_attempts;
+	uint64_t outage_us = (m_down_us != 0 && now_us > m_down_us) ? now_us - m_down_us : 0;
+	stats.downtime = (float)(m_downtime_us + outage_us) * 1e-6F;
+	stats.outage = (float)(m_down_us != 0 ? outage_us : m_outage_us) * 1e-6F;
+	stats.retry_in = (m_state == SUPERVISOR_BACKOFF && m_retry_us > now_us) ? (float)(m_retry_us - now_us) * 1e-6F : 0.F;
+	return stats;
+}
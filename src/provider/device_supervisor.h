@@ -0,0 +1,100 @@
+#pragma once
+#ifndef K4A_OPENVR_DEVICE_SUPERVISOR_H
+#define K4A_OPENVR_DEVICE_SUPERVISOR_H
+
+#include <cstdint>
+
+typedef enum _SupervisorState
+{
+	// Setup, in order
+	SUPERVISOR_OPEN,
+	SUPERVISOR_CONFIGURE,
+	SUPERVISOR_START_CAMERAS,
+	SUPERVISOR_CREATE_TRACKER,
+	SUPERVISOR_RUNNING,
+	// A setup stage failed or the device was lost, to be torn down
+	SUPERVISOR_FAULTED,
+	// Torn down, waiting to open again
+	SUPERVISOR_BACKOFF,
+	// SteamVR is in standby, the cameras are off or only look for a body
+	SUPERVISOR_STANDBY
+} SupervisorState;
+
+typedef struct _supervisor_stats
+{
+	SupervisorState state;
+	// Times the device was lost while running, and brought back after
+	uint32_t faults;
+	uint32_t reconnects;
+	// Setup attempts that failed
+	uint32_t failed_attempts;
+	// Time out of running after a fault, in total and the current or last
+	// outage, seconds
+	float downtime;
+	float outage;
+	// Until the next attempt while backing off, seconds
+	float retry_in;
+} supervisor_stats_t;
+
+// Keeps the device coming back. The bone thread reports every setup stage
+// and every capture, the supervisor decides when the device is gone: a run of
+// failed captures (the USB link dropped) or no capture for capture_timeout.
+// A fault is torn down by the bone thread, then setup starts over after a
+// backoff that doubles per failed attempt up to max_backoff, and drops back
+// once the device has run for stable_time. Time is passed in, nothing here
+// touches the SDK.
+class DeviceSupervisor
+{
+public:
+	void Reset(uint64_t now_us);
+
+	// A setup stage begins, SUPERVISOR_OPEN to SUPERVISOR_CREATE_TRACKER
+	void Enter(SupervisorState stage);
+	// Setup is done
+	void Running(uint64_t now_us);
+	// The current stage failed, or the running or standing by device was lost
+	void Fault(uint64_t now_us);
+	// Torn down after a fault, setup waits out the backoff
+	void Backoff(uint64_t now_us);
+	// The backoff is over, setup can start again
+	bool IsDue(uint64_t now_us) const;
+
+	// Captures while running or standing by. CaptureFailed and CaptureTimedOut return true
+	// once the device counts as lost.
+	void Captured(uint64_t now_us);
+	bool CaptureFailed(uint64_t now_us);
+	bool CaptureTimedOut(uint64_t now_us);
+
+	SupervisorState GetState() const
+	{
+		return m_state;
+	};
+	supervisor_stats_t GetStats(uint64_t now_us) const;
+
+	// Failed captures in a row that mean the device is gone
+	uint32_t max_failures = 3;
+	// No capture for this long while running is a fault, seconds
+	float capture_timeout = 2.F;
+	float initial_backoff = 0.5F;
+	float max_backoff = 30.F;
+	// Running this long resets the backoff, seconds
+	float stable_time = 10.F;
+
+private:
+	SupervisorState m_state = SUPERVISOR_OPEN;
+	uint32_t m_failures = 0;
+	uint64_t m_last_capture_us = 0;
+	uint64_t m_running_us = 0;
+	float m_backoff = 0.F;
+	uint64_t m_retry_us = 0;
+
+	// Down since, 0 while running or before the first fault
+	uint64_t m_down_us = 0;
+	uint64_t m_downtime_us = 0;
+	uint64_t m_outage_us = 0;
+	uint32_t m_faults = 0;
+	uint32_t m_reconnects = 0;
+	uint32_t m_failed_attempts = 0;
+};
+
+#endif
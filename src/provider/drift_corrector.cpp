@@ -0,0 +1,75 @@
+#include "drift_corrector.h"
+#include <algorithm>
+
+void DriftCorrector::Reset(const pose_math::rigid& calibration)
+{
+	m_sums.clear();
+	m_has_last = false;
+	m_calibration = calibration;
+	m_diagnostics = { DRIFT_REFERENCE, 0.F, 0.F, 0.F, 0.F, 0.F };
+}
+
+bool DriftCorrector::Update(const pose_math::vec3& head, const pose_math::vec3& hmd_head, float dt)
+{
+	if (m_diagnostics.state == DRIFT_IDLE)
+		return false;
+
+	m_sums.scale(std::exp(-dt / window));
+
+	// Standing still would collapse the window onto one point
+	if (!m_has_last || pose_math::length(head - m_last_head) >= min_step)
+	{
+		m_sums.add(head, hmd_head);
+		m_last_head = head;
+		m_has_last = true;
+	}
+
+	pose_math::rigid_fit_result fit = pose_math::solve(m_sums);
+	m_diagnostics.residual = fit.rms;
+	m_diagnostics.spread = fit.spread;
+	m_diagnostics.weight = (float)m_sums.weight;
+
+	if (!fit.valid || m_sums.weight < min_weight || fit.spread < min_spread || fit.rms > max_residual)
+		return false;
+
+	if (m_diagnostics.state == DRIFT_REFERENCE)
+	{
+		m_reference_calibration = m_calibration;
+		m_reference_fit = fit.transform;
+		m_diagnostics.state = DRIFT_TRACKING;
+		return false;
+	}
+
+	pose_math::rigid target = m_reference_calibration * pose_math::inverse(m_reference_fit) * fit.transform;
+
+	float angle = pose_math::angle_between(m_calibration.rotation, target.rotation);
+	pose_math::vec3 error = target.translation - m_calibration.translation;
+	float offset = pose_math::length(error);
+	m_diagnostics.angle = angle;
+	m_diagnostics.offset = offset;
+
+	float scale = (m_diagnostics.state == DRIFT_CORRECTING) ? 0.5F : 1.F;
+	if (angle < angle_tolerance * scale && offset < offset_tolerance * scale)
+	{
+		m_diagnostics.state = DRIFT_TRACKING;
+		return false;
+	}
+	m_diagnostics.state = DRIFT_CORRECTING;
+
+	if (angle > 0.F)
+		m_calibration.rotation = pose_math::slerp(m_calibration.rotation, target.rotation,
+			std::min(1.F, max_angular_rate * dt / angle));
+	if (offset > 0.F)
+		m_calibration.translation = m_calibration.translation + error * std::min(1.F, max_linear_rate * dt / offset);
+
+	return true;
+}
+
+bool DriftCorrector::GetWorldFromRaw(pose_math::rigid* world_from_raw) const
+{
+	if (m_diagnostics.state != DRIFT_TRACKING && m_diagnostics.state != DRIFT_CORRECTING)
+		return false;
+
+	*world_from_raw = m_reference_calibration * pose_math::inverse(m_reference_fit);
+	return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef K4A_OPENVR_DRIFT_CORRECTOR_H
+#define K4A_OPENVR_DRIFT_CORRECTOR_H
+
+#include "math/pose_math.h"
+#include "math/rigid_fit.h"
+
+// Keeps the calibration right after the camera is bumped. A recursive least
+// squares fit over an exponentially forgotten window maps the K4A head joint
+// onto the HMD's raw pose. The fit captured just after a calibration is the
+// reference, later fits are compared against it, so the constant offset
+// between the raw and standing universes cancels out:
+//
+// calibration = calibration at reference * reference^-1 * current fit
+//
+// The applied calibration follows that target at bounded rates.
+
+// Head joint centre in the HMD frame, metres (OpenVR, -z forward). Matches
+// Calibrator::hmdToHead in the calibrator.
+constexpr pose_math::vec3 HMD_TO_HEAD = { 0.F, -0.02F, 0.09F };
+
+typedef enum _DriftCorrectorState
+{
+	// No calibration to correct yet
+	DRIFT_IDLE,
+	// Collecting the reference fit after a calibration
+	DRIFT_REFERENCE,
+	// Within tolerance of the estimate
+	DRIFT_TRACKING,
+	// Moving the calibration towards the estimate
+	DRIFT_CORRECTING
+} DriftCorrectorState;
+
+typedef struct _drift_diagnostics
+{
+	DriftCorrectorState state;
+	// RMS residual of the current window, metres
+	float residual;
+	// Second principal axis of the head path in the window, metres
+	float spread;
+	// Effective number of samples in the window
+	float weight;
+	// What is left between the applied calibration and the estimate
+	float angle;
+	float offset;
+} drift_diagnostics_t;
+
+class DriftCorrector
+{
+public:
+	// Starts over from a new calibration, driver to world
+	void Reset(const pose_math::rigid& calibration);
+
+	// One pair: the head joint in driver space and the HMD's head centre in raw
+	// tracking space, dt seconds after the previous call. Constant time.
+	// Returns true if the calibration moved.
+	bool Update(const pose_math::vec3& head, const pose_math::vec3& hmd_head, float dt);
+
+	const pose_math::rigid& GetCalibration() const
+	{
+		return m_calibration;
+	};
+	drift_diagnostics_t GetDiagnostics() const
+	{
+		return m_diagnostics;
+	};
+
+	// Raw tracking space to world, calibration * fit^-1. Constant while tracking
+	// since corrections keep it there, so taken from the reference. False until
+	// the reference is in.
+	bool GetWorldFromRaw(pose_math::rigid* world_from_raw) const;
+
+	// Time constant of the window, seconds
+	float window = 60.F;
+	// Distance the head has to move before another pair is taken, metres
+	float min_step = 0.03F;
+	// Window quality needed before the fit is trusted
+	float min_weight = 40.F;
+	float min_spread = 0.15F;
+	float max_residual = 0.05F;
+	// Error tolerated before correcting, correction stops at half of it
+	float angle_tolerance = 1.F * pose_math::PI / 180.F;
+	float offset_tolerance = 0.02F;
+	// Largest correction rates, radians and metres per second
+	float max_angular_rate = 0.5F * pose_math::PI / 180.F;
+	float max_linear_rate = 0.01F;
+
+private:
+	pose_math::rigid_fit_sums m_sums;
+	pose_math::vec3 m_last_head = { 0.F, 0.F, 0.F };
+	bool m_has_last = false;
+
+	pose_math::rigid m_calibration = pose_math::identity_rigid();
+	// Calibration and fit when the reference was taken
+	pose_math::rigid m_reference_calibration = pose_math::identity_rigid();
+	pose_math::rigid m_reference_fit = pose_math::identity_rigid();
+
+	drift_diagnostics_t m_diagnostics = { DRIFT_IDLE, 0.F, 0.F, 0.F, 0.F, 0.F };
+};
+
+#endif
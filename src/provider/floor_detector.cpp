@@ -0,0 +1,196 @@
+#include "floor_detector.h"
+#include "thread_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// xorshift, one state per hypothesis so the threads share no generator and a
+// run is repeatable for a seed whatever the thread count
+static uint32_t NextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+void FloorDetector::Score(int first, int last, uint32_t seed, const pose_math::vec3& up, floor_hypothesis_t* best) const
+{
+	int count = (int)m_x.size();
+	const float* x = m_x.data();
+	const float* y = m_y.data();
+	const float* z = m_z.data();
+	float min_level = std::cos(max_tilt);
+	int max_below_count = (int)(max_below * count);
+
+	*best = floor_hypothesis_t{ 0, up, 0.F };
+	for (int k = first; k < last; k++)
+	{
+		uint32_t state = (seed + (uint32_t)k) * 2654435761u | 1u;
+		int a = (int)(NextRandom(state) % (uint32_t)count);
+		int b = (int)(NextRandom(state) % (uint32_t)count);
+		int c = (int)(NextRandom(state) % (uint32_t)count);
+		pose_math::vec3 pa = { x[a], y[a], z[a] };
+		pose_math::vec3 pb = { x[b], y[b], z[b] };
+		pose_math::vec3 pc = { x[c], y[c], z[c] };
+
+		pose_math::vec3 normal = pose_math::cross(pb - pa, pc - pa);
+		float length = pose_math::length(normal);
+		if (length < 1e-3F)
+			continue;
+		normal = normal / length;
+		if (pose_math::dot(normal, up) < 0.F)
+			normal = -normal;
+		if (pose_math::dot(normal, up) < min_level)
+			continue;
+
+		float height = pose_math::dot(normal, pa);
+		int inliers = 0;
+		int below = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float distance = normal.x * x[i] + normal.y * y[i] + normal.z * z[i] - height;
+			inliers += std::fabs(distance) < inlier_distance;
+			below += distance < -below_distance;
+		}
+		if (below > max_below_count || inliers <= best->inliers)
+			continue;
+
+		best->inliers = inliers;
+		best->up = normal;
+		best->height = height;
+	}
+}
+
+bool FloorDetector::Detect(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& gravity_up, floor_plane_t* floor)
+{
+	floor->valid = false;
+	pose_math::vec3 up = pose_math::normalize(gravity_up);
+	if (pose_math::length_squared(up) == 0.F)
+		return false;
+	if (unprojector.Unproject(depth, stride, m_points) == 0)
+		return false;
+
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	for (int r = 0; r < m_points.rows; r++)
+	{
+		const float* x = m_points.x() + (size_t)r * m_points.pitch;
+		const float* y = m_points.y() + (size_t)r * m_points.pitch;
+		const float* z = m_points.z() + (size_t)r * m_points.pitch;
+		for (int u = 0; u < m_points.pitch; u++)
+		{
+			if (z[u] > 0.F)
+			{
+				m_x.push_back(x[u]);
+				m_y.push_back(y[u]);
+				m_z.push_back(z[u]);
+			}
+		}
+	}
+
+	int count = (int)m_x.size();
+	if (count < 3 || count * min_support < 3.F)
+		return false;
+
+	const float* x = m_x.data();
+	const float* y = m_y.data();
+	const float* z = m_z.data();
+	float min_level = std::cos(max_tilt);
+	uint32_t seed = m_seed;
+	m_seed += (uint32_t)iterations;
+
+	// Contiguous shares of the hypotheses, the first on this thread
+	int team = std::max(std::min(threads, iterations), 1);
+	std::vector<floor_hypothesis_t> best(team);
+	std::vector<std::thread> helpers;
+	for (int t = 1; t < team; t++)
+	{
+		helpers.emplace_back([this, t, team, seed, &up, &best] {
+			ScopedThread scheduled("k4a floor helper", THREAD_ROLE_BACKGROUND);
+			Score(iterations * t / team, iterations * (t + 1) / team, seed, up, &best[t]);
+		});
+	}
+	Score(0, iterations / team, seed, up, &best[0]);
+	for (std::thread& helper : helpers)
+		helper.join();
+
+	// In hypothesis order, so the winner is the serial loop's
+	int best_inliers = 0;
+	pose_math::vec3 best_up = up;
+	float best_height = 0.F;
+	for (const floor_hypothesis_t& share : best)
+	{
+		if (share.inliers > best_inliers)
+		{
+			best_inliers = share.inliers;
+			best_up = share.up;
+			best_height = share.height;
+		}
+	}
+
+	if (best_inliers < min_support * count)
+		return false;
+
+	// Least squares over the inliers, heights along gravity against the two
+	// level axes, centred
+	pose_math::vec3 e1 = pose_math::normalize(pose_math::cross(up, std::fabs(up.x) < 0.9F ? pose_math::vec3{ 1.F, 0.F, 0.F } : pose_math::vec3{ 0.F, 1.F, 0.F }));
+	pose_math::vec3 e2 = pose_math::cross(up, e1);
+
+	double mean_u = 0.0, mean_v = 0.0, mean_h = 0.0;
+	int used = 0;
+	for (int i = 0; i < count; i++)
+	{
+		pose_math::vec3 p = { x[i], y[i], z[i] };
+		if (std::fabs(pose_math::dot(best_up, p) - best_height) >= inlier_distance)
+			continue;
+		mean_u += pose_math::dot(e1, p);
+		mean_v += pose_math::dot(e2, p);
+		mean_h += pose_math::dot(up, p);
+		used++;
+	}
+	mean_u /= used;
+	mean_v /= used;
+	mean_h /= used;
+
+	double uu = 0.0, vv = 0.0, uv = 0.0, uh = 0.0, vh = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		pose_math::vec3 p = { x[i], y[i], z[i] };
+		if (std::fabs(pose_math::dot(best_up, p) - best_height) >= inlier_distance)
+			continue;
+		double u = pose_math::dot(e1, p) - mean_u;
+		double v = pose_math::dot(e2, p) - mean_v;
+		double h = pose_math::dot(up, p) - mean_h;
+		uu += u * u;
+		vv += v * v;
+		uv += u * v;
+		uh += u * h;
+		vh += v * h;
+	}
+
+	pose_math::vec3 normal = best_up;
+	float height = best_height;
+	double determinant = uu * vv - uv * uv;
+	if (determinant > 1e-9 * uu * vv)
+	{
+		// h = a u + b v + c is dot(up - a e1 - b e2, p) = c
+		float slope_u = (float)((uh * vv - vh * uv) / determinant);
+		float slope_v = (float)((vh * uu - uh * uv) / determinant);
+		float offset = (float)(mean_h - slope_u * mean_u - slope_v * mean_v);
+		pose_math::vec3 fitted = up - e1 * slope_u - e2 * slope_v;
+		float length = pose_math::length(fitted);
+		if (pose_math::dot(fitted / length, up) >= min_level)
+		{
+			normal = fitted / length;
+			height = offset / length;
+		}
+	}
+
+	floor->valid = true;
+	floor->up = normal;
+	floor->height = height;
+	floor->support = (float)best_inliers / count;
+	return true;
+}
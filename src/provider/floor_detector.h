@@ -0,0 +1,74 @@
+#pragma once
+#ifndef K4A_OPENVR_FLOOR_DETECTOR_H
+#define K4A_OPENVR_FLOOR_DETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "depth_unprojector.h"
+#include "math/pose_math.h"
+
+// Floor searched this often until found, then refreshed this often, seconds.
+// The driver and the tracking service run the detector on the same schedule.
+static const float FLOOR_SEARCH_INTERVAL = 1.F;
+static const float FLOOR_REFRESH_INTERVAL = 10.F;
+
+// Floor in camera space, the points p with dot(up, p) == height. Millimetres.
+typedef struct _floor_plane
+{
+	bool valid;
+	pose_math::vec3 up;
+	float height;
+	// Inlier share of the subsampled points, for diagnostics
+	float support;
+} floor_plane_t;
+
+// Finds the floor in a depth frame. Gravity fixes the plane's normal up to a
+// small tilt, so every hypothesis is three random points whose plane lies
+// within max_tilt of level, scored by its inliers over a subsampled cloud.
+// A level plane with many points below it (a table, a bed) is not the floor.
+// Hypotheses are scored in parallel on a small team of background threads,
+// the winner is refined by least squares over its inliers. Runs in a few milliseconds on the CPU; it is meant for a
+// low priority thread and a refresh every few seconds.
+class FloorDetector
+{
+public:
+	// Plane of the floor in depth, up is gravity's up in camera space. False
+	// if nothing level has enough support.
+	bool Detect(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& up, floor_plane_t* floor);
+
+	// Every stride-th pixel in both directions is unprojected and used
+	int stride = 4;
+	int iterations = 96;
+	// Threads scoring the hypotheses: the caller and threads - 1 helpers,
+	// entered as background threads for the one detection
+	int threads = 2;
+	// Points within this of a plane support it, mm
+	float inlier_distance = 20.F;
+	// Largest angle between the floor and level, radians
+	float max_tilt = 0.15F;
+	// Support needed, share of the subsampled points
+	float min_support = 0.05F;
+	// Share of the points allowed further than below_distance under the floor
+	float max_below = 0.02F;
+	float below_distance = 60.F;
+
+private:
+	// Best plane of hypotheses first to last, of the subsampled points
+	typedef struct _floor_hypothesis
+	{
+		int inliers;
+		pose_math::vec3 up;
+		float height;
+	} floor_hypothesis_t;
+	void Score(int first, int last, uint32_t seed, const pose_math::vec3& up, floor_hypothesis_t* best) const;
+
+	DepthPoints m_points;
+	// Subsampled points with a depth, structure of arrays
+	std::vector<float> m_x;
+	std::vector<float> m_y;
+	std::vector<float> m_z;
+	uint32_t m_seed = 1;
+};
+
+#endif
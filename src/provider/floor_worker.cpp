@@ -0,0 +1,95 @@
+#include "floor_worker.h"
+#include "thread_scheduler.h"
+
+void FloorWorker::Start()
+{
+	if (m_thread.joinable())
+		return;
+	m_stopping = false;
+	m_done = false;
+	m_thread = std::thread(Process, this);
+}
+
+void FloorWorker::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	if (m_depth != nullptr)
+		k4a_image_release(m_depth);
+	m_depth = nullptr;
+	m_busy = false;
+	m_done = false;
+}
+
+void FloorWorker::SetCalibration(const k4a_calibration_t& calibration)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_calibration = calibration;
+	m_recalibrate = true;
+}
+
+bool FloorWorker::Request(k4a_image_t depth, const pose_math::vec3& up)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_busy || !m_thread.joinable())
+		return false;
+	k4a_image_reference(depth);
+	m_depth = depth;
+	m_up = up;
+	m_busy = true;
+	m_wake.notify_one();
+	return true;
+}
+
+bool FloorWorker::Take(floor_plane_t* floor)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_done)
+		return false;
+	*floor = m_floor;
+	m_done = false;
+	return true;
+}
+
+void FloorWorker::Process(FloorWorker* worker)
+{
+	// Background work, never in the way of the tracking threads
+	ScopedThread scheduled("k4a floor", THREAD_ROLE_BACKGROUND);
+
+	k4a_calibration_t calibration;
+
+	std::unique_lock<std::mutex> lock(worker->m_mutex);
+	while (true)
+	{
+		worker->m_wake.wait(lock, [worker] { return worker->m_stopping || worker->m_depth != nullptr; });
+		if (worker->m_stopping)
+			break;
+		k4a_image_t depth = worker->m_depth;
+		pose_math::vec3 up = worker->m_up;
+		bool recalibrate = worker->m_recalibrate;
+		if (recalibrate)
+			calibration = worker->m_calibration;
+		worker->m_depth = nullptr;
+		worker->m_recalibrate = false;
+		lock.unlock();
+
+		// Slow, but only after the device was set up again
+		if (recalibrate)
+			worker->m_unprojector.SetCalibration(calibration);
+		floor_plane_t floor = {};
+		worker->detector.Detect(worker->m_unprojector, depth, up, &floor);
+		k4a_image_release(depth);
+
+		lock.lock();
+		worker->m_floor = floor;
+		worker->m_done = true;
+		worker->m_busy = false;
+	}
+}
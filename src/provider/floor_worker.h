@@ -0,0 +1,59 @@
+#pragma once
+#ifndef K4A_OPENVR_FLOOR_WORKER_H
+#define K4A_OPENVR_FLOOR_WORKER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "k4a/k4a.h"
+#include "depth_unprojector.h"
+#include "floor_detector.h"
+
+// Floor detection on its own low priority thread. The owner hands over a
+// depth image now and then and picks up the plane once it is done. The
+// worker unprojects with a ray table of its own, built on its thread from
+// the calibration handed over, so the owner may rebuild its table any time.
+class FloorWorker
+{
+public:
+	~FloorWorker()
+	{
+		Stop();
+	};
+
+	void Start();
+	// Waits for a detection in progress, drops a request not taken yet
+	void Stop();
+
+	// The ray table is rebuilt from it before the next detection
+	void SetCalibration(const k4a_calibration_t& calibration);
+	// Depth is referenced until the detection is done. False while the last
+	// request is still running.
+	bool Request(k4a_image_t depth, const pose_math::vec3& up);
+	// The plane of the last request, once. False until it is done.
+	bool Take(floor_plane_t* floor);
+
+	// Set before Start
+	FloorDetector detector;
+
+private:
+	static void Process(FloorWorker* worker);
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping = false;
+	// Handed over and not taken yet, and the result not picked up yet
+	k4a_image_t m_depth = nullptr;
+	pose_math::vec3 m_up = { 0.F, 0.F, 0.F };
+	k4a_calibration_t m_calibration = {};
+	bool m_recalibrate = false;
+	bool m_busy = false;
+	bool m_done = false;
+	floor_plane_t m_floor = {};
+
+	// Worker thread only
+	DepthUnprojector m_unprojector;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "foot_refiner.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Window half size limits, pixels
+static const int MIN_WINDOW = 4;
+static const int MAX_WINDOW = 64;
+
+bool FootRefiner::RefineFoot(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& up, const k4abt_joint_t& other,
+	k4abt_joint_t& foot)
+{
+	const k4a_calibration_t& calibration = unprojector.GetCalibration();
+	pose_math::vec3 joint = pose_math::to_vec3(foot.position);
+	if (foot.confidence_level < K4ABT_JOINT_CONFIDENCE_LOW || joint.z <= 0.F)
+		return false;
+
+	k4a_float2_t pixel;
+	int projected = 0;
+	if (k4a_calibration_3d_to_2d(&calibration, &foot.position, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH,
+		&pixel, &projected) != K4A_RESULT_SUCCEEDED || !projected)
+		return false;
+
+	int centre_u = (int)std::lround(pixel.xy.x);
+	int centre_v = (int)std::lround(pixel.xy.y);
+	if (centre_u < 0 || centre_v < 0 || centre_u >= unprojector.GetWidth() || centre_v >= unprojector.GetHeight())
+		return false;
+
+	// Window that covers roi_radius at the joint's depth
+	float focal = calibration.depth_camera_calibration.intrinsics.parameters.param.fx;
+	int window = std::min(std::max((int)(roi_radius * focal / joint.z), MIN_WINDOW), MAX_WINDOW);
+
+	// Left edge on an 8 pixel block so the rows take the AVX2 path
+	depth_roi_t roi;
+	roi.left = (centre_u - window) & ~7;
+	roi.top = centre_v - window;
+	roi.width = centre_u + window + 1 - roi.left;
+	roi.height = 2 * window + 1;
+	if (unprojector.Unproject(depth, roi, m_window) < min_points)
+		return false;
+
+	// Points nearer the other foot belong to it
+	bool split = other.confidence_level >= K4ABT_JOINT_CONFIDENCE_LOW;
+	pose_math::vec3 other_joint = pose_math::to_vec3(other.position);
+
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+
+	float radius_squared = roi_radius * roi_radius;
+
+	for (int r = 0; r < m_window.rows; r++)
+	{
+		const float* window_x = m_window.x() + (size_t)r * m_window.pitch;
+		const float* window_y = m_window.y() + (size_t)r * m_window.pitch;
+		const float* window_z = m_window.z() + (size_t)r * m_window.pitch;
+		int u = 0;
+#if defined(POSE_MATH_SSE)
+		const __m128 jx = _mm_set1_ps(joint.x), jy = _mm_set1_ps(joint.y), jz = _mm_set1_ps(joint.z);
+		const __m128 ox = _mm_set1_ps(other_joint.x), oy = _mm_set1_ps(other_joint.y), oz = _mm_set1_ps(other_joint.z);
+		const __m128 limit = _mm_set1_ps(radius_squared);
+		const __m128 zero = _mm_setzero_ps();
+		// The pitch is a multiple of 8, padding has no depth
+		for (; u + 4 <= m_window.pitch; u += 4)
+		{
+			__m128 x = _mm_load_ps(window_x + u);
+			__m128 y = _mm_load_ps(window_y + u);
+			__m128 d = _mm_load_ps(window_z + u);
+
+			__m128 dx = _mm_sub_ps(x, jx), dy = _mm_sub_ps(y, jy), dz = _mm_sub_ps(d, jz);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 keep = _mm_and_ps(_mm_cmplt_ps(distance, limit), _mm_cmpgt_ps(d, zero));
+			if (split)
+			{
+				__m128 ex = _mm_sub_ps(x, ox), ey = _mm_sub_ps(y, oy), ez = _mm_sub_ps(d, oz);
+				__m128 other_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+				keep = _mm_and_ps(keep, _mm_cmple_ps(distance, other_distance));
+			}
+
+			int mask = _mm_movemask_ps(keep);
+			for (int lane = 0; mask != 0 && lane < 4; lane++)
+			{
+				if (mask & (1 << lane))
+				{
+					m_x.push_back(window_x[u + lane]);
+					m_y.push_back(window_y[u + lane]);
+					m_z.push_back(window_z[u + lane]);
+				}
+			}
+		}
+#endif
+		for (; u < m_window.pitch; u++)
+		{
+			pose_math::vec3 p = { window_x[u], window_y[u], window_z[u] };
+			if (!(p.z > 0.F && pose_math::length_squared(p - joint) < radius_squared))
+				continue;
+			if (split && pose_math::length_squared(p - joint) > pose_math::length_squared(p - other_joint))
+				continue;
+			m_x.push_back(p.x);
+			m_y.push_back(p.y);
+			m_z.push_back(p.z);
+		}
+	}
+
+	size_t count = m_x.size();
+	if (count < min_points)
+		return false;
+
+	// Heights along up
+	m_h.resize(count);
+	size_t i = 0;
+#if defined(POSE_MATH_SSE)
+	const __m128 ux = _mm_set1_ps(up.x), uy = _mm_set1_ps(up.y), uz = _mm_set1_ps(up.z);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m_x[i]), ux), _mm_mul_ps(_mm_loadu_ps(&m_y[i]), uy)),
+			_mm_mul_ps(_mm_loadu_ps(&m_z[i]), uz));
+		_mm_storeu_ps(&m_h[i], h);
+	}
+#endif
+	for (; i < count; i++)
+		m_h[i] = m_x[i] * up.x + m_y[i] * up.y + m_z[i] * up.z;
+
+	// The lowest few percent are the floor if enough of the window is near them
+	m_sorted.assign(m_h.begin(), m_h.end());
+	std::nth_element(m_sorted.begin(), m_sorted.begin() + count / 20, m_sorted.end());
+	float floor_height = m_sorted[count / 20];
+	size_t floor_count = (size_t)std::count_if(m_h.begin(), m_h.end(), [&](float h) { return h < floor_height + floor_margin; });
+	bool floor_seen = floor_count >= min_floor_share * count;
+
+	float lowest = floor_seen ? floor_height + floor_margin : -std::numeric_limits<float>::infinity();
+	float highest = pose_math::dot(joint, up) + max_height;
+
+	pose_math::vec3 sum = { 0.F, 0.F, 0.F };
+	size_t used = 0;
+	float foot_bottom = std::numeric_limits<float>::infinity();
+	for (i = 0; i < count; i++)
+	{
+		if (m_h[i] < lowest || m_h[i] > highest)
+			continue;
+		sum = sum + pose_math::vec3{ m_x[i], m_y[i], m_z[i] };
+		foot_bottom = std::min(foot_bottom, m_h[i]);
+		used++;
+	}
+	if (used < min_points)
+		return false;
+
+	// Visible surface to the joint inside the foot
+	pose_math::vec3 centroid = sum / (float)used;
+	pose_math::vec3 refined = centroid + pose_math::normalize(centroid) * surface_depth;
+
+	// Standing, the floor fixes the height
+	if (floor_seen && foot_bottom - floor_height < 2.F * floor_margin)
+		refined = refined + up * (floor_height + contact_height - pose_math::dot(refined, up));
+
+	if (pose_math::length(refined - joint) > max_correction)
+		return false;
+
+	pose_math::store(refined, foot.position);
+	return true;
+}
+
+uint32_t FootRefiner::Refine(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& up, k4abt_skeleton_t& skeleton)
+{
+	if (!unprojector.IsReady() || depth == nullptr)
+		return 0;
+
+	// Both decided from the DNN's feet, not from one refined already
+	k4abt_joint_t left = skeleton.joints[K4ABT_JOINT_FOOT_LEFT];
+	k4abt_joint_t right = skeleton.joints[K4ABT_JOINT_FOOT_RIGHT];
+
+	uint32_t refined = 0;
+	if (RefineFoot(unprojector, depth, up, right, skeleton.joints[K4ABT_JOINT_FOOT_LEFT]))
+		refined |= 1u << K4ABT_JOINT_FOOT_LEFT;
+	if (RefineFoot(unprojector, depth, up, left, skeleton.joints[K4ABT_JOINT_FOOT_RIGHT]))
+		refined |= 1u << K4ABT_JOINT_FOOT_RIGHT;
+	return refined;
+}
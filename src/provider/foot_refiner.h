@@ -0,0 +1,56 @@
+#pragma once
+#ifndef K4A_OPENVR_FOOT_REFINER_H
+#define K4A_OPENVR_FOOT_REFINER_H
+
+#include <cstdint>
+#include <vector>
+#include "k4a/k4a.h"
+#include "k4abttypes.h"
+#include "depth_unprojector.h"
+#include "math/pose_math.h"
+
+// Moves the body tracker's foot joints onto the foot seen in the depth image.
+// Only a small window around each projected foot is unprojected, through the
+// DepthUnprojector's ray table. Points near the floor
+// (the lowest band along up) are split off and the rest is the foot surface;
+// the foot goes behind its centroid along the view ray, and onto the floor
+// when the surface reaches it. Camera space millimetres, depth camera pixels.
+class FootRefiner
+{
+public:
+	// Refines both feet of skeleton in place from the depth image it was
+	// inferred on. up is world up in camera space. Returns a mask of the
+	// refined joints, one bit per k4abt_joint_id_t.
+	uint32_t Refine(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& up, k4abt_skeleton_t& skeleton);
+
+	// Points further than this from the foot joint are ignored, mm
+	float roi_radius = 150.F;
+	// Points above the foot joint by more than this are the leg, mm
+	float max_height = 60.F;
+	// Band above the lowest points that is floor, mm
+	float floor_margin = 15.F;
+	// Share of the points in the floor band for the floor to count as seen
+	float min_floor_share = 0.2F;
+	// Joint height above the floor while standing on it, mm
+	float contact_height = 40.F;
+	// Joint behind the visible surface along the view ray, mm
+	float surface_depth = 25.F;
+	// Larger corrections are a bad fit and are dropped, mm
+	float max_correction = 80.F;
+	size_t min_points = 30;
+
+private:
+	bool RefineFoot(const DepthUnprojector& unprojector, k4a_image_t depth, const pose_math::vec3& up, const k4abt_joint_t& other,
+		k4abt_joint_t& foot);
+
+	// The unprojected window, then the foot's points and their heights,
+	// structure of arrays
+	DepthPoints m_window;
+	std::vector<float> m_x;
+	std::vector<float> m_y;
+	std::vector<float> m_z;
+	std::vector<float> m_h;
+	std::vector<float> m_sorted;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+#ifndef K4A_OPENVR_HOST_CLOCK_H
+#define K4A_OPENVR_HOST_CLOCK_H
+
+#include <chrono>
+#include <cstdint>
+
+// Host steady clock, microseconds. The same clock in every process: the
+// skeleton channel's frame and heartbeat times and the head joint the
+// calibrator pairs with HMD poses are all on it, so use nothing else for
+// host timestamps.
+inline uint64_t HostTimeUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
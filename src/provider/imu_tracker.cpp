@@ -0,0 +1,77 @@
+#include "imu_tracker.h"
+#include <algorithm>
+#include <cmath>
+
+void ImuTracker::Reset()
+{
+	m_up = { 0.F, 0.F, 0.F };
+	m_bias = { 0.F, 0.F, 0.F };
+	m_reference = { 0.F, 0.F, 0.F };
+	m_has_up = false;
+	m_has_reference = false;
+	m_moved = false;
+	m_rest = 0.F;
+	m_turned = 0.F;
+}
+
+void ImuTracker::SetReference()
+{
+	m_reference = m_up;
+	m_has_reference = m_has_up;
+	m_moved = false;
+	m_turned = 0.F;
+}
+
+bool ImuTracker::Update(const pose_math::vec3& acceleration, const pose_math::vec3& angular_velocity, float dt)
+{
+	float magnitude = pose_math::length(acceleration);
+	if (magnitude <= 0.F || dt <= 0.F)
+		return false;
+
+	if (!m_has_up)
+	{
+		m_up = acceleration / magnitude;
+		m_has_up = true;
+		return false;
+	}
+
+	pose_math::vec3 rate = angular_velocity - m_bias;
+	float speed = pose_math::length(rate);
+
+	// A world fixed vector turns against the camera
+	m_up = pose_math::normalize(m_up - pose_math::cross(rate, m_up) * dt);
+
+	float error = std::fabs(magnitude - gravity);
+	float trust = std::max(1.F - error / max_acceleration_error, 0.F);
+	float gain = std::min(trust * dt / time_constant, 1.F);
+	m_up = pose_math::normalize(m_up + (acceleration / magnitude - m_up) * gain);
+
+	if (speed < rest_rate && error < 0.1F * max_acceleration_error)
+	{
+		m_rest += dt;
+		if (IsAtRest())
+		{
+			m_bias = m_bias + (angular_velocity - m_bias) * std::min(dt / bias_time, 1.F);
+			m_turned = 0.F;
+		}
+	}
+	else
+	{
+		m_rest = 0.F;
+		m_turned += speed * dt;
+	}
+
+	// Reported once, the next calibration takes a new reference
+	if (!m_has_reference || m_moved)
+		return false;
+
+	float tilt = std::acos(std::min(std::max(pose_math::dot(m_up, m_reference), -1.F), 1.F));
+	m_moved = tilt > move_angle || m_turned > move_angle || error > shock;
+	return m_moved;
+}
+
+pose_math::vec3 SensorToDepth(const k4a_calibration_t& calibration, k4a_calibration_type_t sensor, const pose_math::vec3& v)
+{
+	const float* r = calibration.extrinsics[sensor][K4A_CALIBRATION_TYPE_DEPTH].rotation;
+	return { r[0] * v.x + r[1] * v.y + r[2] * v.z, r[3] * v.x + r[4] * v.y + r[5] * v.z, r[6] * v.x + r[7] * v.y + r[8] * v.z };
+}
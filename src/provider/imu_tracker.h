@@ -0,0 +1,79 @@
+#pragma once
+#ifndef K4A_OPENVR_IMU_TRACKER_H
+#define K4A_OPENVR_IMU_TRACKER_H
+
+#include <cstdint>
+#include "k4a/k4a.h"
+#include "math/pose_math.h"
+
+// Camera tilt and bumps from the K4A IMU, samples already in the depth
+// camera's axes. A complementary filter keeps gravity's up: the gyro rotates
+// it between samples and the accelerometer pulls it back with time_constant,
+// less so the further the reading is from 1 g. Pitch and roll follow; yaw
+// about gravity is not observable and is left to the calibration.
+//
+// Against a reference taken at calibration, the camera counts as moved when
+// its up has tilted by more than move_angle, when the gyro has turned it by
+// more than that in total since it was last at rest, or on a shock. Nothing
+// allocates, it runs per sample on the IMU thread.
+class ImuTracker
+{
+public:
+	void Reset();
+
+	// One sample, m/s^2 and rad/s, dt seconds since the last one. True on the
+	// sample the camera is found to have moved.
+	bool Update(const pose_math::vec3& acceleration, const pose_math::vec3& angular_velocity, float dt);
+
+	// Takes the current up as the one the calibration was made with
+	void SetReference();
+
+	bool HasUp() const
+	{
+		return m_has_up;
+	};
+	// Gravity's up in camera space, unit
+	const pose_math::vec3& GetUp() const
+	{
+		return m_up;
+	};
+	// Still for rest_time, gyro bias learned only then
+	bool IsAtRest() const
+	{
+		return m_rest > rest_time;
+	};
+	// Moved since the reference, until the next SetReference
+	bool IsMoved() const
+	{
+		return m_moved;
+	};
+
+	float time_constant = 1.F;
+	float gravity = 9.80665F;
+	// Accelerometer weight drops to zero this far from 1 g, m/s^2
+	float max_acceleration_error = 1.5F;
+	// Rates below this are rest, rad/s, for rest_time seconds
+	float rest_rate = 0.03F;
+	float rest_time = 0.5F;
+	float bias_time = 10.F;
+	// Tilt or turn since rest that counts as moved, radians
+	float move_angle = 0.75F * pose_math::PI / 180.F;
+	// Accelerometer error that is a knock on the camera, m/s^2
+	float shock = 4.F;
+
+private:
+	pose_math::vec3 m_up = { 0.F, 0.F, 0.F };
+	pose_math::vec3 m_bias = { 0.F, 0.F, 0.F };
+	pose_math::vec3 m_reference = { 0.F, 0.F, 0.F };
+	bool m_has_up = false;
+	bool m_has_reference = false;
+	bool m_moved = false;
+	float m_rest = 0.F;
+	// Gyro angle turned since the last rest
+	float m_turned = 0.F;
+};
+
+// Rotation of a vector from one of the IMU's sensors to the depth camera's axes
+pose_math::vec3 SensorToDepth(const k4a_calibration_t& calibration, k4a_calibration_type_t sensor, const pose_math::vec3& v);
+
+#endif
@@ -0,0 +1,32 @@
+#include "latency_compensator.h"
+#include <cmath>
+
+bool LatencyCompensator::SetMotion(const pose_math::rigid& hmd_at_capture, const pose_math::rigid& hmd_now)
+{
+	pose_math::vec3 head_at_capture = pose_math::transform(hmd_at_capture, hmd_to_head);
+	pose_math::vec3 head_now = pose_math::transform(hmd_now, hmd_to_head);
+
+	// Twist of the relative rotation about world up
+	float yaw = pose_math::twist_y(hmd_now.rotation * pose_math::conjugate(hmd_at_capture.rotation));
+
+	m_pivot = head_at_capture;
+	m_displacement = head_now - head_at_capture;
+	m_yaw = yaw;
+	m_active = pose_math::length(m_displacement) <= max_displacement && std::fabs(yaw) <= max_yaw;
+
+	return m_active;
+}
+
+void LatencyCompensator::Apply(const latency_weight_t* weights, pose_math::vec3* positions, pose_math::quat* rotations, size_t count) const
+{
+	if (!m_active)
+		return;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		pose_math::quat turn = pose_math::axis_angle({ 0.F, 1.F, 0.F }, m_yaw * weights[i].yaw);
+
+		positions[i] = m_pivot + pose_math::rotate(turn, positions[i] - m_pivot) + m_displacement * weights[i].translation;
+		rotations[i] = turn * rotations[i];
+	}
+}
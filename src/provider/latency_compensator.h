@@ -0,0 +1,41 @@
+#pragma once
+#ifndef K4A_OPENVR_LATENCY_COMPENSATOR_H
+#define K4A_OPENVR_LATENCY_COMPENSATOR_H
+
+#include <cstddef>
+#include "math/pose_math.h"
+
+// Skeletons are 60-100 ms old by the time they are published, the HMD is not.
+// The HMD's motion since the capture is applied to the body: its translation
+// and its yaw about the head, each scaled per joint so the correction fades
+// down the kinematic chain. A planted foot barely moves with the head.
+typedef struct _latency_weight
+{
+	float translation;
+	float yaw;
+} latency_weight_t;
+
+class LatencyCompensator
+{
+public:
+	// HMD poses in world space at the capture time and now. Returns false, and
+	// Apply() does nothing, if the motion is implausible for the interval.
+	bool SetMotion(const pose_math::rigid& hmd_at_capture, const pose_math::rigid& hmd_now);
+
+	// World space joints, in place
+	void Apply(const latency_weight_t* weights, pose_math::vec3* positions, pose_math::quat* rotations, size_t count) const;
+
+	// Head centre in the HMD frame, the yaw pivot
+	pose_math::vec3 hmd_to_head = { 0.F, 0.F, 0.F };
+	// Larger motion over a skeleton's age is a tracking glitch, metres and radians
+	float max_displacement = 0.3F;
+	float max_yaw = 0.8F;
+
+private:
+	pose_math::vec3 m_pivot = { 0.F, 0.F, 0.F };
+	pose_math::vec3 m_displacement = { 0.F, 0.F, 0.F };
+	float m_yaw = 0.F;
+	bool m_active = false;
+};
+
+#endif
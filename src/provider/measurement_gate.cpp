@@ -0,0 +1,121 @@
+#include "measurement_gate.h"
+#include <utility>
+
+// Left and right joints checked for swaps, per limb
+static const k4abt_joint_id_t SWAP_LIMBS[2][3][2] = {
+	{
+		{ K4ABT_JOINT_KNEE_LEFT, K4ABT_JOINT_KNEE_RIGHT },
+		{ K4ABT_JOINT_ANKLE_LEFT, K4ABT_JOINT_ANKLE_RIGHT },
+		{ K4ABT_JOINT_FOOT_LEFT, K4ABT_JOINT_FOOT_RIGHT }
+	},
+	{
+		{ K4ABT_JOINT_ELBOW_LEFT, K4ABT_JOINT_ELBOW_RIGHT },
+		{ K4ABT_JOINT_WRIST_LEFT, K4ABT_JOINT_WRIST_RIGHT },
+		{ K4ABT_JOINT_HAND_LEFT, K4ABT_JOINT_HAND_RIGHT }
+	}
+};
+
+void MeasurementGate::Reset()
+{
+	for (int i = 0; i < K4ABT_JOINT_COUNT; i++)
+	{
+		m_rejections[i] = 0;
+		m_consecutive[i] = 0;
+	}
+	m_swaps = 0;
+}
+
+float MeasurementGate::Distance(const pose_math::vec3& measured, const pose_math::vec3& predicted, float spread, float dt) const
+{
+	pose_math::vec3 innovation = measured - predicted;
+	float drift = 0.5F * acceleration_noise * dt * dt;
+	float lateral = lateral_noise * lateral_noise * spread + drift * drift;
+	float depth = depth_noise * depth_noise * spread + drift * drift;
+	return (innovation.x * innovation.x + innovation.y * innovation.y) / lateral + innovation.z * innovation.z / depth;
+}
+
+uint32_t MeasurementGate::Apply(const SkeletonHistory& history, uint64_t time_us, k4abt_skeleton_t& skeleton)
+{
+	// Needs a velocity, and nothing stale to extrapolate from
+	if (history.Contiguous(max_gap) < 2 || time_us <= history.Time(0) || time_us - history.Time(0) > max_gap)
+		return 0;
+
+	float dt = (float)(time_us - history.Time(0)) * 1e-6F;
+	float step = -history.Seconds(1);
+	if (step <= 0.F)
+		return 0;
+
+	// Constant velocity over the last two frames. The innovation of a new
+	// sample against p0 + (p0 - p1) k has 1 + (1 + k)^2 + k^2 times the
+	// measurement noise variance.
+	float k = dt / step;
+	float spread = 1.F + (1.F + k) * (1.F + k) + k * k;
+
+	pose_math::vec3 predicted[K4ABT_JOINT_COUNT];
+	float distance[K4ABT_JOINT_COUNT];
+	for (int i = 0; i < K4ABT_JOINT_COUNT; i++)
+	{
+		k4abt_joint_id_t joint = (k4abt_joint_id_t)i;
+		pose_math::vec3 p0 = history.Position(joint, 0);
+		predicted[i] = p0 + (p0 - history.Position(joint, 1)) * k;
+		distance[i] = Distance(pose_math::to_vec3(skeleton.joints[i].position), predicted[i], spread, dt);
+	}
+
+	// A limb reported on the wrong side for a frame, whole limb at a time
+	for (int limb = 0; limb < 2; limb++)
+	{
+		float labelled = 0.F;
+		float swapped = 0.F;
+		bool outside = false;
+		for (int i = 0; i < 3; i++)
+		{
+			k4abt_joint_id_t left = SWAP_LIMBS[limb][i][0];
+			k4abt_joint_id_t right = SWAP_LIMBS[limb][i][1];
+			labelled += distance[left] + distance[right];
+			swapped += Distance(pose_math::to_vec3(skeleton.joints[left].position), predicted[right], spread, dt)
+				+ Distance(pose_math::to_vec3(skeleton.joints[right].position), predicted[left], spread, dt);
+			outside = outside || distance[left] > threshold || distance[right] > threshold;
+		}
+
+		if (!outside || swapped >= swap_ratio * labelled)
+			continue;
+
+		for (int i = 0; i < 3; i++)
+		{
+			k4abt_joint_id_t left = SWAP_LIMBS[limb][i][0];
+			k4abt_joint_id_t right = SWAP_LIMBS[limb][i][1];
+			std::swap(skeleton.joints[left].position, skeleton.joints[right].position);
+			std::swap(skeleton.joints[left].confidence_level, skeleton.joints[right].confidence_level);
+
+			// Left and right joint frames are mirrored, so the swapped orientations
+			// are not usable as they are. The last ones stand in for a frame.
+			pose_math::store(history.Orientation(left, 0), skeleton.joints[left].orientation);
+			pose_math::store(history.Orientation(right, 0), skeleton.joints[right].orientation);
+
+			distance[left] = Distance(pose_math::to_vec3(skeleton.joints[left].position), predicted[left], spread, dt);
+			distance[right] = Distance(pose_math::to_vec3(skeleton.joints[right].position), predicted[right], spread, dt);
+		}
+		m_swaps++;
+	}
+
+	uint32_t rejected = 0;
+	for (int i = 0; i < K4ABT_JOINT_COUNT; i++)
+	{
+		if (distance[i] <= threshold || m_consecutive[i] >= max_consecutive)
+		{
+			m_consecutive[i] = 0;
+			continue;
+		}
+
+		k4abt_joint_t& joint = skeleton.joints[i];
+		pose_math::store(predicted[i], joint.position);
+		pose_math::store(history.Orientation((k4abt_joint_id_t)i, 0), joint.orientation);
+		joint.confidence_level = K4ABT_JOINT_CONFIDENCE_NONE;
+
+		m_consecutive[i]++;
+		m_rejections[i]++;
+		rejected |= 1u << i;
+	}
+
+	return rejected;
+}
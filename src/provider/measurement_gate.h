@@ -0,0 +1,66 @@
+#pragma once
+#ifndef K4A_OPENVR_MEASUREMENT_GATE_H
+#define K4A_OPENVR_MEASUREMENT_GATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "k4abttypes.h"
+#include "math/pose_math.h"
+#include "skeleton_history.h"
+
+// Checks a new skeleton against where the history says each joint should be,
+// before anything filters it. The prediction is constant velocity over the
+// last two frames; the innovation is weighted by a diagonal covariance of
+// measurement noise (depth noisier than x and y) plus unmodelled acceleration
+// over the frame time, giving a squared Mahalanobis distance.
+//
+// Limbs whose left and right measurements fit the other side's prediction
+// much better are swapped back. Joints still beyond the gate are replaced by
+// their prediction with no confidence, so the skeleton solver can rebuild
+// them. Camera space millimetres.
+class MeasurementGate
+{
+public:
+	// Gates skeleton in place against history, taken at time_us. Returns a mask
+	// of the rejected joints, one bit per k4abt_joint_id_t.
+	uint32_t Apply(const SkeletonHistory& history, uint64_t time_us, k4abt_skeleton_t& skeleton);
+
+	// Rejections of a joint and limb swaps corrected since the last Reset
+	uint32_t GetRejections(k4abt_joint_id_t joint) const
+	{
+		return m_rejections[joint];
+	};
+	uint32_t GetSwaps() const
+	{
+		return m_swaps;
+	};
+
+	void Reset();
+
+	// Squared Mahalanobis distance beyond which a joint is rejected, 3 degrees
+	// of freedom
+	float threshold = 25.F;
+	// A swap is taken when it costs less than this share of the labelled
+	// assignment, and the labelled one is outside the gate
+	float swap_ratio = 0.25F;
+	// Measurement noise across and along the camera axis, mm
+	float lateral_noise = 20.F;
+	float depth_noise = 40.F;
+	// Unmodelled acceleration, mm/s^2
+	float acceleration_noise = 30000.F;
+	// After this many rejections in a row the measurement is taken anyway
+	uint32_t max_consecutive = 3;
+	// Predictions are not made across longer gaps, microseconds
+	uint64_t max_gap = 250000;
+
+private:
+	// Squared Mahalanobis distance of a measurement from a prediction, spread
+	// scales the measurement noise variance
+	float Distance(const pose_math::vec3& measured, const pose_math::vec3& predicted, float spread, float dt) const;
+
+	uint32_t m_rejections[K4ABT_JOINT_COUNT] = {};
+	uint32_t m_consecutive[K4ABT_JOINT_COUNT] = {};
+	uint32_t m_swaps = 0;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "motion_estimator.h"
+#include <cmath>
+
+// First and second derivative at tau = 0 of the least squares line (two
+// samples) or parabola (three or more) through values over tau
+static void FitDerivatives(const double* tau, const pose_math::vec3* values, int count,
+	pose_math::vec3* first, pose_math::vec3* second)
+{
+	*first = { 0.F, 0.F, 0.F };
+	*second = { 0.F, 0.F, 0.F };
+	if (count < 2)
+		return;
+
+	double s[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	double t[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+	for (int i = 0; i < count; i++)
+	{
+		double p = 1.0;
+		for (int k = 0; k < 5; k++)
+		{
+			s[k] += p;
+			if (k < 3)
+			{
+				t[k][0] += p * values[i].x;
+				t[k][1] += p * values[i].y;
+				t[k][2] += p * values[i].z;
+			}
+			p *= tau[i];
+		}
+	}
+
+	double result_first[3];
+	double result_second[3] = { 0.0, 0.0, 0.0 };
+
+	if (count == 2)
+	{
+		double det = s[0] * s[2] - s[1] * s[1];
+		if (std::fabs(det) < 1e-12)
+			return;
+		for (int j = 0; j < 3; j++)
+			result_first[j] = (s[0] * t[1][j] - s[1] * t[0][j]) / det;
+	}
+	else
+	{
+		// Cramer's rule on the 3x3 normal equations
+		double m00 = s[0], m01 = s[1], m02 = s[2];
+		double m11 = s[2], m12 = s[3], m22 = s[4];
+		double det = m00 * (m11 * m22 - m12 * m12) - m01 * (m01 * m22 - m12 * m02) + m02 * (m01 * m12 - m11 * m02);
+		if (std::fabs(det) < 1e-18)
+			return;
+
+		for (int j = 0; j < 3; j++)
+		{
+			double r0 = t[0][j], r1 = t[1][j], r2 = t[2][j];
+			double b = (m00 * (r1 * m22 - m12 * r2) - r0 * (m01 * m22 - m12 * m02) + m02 * (m01 * r2 - r1 * m02)) / det;
+			double c = (m00 * (m11 * r2 - r1 * m12) - m01 * (m01 * r2 - r1 * m02) + r0 * (m01 * m12 - m11 * m02)) / det;
+			result_first[j] = b;
+			result_second[j] = 2.0 * c;
+		}
+	}
+
+	*first = { (float)result_first[0], (float)result_first[1], (float)result_first[2] };
+	*second = { (float)result_second[0], (float)result_second[1], (float)result_second[2] };
+}
+
+static pose_math::vec3 Limit(const pose_math::vec3& v, float floor, float ceiling)
+{
+	float magnitude = pose_math::length(v);
+	if (magnitude < floor)
+		return { 0.F, 0.F, 0.F };
+	if (magnitude > ceiling)
+		return v * (ceiling / magnitude);
+	return v;
+}
+
+motion_state_t MotionEstimator::Estimate(const SkeletonHistory& history, k4abt_joint_id_t joint) const
+{
+	static const size_t MAX_FRAMES = 8;
+
+	size_t available = history.Contiguous(max_gap);
+	if (available > frames)
+		available = frames;
+	if (available > MAX_FRAMES)
+		available = MAX_FRAMES;
+
+	double tau[MAX_FRAMES];
+	pose_math::vec3 positions[MAX_FRAMES];
+	pose_math::vec3 rotations[MAX_FRAMES];
+	int count = 0;
+
+	if (history.Size() > 0 && history.HasOutput(joint, 0))
+	{
+		pose_math::quat reference = pose_math::conjugate(history.OutputRotation(joint, 0));
+		for (size_t age = 0; age < available && history.HasOutput(joint, age); age++)
+		{
+			tau[count] = history.Seconds(age);
+			positions[count] = history.OutputPosition(joint, age);
+			// World frame rotation from the newest orientation to this one
+			rotations[count] = pose_math::to_rotation_vector(history.OutputRotation(joint, age) * reference);
+			count++;
+		}
+	}
+
+	motion_state_t state;
+	FitDerivatives(tau, positions, count, &state.velocity, &state.acceleration);
+	FitDerivatives(tau, rotations, count, &state.angular_velocity, &state.angular_acceleration);
+
+	state.velocity = Limit(state.velocity, velocity_floor, max_velocity);
+	state.acceleration = Limit(state.acceleration, acceleration_floor, max_acceleration);
+	state.angular_velocity = Limit(state.angular_velocity, angular_velocity_floor, max_angular_velocity);
+	state.angular_acceleration = Limit(state.angular_acceleration, angular_acceleration_floor, max_angular_acceleration);
+
+	return state;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef K4A_OPENVR_MOTION_ESTIMATOR_H
+#define K4A_OPENVR_MOTION_ESTIMATOR_H
+
+#include "math/pose_math.h"
+#include "skeleton_history.h"
+
+// Derivatives for SteamVR's pose prediction, in world space. A quadratic least
+// squares fit over a joint's last few published poses in the skeleton history,
+// evaluated at the newest one, so single frame noise is averaged out. Rotations
+// are fitted as rotation vectors (quaternion log) relative to the newest
+// orientation.
+typedef struct _motion_state
+{
+	pose_math::vec3 velocity;
+	pose_math::vec3 acceleration;
+	pose_math::vec3 angular_velocity;
+	pose_math::vec3 angular_acceleration;
+} motion_state_t;
+
+class MotionEstimator
+{
+public:
+	// Derivatives of joint's output at the newest frame of history
+	motion_state_t Estimate(const SkeletonHistory& history, k4abt_joint_id_t joint) const;
+
+	// Magnitudes below the floor are noise and read as zero, above the ceiling
+	// they are clamped. Metres and radians per second (squared).
+	float velocity_floor = 0.02F;
+	float max_velocity = 8.F;
+	float acceleration_floor = 0.5F;
+	float max_acceleration = 40.F;
+	float angular_velocity_floor = 0.05F;
+	float max_angular_velocity = 20.F;
+	float angular_acceleration_floor = 1.F;
+	float max_angular_acceleration = 150.F;
+
+	// Frames used, and the longest gap between two of them, microseconds
+	size_t frames = 5;
+	uint64_t max_gap = 250000;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "polynomial_filter.h"
+#include <cmath>
+#include <utility>
+
+// Sums are rebuilt around a new origin this often, keeps tau^4 well scaled
+static const uint64_t REBASE_US = 2000000;
+
+void PolynomialFilter::Accumulate(const SkeletonHistory& history, k4abt_joint_id_t joint, size_t age, double sign)
+{
+	double tau = (double)(int64_t)(history.Time(age) - m_origin) * 1e-6;
+	pose_math::vec3 p = history.Position(joint, age);
+
+	double power = sign;
+	for (int k = 0; k < 2 * MAX_TERMS - 1; k++)
+	{
+		m_power[k] += power;
+		if (k < MAX_TERMS)
+		{
+			m_moment[k][0] += power * p.x;
+			m_moment[k][1] += power * p.y;
+			m_moment[k][2] += power * p.z;
+		}
+		power *= tau;
+	}
+}
+
+void PolynomialFilter::Rebuild(const SkeletonHistory& history, k4abt_joint_id_t joint, size_t count)
+{
+	m_origin = history.Time(0);
+	m_newest = m_origin;
+	for (int k = 0; k < 2 * MAX_TERMS - 1; k++)
+		m_power[k] = 0.0;
+	for (int k = 0; k < MAX_TERMS; k++)
+		m_moment[k][0] = m_moment[k][1] = m_moment[k][2] = 0.0;
+
+	for (size_t age = 0; age < count; age++)
+		Accumulate(history, joint, age, 1.0);
+	m_count = count;
+}
+
+void PolynomialFilter::Update(const SkeletonHistory& history, k4abt_joint_id_t joint)
+{
+	if (history.Size() == 0)
+		return;
+
+	size_t limit = history.Contiguous(max_gap);
+	size_t capacity = (window < SKELETON_HISTORY_CAPACITY) ? window : SKELETON_HISTORY_CAPACITY - 1;
+	if (limit > capacity)
+		limit = capacity;
+	if (limit < 1)
+		limit = 1;
+
+	// Only the newest frame is new if the previous one is what was added last
+	bool continues = m_count > 0 && history.Size() > 1 && history.Contiguous(max_gap) > 1 && history.Time(1) == m_newest;
+	if (!continues || history.Time(0) - m_origin > REBASE_US)
+	{
+		Rebuild(history, joint, limit);
+		return;
+	}
+
+	Accumulate(history, joint, 0, 1.0);
+	m_count++;
+	m_newest = history.Time(0);
+
+	// Oldest sample leaves the window, it is still in history
+	while (m_count > limit)
+	{
+		Accumulate(history, joint, m_count - 1, -1.0);
+		m_count--;
+	}
+}
+
+bool PolynomialFilter::Evaluate(float lead, pose_math::vec3* position, pose_math::vec3* velocity) const
+{
+	if (m_count == 0)
+		return false;
+
+	int terms = order + 1;
+	if (terms > MAX_TERMS)
+		terms = MAX_TERMS;
+	if (terms > (int)m_count)
+		terms = (int)m_count;
+
+	// Normal equations, one right hand side per axis, Gaussian elimination
+	double a[MAX_TERMS][MAX_TERMS + 3];
+	for (int i = 0; i < terms; i++)
+	{
+		for (int j = 0; j < terms; j++)
+			a[i][j] = m_power[i + j];
+		for (int axis = 0; axis < 3; axis++)
+			a[i][terms + axis] = m_moment[i][axis];
+	}
+
+	for (int column = 0; column < terms; column++)
+	{
+		int pivot = column;
+		for (int row = column + 1; row < terms; row++)
+			if (std::fabs(a[row][column]) > std::fabs(a[pivot][column]))
+				pivot = row;
+		if (std::fabs(a[pivot][column]) < 1e-15)
+			return false;
+		if (pivot != column)
+			for (int j = 0; j < terms + 3; j++)
+				std::swap(a[pivot][j], a[column][j]);
+
+		for (int row = 0; row < terms; row++)
+		{
+			if (row == column)
+				continue;
+			double factor = a[row][column] / a[column][column];
+			for (int j = column; j < terms + 3; j++)
+				a[row][j] -= factor * a[column][j];
+		}
+	}
+
+	double tau = (double)(int64_t)(m_newest - m_origin) * 1e-6 + lead;
+	double p[3] = { 0.0, 0.0, 0.0 };
+	double v[3] = { 0.0, 0.0, 0.0 };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		double power = 1.0;
+		for (int k = 0; k < terms; k++)
+		{
+			double coefficient = a[k][terms + axis] / a[k][k];
+			p[axis] += coefficient * power;
+			if (k + 1 < terms)
+				v[axis] += (k + 1) * (a[k + 1][terms + axis] / a[k + 1][k + 1]) * power;
+			power *= tau;
+		}
+	}
+
+	*position = { (float)p[0], (float)p[1], (float)p[2] };
+	*velocity = { (float)v[0], (float)v[1], (float)v[2] };
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef K4A_OPENVR_POLYNOMIAL_FILTER_H
+#define K4A_OPENVR_POLYNOMIAL_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "k4abttypes.h"
+#include "math/pose_math.h"
+#include "skeleton_history.h"
+
+// Least squares polynomial over a joint's last `window` positions in the
+// skeleton history, Savitzky-Golay with real timestamps so dropped frames are
+// handled. The power sums are updated as samples enter and leave the window,
+// so a frame costs the same whatever the window. Lag is tuned with the window
+// and order, and the fit can be evaluated ahead of the newest sample.
+//
+// Works in whatever space the history holds, camera millimetres.
+class PolynomialFilter
+{
+public:
+	// Takes the joint's newest sample from history, call once per appended frame
+	void Update(const SkeletonHistory& history, k4abt_joint_id_t joint);
+
+	// Position and velocity (per second) of the fit at newest sample + lead
+	// seconds. False until enough samples are in.
+	bool Evaluate(float lead, pose_math::vec3* position, pose_math::vec3* velocity) const;
+
+	void Reset()
+	{
+		m_count = 0;
+	};
+
+	// Samples in the window, up to SKELETON_HISTORY_CAPACITY - 1
+	size_t window = 7;
+	// 1 or 2
+	int order = 2;
+	// A longer gap starts a new window, microseconds
+	uint64_t max_gap = 250000;
+
+private:
+	static const int MAX_TERMS = 3;
+
+	void Accumulate(const SkeletonHistory& history, k4abt_joint_id_t joint, size_t age, double sign);
+	void Rebuild(const SkeletonHistory& history, k4abt_joint_id_t joint, size_t count);
+
+	// Sums of tau^k and tau^k * x, tau seconds from m_origin
+	double m_power[2 * MAX_TERMS - 1];
+	double m_moment[MAX_TERMS][3];
+	uint64_t m_origin = 0;
+	uint64_t m_newest = 0;
+	size_t m_count = 0;
+};
+
+#endif
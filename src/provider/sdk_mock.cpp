@@ -0,0 +1,425 @@
+#include "sdk_mock.h"
+#include <k4a/k4atypes.h>
+#include <k4abttypes.h>
+#include <openvr_driver.h>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock mock_clock;
+
+// Depth image size, in the narrow binned mode's proportions
+static const int MOCK_WIDTH = 64;
+static const int MOCK_HEIGHT = 64;
+static const uint16_t MOCK_DEPTH_MM = 2000;
+static const float MOCK_FOCAL = 50.F;
+static const int64_t MOCK_PERIOD_US = 66667;
+
+// The SDK's handles are opaque, these stand behind them
+typedef struct _mock_image
+{
+	std::atomic<int> refs;
+	uint64_t device_us;
+	std::vector<uint16_t> pixels;
+} mock_image_t;
+
+typedef struct _mock_capture
+{
+	std::atomic<int> refs;
+	mock_image_t* depth;
+} mock_capture_t;
+
+typedef struct _mock_tracker
+{
+	std::mutex mutex;
+	std::vector<mock_capture_t*> queue;
+} mock_tracker_t;
+
+typedef struct _mock_frame
+{
+	uint64_t device_us;
+	mock_capture_t* capture;
+} mock_frame_t;
+
+static mock_clock::time_point s_next_capture;
+static uint64_t s_capture_index = 0;
+static uint64_t s_imu_us = 0;
+
+sdk_mock_t& SdkMock()
+{
+	static sdk_mock_t mock;
+	return mock;
+}
+
+// Only the SDKs' types are included, their headers declare the functions
+// imported from the SDK libraries. Callers built against those link to
+// these instead.
+extern "C" {
+
+k4a_result_t k4a_set_debug_message_handler(k4a_logging_message_cb_t* message_cb, void* message_cb_context, k4a_log_level_t min_level)
+{
+	return K4A_RESULT_SUCCEEDED;
+}
+
+k4a_result_t k4a_set_allocator(k4a_memory_allocate_cb_t allocate, k4a_memory_destroy_cb_t free)
+{
+	// Images here are not the SDK's, the buffer pool stays out of it
+	return K4A_RESULT_FAILED;
+}
+
+k4a_result_t k4a_device_open(uint32_t index, k4a_device_t* device_handle)
+{
+	*device_handle = (k4a_device_t)&s_capture_index;
+	return K4A_RESULT_SUCCEEDED;
+}
+
+void k4a_device_close(k4a_device_t device_handle)
+{
+}
+
+k4a_result_t k4a_device_start_cameras(k4a_device_t device_handle, const k4a_device_configuration_t* config)
+{
+	// The device clock starts over with the cameras
+	s_capture_index = 0;
+	s_next_capture = mock_clock::now();
+	return K4A_RESULT_SUCCEEDED;
+}
+
+void k4a_device_stop_cameras(k4a_device_t device_handle)
+{
+}
+
+k4a_result_t k4a_device_start_imu(k4a_device_t device_handle)
+{
+	return K4A_RESULT_SUCCEEDED;
+}
+
+void k4a_device_stop_imu(k4a_device_t device_handle)
+{
+}
+
+k4a_wait_result_t k4a_device_get_capture(k4a_device_t device_handle, k4a_capture_t* capture_handle, int32_t timeout_in_ms)
+{
+	mock_clock::time_point now = mock_clock::now();
+	mock_clock::time_point limit = (timeout_in_ms < 0) ? mock_clock::time_point::max() : now + std::chrono::milliseconds(timeout_in_ms);
+	if (s_next_capture < now)
+		s_next_capture = now;
+	if (!SdkMock().captures || s_next_capture > limit)
+	{
+		// A device that stopped sending blocks an infinite wait for good
+		if (timeout_in_ms < 0)
+			for (;;)
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+		std::this_thread::sleep_until(limit);
+		return K4A_WAIT_RESULT_TIMEOUT;
+	}
+
+	std::this_thread::sleep_until(s_next_capture);
+	s_next_capture += std::chrono::microseconds(MOCK_PERIOD_US);
+	mock_image_t* depth = new mock_image_t{ { 1 }, s_capture_index++ * MOCK_PERIOD_US + 1000,
+		std::vector<uint16_t>(MOCK_WIDTH * MOCK_HEIGHT, MOCK_DEPTH_MM) };
+	*capture_handle = (k4a_capture_t)new mock_capture_t{ { 1 }, depth };
+	return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+k4a_wait_result_t k4a_device_get_imu_sample(k4a_device_t device_handle, k4a_imu_sample_t* imu_sample, int32_t timeout_in_ms)
+{
+	// At rest, 1 kHz
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::memset(imu_sample, 0, sizeof(*imu_sample));
+	imu_sample->acc_sample.xyz.y = -9.80665F;
+	s_imu_us += 1000;
+	imu_sample->acc_timestamp_usec = s_imu_us;
+	imu_sample->gyro_timestamp_usec = s_imu_us;
+	return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+k4a_buffer_result_t k4a_device_get_serialnum(k4a_device_t device_handle, char* serial_number, size_t* serial_number_size)
+{
+	static const char serial[] = "000000000000";
+	if (serial_number == nullptr || *serial_number_size < sizeof(serial))
+	{
+		*serial_number_size = sizeof(serial);
+		return K4A_BUFFER_RESULT_TOO_SMALL;
+	}
+	std::memcpy(serial_number, serial, sizeof(serial));
+	*serial_number_size = sizeof(serial);
+	return K4A_BUFFER_RESULT_SUCCEEDED;
+}
+
+k4a_buffer_result_t k4a_device_get_raw_calibration(k4a_device_t device_handle, uint8_t* data, size_t* data_size)
+{
+	return K4A_BUFFER_RESULT_FAILED;
+}
+
+k4a_result_t k4a_device_get_calibration(k4a_device_t device_handle, const k4a_depth_mode_t depth_mode,
+	const k4a_color_resolution_t color_resolution, k4a_calibration_t* calibration)
+{
+	std::memset(calibration, 0, sizeof(*calibration));
+	calibration->depth_mode = depth_mode;
+	calibration->depth_camera_calibration.resolution_width = MOCK_WIDTH;
+	calibration->depth_camera_calibration.resolution_height = MOCK_HEIGHT;
+	for (int source = 0; source < K4A_CALIBRATION_TYPE_NUM; source++)
+	{
+		for (int target = 0; target < K4A_CALIBRATION_TYPE_NUM; target++)
+		{
+			float* rotation = calibration->extrinsics[source][target].rotation;
+			rotation[0] = rotation[4] = rotation[8] = 1.F;
+		}
+	}
+	return K4A_RESULT_SUCCEEDED;
+}
+
+k4a_result_t k4a_calibration_get_from_raw(char* raw_calibration, size_t raw_calibration_size, const k4a_depth_mode_t depth_mode,
+	const k4a_color_resolution_t color_resolution, k4a_calibration_t* calibration)
+{
+	return K4A_RESULT_FAILED;
+}
+
+// A pinhole camera, centred
+k4a_result_t k4a_calibration_3d_to_2d(const k4a_calibration_t* calibration, const k4a_float3_t* source_point3d_mm,
+	const k4a_calibration_type_t source_camera, const k4a_calibration_type_t target_camera, k4a_float2_t* target_point2d, int* valid)
+{
+	*valid = source_point3d_mm->xyz.z > 0.F;
+	if (*valid)
+	{
+		target_point2d->xy.x = MOCK_WIDTH * 0.5F + source_point3d_mm->xyz.x / source_point3d_mm->xyz.z * MOCK_FOCAL;
+		target_point2d->xy.y = MOCK_HEIGHT * 0.5F + source_point3d_mm->xyz.y / source_point3d_mm->xyz.z * MOCK_FOCAL;
+	}
+	return K4A_RESULT_SUCCEEDED;
+}
+
+k4a_result_t k4a_calibration_2d_to_3d(const k4a_calibration_t* calibration, const k4a_float2_t* source_point2d, const float source_depth_mm,
+	const k4a_calibration_type_t source_camera, const k4a_calibration_type_t target_camera, k4a_float3_t* target_point3d_mm, int* valid)
+{
+	target_point3d_mm->xyz.x = (source_point2d->xy.x - MOCK_WIDTH * 0.5F) / MOCK_FOCAL * source_depth_mm;
+	target_point3d_mm->xyz.y = (source_point2d->xy.y - MOCK_HEIGHT * 0.5F) / MOCK_FOCAL * source_depth_mm;
+	target_point3d_mm->xyz.z = source_depth_mm;
+	*valid = 1;
+	return K4A_RESULT_SUCCEEDED;
+}
+
+k4a_image_t k4a_capture_get_depth_image(k4a_capture_t capture_handle)
+{
+	mock_image_t* depth = ((mock_capture_t*)capture_handle)->depth;
+	depth->refs++;
+	return (k4a_image_t)depth;
+}
+
+void k4a_image_reference(k4a_image_t image_handle)
+{
+	((mock_image_t*)image_handle)->refs++;
+}
+
+void k4a_image_release(k4a_image_t image_handle)
+{
+	mock_image_t* image = (mock_image_t*)image_handle;
+	if (--image->refs == 0)
+		delete image;
+}
+
+static void ReleaseCapture(mock_capture_t* capture)
+{
+	if (--capture->refs == 0)
+	{
+		k4a_image_release((k4a_image_t)capture->depth);
+		delete capture;
+	}
+}
+
+void k4a_capture_release(k4a_capture_t capture_handle)
+{
+	ReleaseCapture((mock_capture_t*)capture_handle);
+}
+
+uint8_t* k4a_image_get_buffer(k4a_image_t image_handle)
+{
+	return (uint8_t*)((mock_image_t*)image_handle)->pixels.data();
+}
+
+int k4a_image_get_width_pixels(k4a_image_t image_handle)
+{
+	return MOCK_WIDTH;
+}
+
+int k4a_image_get_height_pixels(k4a_image_t image_handle)
+{
+	return MOCK_HEIGHT;
+}
+
+int k4a_image_get_stride_bytes(k4a_image_t image_handle)
+{
+	return MOCK_WIDTH * (int)sizeof(uint16_t);
+}
+
+uint64_t k4a_image_get_device_timestamp_usec(k4a_image_t image_handle)
+{
+	return ((mock_image_t*)image_handle)->device_us;
+}
+
+k4a_result_t k4abt_tracker_create(const k4a_calibration_t* sensor_calibration, k4abt_tracker_configuration_t config, k4abt_tracker_t* tracker_handle)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(SdkMock().model_ms.load()));
+	SdkMock().trackers++;
+	*tracker_handle = (k4abt_tracker_t)new mock_tracker_t;
+	return K4A_RESULT_SUCCEEDED;
+}
+
+void k4abt_tracker_destroy(k4abt_tracker_t tracker_handle)
+{
+	mock_tracker_t* tracker = (mock_tracker_t*)tracker_handle;
+	for (mock_capture_t* capture : tracker->queue)
+		ReleaseCapture(capture);
+	delete tracker;
+	SdkMock().trackers--;
+}
+
+void k4abt_tracker_shutdown(k4abt_tracker_t tracker_handle)
+{
+}
+
+void k4abt_tracker_set_temporal_smoothing(k4abt_tracker_t tracker_handle, float smoothing_factor)
+{
+}
+
+k4a_wait_result_t k4abt_tracker_enqueue_capture(k4abt_tracker_t tracker_handle, k4a_capture_t sensor_capture_handle, int32_t timeout_in_ms)
+{
+	mock_tracker_t* tracker = (mock_tracker_t*)tracker_handle;
+	mock_capture_t* capture = (mock_capture_t*)sensor_capture_handle;
+	std::lock_guard<std::mutex> lock(tracker->mutex);
+	capture->refs++;
+	tracker->queue.push_back(capture);
+	return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+k4a_wait_result_t k4abt_tracker_pop_result(k4abt_tracker_t tracker_handle, k4abt_frame_t* body_frame_handle, int32_t timeout_in_ms)
+{
+	mock_tracker_t* tracker = (mock_tracker_t*)tracker_handle;
+	std::lock_guard<std::mutex> lock(tracker->mutex);
+	if (tracker->queue.empty())
+		return K4A_WAIT_RESULT_TIMEOUT;
+
+	mock_capture_t* capture = tracker->queue.front();
+	tracker->queue.erase(tracker->queue.begin());
+	*body_frame_handle = (k4abt_frame_t)new mock_frame_t{ capture->depth->device_us, capture };
+	return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+void k4abt_frame_release(k4abt_frame_t body_frame_handle)
+{
+	mock_frame_t* frame = (mock_frame_t*)body_frame_handle;
+	ReleaseCapture(frame->capture);
+	delete frame;
+}
+
+uint32_t k4abt_frame_get_num_bodies(k4abt_frame_t body_frame_handle)
+{
+	return SdkMock().bodies;
+}
+
+k4a_result_t k4abt_frame_get_body_skeleton(k4abt_frame_t body_frame_handle, uint32_t index, k4abt_skeleton_t* skeleton)
+{
+	if (index >= SdkMock().bodies)
+		return K4A_RESULT_FAILED;
+	std::memset(skeleton, 0, sizeof(*skeleton));
+	for (k4abt_joint_t& joint : skeleton->joints)
+	{
+		joint.position.xyz.z = MOCK_DEPTH_MM - 500.F;
+		joint.orientation.wxyz.w = 1.F;
+		joint.confidence_level = K4ABT_JOINT_CONFIDENCE_MEDIUM;
+	}
+	return K4A_RESULT_SUCCEEDED;
+}
+
+uint64_t k4abt_frame_get_device_timestamp_usec(k4abt_frame_t body_frame_handle)
+{
+	return ((mock_frame_t*)body_frame_handle)->device_us;
+}
+
+k4a_capture_t k4abt_frame_get_capture(k4abt_frame_t body_frame_handle)
+{
+	mock_capture_t* capture = ((mock_frame_t*)body_frame_handle)->capture;
+	capture->refs++;
+	return (k4a_capture_t)capture;
+}
+
+}
+
+// SteamVR: no settings set, no other devices
+class MockSettings : public vr::IVRSettings
+{
+public:
+	const char* GetSettingsErrorNameFromEnum(vr::EVRSettingsError eError) override { return ""; }
+	void SetBool(const char* pchSection, const char* pchSettingsKey, bool bValue, vr::EVRSettingsError* peError) override { Unset(peError); }
+	void SetInt32(const char* pchSection, const char* pchSettingsKey, int32_t nValue, vr::EVRSettingsError* peError) override { Unset(peError); }
+	void SetFloat(const char* pchSection, const char* pchSettingsKey, float flValue, vr::EVRSettingsError* peError) override { Unset(peError); }
+	void SetString(const char* pchSection, const char* pchSettingsKey, const char* pchValue, vr::EVRSettingsError* peError) override { Unset(peError); }
+	bool GetBool(const char* pchSection, const char* pchSettingsKey, vr::EVRSettingsError* peError) override { Unset(peError); return false; }
+	int32_t GetInt32(const char* pchSection, const char* pchSettingsKey, vr::EVRSettingsError* peError) override { Unset(peError); return 0; }
+	float GetFloat(const char* pchSection, const char* pchSettingsKey, vr::EVRSettingsError* peError) override { Unset(peError); return 0.F; }
+	void GetString(const char* pchSection, const char* pchSettingsKey, char* pchValue, uint32_t unValueLen, vr::EVRSettingsError* peError) override
+	{
+		if (unValueLen > 0)
+			pchValue[0] = '\0';
+		Unset(peError);
+	}
+	void RemoveSection(const char* pchSection, vr::EVRSettingsError* peError) override { Unset(peError); }
+	void RemoveKeyInSection(const char* pchSection, const char* pchSettingsKey, vr::EVRSettingsError* peError) override { Unset(peError); }
+
+private:
+	static void Unset(vr::EVRSettingsError* peError)
+	{
+		if (peError != nullptr)
+			*peError = vr::VRSettingsError_UnsetSettingHasNoDefault;
+	}
+};
+
+class MockServerDriverHost : public vr::IVRServerDriverHost
+{
+public:
+	bool TrackedDeviceAdded(const char* pchDeviceSerialNumber, vr::ETrackedDeviceClass eDeviceClass, vr::ITrackedDeviceServerDriver* pDriver) override { return true; }
+	void TrackedDevicePoseUpdated(uint32_t unWhichDevice, const vr::DriverPose_t& newPose, uint32_t unPoseStructSize) override {}
+	void VsyncEvent(double vsyncTimeOffsetSeconds) override {}
+	void VendorSpecificEvent(uint32_t unWhichDevice, vr::EVREventType eventType, const vr::VREvent_Data_t& eventData, double eventTimeOffset) override {}
+	bool IsExiting() override { return false; }
+	bool PollNextEvent(vr::VREvent_t* pEvent, uint32_t uncbVREvent) override { return false; }
+	void GetRawTrackedDevicePoses(float fPredictedSecondsFromNow, vr::TrackedDevicePose_t* pTrackedDevicePoseArray, uint32_t unTrackedDevicePoseArrayCount) override
+	{
+		std::memset(pTrackedDevicePoseArray, 0, sizeof(vr::TrackedDevicePose_t) * unTrackedDevicePoseArrayCount);
+	}
+	void RequestRestart(const char* pchLocalizedReason, const char* pchExecutableToStart, const char* pchArguments, const char* pchWorkingDirectory) override {}
+	uint32_t GetFrameTimings(vr::Compositor_FrameTiming* pTiming, uint32_t nFrames) override { return 0; }
+	void SetDisplayEyeToHead(uint32_t unWhichDevice, const vr::HmdMatrix34_t& eyeToHeadLeft, const vr::HmdMatrix34_t& eyeToHeadRight) override {}
+	void SetDisplayProjectionRaw(uint32_t unWhichDevice, const vr::HmdRect2_t& eyeLeft, const vr::HmdRect2_t& eyeRight) override {}
+	void SetRecommendedRenderTargetSize(uint32_t unWhichDevice, uint32_t nWidth, uint32_t nHeight) override {}
+};
+
+class MockDriverContext : public vr::IVRDriverContext
+{
+public:
+	void* GetGenericInterface(const char* pchInterfaceVersion, vr::EVRInitError* peError) override
+	{
+		void* found = nullptr;
+		if (std::strcmp(pchInterfaceVersion, vr::IVRSettings_Version) == 0)
+			found = &m_settings;
+		else if (std::strcmp(pchInterfaceVersion, vr::IVRServerDriverHost_Version) == 0)
+			found = &m_host;
+		if (peError != nullptr)
+			*peError = found ? vr::VRInitError_None : vr::VRInitError_Init_InterfaceNotFound;
+		return found;
+	}
+
+	vr::DriverHandle_t GetDriverHandle() override { return 1; }
+
+private:
+	MockSettings m_settings;
+	MockServerDriverHost m_host;
+};
+
+void InstallSdkMock()
+{
+	static MockDriverContext context;
+	vr::InitServerDriverContext(&context);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef K4A_OPENVR_SDK_MOCK_H
+#define K4A_OPENVR_SDK_MOCK_H
+
+#include <atomic>
+#include <cstdint>
+
+// Stand-ins for the K4A, body tracking and SteamVR runtimes, linked into
+// tests in place of the SDK libraries so the provider's threads run without
+// a device or a headset. Captures come at 15 fps from a flat wall 2 m away,
+// every body frame has one body standing in front of it.
+typedef struct _sdk_mock
+{
+	// False for a device that stops sending, captures time out
+	std::atomic<bool> captures{ true };
+	// How long k4abt_tracker_create takes, the model load
+	std::atomic<int> model_ms{ 0 };
+	// Trackers created and not yet destroyed
+	std::atomic<int> trackers{ 0 };
+	std::atomic<uint32_t> bodies{ 1 };
+} sdk_mock_t;
+
+sdk_mock_t& SdkMock();
+
+// Hands the mocked SteamVR interfaces to openvr_driver.h's accessors, before
+// the provider is created
+void InstallSdkMock();
+
+#endif
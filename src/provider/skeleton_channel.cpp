@@ -0,0 +1,271 @@
+#include "skeleton_channel.h"
+#include "host_clock.h"
+#include <cstring>
+#include <string>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t RING_MAGIC = 0x4B34534B;
+static const uint32_t RING_VERSION = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+	"The ring is shared between processes, its atomics cannot take locks");
+
+typedef struct alignas(64) _skeleton_slot
+{
+	// Odd while written, and the frame count the slot holds
+	std::atomic<uint32_t> sequence;
+	uint64_t index;
+	skeleton_frame_t frame;
+} skeleton_slot_t;
+
+struct SkeletonChannel::Ring
+{
+	// Set last by the writer, the reader checks them before using anything
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint32_t frame_size;
+
+	// Writer to reader
+	alignas(64) std::atomic<uint64_t> head;
+	// Bumped on every write, the futex word
+	std::atomic<uint32_t> wake;
+	std::atomic<uint64_t> heartbeat_us;
+
+	// Reader to writer
+	alignas(64) std::atomic<uint32_t> options;
+	std::atomic<uint32_t> references;
+
+	skeleton_slot_t slots[SKELETON_CHANNEL_SLOTS];
+};
+
+SkeletonChannel::~SkeletonChannel()
+{
+	Close();
+}
+
+bool SkeletonChannel::Map(const char* name, bool create)
+{
+	Close();
+#if defined(_WIN32)
+	HANDLE mapping = create ?
+		CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(Ring), name) :
+		OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	if (mapping == NULL)
+		return false;
+	void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Ring));
+	if (view == NULL)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	// Auto reset, there is one reader
+	m_event = CreateEventA(NULL, FALSE, FALSE, (std::string(name) + "Event").c_str());
+	m_mapping = mapping;
+#else
+	std::string path = std::string("/") + name;
+	int fd = create ? shm_open(path.c_str(), O_RDWR | O_CREAT, 0600) : shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return false;
+	struct stat status;
+	if ((create && ftruncate(fd, sizeof(Ring)) != 0) || fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(Ring))
+	{
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		close(fd);
+		return false;
+	}
+	m_fd = fd;
+#endif
+	m_ring = (Ring*)view;
+	return true;
+}
+
+void SkeletonChannel::Close()
+{
+	if (m_ring == nullptr)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(m_ring);
+	CloseHandle((HANDLE)m_mapping);
+	if (m_event != nullptr)
+		CloseHandle((HANDLE)m_event);
+	m_mapping = nullptr;
+	m_event = nullptr;
+#else
+	munmap(m_ring, sizeof(Ring));
+	close(m_fd);
+	m_fd = -1;
+#endif
+	m_ring = nullptr;
+}
+
+bool SkeletonChannel::Create(const char* name)
+{
+	if (!Map(name, true))
+		return false;
+
+	// A ring left by an earlier writer keeps its count, the reader's stays valid
+	if (m_ring->magic.load(std::memory_order_acquire) != RING_MAGIC || m_ring->version != RING_VERSION ||
+		m_ring->frame_size != sizeof(skeleton_frame_t))
+	{
+		m_ring->magic.store(0, std::memory_order_relaxed);
+		m_ring->version = RING_VERSION;
+		m_ring->frame_size = sizeof(skeleton_frame_t);
+		m_ring->head.store(0, std::memory_order_relaxed);
+		m_ring->wake.store(0, std::memory_order_relaxed);
+		m_ring->options.store(0, std::memory_order_relaxed);
+		m_ring->references.store(0, std::memory_order_relaxed);
+		for (skeleton_slot_t& slot : m_ring->slots)
+		{
+			slot.sequence.store(0, std::memory_order_relaxed);
+			slot.index = 0;
+		}
+	}
+	m_references = m_ring->references.load(std::memory_order_relaxed);
+	m_ring->heartbeat_us.store(HostTimeUs(), std::memory_order_relaxed);
+	m_ring->magic.store(RING_MAGIC, std::memory_order_release);
+	return true;
+}
+
+bool SkeletonChannel::Open(const char* name)
+{
+	if (!Map(name, false))
+		return false;
+
+	if (m_ring->magic.load(std::memory_order_acquire) != RING_MAGIC || m_ring->version != RING_VERSION ||
+		m_ring->frame_size != sizeof(skeleton_frame_t))
+	{
+		Close();
+		return false;
+	}
+	// Only frames written from now on
+	m_read = m_ring->head.load(std::memory_order_acquire);
+	m_skipped = 0;
+	return true;
+}
+
+void SkeletonChannel::Write(const skeleton_frame_t& frame)
+{
+	uint64_t index = m_ring->head.load(std::memory_order_relaxed);
+	skeleton_slot_t& slot = m_ring->slots[index % SKELETON_CHANNEL_SLOTS];
+
+	uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.index = index;
+	std::memcpy(&slot.frame, &frame, sizeof(frame));
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	m_ring->head.store(index + 1, std::memory_order_release);
+	m_ring->heartbeat_us.store(HostTimeUs(), std::memory_order_relaxed);
+	m_ring->wake.fetch_add(1, std::memory_order_release);
+	Signal();
+}
+
+void SkeletonChannel::Heartbeat()
+{
+	m_ring->heartbeat_us.store(HostTimeUs(), std::memory_order_relaxed);
+}
+
+uint32_t SkeletonChannel::GetOptions() const
+{
+	return m_ring->options.load(std::memory_order_relaxed);
+}
+
+bool SkeletonChannel::TakeReferenceRequest()
+{
+	uint32_t references = m_ring->references.load(std::memory_order_relaxed);
+	if (references == m_references)
+		return false;
+	m_references = references;
+	return true;
+}
+
+bool SkeletonChannel::Read(skeleton_frame_t* frame, uint32_t timeout_ms)
+{
+	uint64_t deadline_us = HostTimeUs() + (uint64_t)timeout_ms * 1000;
+	for (;;)
+	{
+		// The wake word before the head, a write in between still wakes the wait
+		uint32_t wake = m_ring->wake.load(std::memory_order_acquire);
+		uint64_t head = m_ring->head.load(std::memory_order_acquire);
+		if (head < m_read)
+			m_read = head;
+		if (head > m_read)
+		{
+			const skeleton_slot_t& slot = m_ring->slots[(head - 1) % SKELETON_CHANNEL_SLOTS];
+			uint32_t before = slot.sequence.load(std::memory_order_acquire);
+			uint64_t index = slot.index;
+			std::memcpy(frame, &slot.frame, sizeof(*frame));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint32_t after = slot.sequence.load(std::memory_order_relaxed);
+
+			// Torn or lapped, a newer frame is already in, take that one
+			if (before != after || (before & 1) != 0 || index != head - 1)
+				continue;
+
+			m_skipped += head - 1 - m_read;
+			m_read = head;
+			return true;
+		}
+
+		uint64_t now_us = HostTimeUs();
+		if (now_us >= deadline_us)
+			return false;
+		Wait(wake, (uint32_t)((deadline_us - now_us + 999) / 1000));
+	}
+}
+
+bool SkeletonChannel::IsWriterAlive(uint64_t timeout_us) const
+{
+	return HostTimeUs() < m_ring->heartbeat_us.load(std::memory_order_relaxed) + timeout_us;
+}
+
+void SkeletonChannel::SetOptions(uint32_t options)
+{
+	m_ring->options.store(options, std::memory_order_relaxed);
+}
+
+void SkeletonChannel::RequestReference()
+{
+	m_ring->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SkeletonChannel::Wait(uint32_t wake, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+	// A signal left over from a frame already read only costs one more loop
+	if (m_ring->wake.load(std::memory_order_acquire) == wake && m_event != nullptr)
+		WaitForSingleObject((HANDLE)m_event, timeout_ms);
+#else
+	// Not the private futex, the word is shared between processes
+	struct timespec timeout = { (time_t)(timeout_ms / 1000), (long)(timeout_ms % 1000) * 1000000L };
+	syscall(SYS_futex, (uint32_t*)&m_ring->wake, FUTEX_WAIT, wake, &timeout, nullptr, 0);
+#endif
+}
+
+void SkeletonChannel::Signal()
+{
+#if defined(_WIN32)
+	if (m_event != nullptr)
+		SetEvent((HANDLE)m_event);
+#else
+	syscall(SYS_futex, (uint32_t*)&m_ring->wake, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
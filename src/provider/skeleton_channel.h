@@ -0,0 +1,112 @@
+#pragma once
+#ifndef K4A_OPENVR_SKELETON_CHANNEL_H
+#define K4A_OPENVR_SKELETON_CHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "k4abttypes.h"
+#include "floor_detector.h"
+
+#define SKELETON_CHANNEL_NAME "K4AOpenVRSkeletons"
+#define SKELETON_CHANNEL_SLOTS 8
+
+// What the reader wants the writer to do with the depth image, see SetOptions
+#define SKELETON_OPTION_FEET 0x1
+#define SKELETON_OPTION_FLOOR 0x2
+// SteamVR is in standby: no inference, or with PRESENCE one capture a second
+// and its frame written so the reader sees a body walk up
+#define SKELETON_OPTION_STANDBY 0x4
+#define SKELETON_OPTION_PRESENCE 0x8
+
+// One body tracker result with what the service knows about the camera.
+// Camera space and millimetres, as the SDK gives them.
+typedef struct _skeleton_frame
+{
+	// Device time of the depth image, and the host steady clock time it was
+	// captured at, microseconds
+	uint64_t frame_us;
+	uint64_t capture_us;
+	bool body;
+	k4abt_skeleton_t skeleton;
+
+	// Gravity's up from the IMU while has_up
+	bool has_up;
+	pose_math::vec3 up;
+	// The camera moved since the last reference, stays set until the next
+	bool moved;
+
+	// Last floor found, floor_sequence counts the detections
+	uint32_t floor_sequence;
+	floor_plane_t floor;
+} skeleton_frame_t;
+
+// Skeletons from the tracking service to the driver through shared memory,
+// one writer and one reader. A ring of slots, each behind a seqlock like the
+// calibrator's head joint: the writer never waits, the reader takes the
+// newest frame and skips the ones it was too slow for. The reader sleeps on a
+// futex (Linux) or a named event (Windows) that every write signals, so a
+// frame is in the driver within tens of microseconds.
+//
+// A small back channel lets the reader pass options and reference requests to
+// the writer. Mappings outlive either side, a restarted service carries on
+// where the last one stopped.
+class SkeletonChannel
+{
+public:
+	SkeletonChannel() = default;
+	SkeletonChannel(const SkeletonChannel&) = delete;
+	SkeletonChannel& operator=(const SkeletonChannel&) = delete;
+	~SkeletonChannel();
+
+	// Writer side, creates the ring or takes over an existing one
+	bool Create(const char* name = SKELETON_CHANNEL_NAME);
+	// Reader side, false until a writer has created the ring
+	bool Open(const char* name = SKELETON_CHANNEL_NAME);
+	void Close();
+	bool IsOpen() const
+	{
+		return m_ring != nullptr;
+	};
+
+	// Writer
+	void Write(const skeleton_frame_t& frame);
+	// Keeps the writer alive to the reader while there are no frames
+	void Heartbeat();
+	uint32_t GetOptions() const;
+	// True once per RequestReference
+	bool TakeReferenceRequest();
+
+	// Reader: the newest frame not read yet, waiting up to timeout_ms for it
+	bool Read(skeleton_frame_t* frame, uint32_t timeout_ms);
+	// The writer wrote or beat within timeout_us
+	bool IsWriterAlive(uint64_t timeout_us) const;
+	void SetOptions(uint32_t options);
+	void RequestReference();
+	// Frames written but never read since Open
+	uint64_t GetSkipped() const
+	{
+		return m_skipped;
+	};
+
+private:
+	struct Ring;
+
+	bool Map(const char* name, bool create);
+	// Until the ring's wake word moves from wake, or timeout_ms
+	void Wait(uint32_t wake, uint32_t timeout_ms);
+	void Signal();
+
+	Ring* m_ring = nullptr;
+	// Native handles: the mapping and the event on Windows, the fd on Linux
+	void* m_mapping = nullptr;
+	void* m_event = nullptr;
+	int m_fd = -1;
+
+	// Reader: frames read so far, by the writer's count
+	uint64_t m_read = 0;
+	uint64_t m_skipped = 0;
+	uint32_t m_references = 0;
+};
+
+#endif
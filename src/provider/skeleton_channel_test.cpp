@@ -0,0 +1,132 @@
+// Write to read latency of the skeleton channel, the writer on one thread
+// and the reader asleep in Read on another so every frame goes through the
+// futex or event wake. The channel must add under CHANNEL_LIMIT_US to a
+// frame. Returns non zero on failure.
+
+#include "skeleton_channel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock test_clock;
+
+static const double CHANNEL_LIMIT_US = 100.0;
+// Frames timed, and the gap between writes, long enough for the reader to
+// be back asleep before the next
+static const int LATENCY_FRAMES = 2000;
+static const int WRITE_INTERVAL_US = 500;
+static const char* TEST_CHANNEL = "K4AOpenVRSkeletonsTest";
+
+static int s_failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); s_failures++; } } while (0)
+
+static uint64_t Nanoseconds()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(test_clock::now().time_since_epoch()).count();
+}
+
+static double Percentile(std::vector<double>& values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	size_t i = std::min((size_t)(p * (double)values.size()), values.size() - 1);
+	std::nth_element(values.begin(), values.begin() + i, values.end());
+	return values[i];
+}
+
+static void TestRoundTrip()
+{
+	SkeletonChannel writer;
+	SkeletonChannel reader;
+	CHECK(writer.Create(TEST_CHANNEL));
+	CHECK(reader.Open(TEST_CHANNEL));
+
+	skeleton_frame_t frame = {};
+	frame.frame_us = 1000;
+	frame.capture_us = 2000;
+	frame.body = true;
+	frame.skeleton.joints[K4ABT_JOINT_PELVIS].position.xyz.x = 12.5F;
+	frame.floor_sequence = 3;
+	writer.Write(frame);
+
+	skeleton_frame_t read = {};
+	CHECK(reader.Read(&read, 100));
+	CHECK(read.frame_us == 1000 && read.capture_us == 2000 && read.body);
+	CHECK(read.skeleton.joints[K4ABT_JOINT_PELVIS].position.xyz.x == 12.5F);
+	CHECK(read.floor_sequence == 3);
+	// Nothing newer
+	CHECK(!reader.Read(&read, 0));
+
+	reader.SetOptions(SKELETON_OPTION_FLOOR);
+	CHECK(writer.GetOptions() == SKELETON_OPTION_FLOOR);
+}
+
+static void TestLatency()
+{
+	SkeletonChannel writer;
+	SkeletonChannel reader;
+	CHECK(writer.Create(TEST_CHANNEL));
+	CHECK(reader.Open(TEST_CHANNEL));
+
+	std::vector<double> latencies;
+	latencies.reserve(LATENCY_FRAMES);
+	std::thread reading([&] {
+		skeleton_frame_t frame;
+		while ((int)latencies.size() < LATENCY_FRAMES)
+		{
+			if (!reader.Read(&frame, 1000))
+				break;
+			// The write time rides in capture_us, nanoseconds, for this test only
+			latencies.push_back((double)(Nanoseconds() - frame.capture_us) * 1e-3);
+		}
+	});
+
+	skeleton_frame_t frame = {};
+	for (int i = 0; i < LATENCY_FRAMES; i++)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(WRITE_INTERVAL_US));
+		frame.frame_us = (uint64_t)(i + 1) * WRITE_INTERVAL_US;
+		frame.capture_us = Nanoseconds();
+		writer.Write(frame);
+	}
+	reading.join();
+
+	CHECK((int)latencies.size() == LATENCY_FRAMES);
+	double p50 = Percentile(latencies, 0.5);
+	double p99 = Percentile(latencies, 0.99);
+	double worst = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+	std::printf("  %zu frames, %llu skipped: p50 %.1f us, p99 %.1f us, worst %.1f us, limit %.0f us\n", latencies.size(),
+		(unsigned long long)reader.GetSkipped(), p50, p99, worst, CHANNEL_LIMIT_US);
+	CHECK(p99 < CHANNEL_LIMIT_US);
+}
+
+typedef struct _skeleton_channel_test
+{
+	const char* name;
+	void(*run)();
+} skeleton_channel_test_t;
+
+int main()
+{
+	static const skeleton_channel_test_t tests[] = {
+		{ "round trip", TestRoundTrip },
+		{ "latency", TestLatency },
+	};
+
+	int failed = 0;
+	for (const skeleton_channel_test_t& test : tests)
+	{
+		int before = s_failures;
+		std::printf("%s\n", test.name);
+		test.run();
+		bool passed = s_failures == before;
+		std::printf("%-24s %s\n", test.name, passed ? "ok" : "FAILED");
+		failed += passed ? 0 : 1;
+	}
+
+	return failed == 0 ? 0 : 1;
+}
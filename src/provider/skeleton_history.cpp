@@ -0,0 +1,109 @@
+#include "skeleton_history.h"
+
+void SkeletonHistory::Append(uint64_t time_us, const k4abt_skeleton_t& skeleton)
+{
+	// Device clock restarted, what is kept no longer lines up
+	if (m_size > 0 && time_us <= m_time[m_newest])
+		m_size = 0;
+
+	m_newest = (m_newest + 1) % SKELETON_HISTORY_CAPACITY;
+	if (m_size < SKELETON_HISTORY_CAPACITY)
+		m_size++;
+
+	size_t slot = m_newest;
+	m_time[slot] = time_us;
+
+	for (int i = 0; i < K4ABT_JOINT_COUNT; i++)
+	{
+		const k4abt_joint_t& joint = skeleton.joints[i];
+		joint_history_t& history = m_joints[i];
+
+		history.x[slot] = joint.position.xyz.x;
+		history.y[slot] = joint.position.xyz.y;
+		history.z[slot] = joint.position.xyz.z;
+		history.qw[slot] = joint.orientation.wxyz.w;
+		history.qx[slot] = joint.orientation.wxyz.x;
+		history.qy[slot] = joint.orientation.wxyz.y;
+		history.qz[slot] = joint.orientation.wxyz.z;
+		history.confidence[slot] = (uint8_t)joint.confidence_level;
+		history.has_output[slot] = 0;
+	}
+}
+
+void SkeletonHistory::SetOutput(k4abt_joint_id_t joint, const pose_math::vec3& position, const pose_math::quat& rotation)
+{
+	joint_history_t& history = m_joints[joint];
+	size_t slot = m_newest;
+
+	history.out_x[slot] = position.x;
+	history.out_y[slot] = position.y;
+	history.out_z[slot] = position.z;
+	history.out_qw[slot] = rotation.w;
+	history.out_qx[slot] = rotation.x;
+	history.out_qy[slot] = rotation.y;
+	history.out_qz[slot] = rotation.z;
+	history.has_output[slot] = 1;
+}
+
+pose_math::vec3 SkeletonHistory::Position(k4abt_joint_id_t joint, size_t age) const
+{
+	const joint_history_t& history = m_joints[joint];
+	size_t slot = Slot(age);
+	return { history.x[slot], history.y[slot], history.z[slot] };
+}
+
+pose_math::quat SkeletonHistory::Orientation(k4abt_joint_id_t joint, size_t age) const
+{
+	const joint_history_t& history = m_joints[joint];
+	size_t slot = Slot(age);
+	return { history.qw[slot], history.qx[slot], history.qy[slot], history.qz[slot] };
+}
+
+k4abt_joint_confidence_level_t SkeletonHistory::Confidence(k4abt_joint_id_t joint, size_t age) const
+{
+	return (k4abt_joint_confidence_level_t)m_joints[joint].confidence[Slot(age)];
+}
+
+pose_math::vec3 SkeletonHistory::OutputPosition(k4abt_joint_id_t joint, size_t age) const
+{
+	const joint_history_t& history = m_joints[joint];
+	size_t slot = Slot(age);
+	return { history.out_x[slot], history.out_y[slot], history.out_z[slot] };
+}
+
+pose_math::quat SkeletonHistory::OutputRotation(k4abt_joint_id_t joint, size_t age) const
+{
+	const joint_history_t& history = m_joints[joint];
+	size_t slot = Slot(age);
+	return { history.out_qw[slot], history.out_qx[slot], history.out_qy[slot], history.out_qz[slot] };
+}
+
+int SkeletonHistory::AgeAt(uint64_t time_us) const
+{
+	if (m_size == 0 || time_us < Time(m_size - 1))
+		return -1;
+
+	// Timestamps increase with slot order, binary search over age
+	size_t newer = 0;
+	size_t older = m_size - 1;
+	while (newer < older)
+	{
+		size_t middle = (newer + older) / 2;
+		if (Time(middle) <= time_us)
+			older = middle;
+		else
+			newer = middle + 1;
+	}
+	return (int)newer;
+}
+
+size_t SkeletonHistory::Contiguous(uint64_t max_gap_us) const
+{
+	if (m_size == 0)
+		return 0;
+
+	size_t count = 1;
+	while (count < m_size && Time(count - 1) - Time(count) <= max_gap_us)
+		count++;
+	return count;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#ifndef K4A_OPENVR_SKELETON_HISTORY_H
+#define K4A_OPENVR_SKELETON_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include "k4abttypes.h"
+#include "math/pose_math.h"
+
+// The last SKELETON_HISTORY_CAPACITY body frames, shared by every temporal
+// stage of the provider instead of each keeping its own samples. Joint major
+// structure of arrays: one joint's samples over time are contiguous, which is
+// how the stages walk it. Fixed size, nothing is allocated after construction.
+//
+// Frames are addressed by age, 0 being the newest.
+#define SKELETON_HISTORY_CAPACITY 32
+
+typedef struct _joint_history
+{
+	// Body tracker measurement, camera space millimetres
+	float x[SKELETON_HISTORY_CAPACITY];
+	float y[SKELETON_HISTORY_CAPACITY];
+	float z[SKELETON_HISTORY_CAPACITY];
+	float qw[SKELETON_HISTORY_CAPACITY];
+	float qx[SKELETON_HISTORY_CAPACITY];
+	float qy[SKELETON_HISTORY_CAPACITY];
+	float qz[SKELETON_HISTORY_CAPACITY];
+	uint8_t confidence[SKELETON_HISTORY_CAPACITY];
+
+	// World space pose as published, if the joint drives a tracker
+	uint8_t has_output[SKELETON_HISTORY_CAPACITY];
+	float out_x[SKELETON_HISTORY_CAPACITY];
+	float out_y[SKELETON_HISTORY_CAPACITY];
+	float out_z[SKELETON_HISTORY_CAPACITY];
+	float out_qw[SKELETON_HISTORY_CAPACITY];
+	float out_qx[SKELETON_HISTORY_CAPACITY];
+	float out_qy[SKELETON_HISTORY_CAPACITY];
+	float out_qz[SKELETON_HISTORY_CAPACITY];
+} joint_history_t;
+
+class SkeletonHistory
+{
+public:
+	void Clear()
+	{
+		m_size = 0;
+	};
+
+	// Starts a new frame, overwriting the oldest once full
+	void Append(uint64_t time_us, const k4abt_skeleton_t& skeleton);
+
+	// Stores a joint's published pose in the newest frame
+	void SetOutput(k4abt_joint_id_t joint, const pose_math::vec3& position, const pose_math::quat& rotation);
+
+	size_t Size() const
+	{
+		return m_size;
+	};
+
+	// Device timestamp, microseconds
+	uint64_t Time(size_t age) const
+	{
+		return m_time[Slot(age)];
+	};
+	float Seconds(size_t age) const
+	{
+		return (float)(int64_t)(m_time[Slot(age)] - m_time[m_newest]) * 1e-6F;
+	};
+
+	pose_math::vec3 Position(k4abt_joint_id_t joint, size_t age) const;
+	pose_math::quat Orientation(k4abt_joint_id_t joint, size_t age) const;
+	k4abt_joint_confidence_level_t Confidence(k4abt_joint_id_t joint, size_t age) const;
+
+	bool HasOutput(k4abt_joint_id_t joint, size_t age) const
+	{
+		return m_joints[joint].has_output[Slot(age)] != 0;
+	};
+	pose_math::vec3 OutputPosition(k4abt_joint_id_t joint, size_t age) const;
+	pose_math::quat OutputRotation(k4abt_joint_id_t joint, size_t age) const;
+
+	// Age of the newest frame captured at or before time_us, -1 if older than
+	// everything kept
+	int AgeAt(uint64_t time_us) const;
+
+	// Number of frames from the newest back with no gap over max_gap_us
+	size_t Contiguous(uint64_t max_gap_us) const;
+
+	const joint_history_t& Joint(k4abt_joint_id_t joint) const
+	{
+		return m_joints[joint];
+	};
+	// Slot of a frame in the joint_history_t arrays
+	size_t Slot(size_t age) const
+	{
+		return (m_newest + SKELETON_HISTORY_CAPACITY - age) % SKELETON_HISTORY_CAPACITY;
+	};
+
+private:
+	joint_history_t m_joints[K4ABT_JOINT_COUNT];
+	uint64_t m_time[SKELETON_HISTORY_CAPACITY];
+	size_t m_newest = SKELETON_HISTORY_CAPACITY - 1;
+	size_t m_size = 0;
+};
+
+#endif
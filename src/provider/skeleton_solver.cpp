@@ -0,0 +1,213 @@
+#include "skeleton_solver.h"
+#include <cmath>
+
+// Joints of each chain, root, middle, end, tip
+static const k4abt_joint_id_t CHAIN_JOINTS[SOLVER_CHAIN_COUNT][4] = {
+	{ K4ABT_JOINT_HIP_LEFT, K4ABT_JOINT_KNEE_LEFT, K4ABT_JOINT_ANKLE_LEFT, K4ABT_JOINT_FOOT_LEFT },
+	{ K4ABT_JOINT_HIP_RIGHT, K4ABT_JOINT_KNEE_RIGHT, K4ABT_JOINT_ANKLE_RIGHT, K4ABT_JOINT_FOOT_RIGHT },
+	{ K4ABT_JOINT_SHOULDER_LEFT, K4ABT_JOINT_ELBOW_LEFT, K4ABT_JOINT_WRIST_LEFT, K4ABT_JOINT_HAND_LEFT },
+	{ K4ABT_JOINT_SHOULDER_RIGHT, K4ABT_JOINT_ELBOW_RIGHT, K4ABT_JOINT_WRIST_RIGHT, K4ABT_JOINT_HAND_RIGHT }
+};
+
+static const char* BONE_NAMES[SOLVER_BONE_COUNT] = {
+	"thigh_left", "shin_left", "foot_left",
+	"thigh_right", "shin_right", "foot_right",
+	"upper_arm_left", "forearm_left", "hand_left",
+	"upper_arm_right", "forearm_right", "hand_right"
+};
+
+// Offset of the middle joint from the root-end line that gives a bend direction, mm
+static const float MIN_BEND = 10.F;
+
+// Medium is the best level the body tracker currently reports
+static bool Confident(const k4abt_joint_t& joint)
+{
+	return joint.confidence_level >= K4ABT_JOINT_CONFIDENCE_MEDIUM;
+}
+
+static pose_math::vec3 Position(const k4abt_joint_t& joint)
+{
+	return pose_math::to_vec3(joint.position);
+}
+
+// Part of v perpendicular to the unit direction axis, normalised
+static pose_math::vec3 Perpendicular(const pose_math::vec3& v, const pose_math::vec3& axis)
+{
+	return pose_math::normalize(v - axis * pose_math::dot(v, axis));
+}
+
+const char* SkeletonSolver::BoneName(size_t bone)
+{
+	return (bone < SOLVER_BONE_COUNT) ? BONE_NAMES[bone] : "";
+}
+
+void SkeletonSolver::Reset()
+{
+	for (size_t i = 0; i < SOLVER_CHAIN_COUNT; i++)
+	{
+		m_memory[i].valid = false;
+		m_memory[i].bend_valid = false;
+		m_memory[i].tip_valid = false;
+	}
+}
+
+void SkeletonSolver::GetLengths(float* lengths) const
+{
+	for (size_t i = 0; i < SOLVER_BONE_COUNT; i++)
+		lengths[i] = Known(i) ? m_lengths[i].length : 0.F;
+}
+
+void SkeletonSolver::SetLengths(const float* lengths)
+{
+	// Stored lengths are trusted straight away and keep being refined
+	for (size_t i = 0; i < SOLVER_BONE_COUNT; i++)
+	{
+		if (lengths[i] > 0.F)
+		{
+			m_lengths[i].length = lengths[i];
+			m_lengths[i].samples = min_samples;
+		}
+	}
+}
+
+void SkeletonSolver::Learn(size_t bone, const pose_math::vec3& a, const pose_math::vec3& b)
+{
+	bone_length_t& learned = m_lengths[bone];
+	float measured = pose_math::length(b - a);
+
+	if (Known(bone) && std::fabs(measured - learned.length) > max_length_error * learned.length)
+		return;
+
+	// Running mean, fading into a moving average once the window is full
+	uint32_t count = (learned.samples < max_samples) ? learned.samples + 1 : max_samples;
+	learned.length += (measured - learned.length) / (float)count;
+	if (learned.samples < max_samples)
+		learned.samples++;
+}
+
+uint32_t SkeletonSolver::SolveChain(size_t chain, k4abt_skeleton_t& skeleton)
+{
+	const k4abt_joint_id_t* ids = CHAIN_JOINTS[chain];
+	k4abt_joint_t& root = skeleton.joints[ids[0]];
+	k4abt_joint_t& middle = skeleton.joints[ids[1]];
+	k4abt_joint_t& end = skeleton.joints[ids[2]];
+	k4abt_joint_t& tip = skeleton.joints[ids[3]];
+	bool root_ok = Confident(root);
+	bool middle_ok = Confident(middle);
+	bool end_ok = Confident(end);
+	bool tip_ok = Confident(tip);
+
+	size_t upper_bone = chain * SOLVER_BONES_PER_CHAIN;
+	size_t lower_bone = upper_bone + 1;
+	size_t tip_bone = upper_bone + 2;
+
+	if (root_ok && middle_ok)
+		Learn(upper_bone, Position(root), Position(middle));
+	if (middle_ok && end_ok)
+		Learn(lower_bone, Position(middle), Position(end));
+	if (end_ok && tip_ok)
+		Learn(tip_bone, Position(end), Position(tip));
+
+	chain_memory_t& memory = m_memory[chain];
+	if (root_ok && middle_ok && end_ok)
+	{
+		pose_math::vec3 direction = pose_math::normalize(Position(end) - Position(root));
+		memory.upper = Position(middle) - Position(root);
+		memory.lower = Position(end) - Position(middle);
+		memory.middle_rotation = pose_math::to_quat(middle.orientation);
+		memory.end_rotation = pose_math::to_quat(end.orientation);
+
+		// A nearly straight limb says nothing about the way it bends
+		pose_math::vec3 offset = memory.upper - direction * pose_math::dot(memory.upper, direction);
+		if (pose_math::length(offset) > MIN_BEND)
+		{
+			memory.bend = pose_math::normalize(offset);
+			memory.bend_valid = true;
+		}
+		memory.valid = true;
+		if (tip_ok)
+		{
+			memory.tip = Position(tip) - Position(end);
+			memory.tip_rotation = pose_math::to_quat(tip.orientation);
+			memory.tip_valid = true;
+		}
+		if (tip_ok || !memory.tip_valid || !Known(tip_bone))
+			return 0;
+	}
+
+	// Everything hangs off the root and the last confident pose
+	if (!root_ok || !memory.valid || !Known(upper_bone) || !Known(lower_bone))
+		return 0;
+
+	float upper_length = m_lengths[upper_bone].length;
+	float lower_length = m_lengths[lower_bone].length;
+	pose_math::vec3 root_position = Position(root);
+	pose_math::vec3 middle_position = Position(middle);
+	pose_math::vec3 end_position = Position(end);
+	uint32_t rebuilt = 0;
+
+	if (!middle_ok)
+	{
+		// End from the measurement, or where it last was relative to the root
+		pose_math::vec3 target = end_ok ? end_position : root_position + memory.upper + memory.lower;
+		pose_math::vec3 reach = target - root_position;
+		float distance = pose_math::length(reach);
+		if (distance < 1e-3F)
+			return 0;
+		pose_math::vec3 direction = reach / distance;
+
+		// Two bone IK, law of cosines, bent the way the limb last bent
+		float max_reach = (upper_length + lower_length) * 0.999F;
+		float min_reach = std::fabs(upper_length - lower_length) * 1.001F;
+		distance = (distance > max_reach) ? max_reach : (distance < min_reach) ? min_reach : distance;
+		float along = (upper_length * upper_length - lower_length * lower_length + distance * distance) / (2.F * distance);
+		float height = std::sqrt(std::fmax(upper_length * upper_length - along * along, 0.F));
+
+		pose_math::vec3 bend = Perpendicular(memory.bend, direction);
+		if (!memory.bend_valid || pose_math::length_squared(bend) == 0.F)
+			return 0;
+
+		middle_position = root_position + direction * along + bend * height;
+		pose_math::store(middle_position, middle.position);
+		pose_math::store(pose_math::rotation_between(memory.upper, middle_position - root_position) * memory.middle_rotation, middle.orientation);
+		rebuilt |= 1u << ids[1];
+
+		if (!end_ok)
+		{
+			end_position = root_position + direction * distance;
+			pose_math::store(end_position, end.position);
+			rebuilt |= 1u << ids[2];
+		}
+	}
+	else if (!end_ok)
+	{
+		// Last knee or elbow angle, carried along with the upper bone
+		pose_math::quat upper_delta = pose_math::rotation_between(memory.upper, middle_position - root_position);
+		end_position = middle_position + pose_math::normalize(pose_math::rotate(upper_delta, memory.lower)) * lower_length;
+		pose_math::store(end_position, end.position);
+		rebuilt |= 1u << ids[2];
+	}
+
+	pose_math::quat lower_delta = pose_math::rotation_between(memory.lower, end_position - middle_position);
+	if (rebuilt & (1u << ids[2]))
+		pose_math::store(pose_math::normalize(lower_delta * memory.end_rotation), end.orientation);
+
+	// Feet and hands stay rigid to the lower bone
+	if (!tip_ok && memory.tip_valid && Known(tip_bone))
+	{
+		pose_math::vec3 tip_position = end_position + pose_math::normalize(pose_math::rotate(lower_delta, memory.tip)) * m_lengths[tip_bone].length;
+		pose_math::store(tip_position, tip.position);
+		pose_math::store(pose_math::normalize(lower_delta * memory.tip_rotation), tip.orientation);
+		rebuilt |= 1u << ids[3];
+	}
+
+	return rebuilt;
+}
+
+uint32_t SkeletonSolver::Solve(k4abt_skeleton_t& skeleton)
+{
+	uint32_t rebuilt = 0;
+	for (size_t chain = 0; chain < SOLVER_CHAIN_COUNT; chain++)
+		rebuilt |= SolveChain(chain, skeleton);
+	return rebuilt;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#ifndef K4A_OPENVR_SKELETON_SOLVER_H
+#define K4A_OPENVR_SKELETON_SOLVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "k4abttypes.h"
+#include "math/pose_math.h"
+
+// Limbs the solver looks after, root -> middle -> end -> tip
+typedef enum
+{
+	SOLVER_LEG_LEFT = 0,
+	SOLVER_LEG_RIGHT,
+	SOLVER_ARM_LEFT,
+	SOLVER_ARM_RIGHT,
+	SOLVER_CHAIN_COUNT
+} solver_chain_t;
+
+// Each chain has an upper (root-middle), lower (middle-end) and tip (end-tip) bone
+#define SOLVER_BONES_PER_CHAIN 3
+#define SOLVER_BONE_COUNT (SOLVER_CHAIN_COUNT * SOLVER_BONES_PER_CHAIN)
+
+// Bone length constraints for the limbs, in camera space millimetres. Lengths
+// are learned online from frames where both ends of a bone are confident.
+// Joints the body tracker reports with low or no confidence are then rebuilt
+// from their parents: two bone IK for the middle joint, keeping the last
+// confident bend direction, and the last confident limb pose carried along
+// with the bones for the rest. Runs in place on the skeleton before it enters
+// the history.
+class SkeletonSolver
+{
+public:
+	// Learns from the confident joints and rebuilds the others in place.
+	// Returns a mask of the rebuilt joints, one bit per k4abt_joint_id_t.
+	uint32_t Solve(k4abt_skeleton_t& skeleton);
+
+	// Forgets the last confident pose, lengths are kept
+	void Reset();
+
+	// Learned lengths in millimetres, 0 where not learned yet. Arrays of
+	// SOLVER_BONE_COUNT, indexed chain * SOLVER_BONES_PER_CHAIN + bone.
+	void GetLengths(float* lengths) const;
+	void SetLengths(const float* lengths);
+
+	// Name of a bone for profile storage
+	static const char* BoneName(size_t bone);
+
+	// Samples before a length is trusted, and the averaging window after that
+	uint32_t min_samples = 30;
+	uint32_t max_samples = 600;
+	// Measurements this far off a learned length (fraction) are not learned
+	float max_length_error = 0.25F;
+
+private:
+	typedef struct _bone_length
+	{
+		float length;
+		uint32_t samples;
+	} bone_length_t;
+
+	// Last pose of a chain with root, middle and end confident
+	typedef struct _chain_memory
+	{
+		bool valid;
+		bool bend_valid;
+		bool tip_valid;
+		pose_math::vec3 upper;
+		pose_math::vec3 lower;
+		pose_math::vec3 tip;
+		pose_math::vec3 bend;
+		pose_math::quat middle_rotation;
+		pose_math::quat end_rotation;
+		pose_math::quat tip_rotation;
+	} chain_memory_t;
+
+	void Learn(size_t bone, const pose_math::vec3& a, const pose_math::vec3& b);
+	bool Known(size_t bone) const
+	{
+		return m_lengths[bone].samples >= min_samples;
+	};
+	uint32_t SolveChain(size_t chain, k4abt_skeleton_t& skeleton);
+
+	bone_length_t m_lengths[SOLVER_BONE_COUNT] = {};
+	chain_memory_t m_memory[SOLVER_CHAIN_COUNT] = {};
+};
+
+#endif
@@ -0,0 +1,245 @@
+#include "thread_scheduler.h"
+#include "host_clock.h"
+#include <cstdio>
+#if defined(_WIN32)
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32)
+// SCHED_FIFO priorities when realtime, the IMU above the tracking thread so
+// its short reads are never queued behind a frame
+static const int FIFO_PRIORITY_TRACKING = 10;
+static const int FIFO_PRIORITY_SENSOR = 11;
+// Nice values otherwise. Raising needs CAP_SYS_NICE or RLIMIT_NICE, lowering
+// always works.
+static const int NICE_TRACKING = -10;
+static const int NICE_SENSOR = -5;
+static const int NICE_BACKGROUND = 10;
+#endif
+
+static uint64_t CurrentThreadId()
+{
+#if defined(_WIN32)
+	return (uint64_t)GetCurrentThreadId();
+#else
+	return (uint64_t)syscall(SYS_gettid);
+#endif
+}
+
+ThreadScheduler& ThreadScheduler::Instance()
+{
+	static ThreadScheduler scheduler;
+	return scheduler;
+}
+
+void ThreadScheduler::Configure(const thread_schedule_t& schedule)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_schedule = schedule;
+}
+
+thread_schedule_t ThreadScheduler::GetSchedule()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_schedule;
+}
+
+bool ThreadScheduler::Enter(const char* name, ThreadRole role)
+{
+	thread_entry_t entry = {};
+	entry.name = name;
+	entry.role = role;
+	entry.id = CurrentThreadId();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	entry.applied = Apply(&entry);
+	Measure(&entry, &entry.cpu_ns, &entry.voluntary, &entry.involuntary);
+	entry.sampled_us = HostTimeUs();
+	m_threads.push_back(entry);
+	return entry.applied;
+}
+
+void ThreadScheduler::Leave()
+{
+	uint64_t id = CurrentThreadId();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		if (m_threads[i].id != id)
+			continue;
+#if defined(_WIN32)
+		// The MMCSS task is the calling thread's to end
+		if (m_threads[i].task != nullptr)
+			AvRevertMmThreadCharacteristics(m_threads[i].task);
+		if (m_threads[i].handle != nullptr)
+			CloseHandle(m_threads[i].handle);
+#endif
+		m_threads.erase(m_threads.begin() + i);
+		return;
+	}
+}
+
+std::vector<thread_stats_t> ThreadScheduler::Sample()
+{
+	std::vector<thread_stats_t> stats;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint64_t now_us = HostTimeUs();
+	for (thread_entry_t& entry : m_threads)
+	{
+		uint64_t cpu_ns, voluntary, involuntary;
+		Measure(&entry, &cpu_ns, &voluntary, &involuntary);
+		float seconds = (float)(now_us - entry.sampled_us) * 1e-6F;
+
+		thread_stats_t thread;
+		thread.name = entry.name;
+		thread.role = entry.role;
+		thread.applied = entry.applied;
+		thread.cpu = seconds > 0.F ? (float)(cpu_ns - entry.cpu_ns) * 1e-9F / seconds : 0.F;
+		thread.switches = seconds > 0.F ? (float)((voluntary + involuntary) - (entry.voluntary + entry.involuntary)) / seconds : 0.F;
+		thread.involuntary = seconds > 0.F ? (float)(involuntary - entry.involuntary) / seconds : 0.F;
+		stats.push_back(thread);
+
+		entry.cpu_ns = cpu_ns;
+		entry.voluntary = voluntary;
+		entry.involuntary = involuntary;
+		entry.sampled_us = now_us;
+	}
+	return stats;
+}
+
+#if defined(_WIN32)
+
+bool ThreadScheduler::Apply(thread_entry_t* entry)
+{
+	// Shown by debuggers and profilers, Windows 10 1607 on
+	wchar_t wide[64];
+	size_t length = 0;
+	for (; entry->name[length] != '\0' && length + 1 < sizeof(wide) / sizeof(wide[0]); length++)
+		wide[length] = (wchar_t)entry->name[length];
+	wide[length] = L'\0';
+	SetThreadDescription(GetCurrentThread(), wide);
+
+	// A real handle, the pseudo handle means whoever calls Sample
+	entry->handle = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, GetCurrentThreadId());
+	entry->task = nullptr;
+
+	bool applied = true;
+	bool background = entry->role == THREAD_ROLE_BACKGROUND;
+	uint64_t cores = background ? m_schedule.background_cores : m_schedule.tracking_cores;
+	if (cores != 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)cores) == 0)
+		applied = false;
+
+	if (background)
+		return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST) && applied;
+	if (!m_schedule.priorities)
+		return applied;
+
+	if (entry->role == THREAD_ROLE_TRACKING)
+	{
+		// MMCSS boosts the thread for the class's share of each period and
+		// drops it for the rest, so it cannot starve the game or the compositor
+		DWORD task_index = 0;
+		entry->task = AvSetMmThreadCharacteristicsA(m_schedule.realtime ? "Pro Audio" : "Games", &task_index);
+		if (entry->task != nullptr)
+			return AvSetMmThreadPriority(entry->task, AVRT_PRIORITY_HIGH) && applied;
+		// No MMCSS service, a plain boost that counts as refused
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+		return false;
+	}
+	return SetThreadPriority(GetCurrentThread(), m_schedule.realtime ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_ABOVE_NORMAL) && applied;
+}
+
+void ThreadScheduler::Measure(thread_entry_t* entry, uint64_t* cpu_ns, uint64_t* voluntary, uint64_t* involuntary)
+{
+	*cpu_ns = 0;
+	*voluntary = 0;
+	*involuntary = 0;
+	FILETIME creation, exit, kernel, user;
+	if (entry->handle == nullptr || !GetThreadTimes(entry->handle, &creation, &exit, &kernel, &user))
+		return;
+	// 100 ns units
+	uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+		((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+	*cpu_ns = ticks * 100;
+}
+
+#else
+
+bool ThreadScheduler::Apply(thread_entry_t* entry)
+{
+	// At most 15 characters
+	char name[16];
+	std::snprintf(name, sizeof(name), "%s", entry->name.c_str());
+	pthread_setname_np(pthread_self(), name);
+
+	clockid_t clock;
+	entry->handle = pthread_getcpuclockid(pthread_self(), &clock) == 0 ? (void*)(intptr_t)clock : nullptr;
+	entry->task = nullptr;
+
+	bool applied = true;
+	bool background = entry->role == THREAD_ROLE_BACKGROUND;
+	uint64_t cores = background ? m_schedule.background_cores : m_schedule.tracking_cores;
+	if (cores != 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int core = 0; core < 64 && core < CPU_SETSIZE; core++)
+		{
+			if (cores & (1ull << core))
+				CPU_SET(core, &set);
+		}
+		applied = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+	}
+
+	// Nice values are per thread on Linux, by thread id
+	if (background)
+		return setpriority(PRIO_PROCESS, (id_t)entry->id, NICE_BACKGROUND) == 0 && applied;
+	if (!m_schedule.priorities)
+		return applied;
+
+	bool tracking = entry->role == THREAD_ROLE_TRACKING;
+	if (m_schedule.realtime)
+	{
+		sched_param param = {};
+		param.sched_priority = tracking ? FIFO_PRIORITY_TRACKING : FIFO_PRIORITY_SENSOR;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+			return applied;
+	}
+	return setpriority(PRIO_PROCESS, (id_t)entry->id, tracking ? NICE_TRACKING : NICE_SENSOR) == 0 && applied;
+}
+
+void ThreadScheduler::Measure(thread_entry_t* entry, uint64_t* cpu_ns, uint64_t* voluntary, uint64_t* involuntary)
+{
+	*cpu_ns = 0;
+	*voluntary = 0;
+	*involuntary = 0;
+	timespec time;
+	if (entry->handle != nullptr && clock_gettime((clockid_t)(intptr_t)entry->handle, &time) == 0)
+		*cpu_ns = (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+
+	char path[64];
+	std::snprintf(path, sizeof(path), "/proc/self/task/%llu/status", (unsigned long long)entry->id);
+	FILE* status = std::fopen(path, "r");
+	if (status == nullptr)
+		return;
+	char line[128];
+	unsigned long long count;
+	while (std::fgets(line, sizeof(line), status) != nullptr)
+	{
+		if (std::sscanf(line, "voluntary_ctxt_switches: %llu", &count) == 1)
+			*voluntary = count;
+		else if (std::sscanf(line, "nonvoluntary_ctxt_switches: %llu", &count) == 1)
+			*involuntary = count;
+	}
+	std::fclose(status);
+}
+
+#endif
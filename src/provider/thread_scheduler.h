@@ -0,0 +1,108 @@
+#pragma once
+#ifndef K4A_OPENVR_THREAD_SCHEDULER_H
+#define K4A_OPENVR_THREAD_SCHEDULER_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef enum _ThreadRole
+{
+	// Captures, the body tracker's queue and the poses: the latency path
+	THREAD_ROLE_TRACKING,
+	// IMU samples, short and frequent
+	THREAD_ROLE_SENSOR,
+	// Floor detection, logging, anything that only needs throughput
+	THREAD_ROLE_BACKGROUND
+} ThreadRole;
+
+typedef struct _thread_schedule
+{
+	// Tracking and sensor threads raised: MMCSS "Games" on Windows, a lower
+	// nice value on Linux. Background threads are lowered either way.
+	bool priorities = true;
+	// MMCSS "Pro Audio" on Windows, SCHED_FIFO on Linux (falling back to
+	// nice without CAP_SYS_NICE). Can starve the game on a busy machine.
+	bool realtime = false;
+	// Cores for the tracking and sensor threads and for the background
+	// threads, a bit per core, 0 for any
+	uint64_t tracking_cores = 0;
+	uint64_t background_cores = 0;
+} thread_schedule_t;
+
+typedef struct _thread_stats
+{
+	std::string name;
+	ThreadRole role;
+	// The priority and affinity asked for were granted
+	bool applied;
+	// Share of one core, and context switches per second, since the last
+	// Sample. Switches are not counted on Windows.
+	float cpu;
+	float switches;
+	float involuntary;
+} thread_stats_t;
+
+// Names, prioritizes and pins the pipeline's threads, and reports what each
+// costs so a schedule can be checked against tail latency. Threads register
+// themselves for their whole body with a ScopedThread; the schedule applies
+// to threads entered after Configure.
+class ThreadScheduler
+{
+public:
+	// Threads are per process, so is the scheduler
+	static ThreadScheduler& Instance();
+
+	void Configure(const thread_schedule_t& schedule);
+	thread_schedule_t GetSchedule();
+
+	// The calling thread, until it calls Leave. False if its priority or
+	// affinity was refused, it then runs as it was.
+	bool Enter(const char* name, ThreadRole role);
+	void Leave();
+
+	// Every entered thread since the last call
+	std::vector<thread_stats_t> Sample();
+
+private:
+	typedef struct _thread_entry
+	{
+		std::string name;
+		ThreadRole role;
+		bool applied;
+		uint64_t id;
+		// Thread handle and MMCSS task on Windows, CPU clock on Linux
+		void* handle;
+		void* task;
+		uint64_t cpu_ns;
+		uint64_t voluntary;
+		uint64_t involuntary;
+		uint64_t sampled_us;
+	} thread_entry_t;
+
+	bool Apply(thread_entry_t* entry);
+	static void Measure(thread_entry_t* entry, uint64_t* cpu_ns, uint64_t* voluntary, uint64_t* involuntary);
+
+	std::mutex m_mutex;
+	thread_schedule_t m_schedule;
+	std::vector<thread_entry_t> m_threads;
+};
+
+// Enters the calling thread for the rest of the scope
+class ScopedThread
+{
+public:
+	ScopedThread(const char* name, ThreadRole role)
+	{
+		ThreadScheduler::Instance().Enter(name, role);
+	};
+	~ScopedThread()
+	{
+		ThreadScheduler::Instance().Leave();
+	};
+	ScopedThread(const ScopedThread&) = delete;
+	ScopedThread& operator=(const ScopedThread&) = delete;
+};
+
+#endif
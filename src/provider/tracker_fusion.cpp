@@ -0,0 +1,164 @@
+#include "tracker_fusion.h"
+#include <cmath>
+
+void TrackerFusion::Reset()
+{
+	for (size_t i = 0; i < FUSION_MAX_JOINTS; i++)
+		m_joints[i] = {};
+	m_count = 0;
+}
+
+uint32_t TrackerFusion::GetCoveredMask() const
+{
+	uint32_t mask = 0;
+	for (size_t i = 0; i < m_count; i++)
+		if (m_joints[i].covered)
+			mask |= 1u << i;
+	return mask;
+}
+
+void TrackerFusion::Associate(const fusion_device_t* devices, size_t device_count, const pose_math::vec3* joints, size_t joint_count, float dt)
+{
+	m_count = (joint_count < FUSION_MAX_JOINTS) ? joint_count : FUSION_MAX_JOINTS;
+	float mount_rate = 1.F - std::exp(-dt / mount_time);
+	float error_rate = 1.F - std::exp(-dt / error_time);
+
+	// Devices already on a joint are not matched again
+	bool used[FUSION_MAX_DEVICES] = {};
+
+	for (size_t j = 0; j < m_count; j++)
+	{
+		fusion_joint_t& joint = m_joints[j];
+		m_positions[j] = joints[j];
+		joint.present = false;
+		if (!joint.covered)
+			continue;
+
+		const fusion_device_t* device = nullptr;
+		for (size_t d = 0; d < device_count; d++)
+			if (devices[d].index == joint.device)
+				device = &devices[d];
+
+		// Gone, or worn somewhere else now
+		float distance = device ? pose_math::length(device->at_capture.translation - joints[j]) : 0.F;
+		joint.dwell = (device && distance > release_distance) ? joint.dwell + dt : 0.F;
+		if (device == nullptr || joint.dwell > dwell_time)
+		{
+			joint.covered = false;
+			joint.dwell = 0.F;
+			continue;
+		}
+
+		if (device->index < FUSION_MAX_DEVICES)
+			used[device->index] = true;
+		joint.present = true;
+		joint.at_capture = device->at_capture;
+		joint.now = device->now;
+
+		joint.mount = joint.mount + (pose_math::transform(pose_math::inverse(device->at_capture), joints[j]) - joint.mount) * mount_rate;
+		pose_math::vec3 error = pose_math::transform(device->at_capture, joint.mount) - joints[j];
+		joint.error = joint.error + (error - joint.error) * error_rate;
+		float magnitude = pose_math::length(joint.error);
+		if (magnitude > max_error)
+			joint.error = joint.error * (max_error / magnitude);
+	}
+
+	for (size_t j = 0; j < m_count; j++)
+	{
+		fusion_joint_t& joint = m_joints[j];
+		if (joint.covered)
+			continue;
+
+		const fusion_device_t* nearest = nullptr;
+		float nearest_distance = associate_distance;
+		for (size_t d = 0; d < device_count; d++)
+		{
+			if (devices[d].index < FUSION_MAX_DEVICES && used[devices[d].index])
+				continue;
+			float distance = pose_math::length(devices[d].at_capture.translation - joints[j]);
+			if (distance < nearest_distance)
+			{
+				nearest = &devices[d];
+				nearest_distance = distance;
+			}
+		}
+
+		if (nearest == nullptr)
+		{
+			joint.dwell = 0.F;
+			continue;
+		}
+		if (nearest->index != joint.device)
+		{
+			joint.device = nearest->index;
+			joint.dwell = 0.F;
+		}
+		joint.dwell += dt;
+
+		if (joint.dwell >= dwell_time)
+		{
+			joint.covered = true;
+			joint.present = true;
+			joint.dwell = 0.F;
+			joint.at_capture = nearest->at_capture;
+			joint.now = nearest->now;
+			joint.mount = pose_math::transform(pose_math::inverse(nearest->at_capture), joints[j]);
+			joint.error = { 0.F, 0.F, 0.F };
+			if (nearest->index < FUSION_MAX_DEVICES)
+				used[nearest->index] = true;
+		}
+	}
+
+	for (size_t j = 0; j < m_count; j++)
+	{
+		float total = 0.F;
+		if (!m_joints[j].covered)
+			for (size_t a = 0; a < m_count; a++)
+				if (m_joints[a].present)
+					total += std::exp(-pose_math::length(m_positions[j] - m_positions[a]) / radius);
+		m_joints[j].weight = (total < 1.F) ? total : 1.F;
+	}
+}
+
+void TrackerFusion::Apply(pose_math::vec3* positions, pose_math::quat* rotations, size_t count) const
+{
+	if (count > m_count)
+		count = m_count;
+
+	for (size_t j = 0; j < count; j++)
+	{
+		if (m_joints[j].covered || m_joints[j].weight <= 0.F)
+			continue;
+
+		float weights[FUSION_MAX_JOINTS];
+		float total = 0.F;
+		for (size_t a = 0; a < m_count; a++)
+		{
+			weights[a] = m_joints[a].present ? std::exp(-pose_math::length(m_positions[j] - m_positions[a]) / radius) : 0.F;
+			total += weights[a];
+		}
+		// Anchors share the joint's anchor weight between them
+		float scale = m_joints[j].weight / total;
+
+		pose_math::vec3 shift = { 0.F, 0.F, 0.F };
+		float yaw = 0.F;
+		for (size_t a = 0; a < m_count; a++)
+		{
+			if (weights[a] <= 0.F)
+				continue;
+			const fusion_joint_t& anchor = m_joints[a];
+			float weight = weights[a] * scale;
+
+			// Translation and yaw about the anchor since the capture, like the HMD's
+			float turn = pose_math::twist_y(anchor.now.rotation * pose_math::conjugate(anchor.at_capture.rotation));
+			pose_math::vec3 pivot = anchor.at_capture.translation;
+			pose_math::vec3 moved = anchor.now.translation + pose_math::rotate(pose_math::axis_angle({ 0.F, 1.F, 0.F }, turn), positions[j] - pivot);
+
+			shift = shift + (moved - positions[j] + anchor.error) * weight;
+			yaw += turn * weight;
+		}
+
+		positions[j] = positions[j] + shift;
+		rotations[j] = pose_math::axis_angle({ 0.F, 1.F, 0.F }, yaw) * rotations[j];
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+#ifndef K4A_OPENVR_TRACKER_FUSION_H
+#define K4A_OPENVR_TRACKER_FUSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include "math/pose_math.h"
+
+#define FUSION_MAX_JOINTS 8
+// Device indices, vr::k_unMaxTrackedDeviceCount
+#define FUSION_MAX_DEVICES 64
+
+// A real tracker's world space pose at the skeleton's capture time and now
+typedef struct _fusion_device
+{
+	uint32_t index;
+	pose_math::rigid at_capture;
+	pose_math::rigid now;
+} fusion_device_t;
+
+// Physical trackers worn alongside the camera. A real tracker that stays on
+// one of our tracked joints covers it: that joint is no longer filtered or
+// published. Covered joints become anchors for the others, weighted by
+// distance:
+//  - the anchor's motion since the capture replaces the HMD's in latency
+//    compensation, it is closer and moves with the body
+//  - the error between the K4A joint and where the anchor puts it, with the
+//    mounting offset learned in the tracker's frame, is added as an offset.
+// World space metres.
+class TrackerFusion
+{
+public:
+	// Matches real trackers to joints, raw joint positions at the capture time
+	void Associate(const fusion_device_t* devices, size_t device_count, const pose_math::vec3* joints, size_t joint_count, float dt);
+
+	bool IsCovered(size_t joint) const
+	{
+		return m_joints[joint].covered;
+	};
+	uint32_t GetCoveredMask() const;
+
+	// Share of a joint's correction that comes from the anchors, 0 to 1.
+	// Associate must have been called this frame.
+	float GetAnchorWeight(size_t joint) const
+	{
+		return m_joints[joint].weight;
+	};
+
+	// Anchor motion since the capture and offsets, world space joints in place,
+	// covered ones untouched
+	void Apply(pose_math::vec3* positions, pose_math::quat* rotations, size_t count) const;
+
+	void Reset();
+
+	// A tracker within associate_distance of a joint for dwell_time seconds
+	// covers it, one further than release_distance for dwell_time releases it
+	float associate_distance = 0.2F;
+	float release_distance = 0.35F;
+	float dwell_time = 1.F;
+	// Anchors weigh exp(-distance / radius) on other joints
+	float radius = 0.5F;
+	// Time constants of the mounting offset and error estimates, seconds
+	float mount_time = 5.F;
+	float error_time = 1.F;
+	// Largest offset applied, metres
+	float max_error = 0.1F;
+
+private:
+	typedef struct _fusion_joint
+	{
+		bool covered;
+		bool present;
+		uint32_t device;
+		float dwell;
+		// Joint in the device's frame, and the smoothed world space error
+		pose_math::vec3 mount;
+		pose_math::vec3 error;
+		// Where the anchor was, its motion since, for this frame
+		pose_math::rigid at_capture;
+		pose_math::rigid now;
+		// Anchor weight of an uncovered joint, this frame
+		float weight;
+	} fusion_joint_t;
+
+	fusion_joint_t m_joints[FUSION_MAX_JOINTS] = {};
+	pose_math::vec3 m_positions[FUSION_MAX_JOINTS] = {};
+	size_t m_count = 0;
+};
+
+#endif
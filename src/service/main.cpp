@@ -0,0 +1,85 @@
+// k4a_tracking_service: body tracking out of SteamVR's process, see tracking_service.h
+//
+// k4a_tracking_service [--playback file.mkv [--loop]] [--depth-mode nfov|nfov-unbinned|wfov|wfov-unbinned]
+//     [--keyframe N] [--cpu] [--channel name] [--no-priorities] [--realtime] [--cores mask]
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "tracking_service.h"
+
+static TrackingService* g_service = nullptr;
+
+static void OnSignal(int)
+{
+	if (g_service != nullptr)
+		g_service->Stop();
+}
+
+static bool ParseDepthMode(const char* name, k4a_depth_mode_t* mode)
+{
+	static const struct { const char* name; k4a_depth_mode_t mode; } modes[] = {
+		{ "nfov", K4A_DEPTH_MODE_NFOV_2X2BINNED },
+		{ "nfov-unbinned", K4A_DEPTH_MODE_NFOV_UNBINNED },
+		{ "wfov", K4A_DEPTH_MODE_WFOV_2X2BINNED },
+		{ "wfov-unbinned", K4A_DEPTH_MODE_WFOV_UNBINNED },
+	};
+	for (const auto& entry : modes)
+	{
+		if (std::strcmp(name, entry.name) == 0)
+		{
+			*mode = entry.mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+static int Usage(const char* program)
+{
+	std::fprintf(stderr, "Usage: %s [--playback file.mkv [--loop]] [--depth-mode nfov|nfov-unbinned|wfov|wfov-unbinned]\n"
+		"    [--keyframe N] [--cpu] [--channel name] [--no-priorities] [--realtime] [--cores mask]\n", program);
+	return 64;
+}
+
+int main(int argc, char** argv)
+{
+	service_options_t options;
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if (std::strcmp(argv[i], "--playback") == 0 && has_value)
+			options.playback = argv[++i];
+		else if (std::strcmp(argv[i], "--loop") == 0)
+			options.loop = true;
+		else if (std::strcmp(argv[i], "--depth-mode") == 0 && has_value)
+		{
+			if (!ParseDepthMode(argv[++i], &options.depth_mode))
+				return Usage(argv[0]);
+		}
+		else if (std::strcmp(argv[i], "--keyframe") == 0 && has_value)
+			options.keyframe_interval = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--cpu") == 0)
+			options.cpu = true;
+		else if (std::strcmp(argv[i], "--channel") == 0 && has_value)
+			options.channel = argv[++i];
+		else if (std::strcmp(argv[i], "--no-priorities") == 0)
+			options.schedule.priorities = false;
+		else if (std::strcmp(argv[i], "--realtime") == 0)
+			options.schedule.realtime = true;
+		else if (std::strcmp(argv[i], "--cores") == 0 && has_value)
+			options.schedule.tracking_cores = std::strtoull(argv[++i], nullptr, 0);
+		else
+			return Usage(argv[0]);
+	}
+
+	TrackingService service(options);
+	g_service = &service;
+	std::signal(SIGINT, OnSignal);
+	std::signal(SIGTERM, OnSignal);
+
+	int result = service.Run();
+	g_service = nullptr;
+	return result;
+}
@@ -0,0 +1,665 @@
+#include "tracking_service.h"
+#include <chrono>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include "provider/buffer_pool.h"
+#include "provider/calibration_cache.h"
+#include "provider/camera_transform.h"
+#include "provider/host_clock.h"
+
+// Longest wait for a capture or an IMU sample before checking for a stop, milliseconds.
+// The supervisor decides when a run of capture timeouts means the device is gone.
+static const int CAPTURE_TIMEOUT_MS = 100;
+static const int IMU_TIMEOUT_MS = 100;
+// Wait between checks while backing off, milliseconds
+static const int BACKOFF_POLL_MS = 100;
+// Device time between two frames at 30 fps, microseconds
+static const uint64_t FRAME_PERIOD_US = 33333;
+// Frame counters logged this often, seconds
+static const float STATS_INTERVAL = 10.F;
+// Inference while looking for a body in standby, one capture this often, seconds
+static const float PRESENCE_INTERVAL = 1.F;
+
+static void Log(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	std::vfprintf(stderr, format, args);
+	va_end(args);
+	std::fflush(stderr);
+}
+
+static void k4a_log_cb(void* /*context*/, k4a_log_level_t level, const char* file, const int line, const char* message)
+{
+	Log("%d : %s:%d - %s\n", level, file, line, message);
+}
+
+TrackingService::TrackingService(const service_options_t& options) : m_options(options)
+{
+}
+
+TrackingService::~TrackingService()
+{
+	TearDown();
+}
+
+bool TrackingService::OpenSource()
+{
+	k4a_set_debug_message_handler(k4a_log_cb, this, K4A_LOG_LEVEL_ERROR);
+
+	if (!m_options.playback.empty())
+	{
+		if (k4a_playback_open(m_options.playback.c_str(), &m_playback) != K4A_RESULT_SUCCEEDED)
+		{
+			Log("Open recording %s failed\n", m_options.playback.c_str());
+			m_playback = nullptr;
+			return false;
+		}
+		k4a_record_configuration_t record;
+		if (k4a_playback_get_calibration(m_playback, &m_calibration) != K4A_RESULT_SUCCEEDED ||
+			k4a_playback_get_record_configuration(m_playback, &record) != K4A_RESULT_SUCCEEDED || !record.depth_track_enabled)
+		{
+			Log("Recording has no depth track or calibration\n");
+			return false;
+		}
+		m_imu = record.imu_track_enabled;
+		m_options.depth_mode = record.depth_mode;
+		Log("Playing %s%s\n", m_options.playback.c_str(), m_options.loop ? " in a loop" : "");
+		return true;
+	}
+
+	m_supervisor.Enter(SUPERVISOR_OPEN);
+	if (k4a_device_open(K4A_DEVICE_DEFAULT, &m_device) != K4A_RESULT_SUCCEEDED)
+	{
+		Log("Open K4A device failed\n");
+		m_device = nullptr;
+		return false;
+	}
+
+	m_supervisor.Enter(SUPERVISOR_CONFIGURE);
+	CalibrationCache cache;
+	std::string serial = CalibrationCache::Serial(m_device);
+	if (!cache.Load(serial.c_str(), m_options.depth_mode, &m_calibration) &&
+		!cache.Fetch(m_device, serial.c_str(), m_options.depth_mode, &m_calibration))
+	{
+		Log("Get depth camera calibration failed!\n");
+		return false;
+	}
+
+	// Keyframes need 30 fps, which the wide unbinned mode cannot do
+	if (m_options.keyframe_interval <= 1 || m_options.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED)
+		m_options.keyframe_interval = 1;
+	m_supervisor.Enter(SUPERVISOR_START_CAMERAS);
+	if (!StartCameras())
+		return false;
+	Log("Device %s started\n", serial.c_str());
+	return true;
+}
+
+bool TrackingService::StartCameras()
+{
+	// 30 fps for keyframe mode, 5 for presence in standby
+	k4a_device_configuration_t config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
+	config.depth_mode = m_options.depth_mode;
+	config.camera_fps = m_options.keyframe_interval > 1 ? K4A_FRAMES_PER_SECOND_30 : K4A_FRAMES_PER_SECOND_15;
+	if (m_standby)
+		config.camera_fps = K4A_FRAMES_PER_SECOND_5;
+	if (k4a_device_start_cameras(m_device, &config) != K4A_RESULT_SUCCEEDED)
+	{
+		Log("Start camera failed\n");
+		return false;
+	}
+	m_cameras = true;
+
+	// Nothing to read the IMU for in standby
+	if (m_standby)
+		return true;
+	m_imu = k4a_device_start_imu(m_device) == K4A_RESULT_SUCCEEDED;
+	if (!m_imu)
+		Log("Start IMU failed, no tilt or bump detection\n");
+	return true;
+}
+
+void TrackingService::StopCameras()
+{
+	m_imu_running = false;
+	if (m_imu_thread.joinable())
+		m_imu_thread.join();
+	if (m_imu)
+		k4a_device_stop_imu(m_device);
+	if (m_cameras)
+		k4a_device_stop_cameras(m_device);
+	m_imu = false;
+	m_cameras = false;
+}
+
+void TrackingService::CloseSource()
+{
+	if (m_device != nullptr)
+	{
+		StopCameras();
+		k4a_device_close(m_device);
+	}
+	if (m_playback != nullptr)
+		k4a_playback_close(m_playback);
+	m_device = nullptr;
+	m_playback = nullptr;
+	m_cameras = false;
+	m_imu = false;
+}
+
+bool TrackingService::CreateTracker()
+{
+	m_supervisor.Enter(SUPERVISOR_CREATE_TRACKER);
+	k4abt_tracker_configuration_t config = K4ABT_TRACKER_CONFIG_DEFAULT;
+	if (m_options.cpu)
+		config.processing_mode = K4ABT_TRACKER_PROCESSING_MODE_CPU;
+	uint64_t start_us = HostTimeUs();
+	if (k4abt_tracker_create(&m_calibration, config, &m_tracker) != K4A_RESULT_SUCCEEDED)
+	{
+		Log("Body tracker create failed\n");
+		m_tracker = nullptr;
+		return false;
+	}
+	k4abt_tracker_set_temporal_smoothing(m_tracker, 0);
+	Log("Body tracker ready in %.0f ms\n", (float)(HostTimeUs() - start_us) * 1e-3F);
+	return true;
+}
+
+bool TrackingService::SetUp()
+{
+	if (!OpenSource())
+		return false;
+	if (!BufferPool::Instance().Configure(m_calibration.depth_camera_calibration.resolution_width,
+		m_calibration.depth_camera_calibration.resolution_height))
+		Log("Buffer pool busy, size classes of the last depth mode kept\n");
+	m_unprojector.SetCalibration(m_calibration);
+	m_floor_worker.SetCalibration(m_calibration);
+	if (!CreateTracker())
+		return false;
+
+	m_keyframe_interval = m_options.keyframe_interval;
+	RestartClock();
+
+	m_imu_tracker.Reset();
+	m_imu_last_us = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_imu_mutex);
+		m_has_up = false;
+		m_moved = false;
+	}
+	StartImuThread();
+	return true;
+}
+
+void TrackingService::RestartClock()
+{
+	// The device clock starts over with the cameras, frame times carry on
+	// from the last one written
+	if (m_last_frame_us != 0)
+		m_time_offset_us = m_last_frame_us + FRAME_PERIOD_US;
+	m_host_from_device_us = LLONG_MAX;
+	m_capture_index = 0;
+	m_propagator.Clear();
+	m_presence_pending = false;
+}
+
+void TrackingService::StartImuThread()
+{
+	m_imu_running = m_imu && m_device != nullptr;
+	if (m_imu_running)
+		m_imu_thread = std::thread(ProcessImu, this);
+}
+
+void TrackingService::DrainTracker()
+{
+	k4abt_frame_t body_frame = nullptr;
+	while (m_tracker != nullptr && k4abt_tracker_pop_result(m_tracker, &body_frame, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+		k4abt_frame_release(body_frame);
+	m_presence_pending = false;
+}
+
+bool TrackingService::UpdateStandby()
+{
+	// The reader's SteamVR is in standby. With presence the cameras run at
+	// 5 fps and the DNN sees a capture a second, otherwise both idle.
+	uint32_t options = m_channel.GetOptions();
+	bool standby = (options & SKELETON_OPTION_STANDBY) != 0;
+	bool presence = standby && (options & SKELETON_OPTION_PRESENCE) != 0;
+	if (standby == m_standby && presence == m_standby_presence)
+		return true;
+
+	m_standby = standby;
+	m_standby_presence = presence;
+	m_presence_us = 0;
+	// Results queued before the switch are of no use after it
+	DrainTracker();
+	if (m_device != nullptr)
+	{
+		StopCameras();
+		if ((!standby || m_standby_presence) && !StartCameras())
+			return false;
+		if (!standby)
+			StartImuThread();
+		RestartClock();
+		m_supervisor.Captured(HostTimeUs());
+	}
+	if (!standby)
+		Log("Resumed\n");
+	else
+		Log("Standby, %s\n", m_standby_presence ? "cameras at 5 fps, looking for a body once a second" : "cameras off");
+	return true;
+}
+
+void TrackingService::TearDown()
+{
+	m_imu_running = false;
+	if (m_imu_thread.joinable())
+		m_imu_thread.join();
+	if (m_tracker != nullptr)
+	{
+		k4abt_tracker_shutdown(m_tracker);
+		k4abt_tracker_destroy(m_tracker);
+		m_tracker = nullptr;
+	}
+	CloseSource();
+	// The cameras come back at full rate, UpdateStandby idles them again
+	m_standby = false;
+	m_presence_pending = false;
+}
+
+k4a_wait_result_t TrackingService::NextCapture(k4a_capture_t* capture)
+{
+	if (m_device != nullptr)
+		return k4a_device_get_capture(m_device, capture, CAPTURE_TIMEOUT_MS);
+
+	k4a_stream_result_t result = k4a_playback_get_next_capture(m_playback, capture);
+	if (result == K4A_STREAM_RESULT_EOF && m_options.loop)
+	{
+		// Times carry on from the last frame, one frame apart
+		m_time_offset_us += m_playback_last_us - m_playback_first_us + FRAME_PERIOD_US;
+		m_playback_start_us = 0;
+		m_has_imu_pending = false;
+		k4a_playback_seek_timestamp(m_playback, 0, K4A_PLAYBACK_SEEK_BEGIN);
+		result = k4a_playback_get_next_capture(m_playback, capture);
+	}
+	if (result != K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		if (result == K4A_STREAM_RESULT_FAILED)
+			return K4A_WAIT_RESULT_FAILED;
+		m_running = false;
+		return K4A_WAIT_RESULT_TIMEOUT;
+	}
+
+	// Paced by the recording's own clock
+	k4a_image_t depth = k4a_capture_get_depth_image(*capture);
+	if (depth == nullptr)
+		return K4A_WAIT_RESULT_SUCCEEDED;
+	uint64_t time_us = k4a_image_get_device_timestamp_usec(depth);
+	k4a_image_release(depth);
+	if (m_playback_start_us == 0)
+	{
+		m_playback_start_us = HostTimeUs();
+		m_playback_first_us = time_us;
+	}
+	m_playback_last_us = time_us;
+	uint64_t due_us = m_playback_start_us + (time_us - m_playback_first_us);
+	uint64_t now_us = HostTimeUs();
+	if (due_us > now_us)
+		std::this_thread::sleep_for(std::chrono::microseconds(due_us - now_us));
+
+	if (m_imu)
+		PlaybackImu(time_us);
+	return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+void TrackingService::UpdateImu(const k4a_imu_sample_t& sample)
+{
+	// The reference is taken once the filter has settled
+	if (m_imu_tracker.IsAtRest() && m_rereference.exchange(false))
+		m_imu_tracker.SetReference();
+
+	float dt = (m_imu_last_us != 0 && sample.acc_timestamp_usec > m_imu_last_us) ? (float)(sample.acc_timestamp_usec - m_imu_last_us) * 1e-6F : 0.F;
+	m_imu_last_us = sample.acc_timestamp_usec;
+
+	pose_math::vec3 acceleration = SensorToDepth(m_calibration, K4A_CALIBRATION_TYPE_ACCEL, pose_math::to_vec3(sample.acc_sample));
+	pose_math::vec3 angular_velocity = SensorToDepth(m_calibration, K4A_CALIBRATION_TYPE_GYRO, pose_math::to_vec3(sample.gyro_sample));
+	if (m_imu_tracker.Update(acceleration, angular_velocity, dt))
+		Log("Camera moved\n");
+
+	std::lock_guard<std::mutex> lock(m_imu_mutex);
+	if (m_imu_tracker.HasUp())
+	{
+		m_up = m_imu_tracker.GetUp();
+		m_has_up = true;
+	}
+	m_moved = m_imu_tracker.IsMoved();
+}
+
+void TrackingService::ProcessImu(TrackingService* service)
+{
+	ScopedThread scheduled("k4a imu", THREAD_ROLE_SENSOR);
+	k4a_imu_sample_t sample;
+	while (service->m_imu_running)
+	{
+		if (k4a_device_get_imu_sample(service->m_device, &sample, IMU_TIMEOUT_MS) == K4A_WAIT_RESULT_SUCCEEDED)
+			service->UpdateImu(sample);
+	}
+}
+
+void TrackingService::PlaybackImu(uint64_t until_us)
+{
+	if (m_has_imu_pending)
+	{
+		if (m_imu_pending.acc_timestamp_usec > until_us)
+			return;
+		UpdateImu(m_imu_pending);
+		m_has_imu_pending = false;
+	}
+	while (k4a_playback_get_next_imu_sample(m_playback, &m_imu_pending) == K4A_STREAM_RESULT_SUCCEEDED)
+	{
+		if (m_imu_pending.acc_timestamp_usec > until_us)
+		{
+			m_has_imu_pending = true;
+			return;
+		}
+		UpdateImu(m_imu_pending);
+	}
+}
+
+void TrackingService::Publish(skeleton_frame_t& frame, k4a_image_t depth)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_imu_mutex);
+		frame.has_up = m_has_up;
+		frame.up = m_up;
+		frame.moved = m_moved;
+	}
+	// Without gravity the camera is taken to stand level
+	pose_math::vec3 up = frame.has_up ? frame.up : CameraUp(ComposeCameraTransform(DefaultCameraTilt(), pose_math::identity_rigid()));
+
+	uint32_t options = m_channel.GetOptions();
+	if ((options & SKELETON_OPTION_FEET) && frame.body && depth != nullptr)
+		m_foot_refiner.Refine(m_unprojector, depth, up, frame.skeleton);
+
+	// Handed to the floor worker, this thread only picks up the plane
+	float interval = m_floor.valid ? FLOOR_REFRESH_INTERVAL : FLOOR_SEARCH_INTERVAL;
+	if ((options & SKELETON_OPTION_FLOOR) && frame.has_up && depth != nullptr &&
+		(m_floor_us == 0 || frame.frame_us > m_floor_us + (uint64_t)(interval * 1e6F)) && m_floor_worker.Request(depth, up))
+		m_floor_us = frame.frame_us;
+	floor_plane_t floor;
+	if (m_floor_worker.Take(&floor) && (floor.valid || !m_floor.valid))
+	{
+		m_floor = floor;
+		m_floor_sequence++;
+	}
+	frame.floor = m_floor;
+	frame.floor_sequence = m_floor_sequence;
+
+	m_channel.Write(frame);
+}
+
+void TrackingService::DetectPresence(k4a_capture_t capture)
+{
+	k4abt_frame_t body_frame = nullptr;
+	while (m_presence_pending && k4abt_tracker_pop_result(m_tracker, &body_frame, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		// Anything but the capture sent for presence is from before standby
+		uint64_t device_us = k4abt_frame_get_device_timestamp_usec(body_frame);
+		if (device_us != m_presence_device_us)
+		{
+			k4abt_frame_release(body_frame);
+			continue;
+		}
+
+		skeleton_frame_t frame = {};
+		frame.frame_us = device_us + m_time_offset_us;
+		// Sent at, which the reader checks against when it asked for standby
+		frame.capture_us = m_presence_us;
+		frame.body = k4abt_frame_get_num_bodies(body_frame) != 0 && k4abt_frame_get_body_skeleton(body_frame, 0, &frame.skeleton) == K4A_RESULT_SUCCEEDED;
+		k4abt_frame_release(body_frame);
+		m_presence_pending = false;
+		if (frame.frame_us > m_last_frame_us)
+		{
+			m_last_frame_us = frame.frame_us;
+			Publish(frame, nullptr);
+		}
+	}
+
+	uint64_t now_us = HostTimeUs();
+	if (m_presence_pending || now_us < m_presence_us + (uint64_t)(PRESENCE_INTERVAL * 1e6F))
+		return;
+	k4a_image_t depth = k4a_capture_get_depth_image(capture);
+	if (depth == nullptr)
+		return;
+	m_presence_device_us = k4a_image_get_device_timestamp_usec(depth);
+	k4a_image_release(depth);
+	if (k4abt_tracker_enqueue_capture(m_tracker, capture, 0) == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		m_presence_pending = true;
+		m_presence_us = now_us;
+	}
+}
+
+void TrackingService::Track(k4a_capture_t capture)
+{
+	uint64_t arrival_us = HostTimeUs();
+	k4a_image_t depth = k4a_capture_get_depth_image(capture);
+	if (depth != nullptr)
+	{
+		int64_t offset = (int64_t)arrival_us - (int64_t)(k4a_image_get_device_timestamp_usec(depth) + m_time_offset_us);
+		if (offset < m_host_from_device_us)
+			m_host_from_device_us = offset;
+		k4a_image_release(depth);
+	}
+
+	// As in the provider: keyframes to the DNN, the captures between propagated
+	bool keyframe = m_keyframe_interval <= 1 || m_capture_index % m_keyframe_interval == 0;
+	m_capture_index++;
+	if (keyframe && k4abt_tracker_enqueue_capture(m_tracker, capture, 3) != K4A_WAIT_RESULT_SUCCEEDED)
+		Log("Body tracker queue full\n");
+
+	skeleton_frame_t frame = {};
+	bool have_frame = false;
+	k4a_image_t frame_depth = nullptr;
+	k4abt_frame_t body_frame = nullptr;
+	if (k4abt_tracker_pop_result(m_tracker, &body_frame, keyframe ? 3 : 0) == K4A_WAIT_RESULT_SUCCEEDED)
+	{
+		frame.frame_us = k4abt_frame_get_device_timestamp_usec(body_frame) + m_time_offset_us;
+		frame.body = k4abt_frame_get_num_bodies(body_frame) != 0 && k4abt_frame_get_body_skeleton(body_frame, 0, &frame.skeleton) == K4A_RESULT_SUCCEEDED;
+		k4a_capture_t inferred = k4abt_frame_get_capture(body_frame);
+		if (inferred != nullptr)
+		{
+			frame_depth = k4a_capture_get_depth_image(inferred);
+			k4a_capture_release(inferred);
+		}
+		if (m_keyframe_interval > 1)
+		{
+			if (!frame.body)
+				m_propagator.Clear();
+			else if (frame_depth != nullptr)
+				m_propagator.Keyframe(m_calibration, frame_depth, frame.skeleton);
+		}
+		k4abt_frame_release(body_frame);
+		have_frame = frame.frame_us > m_last_frame_us;
+	}
+	if (!have_frame && !keyframe && m_propagator.IsReady())
+	{
+		if (frame_depth != nullptr)
+			k4a_image_release(frame_depth);
+		frame_depth = k4a_capture_get_depth_image(capture);
+		if (frame_depth != nullptr)
+		{
+			frame.frame_us = k4a_image_get_device_timestamp_usec(frame_depth) + m_time_offset_us;
+			if (frame.frame_us > m_last_frame_us)
+				have_frame = frame.body = m_propagator.Propagate(m_calibration, frame_depth, &frame.skeleton);
+		}
+	}
+
+	if (have_frame)
+	{
+		m_last_frame_us = frame.frame_us;
+		frame.capture_us = (m_host_from_device_us != LLONG_MAX) ? (uint64_t)((int64_t)frame.frame_us + m_host_from_device_us) : 0;
+		Publish(frame, frame_depth);
+		m_frames++;
+		if (frame.body)
+			m_bodies++;
+	}
+	else
+		m_channel.Heartbeat();
+
+	if (frame_depth != nullptr)
+		k4a_image_release(frame_depth);
+}
+
+int TrackingService::Run()
+{
+	ThreadScheduler::Instance().Configure(m_options.schedule);
+	ScopedThread scheduled("k4a service", THREAD_ROLE_TRACKING);
+
+	if (!m_channel.Create(m_options.channel.c_str()))
+	{
+		Log("Create skeleton channel %s failed\n", m_options.channel.c_str());
+		return 1;
+	}
+
+	// Before any SDK handle exists, every buffer after comes from the pool
+	if (!BufferPool::Instance().Install())
+		Log("Buffer pool not installed, SDK allocator in use\n");
+	m_floor_worker.Start();
+
+	m_supervisor.Reset(HostTimeUs());
+	if (!SetUp())
+	{
+		// A recording that cannot be read will not get any better
+		TearDown();
+		if (!m_options.playback.empty())
+			return 2;
+		m_supervisor.Fault(HostTimeUs());
+		Log("K4A device not ready, retrying in the background\n");
+	}
+	else
+		m_supervisor.Running(HostTimeUs());
+
+	int result = 0;
+	uint64_t stats_us = HostTimeUs();
+
+	while (m_running)
+	{
+		if (m_channel.TakeReferenceRequest())
+			m_rereference = true;
+
+		uint64_t now_us = HostTimeUs();
+		switch (m_supervisor.GetState())
+		{
+		case SUPERVISOR_RUNNING:
+		{
+			if (!UpdateStandby())
+			{
+				m_supervisor.Fault(HostTimeUs());
+				break;
+			}
+			if (m_standby && !m_cameras && m_device != nullptr)
+			{
+				// Nothing to read until SteamVR wakes up
+				m_supervisor.Captured(now_us);
+				m_channel.Heartbeat();
+				std::this_thread::sleep_for(std::chrono::milliseconds(BACKOFF_POLL_MS));
+				break;
+			}
+
+			k4a_capture_t capture = nullptr;
+			k4a_wait_result_t wait = NextCapture(&capture);
+			now_us = HostTimeUs();
+			if (wait != K4A_WAIT_RESULT_SUCCEEDED)
+			{
+				if (!m_options.playback.empty())
+				{
+					if (wait == K4A_WAIT_RESULT_FAILED)
+					{
+						Log("Reading %s failed\n", m_options.playback.c_str());
+						result = 4;
+						m_running = false;
+					}
+				}
+				else if (wait == K4A_WAIT_RESULT_FAILED ? m_supervisor.CaptureFailed(now_us) : m_supervisor.CaptureTimedOut(now_us))
+				{
+					Log("K4A device lost, %s\n", wait == K4A_WAIT_RESULT_FAILED ? "captures failing" : "no captures");
+					m_supervisor.Fault(now_us);
+				}
+				else
+				{
+					// Late, not gone yet
+					m_channel.Heartbeat();
+				}
+				break;
+			}
+			m_supervisor.Captured(now_us);
+
+			// In standby a recording keeps playing and the device streams at
+			// 5 fps, the DNN only sees a capture now and then for presence
+			if (m_standby)
+			{
+				if (m_standby_presence)
+					DetectPresence(capture);
+				m_channel.Heartbeat();
+			}
+			else
+				Track(capture);
+			k4a_capture_release(capture);
+			break;
+		}
+		case SUPERVISOR_FAULTED:
+		{
+			// No heartbeats from here until the device is back, the reader
+			// marks its trackers out of range
+			TearDown();
+			m_supervisor.Backoff(now_us);
+			Log("K4A device closed, next attempt in %.1f s\n", m_supervisor.GetStats(now_us).retry_in);
+			break;
+		}
+		default:
+		{
+			if (!m_supervisor.IsDue(now_us))
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(BACKOFF_POLL_MS));
+				break;
+			}
+			if (!SetUp())
+			{
+				m_supervisor.Fault(HostTimeUs());
+				break;
+			}
+			now_us = HostTimeUs();
+			m_supervisor.Running(now_us);
+			supervisor_stats_t stats = m_supervisor.GetStats(now_us);
+			if (stats.faults != 0)
+				Log("K4A device back after %.1f s, reconnect %u\n", stats.outage, stats.reconnects);
+			else
+				Log("K4A device ready after %u failed attempts\n", stats.failed_attempts);
+			break;
+		}
+		}
+
+		now_us = HostTimeUs();
+		if (now_us > stats_us + (uint64_t)(STATS_INTERVAL * 1e6F))
+		{
+			supervisor_stats_t stats = m_supervisor.GetStats(now_us);
+			Log("%.1f fps, body in %.0f%% of frames, %u device faults, %.1f s down\n", (float)m_frames / ((float)(now_us - stats_us) * 1e-6F),
+				m_frames != 0 ? 100.F * (float)m_bodies / (float)m_frames : 0.F, stats.faults, stats.downtime);
+			for (const thread_stats_t& thread : ThreadScheduler::Instance().Sample())
+				Log("  %s: %.1f%% cpu, %.0f/s switches (%.0f involuntary)%s\n", thread.name.c_str(), thread.cpu * 100.F,
+					thread.switches, thread.involuntary, thread.applied ? "" : ", priority or cores refused");
+			stats_us = now_us;
+			m_frames = 0;
+			m_bodies = 0;
+		}
+	}
+
+	m_running = false;
+	m_floor_worker.Stop();
+	TearDown();
+	Log("Stopped\n");
+	return result;
+}
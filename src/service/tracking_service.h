@@ -0,0 +1,151 @@
+#pragma once
+#ifndef K4A_OPENVR_TRACKING_SERVICE_H
+#define K4A_OPENVR_TRACKING_SERVICE_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "k4a/k4a.h"
+#include "k4arecord/playback.h"
+#include "k4abt.h"
+#include "provider/skeleton_channel.h"
+#include "provider/depth_propagator.h"
+#include "provider/depth_unprojector.h"
+#include "provider/foot_refiner.h"
+#include "provider/floor_worker.h"
+#include "provider/imu_tracker.h"
+#include "provider/thread_scheduler.h"
+#include "provider/device_supervisor.h"
+
+typedef struct _service_options
+{
+	// Recording played at its own pace instead of the device, from start again at its end with loop
+	std::string playback;
+	bool loop = false;
+	k4a_depth_mode_t depth_mode = K4A_DEPTH_MODE_WFOV_2X2BINNED;
+	// Inference on every Nth capture at 30 fps, see K4ABoneProvider::SetKeyframeInterval
+	int keyframe_interval = 1;
+	// Body tracking on the CPU, for machines without a GPU
+	bool cpu = false;
+	std::string channel = SKELETON_CHANNEL_NAME;
+	// Priorities and cores of the tracking and IMU threads
+	thread_schedule_t schedule;
+} service_options_t;
+
+// The process that owns the device and the body tracker, so CUDA, ONNX
+// Runtime and the DNN stay out of vrserver. Captures go through the tracker,
+// or the depth propagator between keyframes, and every skeleton is written to
+// the skeleton channel with the IMU's gravity and the floor. The driver reads
+// the channel and does everything that needs SteamVR. A lost device is torn
+// down and opened again by a DeviceSupervisor, as in the driver; the channel
+// gets no heartbeat meanwhile, so the driver sees the service as gone. Runs
+// the same against a recording, with no device and no SteamVR.
+class TrackingService
+{
+public:
+	explicit TrackingService(const service_options_t& options);
+	~TrackingService();
+
+	// Tracks until Stop, or the end of a recording played once. 0 on a clean
+	// stop, non zero if the channel, the recording or its body tracker failed.
+	int Run();
+	// From any thread or a signal handler
+	void Stop()
+	{
+		m_running = false;
+	};
+
+private:
+	// Device or recording, then the body tracker and the IMU, the supervisor
+	// told of every stage. TearDown undoes whatever got done.
+	bool SetUp();
+	void TearDown();
+	bool OpenSource();
+	void CloseSource();
+	// Cameras at the rate for the mode or for standby, the IMU only outside
+	// standby. StopCameras joins the IMU thread first.
+	bool StartCameras();
+	void StopCameras();
+	void StartImuThread();
+	// Frame times carry on over a camera restart, tracking starts over
+	void RestartClock();
+	// Results still queued in the tracker, released unread
+	void DrainTracker();
+	// Follows the reader's standby option: cameras at 5 fps with presence,
+	// stopped without. False if the cameras did not come back.
+	bool UpdateStandby();
+	bool CreateTracker();
+	// Next capture of the device or the recording. Timeout at the end of a
+	// recording, which also stops the service.
+	k4a_wait_result_t NextCapture(k4a_capture_t* capture);
+	// Inference or propagation of one capture, the frame into the channel
+	void Track(k4a_capture_t capture);
+	// Gravity and bumps, from the device on its own thread or the recording in line
+	static void ProcessImu(TrackingService* service);
+	void UpdateImu(const k4a_imu_sample_t& sample);
+	void PlaybackImu(uint64_t until_us);
+	// Feet and floor as the reader asked for, then the frame into the channel
+	void Publish(skeleton_frame_t& frame, k4a_image_t depth);
+	// In standby, one capture a second to the tracker and its result written
+	void DetectPresence(k4a_capture_t capture);
+
+	service_options_t m_options;
+	std::atomic<bool> m_running{ true };
+
+	k4a_device_t m_device = nullptr;
+	k4a_playback_t m_playback = nullptr;
+	k4a_calibration_t m_calibration = {};
+	k4abt_tracker_t m_tracker = nullptr;
+	bool m_cameras = false;
+	bool m_imu = false;
+	DeviceSupervisor m_supervisor;
+	std::thread m_imu_thread;
+	std::atomic<bool> m_imu_running{ false };
+
+	// Recording time to host time
+	uint64_t m_playback_start_us = 0;
+	uint64_t m_playback_first_us = 0;
+	uint64_t m_playback_last_us = 0;
+	// Added to device times so frame times keep increasing over loops of a
+	// recording and over device restarts, which start the device clock over
+	uint64_t m_time_offset_us = 0;
+
+	// Tracking state, reset by SetUp
+	int64_t m_host_from_device_us = 0;
+	int m_keyframe_interval = 1;
+	uint64_t m_capture_index = 0;
+	uint64_t m_last_frame_us = 0;
+	uint64_t m_frames = 0;
+	uint64_t m_bodies = 0;
+	k4a_imu_sample_t m_imu_pending = {};
+	bool m_has_imu_pending = false;
+
+	SkeletonChannel m_channel;
+	DepthPropagator m_propagator;
+	DepthUnprojector m_unprojector;
+	FootRefiner m_foot_refiner;
+	// Detection on its own background thread, the plane published once done
+	FloorWorker m_floor_worker;
+	floor_plane_t m_floor = {};
+	uint32_t m_floor_sequence = 0;
+	uint64_t m_floor_us = 0;
+	bool m_standby = false;
+	bool m_standby_presence = false;
+	uint64_t m_presence_us = 0;
+	// Device time of the capture sent for presence, results of any other are stale
+	uint64_t m_presence_device_us = 0;
+	bool m_presence_pending = false;
+
+	// Written by whichever thread feeds the IMU
+	ImuTracker m_imu_tracker;
+	std::mutex m_imu_mutex;
+	uint64_t m_imu_last_us = 0;
+	pose_math::vec3 m_up = { 0.F, 0.F, 0.F };
+	bool m_has_up = false;
+	bool m_moved = false;
+	// The reader recalibrated, a new reference once at rest
+	std::atomic<bool> m_rereference{ false };
+};
+
+#endif